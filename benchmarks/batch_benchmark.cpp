@@ -0,0 +1,300 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/approximate_cache.h"
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/numa.h"
+
+using namespace spauly::vccore;
+
+namespace {
+
+/// Bytes read and written per row by the batch path.
+constexpr double kBytesPerRow =
+    static_cast<double>(sizeof(Parameters) + sizeof(CorrectionFactors));
+
+/// Runs fn repeat times and returns the best time in seconds.
+double Measure(int repeat, const std::function<void()>& fn) {
+  double best = 0;
+  for (int r = 0; r < repeat; r++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (r == 0 || elapsed.count() < best) best = elapsed.count();
+  }
+  return best;
+}
+
+void Report(const char* name, size_t rows, double seconds) {
+  std::printf("%-28s %10.3f ms %10.2f Mrows/s %8.2f GB/s\n", name,
+              seconds * 1e3, static_cast<double>(rows) / seconds * 1e-6,
+              static_cast<double>(rows) * kBytesPerRow / seconds * 1e-9);
+}
+
+/// Writes the synthetic duty points for the rows [begin, end).
+void FillInput(Parameters* in, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    in[i] = Parameters(6.0 + static_cast<double>(i % 1994),
+                       5.0 + static_cast<double>(i % 195),
+                       10.0 + static_cast<double>(i % 3990));
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t rows = 1 << 20;
+  int repeat = 5;
+  bool huge_pages = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+      rows = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--huge-pages") == 0) {
+      huge_pages = true;
+    } else {
+      std::printf("Usage: %s [--rows N] [--repeat N] [--huge-pages]\n",
+                  argv[0]);
+      return 1;
+    }
+  }
+
+  Calculator calc;
+  std::printf("rows: %zu, repeat: %d, huge pages: %s\n\n", rows, repeat,
+              huge_pages ? "on" : "off");
+
+  // Single thread and built-in pool on plain vectors.
+  {
+    std::vector<Parameters> in(rows);
+    std::vector<CorrectionFactors> out(rows);
+    FillInput(in.data(), 0, rows);
+
+    Report("sequential", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows);
+           }));
+
+    ThreadPoolExecutor pool;
+    BatchOptions options(&pool);
+    Report("thread pool", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits,
+                            options);
+           }));
+
+    // The rows above are reproducible, these may differ in the last bits.
+    BatchOptions fast;
+    fast.mode = ExecutionMode::kFast;
+    Report("sequential, fast mode", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits, fast);
+           }));
+    fast.executor = &pool;
+    Report("thread pool, fast mode", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits, fast);
+           }));
+
+    // The same rows through the HI 9.6.7 formula instead of the chart.
+    const EngineOptions formula(Engine::kFormula);
+    Report("formula, per row", rows, Measure(repeat, [&]() {
+             for (size_t i = 0; i < rows; i++) {
+               out[i] = calc.Calculate(in[i], kStandardUnits, formula);
+             }
+           }));
+    BatchOptions formula_batch;
+    formula_batch.engine = formula;
+    Report("formula, batch", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits,
+                            formula_batch);
+           }));
+    formula_batch.mode = ExecutionMode::kFast;
+    Report("formula, vectorised", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits,
+                            formula_batch);
+           }));
+    formula_batch.executor = &pool;
+    Report("formula, thread pool", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits,
+                            formula_batch);
+           }));
+
+    // Sensor readings drifting around a few duty points. The approximate
+    // cache interpolates them from cells calculated once.
+    std::vector<Parameters> drift(rows);
+    for (size_t i = 0; i < rows; i++) {
+      const double offset = static_cast<double>(i % 1000) * 0.01;
+      drift[i] = Parameters(100.0 + static_cast<double>(i % 4) * 50.0 + offset,
+                            50.0, 300.0 + offset);
+    }
+    ApproximateCache approximate;
+    BatchOptions approximated;
+    approximated.mode = ExecutionMode::kFast;
+    approximated.approximate = &approximate;
+    Report("sensor drift, exact", rows, Measure(repeat, [&]() {
+             calc.Calculate(drift.data(), out.data(), rows);
+           }));
+    Report("sensor drift, approximate", rows, Measure(repeat, [&]() {
+             calc.Calculate(drift.data(), out.data(), rows, kStandardUnits,
+                            approximated);
+           }));
+    std::printf("%-28s %10llu hits %10llu misses %10.2e max error\n",
+                "approximate cache",
+                static_cast<unsigned long long>(approximate.Hits()),
+                static_cast<unsigned long long>(approximate.Misses()),
+                approximate.MaxError());
+
+    // A skewed mix: most rows lie right of all charts, some are invalid and
+    // a few need the fitted functions. The batch sorts them by region.
+    std::vector<Parameters> mixed(rows);
+    for (size_t i = 0; i < rows; i++) {
+      switch (i % 10) {
+        case 0:
+          mixed[i] = Parameters(100.0 + static_cast<double>(i % 900), 50.0,
+                                100.0);
+          break;
+        case 1:
+          mixed[i] = Parameters(1.0, 50.0, 100.0);
+          break;
+        default:
+          mixed[i] = Parameters(6.0 + static_cast<double>(i % 40), 5.0,
+                                4000.0);
+          break;
+      }
+    }
+    Report("skewed mix, per row", rows, Measure(repeat, [&]() {
+             for (size_t i = 0; i < rows; i++) {
+               out[i] = calc.Calculate(mixed[i]);
+             }
+           }));
+    Report("skewed mix, batch", rows, Measure(repeat, [&]() {
+             calc.Calculate(mixed.data(), out.data(), rows);
+           }));
+
+    // Every row of the second input is out of range. With diagnostics each
+    // of them records an event, which should not cost measurable time.
+    std::vector<Parameters> errors(rows);
+    for (size_t i = 0; i < rows; i++) {
+      errors[i] = Parameters(6.0 + static_cast<double>(i % 100), 5.0, 4000.0);
+    }
+    size_t events = 0;
+    DiagnosticsChannel channel(
+        [&events](const DiagnosticEvent*, size_t n) { events += n; });
+    BatchOptions diagnosed = options;
+    diagnosed.diagnostics = &channel;
+
+    Report("all flagged", rows, Measure(repeat, [&]() {
+             calc.Calculate(errors.data(), out.data(), rows, kStandardUnits,
+                            options);
+           }));
+    Report("all flagged, diagnostics", rows, Measure(repeat, [&]() {
+             calc.Calculate(errors.data(), out.data(), rows, kStandardUnits,
+                            diagnosed);
+           }));
+    channel.Flush();
+    std::printf("%-28s %10zu events %10llu dropped\n", "diagnostics", events,
+                static_cast<unsigned long long>(channel.Dropped()));
+  }
+
+  // Duty points embedded in a larger record, repacked or read in place.
+  {
+    struct PumpRecord {
+      int id;
+      double flowrate;
+      double head;
+      double viscosity;
+      double q;
+      double eta;
+      std::array<double, 4> h;
+    };
+    std::vector<PumpRecord> records(rows);
+    std::vector<Parameters> in(rows);
+    std::vector<CorrectionFactors> out(rows);
+    FillInput(in.data(), 0, rows);
+    for (size_t i = 0; i < rows; i++) {
+      PumpRecord& r = records[i];
+      r = PumpRecord{};
+      r.id = static_cast<int>(i);
+      r.flowrate = in[i].flowrate;
+      r.head = in[i].total_head;
+      r.viscosity = in[i].viscosity;
+    }
+
+    Report("records, repacked", rows, Measure(repeat, [&]() {
+             for (size_t i = 0; i < rows; i++) {
+               in[i] = Parameters(records[i].flowrate, records[i].head,
+                                  records[i].viscosity);
+             }
+             calc.Calculate(in.data(), out.data(), rows);
+             for (size_t i = 0; i < rows; i++) {
+               records[i].q = out[i].q;
+               records[i].eta = out[i].eta;
+               records[i].h = out[i].h;
+             }
+           }));
+
+    const StridedInput strided_in = StridedInput::FromRows(
+        records.data(), &PumpRecord::flowrate, &PumpRecord::head,
+        &PumpRecord::viscosity);
+    const StridedOutput strided_out = StridedOutput::FromRows(
+        records.data(), &PumpRecord::q, &PumpRecord::eta, &PumpRecord::h);
+    Report("records, strided", rows, Measure(repeat, [&]() {
+             calc.Calculate(strided_in, strided_out, rows);
+           }));
+  }
+
+  // NUMA executor with buffers first touched by the owning node.
+  {
+    NumaExecutor numa;
+    BatchOptions options(&numa);
+
+    LargeBuffer<Parameters> in(rows, options, huge_pages);
+    LargeBuffer<CorrectionFactors> out(rows, options, huge_pages);
+    numa.ParallelFor(rows, BlockAlignedGrain(options.grain),
+                     [&in](size_t begin, size_t end) {
+                       FillInput(in.data(), begin, end);
+                     });
+
+    numa.ResetStats();
+    Report("numa", rows, Measure(repeat, [&]() {
+             calc.Calculate(in.data(), out.data(), rows, kStandardUnits,
+                            options);
+           }));
+
+    std::printf("\n%-6s %10s %12s %10s\n", "node", "rows", "busy ms", "GB/s");
+    for (const NodeStats& stats : numa.Stats()) {
+      double gbps = stats.seconds > 0
+                        ? static_cast<double>(stats.indices) * kBytesPerRow /
+                              stats.seconds * 1e-9
+                        : 0.0;
+      std::printf("%-6d %10zu %12.3f %10.2f\n", stats.node, stats.indices,
+                  stats.seconds * 1e3, gbps);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,35 @@
+# Fails if the freestanding core library references the heap, exceptions,
+# RTTI, iostream or std::map. Run with -DNM=<nm> -DARCHIVE=<library>.
+
+execute_process(
+    COMMAND ${NM} -C ${ARCHIVE}
+    OUTPUT_VARIABLE symbols
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${ARCHIVE}")
+endif()
+
+foreach(pattern
+    "operator new"
+    "operator delete"
+    "malloc"
+    "__cxa_allocate_exception"
+    "__cxa_throw"
+    "__gxx_personality"
+    "typeinfo for"
+    "vtable for"
+    "std::basic_string"
+    "std::__cxx11::basic_string"
+    "std::map"
+    "std::_Rb_tree"
+    "std::ios_base"
+    "std::basic_ostream"
+)
+    string(FIND "${symbols}" "${pattern}" position)
+    if(NOT position EQUAL -1)
+        message(FATAL_ERROR "${ARCHIVE} references ${pattern}")
+    endif()
+endforeach()
+
+message(STATUS "${ARCHIVE} is freestanding")
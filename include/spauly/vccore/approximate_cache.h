@@ -0,0 +1,125 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_APPROXIMATE_CACHE_H_
+#define SPAULY_VCCORE_APPROXIMATE_CACHE_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+/// Default width of an ApproximateCache cell in chart pixels. Linear
+/// interpolation over it is off by about 1e-7 at most.
+static constexpr double kDefaultApproximateStep = 0.1;
+
+/// Default largest interpolation error an ApproximateCache accepts.
+static constexpr double kDefaultApproximateTolerance = 1e-6;
+
+/// @brief ApproximateCache answers duty points close to earlier ones by
+/// interpolating between cached neighbours instead of calculating them.
+///
+/// All factors of a valid duty point depend on its position on the
+/// correction charts only. The cache splits the chart axis into cells of
+/// step pixels. The first row that falls into a cell calculates the factors
+/// at both cell ends and at its middle. The midpoint then gives the
+/// interpolation error of the cell: the largest difference of any factor
+/// from the straight line. Later rows in the cell are interpolated if that
+/// error is within the tolerance. Otherwise, and for cells that contain a
+/// chart cutoff, they are calculated exactly, like Calculator::Calculate.
+/// Invalid rows are never interpolated.
+///
+/// Cells are filled once and then only read, so concurrent calls are safe
+/// and never block: a row whose cell is being filled is calculated exactly.
+class ApproximateCache {
+ public:
+  /// @param tolerance Largest interpolation error of any factor to accept.
+  /// @param step Width of a cell in chart pixels.
+  explicit ApproximateCache(double tolerance = kDefaultApproximateTolerance,
+                            double step = kDefaultApproximateStep);
+
+  ApproximateCache(const ApproximateCache&) = delete;
+  ApproximateCache& operator=(const ApproximateCache&) = delete;
+
+  /// @brief Returns the correction factors of p, interpolated if the cell
+  /// of p allows it.
+  CorrectionFactors Calculate(const Parameters& p,
+                              const Units& u = kStandardUnits) noexcept;
+
+  /// @brief Calculates count rows, see Calculate.
+  void Calculate(const Parameters* in, CorrectionFactors* out, size_t count,
+                 const Units& u = kStandardUnits) noexcept;
+
+  double Tolerance() const noexcept { return tolerance_; }
+  double Step() const noexcept { return step_; }
+
+  /// Valid rows that were interpolated.
+  uint64_t Hits() const noexcept {
+    return hits_.load(std::memory_order_relaxed);
+  }
+
+  /// Valid rows that were calculated exactly.
+  uint64_t Misses() const noexcept {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+  /// Largest interpolation error of a cell that answered a row. The error is
+  /// measured at the middle of a cell, where it peaks for the smooth chart
+  /// functions.
+  double MaxError() const noexcept {
+    return max_error_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /// Factors at one chart position: q, eta, h[0..3].
+  using Factors = std::array<double, 6>;
+
+  struct Cell {
+    // 0 empty, 1 being filled, 2 ready.
+    std::atomic<uint32_t> state{0};
+    bool interpolate = false;
+    double error = 0;
+    Factors lo{};
+    Factors hi{};
+  };
+
+  /// @brief Fills out at the valid chart position pos, exactly or from the
+  /// cell.
+  void Resolve(DoubleT pos, CorrectionFactors& out) noexcept;
+
+  void Fill(Cell& cell, double lo_pos) noexcept;
+
+  const double tolerance_;
+  const double step_;
+  const size_t cell_count_;
+  std::unique_ptr<Cell[]> cells_;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<double> max_error_{0};
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_APPROXIMATE_CACHE_H_
@@ -0,0 +1,70 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_ASYNC_H_
+#define SPAULY_VCCORE_ASYNC_H_
+
+#include <functional>
+#include <memory>
+
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+
+/// @brief BatchHandle tracks the completion of work that was posted to an
+/// Executor, e.g. by Calculator::CalculateAsync. Handles are cheap to copy and
+/// all copies refer to the same work.
+class BatchHandle {
+ public:
+  /// @brief A default constructed handle refers to no work and is ready.
+  BatchHandle() = default;
+  ~BatchHandle() = default;
+
+  /// @brief Posts work to the executor and returns a handle that becomes
+  /// ready once work has returned.
+  /// @param executor Executor to run work on. work runs inline if nullptr.
+  /// @param work Invoked exactly once.
+  /// @return Handle for the posted work.
+  static BatchHandle Post(Executor* executor, std::function<void()> work);
+
+  /// @brief Returns true once the work has finished.
+  bool IsReady() const noexcept;
+
+  /// @brief Blocks the calling thread until the work has finished.
+  void Wait() const noexcept;
+
+  /// @brief Chains continuation after this work. The continuation is posted to
+  /// the same executor once this handle becomes ready, or runs inline if it
+  /// already is.
+  /// @param continuation Next stage, e.g. a consumer of the output buffer.
+  /// @return Handle that becomes ready once the continuation has returned.
+  BatchHandle Then(std::function<void()> continuation) const;
+
+ private:
+  struct State;
+
+  explicit BatchHandle(std::shared_ptr<State> state)
+      : state_(std::move(state)) {}
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_ASYNC_H_
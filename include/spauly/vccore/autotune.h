@@ -0,0 +1,134 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_AUTOTUNE_H_
+#define SPAULY_VCCORE_AUTOTUNE_H_
+
+#include <cstddef>
+#include <string>
+
+#include "spauly/vccore/batch_options.h"
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// forward declarations
+class Calculator;
+
+/// Default number of synthetic rows every candidate is measured on.
+static constexpr size_t kDefaultTuneRows = 1 << 16;
+
+/// A candidate replaces a simpler one only if it is this much faster, so
+/// timing noise does not pick more threads or a cache for nothing.
+static constexpr double kTuneMargin = 0.05;
+
+/// @brief TuneOptions is a DTO that configures an Autotune run.
+struct TuneOptions {
+  /// Largest difference of any factor from the reproducible results the
+  /// chosen profile may have. 0 allows ExecutionMode::kReproducible only.
+  double max_error = 0;
+
+  /// Number of synthetic rows if no sample is given.
+  size_t rows = kDefaultTuneRows;
+
+  /// Runs per candidate, the fastest counts.
+  int repeat = 3;
+
+  /// Largest thread count to try, 0 uses all cores.
+  size_t max_threads = 0;
+
+  /// Calculation method the profile is tuned for. Engine::kFormula never
+  /// uses the approximate cache.
+  EngineOptions engine;
+};
+
+/// @brief TuneProfile is the fastest batch configuration Autotune found on
+/// this host. Stored with SaveProfile, so later runs only need LoadProfile.
+struct TuneProfile {
+  /// HostFingerprint of the host the profile was measured on.
+  std::string fingerprint;
+
+  /// TuneOptions::max_error the profile was chosen for.
+  double accuracy = 0;
+
+  EngineOptions engine;
+  ExecutionMode mode = ExecutionMode::kReproducible;
+  size_t grain = kDefaultGrain;
+
+  /// Threads including the calling one, 1 runs without an executor.
+  size_t threads = 1;
+
+  /// Cell width and tolerance of an ApproximateCache, step is 0 if the
+  /// profile does not use one.
+  double approximate_step = 0;
+  double approximate_tolerance = 0;
+
+  /// Largest difference from the reproducible results on the sample.
+  double error = 0;
+
+  /// Throughput measured on the sample.
+  double rows_per_second = 0;
+
+  bool UsesApproximate() const noexcept { return approximate_step > 0; }
+
+  /// @brief Sets mode, grain and engine of options. The executor with
+  /// threads threads and the ApproximateCache are owned by the caller.
+  void Apply(BatchOptions& options) const noexcept {
+    options.mode = mode;
+    options.grain = grain;
+    options.engine = engine;
+  }
+};
+
+/// @brief Describes what a profile depends on besides the options: the core
+/// count and the instruction set the library was built for.
+std::string HostFingerprint();
+
+/// @brief Measures the batch path with every combination of thread count,
+/// grain, ExecutionMode and ApproximateCache step on sample, and returns the
+/// fastest one whose results stay within options.max_error. Candidates are
+/// tried from the simplest, a later one must be kTuneMargin faster to win.
+/// The reproducible sequential batch always qualifies.
+/// @param sample count duty points representative of the workload.
+TuneProfile Autotune(const Calculator& calc, const Parameters* sample,
+                     size_t count, const TuneOptions& options = TuneOptions());
+
+/// @brief Autotune on options.rows synthetic rows spread over all charts.
+TuneProfile Autotune(const Calculator& calc,
+                     const TuneOptions& options = TuneOptions());
+
+/// @brief Writes profile to path.tmp and atomically replaces path.
+/// @return false if the file could not be written.
+bool SaveProfile(const TuneProfile& profile, const std::string& path);
+
+/// @brief Reads a profile stored by SaveProfile.
+/// @return false if path is missing, damaged or of another host.
+bool LoadProfile(const std::string& path, TuneProfile& profile);
+
+/// @brief Loads the profile at path if it was tuned for the same max_error
+/// and engine on this host, otherwise runs Autotune and stores the result at
+/// path.
+/// @param tuned Set to true if Autotune ran, may be nullptr.
+TuneProfile LoadOrAutotune(const std::string& path, const Calculator& calc,
+                           const TuneOptions& options = TuneOptions(),
+                           bool* tuned = nullptr);
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_AUTOTUNE_H_
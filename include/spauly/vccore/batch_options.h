@@ -0,0 +1,132 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_BATCH_OPTIONS_H_
+#define SPAULY_VCCORE_BATCH_OPTIONS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "spauly/vccore/data.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/progress.h"
+
+namespace spauly {
+namespace vccore {
+
+// forward declarations
+class ApproximateCache;
+class DiagnosticsChannel;
+class Metrics;
+class ResultCache;
+
+/// Alignment of the batch grain, and number of rows the views and generators
+/// calculate as one block.
+static constexpr size_t kBlockSize = 8;
+
+/// Default number of rows handed to the executor as one chunk.
+static constexpr size_t kDefaultGrain = 128 * kBlockSize;
+
+/// @brief Rounds grain up to a multiple of kBlockSize. Batch calls use this
+/// to chunk the rows, buffers that are first touched per chunk must match it.
+inline constexpr size_t BlockAlignedGrain(size_t grain) noexcept {
+  return (grain == 0) ? kBlockSize
+                      : ((grain + kBlockSize - 1) / kBlockSize) * kBlockSize;
+}
+
+/// ExecutionMode determines whether a batch may trade the last bits of its
+/// results for speed.
+enum class ExecutionMode {
+  /// Results are bit-identical to the scalar Calculate, for every executor,
+  /// thread count, grain and input layout.
+  kReproducible,
+
+  /// Evaluates the fitted polynomials in Horner form. The factors differ from
+  /// kReproducible by less than 1e-12. Cached batches stay reproducible.
+  /// Enables BatchOptions::approximate.
+  kFast
+};
+
+/// @brief BatchOptions is a DTO that configures how a batch call is executed.
+/// Only ExecutionMode::kFast changes the results of the calculation, and a
+/// cancelled batch leaves the rows of its skipped chunks unwritten.
+struct BatchOptions {
+  /// Executor the chunks are scheduled on. The batch runs on the calling
+  /// thread if not set. The executor is not owned and must outlive the call.
+  Executor* executor = nullptr;
+
+  /// Number of rows per chunk. Rounded up to a multiple of kBlockSize.
+  size_t grain = kDefaultGrain;
+
+  /// Whether results must be bit-identical to the scalar Calculate.
+  ExecutionMode mode = ExecutionMode::kReproducible;
+
+  /// Calculation method of all rows. Engine::kFormula uses the vectorised
+  /// formula in ExecutionMode::kFast and never the cache or the approximate
+  /// cache, which hold chart results.
+  EngineOptions engine;
+
+  /// Checked before every chunk, the remaining chunks are skipped once it is
+  /// cancelled. Not owned, must outlive the call.
+  const CancellationToken* cancel = nullptr;
+
+  /// Receives the number of rows and of finished rows. Not owned, must
+  /// outlive the call.
+  ProgressSink* progress = nullptr;
+
+  /// Rows found here are not calculated again, calculated rows are added.
+  /// Cached rows are bit-identical to calculated ones. Not owned, must
+  /// outlive the call.
+  ResultCache* cache = nullptr;
+
+  /// Interpolates rows close to earlier ones within its tolerance. Only used
+  /// in ExecutionMode::kFast, takes precedence over cache. Not owned, must
+  /// outlive the call.
+  ApproximateCache* approximate = nullptr;
+
+  /// Receives a DiagnosticEvent for every row with an ErrorFlag. A batch with
+  /// diagnostics does not use the cache. Not owned, must outlive the call.
+  DiagnosticsChannel* diagnostics = nullptr;
+
+  /// Counts calls, rows, latencies and ErrorFlag bits of the batch. Not
+  /// owned, must outlive the call.
+  Metrics* metrics = nullptr;
+
+  /// Row index of the first row of the batch, reported in diagnostics. The
+  /// pipelines add the offset of every chunk.
+  uint64_t first_row = 0;
+
+  /// ErrorFlag bits of every row known before the calculation, e.g.
+  /// kParseError from a reader. Rows with bits set are not calculated, they
+  /// get zero factors and these bits and are reported as such. Not owned,
+  /// must hold a value per row and outlive the call.
+  const size_t* row_flags = nullptr;
+
+  BatchOptions() = default;
+  BatchOptions(Executor* executor, size_t grain = kDefaultGrain)
+      : executor(executor), grain(grain) {}
+
+  /// @brief Returns true if the batch was asked to stop.
+  bool IsCancelled() const noexcept {
+    return cancel != nullptr && cancel->IsCancelled();
+  }
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_BATCH_OPTIONS_H_
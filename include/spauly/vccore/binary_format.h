@@ -0,0 +1,158 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_BINARY_FORMAT_H_
+#define SPAULY_VCCORE_BINARY_FORMAT_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// The binary batch format is a 4 KiB header followed by fixed size records.
+// Input files hold Parameters, result files hold CorrectionFactors, both in
+// the same row order. Records are grouped into blocks of block_records rows,
+// which are the unit for aligned I/O and for splitting a file. Numbers are
+// stored as little endian IEEE 754 doubles and integers. Unused header bytes
+// are zero, so fields added later default to 0 in older files.
+
+/// Size of the file header. Keeps the records page aligned.
+static constexpr size_t kBinaryHeaderBytes = 4096;
+
+/// Current version of the binary format.
+static constexpr uint16_t kBinaryVersion = 1;
+
+/// Default number of records per block.
+static constexpr uint32_t kBinaryBlockRecords = 4096;
+
+/// Bytes per input record: flowrate, total_head, viscosity, density.
+static constexpr size_t kInputRecordBytes = 4 * sizeof(double);
+
+/// Bytes per result record: q, eta, h[4], error_flag.
+static constexpr size_t kResultRecordBytes = 6 * sizeof(double) + 8;
+
+/// Bytes per quantised result record: q, eta, h[4] and the error flag as
+/// 16 bit integers plus 2 bytes padding.
+static constexpr size_t kResultQ16RecordBytes = 8 * sizeof(uint16_t);
+
+/// Resolution of the quantised encoding. Factors are stored as
+/// round(x * 32768) and cover [0, 2), so a decoded factor is within half of
+/// this, about 1.5e-5, of the calculated one. That is far below the reading
+/// accuracy of the charts, which are digitised to about 1e-3. Only the lower
+/// 16 bits of the error flag are kept.
+static constexpr double kQ16Resolution = 1.0 / 32768.0;
+
+/// RecordKind determines what the records of a binary file hold.
+enum class RecordKind : uint16_t { kInput = 0, kResult = 1, kResultQ16 = 2 };
+
+/// ResultEncoding determines how result columns are stored.
+enum class ResultEncoding {
+  kDouble,  // IEEE 754 doubles, bit exact.
+  kQ16      // 16 bit fixed point, see kQ16Resolution.
+};
+
+/// @brief Returns the record kind of result files with the given encoding.
+constexpr RecordKind ResultKind(ResultEncoding encoding) noexcept {
+  return encoding == ResultEncoding::kQ16 ? RecordKind::kResultQ16
+                                          : RecordKind::kResult;
+}
+
+/// @brief Returns the bytes per record of the given kind.
+constexpr size_t RecordBytes(RecordKind kind) noexcept {
+  return kind == RecordKind::kInput    ? kInputRecordBytes
+         : kind == RecordKind::kResult ? kResultRecordBytes
+                                       : kResultQ16RecordBytes;
+}
+
+/// @brief BinaryHeader is the DTO of the file header.
+struct BinaryHeader {
+  RecordKind kind = RecordKind::kInput;
+  uint64_t record_count = 0;
+  uint32_t record_bytes = kInputRecordBytes;
+  uint32_t block_records = kBinaryBlockRecords;
+
+  /// Units of the input records. Ignored for result files.
+  Units units;
+
+  /// Index of the first record within the unsharded file. Only shard outputs
+  /// start at a record other than 0.
+  uint64_t first_record = 0;
+
+  /// @brief Returns the file offset of the given record.
+  uint64_t RecordOffset(uint64_t record) const noexcept {
+    return kBinaryHeaderBytes + record * record_bytes;
+  }
+
+  /// @brief Returns the number of blocks in the file.
+  uint64_t BlockCount() const noexcept {
+    return (record_count + block_records - 1) / block_records;
+  }
+};
+
+/// @brief Returns the input record stored for a row that could not be read,
+/// so the row order is kept. Its flowrate is NaN.
+inline Parameters UnreadableInputRecord() noexcept {
+  return Parameters(std::numeric_limits<double>::quiet_NaN(), 0, 0, 0);
+}
+
+/// @brief Returns true if p is an input record of a row that could not be
+/// read, i.e. its flowrate is NaN. Such rows get ErrorFlag::kParseError.
+inline bool IsUnreadableInputRecord(const Parameters& p) noexcept {
+  return std::isnan(p.flowrate);
+}
+
+/// @brief Writes header into out, which must hold kBinaryHeaderBytes.
+void EncodeHeader(const BinaryHeader& header, char* out) noexcept;
+
+/// @brief Reads the header from in.
+/// @param in At least kBinaryHeaderBytes bytes.
+/// @param header Decoded header.
+/// @return false if the magic, version or record size does not match.
+bool DecodeHeader(const char* in, BinaryHeader& header) noexcept;
+
+/// @brief Encodes count input records into out.
+void EncodeInputRecords(const Parameters* in, size_t count, char* out) noexcept;
+
+/// @brief Decodes count input records from in.
+void DecodeInputRecords(const char* in, size_t count, Parameters* out) noexcept;
+
+/// @brief Encodes count result records into out. error_msg is not stored.
+void EncodeResultRecords(const CorrectionFactors* in, size_t count,
+                         char* out) noexcept;
+
+/// @brief Decodes count result records from in.
+void DecodeResultRecords(const char* in, size_t count,
+                         CorrectionFactors* out) noexcept;
+
+/// @brief Encodes count result records with the given encoding.
+void EncodeResultRecords(const CorrectionFactors* in, size_t count,
+                         ResultEncoding encoding, char* out) noexcept;
+
+/// @brief Decodes count result records of the given encoding.
+void DecodeResultRecords(const char* in, size_t count,
+                         ResultEncoding encoding,
+                         CorrectionFactors* out) noexcept;
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_BINARY_FORMAT_H_
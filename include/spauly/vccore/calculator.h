@@ -19,12 +19,18 @@
 #define SPAULY_VCCORE_CALCULATOR_H_
 
 #include <array>
-#include <map>
+#include <functional>
 #include <memory>
+#include <vector>
 
+#include "spauly/vccore/async.h"
+#include "spauly/vccore/batch_options.h"
 #include "spauly/vccore/data.h"
+#include "spauly/vccore/impl/chart.h"
 #include "spauly/vccore/impl/conversion_functions.h"
 #include "spauly/vccore/impl/math.h"
+#include "spauly/vccore/strided.h"
+#include "spauly/vccore/view.h"
 
 namespace spauly {
 namespace vccore {
@@ -43,6 +49,85 @@ class Calculator {
   CorrectionFactors Calculate(const Parameters& p,
                               const Units& u = kStandardUnits) const noexcept;
 
+  /// @brief Calculates the correction factors for p with the method set in
+  /// engine. Engine::kChart gives the same results as Calculate(p, u).
+  /// @param p Flowrate, Head, Viscosity, and Density of the fluid.
+  /// @param u Units of p.
+  /// @param engine Calculation method and the pump speed it needs.
+  CorrectionFactors Calculate(const Parameters& p, const Units& u,
+                              const EngineOptions& engine) const noexcept;
+
+  /// @brief Calculates the correction factors for a batch of Parameters. The
+  /// rows are split into chunks that run on the executor set in options.
+  /// @param in Pointer to count Parameters.
+  /// @param out Pointer to count CorrectionFactors. out[i] belongs to in[i].
+  /// @param count Number of rows in the batch.
+  /// @param u Units shared by all rows of the batch.
+  /// @param options Executor and chunk size used for the batch.
+  void Calculate(const Parameters* in, CorrectionFactors* out, size_t count,
+                 const Units& u = kStandardUnits,
+                 const BatchOptions& options = BatchOptions()) const noexcept;
+
+  /// @brief Calculates the correction factors for a batch of Parameters.
+  /// @param in Parameters of the batch.
+  /// @param u Units shared by all rows of the batch.
+  /// @param options Executor and chunk size used for the batch.
+  /// @return CorrectionFactors in the same order as in.
+  std::vector<CorrectionFactors> Calculate(
+      const std::vector<Parameters>& in, const Units& u = kStandardUnits,
+      const BatchOptions& options = BatchOptions()) const;
+
+  /// @brief Calculates a batch whose rows are read from and written to
+  /// strided views, so rows embedded in larger structs need no repacking.
+  /// Each chunk gathers kStridedBlockRows rows at a time.
+  /// @param in Input columns of count rows.
+  /// @param out Output columns of count rows, unset columns are skipped.
+  /// @param count Number of rows in the batch.
+  /// @param u Units shared by all rows of the batch.
+  /// @param options Executor and chunk size used for the batch.
+  void Calculate(const StridedInput& in, const StridedOutput& out,
+                 size_t count, const Units& u = kStandardUnits,
+                 const BatchOptions& options = BatchOptions()) const noexcept;
+
+  /// @brief Returns a lazy view over the correction factors of in. The rows
+  /// are calculated block wise while iterating, no result buffer is allocated.
+  /// @param in Parameters to view, must outlive the view.
+  /// @param u Units shared by all rows.
+  /// @return CalculationView usable with range-for and standard algorithms.
+  CalculationView View(const std::vector<Parameters>& in,
+                       const Units& u = kStandardUnits) const noexcept {
+    return CalculationView(*this, in.data(), in.size(), u);
+  }
+
+  /// @brief Returns a lazy view over the correction factors of count rows
+  /// starting at in.
+  CalculationView View(const Parameters* in, size_t count,
+                       const Units& u = kStandardUnits) const noexcept {
+    return CalculationView(*this, in, count, u);
+  }
+
+  /// @brief Starts a batch calculation on the executor set in options and
+  /// returns without waiting for it. The Calculator, in and out must stay
+  /// alive until the returned handle is ready. Runs synchronously if no
+  /// executor is set.
+  /// @param in Pointer to count Parameters.
+  /// @param out Caller owned buffer for count CorrectionFactors.
+  /// @param count Number of rows in the batch.
+  /// @param u Units shared by all rows of the batch.
+  /// @param options Executor and chunk size used for the batch.
+  /// @return Handle to wait for the batch or to chain further stages.
+  BatchHandle CalculateAsync(
+      const Parameters* in, CorrectionFactors* out, size_t count,
+      const Units& u = kStandardUnits,
+      const BatchOptions& options = BatchOptions()) const;
+
+  /// @brief Same as CalculateAsync but invokes on_done on the executor once
+  /// all rows are written to out.
+  BatchHandle CalculateAsync(const Parameters* in, CorrectionFactors* out,
+                             size_t count, const Units& u,
+                             const BatchOptions& options,
+                             std::function<void()> on_done) const;
+
   /// @brief Converts the given value to the base unit.
   /// @tparam _Unit Must be either FlowrateUnit, HeadUnit, DensityUnit, or
   /// ViscosityUnit.
@@ -69,84 +154,49 @@ class Calculator {
   /// @return ErrorFlags if an error was found.
   const size_t ValidateInput(const Parameters& p) const noexcept;
 
-  /// @brief Maps the input value to the given scale, relative to the given
-  /// values for the scale.
-  /// @param raw_scale_units map where the key is the value of the position and
-  /// the value is the distance in pixels to the next position.
-  /// @param input value input by the user.
-  /// @param startpos position to start the mapping.
-  /// @return Returns the input value mapped to the scale in pixels.
-  const double FitToScale(const std::map<const int, const int>& raw_scale_units,
-                          const double& input,
-                          const int startpos = 0) const noexcept;
+  /// @brief Same as Calculate but also returns the position on the
+  /// correction charts, NaN if the input is invalid.
+  CorrectionFactors Calculate(const Parameters& p, const Units& u,
+                              DoubleT& pos_main) const noexcept;
+
+  /// @brief Runs task over the chunks of a batch of count rows as set in
+  /// options, including cancellation, progress and metrics. task is called
+  /// as task(begin, end), defined in calculator.cpp.
+  template <typename Task>
+  void RunBatch(size_t count, const BatchOptions& options,
+                const Task& task) const noexcept;
+
+  /// @brief Calculates the rows [begin, end) of a batch on the calling thread
+  /// through the cache and diagnostics channel of options. Rows flagged in
+  /// options.row_flags are left out.
+  void CalculateRange(const Parameters* in, CorrectionFactors* out,
+                      size_t begin, size_t end, const Units& u,
+                      const BatchOptions& options) const noexcept;
+
+  /// @brief Same as CalculateRange for rows without options.row_flags, but
+  /// records no metrics.
+  /// @return Number of cut off chart rows if options.metrics is set.
+  size_t CalculateRun(const Parameters* in, CorrectionFactors* out,
+                      size_t begin, size_t end, const Units& u,
+                      const BatchOptions& options) const noexcept;
 
   /// @brief Validates the given x value for the Q correction factor.
   /// @param x x value to be validated.
   constexpr inline bool ValidateXQ(const double& x) const noexcept {
-    return (x >= 242.0 && x <= 384.0);
+    return impl::ChartValidQ(x);
   }
 
   /// @brief Validates the given x value for the Eta correction factor.
   /// @param x x value to be validated.
   constexpr inline bool ValidateXEta(const double& x) const noexcept {
-    return (x >= 122.0 && x <= 363.0);
+    return impl::ChartValidEta(x);
   }
 
   /// @brief Validates the given x value for the H correction factor.
   /// @param x x value to be validated.
   constexpr inline bool ValidateXH(const double& x) const noexcept {
-    return (x >= 146.0 && x <= 382.0);
+    return impl::ChartValidH(x);
   }
-
- private:
-  //------------------------------------------------
-  // Constants for the correction factors calculation
-
-  // The provided values here were calculated in the original code and must
-  // be updated. Please refer to the original code for how the were
-  // obtained: <https://github.com/SPauly/ViscoCorrect>
-  const std::array<DoubleT, 6> kQ{
-      4.3286373442021278e-09, -6.5935466655309209e-06, 0.0039704102541411324,
-      -1.1870337647376101,    176.52190832690891,      -10276.558815133236};
-  const std::array<DoubleT, 6> kEta{
-      2.5116987378131985e-10, -3.2416532447274418e-07, 0.00015531747394399714,
-      -0.037300324399145976,  4.2391803778160968,      -6.2364025573465849};
-  const std::array<const std::array<DoubleT, 3>, 4> kH{{
-      {285.39113639063004, -0.019515612319848788, 451.79876054847699},  // 0.6
-      {286.44331640461877, -0.016739174282778945, 453.11949555301783},  // 0.8
-      {285.70823636118865, -0.016126836943018912, 443.60573501332937},  // 1.0
-      {285.91175890816675, -0.015057232233799856, 436.03377039579027}   // 1.2
-  }};
-
-  const impl::PolynomialFunc<DoubleT, 6> kFuncQ{kQ};
-  const impl::PolynomialFunc<DoubleT, 6> kFuncEta{kEta};
-  std::array<impl::LogisticalFunc, 4> kFuncH{
-      {impl::LogisticalFunc(kH.at(0)), impl::LogisticalFunc(kH.at(1)),
-       impl::LogisticalFunc(kH.at(2)), impl::LogisticalFunc(kH.at(3))}};
-
-  // Constants for the correction factors calculation
-  const DoubleT kPixelsCorrectionScale =
-      22;  // 22 pixels per unit in the original correction factors scale
-  const std::array<const int, 2> kStartFlowrate{0, 0};
-  const std::array<const int, 2> kStartTotalH{4, 1};
-  const std::array<const int, 2> kStartVisco{105, 304};
-  const double kPitchTotalH = 0.5255813953488372;
-  const double kPitchVisco = -1.9090909090909092;
-
-  const std::map<const int, const int> kFlowrateScale{
-      {6, 0},    {7, 14},    {8, 9},    {9, 9},    {10, 9},   {15, 30},
-      {20, 21},  {30, 30},   {40, 21},  {50, 17},  {60, 13},  {70, 12},
-      {80, 9},   {90, 9},    {100, 9},  {150, 30}, {200, 21}, {300, 30},
-      {400, 21}, {500, 17},  {600, 14}, {700, 11}, {800, 10}, {900, 8},
-      {1000, 8}, {1500, 30}, {2000, 22}};
-
-  const std::map<const int, const int> kTotalHeadScale{
-      {5, 0}, {10, 15}, {20, 12}, {40, 14}, {50, 8}, {100, 9}, {200, 13}};
-
-  std::map<const int, const int> kViscoScale{
-      {10, 0},   {20, 27},  {30, 16},   {40, 10},   {60, 15},  {80, 11},
-      {100, 8},  {200, 26}, {300, 16},  {400, 11},  {500, 8},  {600, 6},
-      {800, 12}, {1000, 9}, {2000, 26}, {3000, 14}, {4000, 10}};
 };
 
 // Template definitions
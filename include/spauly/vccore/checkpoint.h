@@ -0,0 +1,112 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_CHECKPOINT_H_
+#define SPAULY_VCCORE_CHECKPOINT_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+
+/// Default minimum time between two checkpoints. Every checkpoint flushes the
+/// outputs to stable storage, so this bounds the cost to well below 1% of a
+/// long run while losing at most a few seconds of work.
+static constexpr double kDefaultCheckpointSeconds = 5.0;
+
+/// @brief Checkpoint records which chunks of a long running job are complete
+/// and persists them, so a restarted job can skip them. The file is replaced
+/// atomically, it never lists a chunk whose output was not flushed before.
+/// Not thread safe.
+class Checkpoint {
+ public:
+  /// Half open range [first, last) of completed chunks.
+  using Range = std::pair<uint64_t, uint64_t>;
+
+  /// Creates a disabled checkpoint that never saves anything.
+  Checkpoint() = default;
+
+  /// @param path File the checkpoint is stored in.
+  /// @param fingerprint Identifies the job, e.g. input size and chunking. A
+  /// stored checkpoint of another job is ignored by Load.
+  /// @param interval_seconds Minimum time between two saves, see Due.
+  Checkpoint(std::string path, std::string fingerprint,
+             double interval_seconds = kDefaultCheckpointSeconds);
+
+  bool IsEnabled() const noexcept { return !path_.empty(); }
+
+  /// @brief Restores the completed chunks from the stored checkpoint.
+  /// @return true if a checkpoint of this job was found.
+  bool Load();
+
+  /// @brief Writes the completed chunks to path.tmp, flushes it and
+  /// atomically replaces path. The outputs of all chunks marked done must
+  /// have been flushed before.
+  /// @return false if the file could not be written.
+  bool Save();
+
+  /// @brief Removes the stored checkpoint, e.g. once the job finished.
+  bool Remove();
+
+  void MarkDone(uint64_t chunk);
+  bool IsDone(uint64_t chunk) const noexcept;
+
+  /// @brief Number of completed chunks.
+  uint64_t DoneCount() const noexcept;
+
+  /// @brief Completed chunks as sorted, disjoint ranges.
+  const std::vector<Range>& Ranges() const noexcept { return ranges_; }
+
+  /// @brief Returns true if the interval has passed since the last save.
+  bool Due() const noexcept;
+
+ private:
+  std::string path_;
+  std::string fingerprint_;
+  std::chrono::steady_clock::duration interval_{};
+  std::chrono::steady_clock::time_point last_save_ =
+      std::chrono::steady_clock::now();
+
+  std::vector<Range> ranges_;
+};
+
+/// @brief Runs task on the chunks [k * chunk_size, (k + 1) * chunk_size) of
+/// [0, count) on executor, skipping the chunks checkpoint marks as done. The
+/// chunks run in waves of a few chunks per thread. After a wave, if the
+/// checkpoint is due, flush is called to make the outputs durable and the
+/// checkpoint is saved. Once all chunks are done flush and save run again.
+/// @param executor Executor to run on, the calling thread if nullptr.
+/// @param flush Makes the outputs of the completed chunks durable. Returning
+/// false stops the run.
+/// @return false if flush or the checkpoint failed.
+bool ParallelForCheckpointed(Executor* executor, size_t count,
+                             size_t chunk_size, Checkpoint& checkpoint,
+                             const Executor::RangeTask& task,
+                             const std::function<bool()>& flush);
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_CHECKPOINT_H_
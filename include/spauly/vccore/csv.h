@@ -0,0 +1,62 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_CSV_H_
+#define SPAULY_VCCORE_CSV_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "spauly/vccore/binary_format.h"
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// CSV input rows are "flowrate,total_head,viscosity[,density]". A first line
+// that does not start with a number is treated as header. Result rows are
+// "q,eta,h0,h1,h2,h3,error_flag" preceded by kCsvResultHeader.
+
+/// Header line of CSV result files.
+static constexpr const char* kCsvResultHeader =
+    "q,eta,h0,h1,h2,h3,error_flag";
+
+/// @brief Returns true if line is a header or empty and holds no record.
+bool IsCsvHeaderOrEmpty(std::string_view line) noexcept;
+
+/// @brief Parses one CSV input row.
+/// @param line Row without the line feed.
+/// @param p Parsed Parameters, density is 0 if not given.
+/// @return false if the row is malformed.
+bool ParseCsvRecord(std::string_view line, Parameters& p) noexcept;
+
+/// @brief Appends one CSV result row including the line feed to out.
+/// @param encoding kDouble writes the shortest text that reads back exactly.
+/// kQ16 rounds the factors to the 16 bit grid and writes 5 decimals, which
+/// adds at most 5e-6 to the error documented at kQ16Resolution.
+void AppendCsvResult(const CorrectionFactors& cf, std::string& out,
+                     ResultEncoding encoding = ResultEncoding::kDouble);
+
+/// @brief Parses one CSV result row as written by AppendCsvResult.
+/// @return false if the row is malformed.
+bool ParseCsvResult(std::string_view line, CorrectionFactors& cf) noexcept;
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_CSV_H_
@@ -19,6 +19,7 @@
 #define SPAULY_VCCORE_DATA_H_
 
 #include <array>
+#include <cstddef>
 #include <string>
 
 namespace spauly {
@@ -69,7 +70,8 @@ enum ErrorFlag : size_t {
   kTotalHeadError = 1 << 1,
   kViscosityError = 1 << 2,
   kDensityError = 1 << 3,
-  kCalculationOOR = 1 << 4
+  kCalculationOOR = 1 << 4,
+  kParseError = 1 << 5  // The input record could not be read.
 };
 
 /// @brief Parameters is a DTO used for the communicatio between the user and
@@ -81,8 +83,8 @@ struct Parameters {
   DoubleT density;
 
   Parameters() = default;
-  Parameters(DoubleT flowrate, DoubleT total_head, DoubleT viscosity,
-             DoubleT density = 0)
+  constexpr Parameters(DoubleT flowrate, DoubleT total_head,
+                       DoubleT viscosity, DoubleT density = 0)
       : flowrate(flowrate),
         total_head(total_head),
         viscosity(viscosity),
@@ -99,23 +101,53 @@ struct Units {
   DensityUnit density = kStandardDensityUnit;
 
   Units() = default;
-  Units(FlowrateUnit flowrate, HeadUnit total_head = kStandardHeadUnit,
-        ViscosityUnit viscosity = kStandardViscosityUnit,
-        DensityUnit density = kStandardDensityUnit)
+  constexpr Units(FlowrateUnit flowrate,
+                  HeadUnit total_head = kStandardHeadUnit,
+                  ViscosityUnit viscosity = kStandardViscosityUnit,
+                  DensityUnit density = kStandardDensityUnit)
       : flowrate(flowrate),
         total_head(total_head),
         viscosity(viscosity),
         density(density) {}
 
-  inline bool operator==(const Units& other) const {
+  constexpr bool operator==(const Units& other) const {
     return flowrate == other.flowrate && total_head == other.total_head &&
            viscosity == other.viscosity && density == other.density;
   }
 
-  inline bool operator!=(const Units& other) const { return !(*this == other); }
+  constexpr bool operator!=(const Units& other) const {
+    return !(*this == other);
+  }
+};
+
+static constexpr Units kStandardUnits = Units();
+
+/// Engine determines the method the correction factors are calculated with.
+enum class Engine : int {
+  /// The digitised correction chart, the default.
+  kChart,
+
+  /// The closed form ANSI/HI 9.6.7 method. Needs the pump speed, the head
+  /// is per stage. Valid for the parameter B < 40, above it the row gets
+  /// kCalculationOOR.
+  kFormula
 };
 
-static const Units kStandardUnits = Units();
+/// Pump speed assumed by Engine::kFormula unless set, a two pole motor at
+/// 50 Hz.
+static constexpr DoubleT kDefaultPumpSpeed = 2900;  // rpm
+
+/// @brief EngineOptions is a DTO that selects the calculation method.
+struct EngineOptions {
+  Engine engine = Engine::kChart;
+
+  /// Pump speed in rpm, only used by Engine::kFormula.
+  DoubleT speed = kDefaultPumpSpeed;
+
+  EngineOptions() = default;
+  constexpr EngineOptions(Engine engine, DoubleT speed = kDefaultPumpSpeed)
+      : engine(engine), speed(speed) {}
+};
 
 /// @brief CorrectionFactors is a DTO used for the communication between the
 /// Calculator and the user. It contains the correction factors based on a
@@ -0,0 +1,123 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_DIAGNOSTICS_H_
+#define SPAULY_VCCORE_DIAGNOSTICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace spauly {
+namespace vccore {
+
+/// @brief DiagnosticEvent is the compact record of one batch row that
+/// carries an ErrorFlag.
+struct DiagnosticEvent {
+  /// Index of the row, counted from BatchOptions::first_row.
+  uint64_t row = 0;
+
+  /// ErrorFlag bits of the row. kCalculationOOR is set for rows whose
+  /// position lies beyond the upper end of a correction chart, the factors of
+  /// those charts are 0. The results themselves do not carry that flag.
+  uint32_t flags = 0;
+
+  /// Position on the correction charts, NaN if the input was invalid or the
+  /// row was calculated with Engine::kFormula.
+  float pos_main = 0;
+};
+
+/// @brief Receives drained events. The pointer is only valid during the call.
+using DiagnosticsSink =
+    std::function<void(const DiagnosticEvent* events, size_t count)>;
+
+/// Events each recording thread can buffer before events are dropped.
+static constexpr size_t kDefaultDiagnosticsRing = size_t(1) << 16;
+
+/// Interval of the background drain.
+static constexpr std::chrono::milliseconds kDefaultDiagnosticsInterval{10};
+
+/// @brief DiagnosticsChannel moves DiagnosticEvents from the batch workers
+/// to a sink without slowing them down. Every recording thread gets its own
+/// single producer ring, so Record is a few plain stores and never blocks. A
+/// background thread drains the rings into the sink, which is never called
+/// concurrently. Events that do not fit into a full ring are dropped and
+/// counted.
+class DiagnosticsChannel {
+ public:
+  /// @param sink Receives the events in batches, in order per thread.
+  /// @param ring_events Capacity per thread, rounded up to a power of two.
+  /// @param interval Time between two background drains.
+  explicit DiagnosticsChannel(
+      DiagnosticsSink sink, size_t ring_events = kDefaultDiagnosticsRing,
+      std::chrono::milliseconds interval = kDefaultDiagnosticsInterval);
+
+  /// @brief Stops the background thread and drains the remaining events.
+  ~DiagnosticsChannel();
+
+  DiagnosticsChannel(const DiagnosticsChannel&) = delete;
+  DiagnosticsChannel& operator=(const DiagnosticsChannel&) = delete;
+
+  /// @brief Buffers an event of the calling thread. The first call of a
+  /// thread registers its ring, later calls are lock-free.
+  void Record(const DiagnosticEvent& event) noexcept;
+
+  /// @brief Drains every event recorded before the call into the sink on the
+  /// calling thread. Call it after a batch to see all of its events.
+  void Flush();
+
+  /// @brief Returns the number of events dropped because a ring was full.
+  uint64_t Dropped() const noexcept;
+
+ private:
+  struct Ring;
+
+  Ring* LocalRing() noexcept;
+  void DrainLoop();
+  void Drain();
+
+  const uint64_t id_;
+  const size_t ring_events_;
+  const std::chrono::milliseconds interval_;
+  DiagnosticsSink sink_;
+
+  // Guards rings_ and by_thread_, only taken when a thread registers.
+  mutable std::mutex rings_mutex_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+  std::unordered_map<std::thread::id, Ring*> by_thread_;
+
+  // Serialises the drains and so the sink.
+  std::mutex drain_mutex_;
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
+  std::thread drainer_;
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_DIAGNOSTICS_H_
@@ -0,0 +1,159 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_EXECUTOR_H_
+#define SPAULY_VCCORE_EXECUTOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace spauly {
+namespace vccore {
+
+/// @brief Executor is the abstraction every parallel entry point of the
+/// library runs on. Host applications that already own a thread pool implement
+/// this interface so that ViscoCorrectCore shares their cores instead of
+/// spawning its own threads.
+class Executor {
+ public:
+  /// @brief Task invoked for the half open index range [begin, end).
+  using RangeTask = std::function<void(size_t begin, size_t end)>;
+
+  Executor() = default;
+  virtual ~Executor() = default;
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  /// @brief Returns the number of chunks that may run concurrently.
+  virtual size_t Concurrency() const noexcept = 0;
+
+  /// @brief Splits [0, count) into chunks of at most grain indices and runs
+  /// task on every chunk. Blocks until all chunks are finished.
+  /// @param count Number of indices to process.
+  /// @param grain Maximum number of indices per chunk. 0 is treated as 1.
+  /// @param task Invoked once per chunk, possibly from several threads.
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) = 0;
+
+  /// @brief Schedules task to run asynchronously and returns immediately.
+  /// The default implementation runs task on the calling thread, executors
+  /// backed by a pool should override it.
+  /// @param task Invoked exactly once.
+  virtual void Post(std::function<void()> task) { task(); }
+};
+
+/// @brief Runs every chunk on the calling thread. Used when no executor was
+/// provided.
+class SequentialExecutor : public Executor {
+ public:
+  SequentialExecutor() = default;
+  virtual ~SequentialExecutor() = default;
+
+  virtual size_t Concurrency() const noexcept override { return 1; }
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override;
+};
+
+/// @brief Small built-in pool for applications that do not bring their own.
+/// The calling thread takes part in ParallelFor, so nested or concurrent calls
+/// can not deadlock even if all workers are busy.
+class ThreadPoolExecutor : public Executor {
+ public:
+  /// @brief Starts the worker threads.
+  /// @param threads Number of workers, 0 selects
+  /// std::thread::hardware_concurrency() - 1 since the caller participates.
+  explicit ThreadPoolExecutor(size_t threads = 0);
+  virtual ~ThreadPoolExecutor();
+
+  virtual size_t Concurrency() const noexcept override {
+    return workers_.size() + 1;
+  }
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override;
+
+  /// @brief Queues task for the workers. Runs inline if the pool has no
+  /// workers.
+  virtual void Post(std::function<void()> task) override;
+
+  /// @brief Returns the number of queued tasks no worker picked up yet.
+  /// Lock-free, meant for monitoring.
+  size_t QueueDepth() const noexcept {
+    return queued_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  /// @brief Queues a task for the workers.
+  void Enqueue(std::function<void()> task);
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> queue_;
+  std::atomic<size_t> queued_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+#if defined(VCCORE_HAS_OPENMP)
+/// @brief Adapter that schedules the chunks on the OpenMP runtime of the host
+/// application. Only available if the library was built with OpenMP.
+class OpenMPExecutor : public Executor {
+ public:
+  /// @param threads Number of OpenMP threads, 0 uses the runtime default.
+  explicit OpenMPExecutor(int threads = 0) : threads_(threads) {}
+  virtual ~OpenMPExecutor() = default;
+
+  virtual size_t Concurrency() const noexcept override;
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override;
+
+ private:
+  int threads_ = 0;
+};
+#endif  // VCCORE_HAS_OPENMP
+
+#if defined(VCCORE_HAS_PARALLEL_STL)
+/// @brief Adapter that runs the chunks through the C++17 parallel algorithms
+/// (std::execution::par) of the standard library in use.
+class ParallelAlgorithmsExecutor : public Executor {
+ public:
+  ParallelAlgorithmsExecutor() = default;
+  virtual ~ParallelAlgorithmsExecutor() = default;
+
+  virtual size_t Concurrency() const noexcept override;
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override;
+};
+#endif  // VCCORE_HAS_PARALLEL_STL
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_EXECUTOR_H_
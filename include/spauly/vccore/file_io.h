@@ -0,0 +1,193 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_FILE_IO_H_
+#define SPAULY_VCCORE_FILE_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace spauly {
+namespace vccore {
+
+/// Alignment of I/O buffers, a multiple of the page and sector size.
+static constexpr size_t kIoAlignment = 4096;
+
+/// @brief File is a thin RAII wrapper around a native file descriptor that
+/// supports positioned reads and writes.
+class File {
+ public:
+  /// OpenMode determines how the file is opened.
+  enum class OpenMode { kRead, kWrite, kReadWrite };
+
+  File() = default;
+  ~File() { Close(); }
+
+  File(File&& other) noexcept;
+  File& operator=(File&& other) noexcept;
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+
+  /// @brief Opens path. kWrite creates or truncates the file, kReadWrite
+  /// creates it if needed and keeps the content.
+  /// @return false if the file could not be opened.
+  bool Open(const std::string& path, OpenMode mode) noexcept;
+  void Close() noexcept;
+
+  bool IsOpen() const noexcept { return fd_ >= 0; }
+  int Descriptor() const noexcept { return fd_; }
+
+  /// @brief Returns the size of the file in bytes or -1 on error.
+  int64_t Size() const noexcept;
+
+  /// @brief Returns the last modification time in nanoseconds since the
+  /// epoch or -1 on error.
+  int64_t ModifiedTime() const noexcept;
+
+  /// @brief Reads up to size bytes at offset.
+  /// @return Number of bytes read or -1 on error.
+  int64_t ReadAt(void* buffer, size_t size, uint64_t offset) const noexcept;
+
+  /// @brief Writes size bytes at offset.
+  /// @return Number of bytes written or -1 on error.
+  int64_t WriteAt(const void* buffer, size_t size,
+                  uint64_t offset) const noexcept;
+
+  /// @brief Flushes the file content to stable storage.
+  bool Sync() const noexcept;
+
+ private:
+  int fd_ = -1;
+};
+
+/// @brief Renames from to to, replacing to atomically, and flushes the
+/// directory entry so the rename survives a crash.
+bool AtomicReplaceFile(const std::string& from,
+                       const std::string& to) noexcept;
+
+/// @brief Removes path. Returns true if it is gone afterwards.
+bool RemoveFile(const std::string& path) noexcept;
+
+/// @brief Heap buffer aligned to kIoAlignment.
+class AlignedBuffer {
+ public:
+  AlignedBuffer() = default;
+  explicit AlignedBuffer(size_t size);
+  ~AlignedBuffer();
+
+  AlignedBuffer(AlignedBuffer&& other) noexcept;
+  AlignedBuffer& operator=(AlignedBuffer&& other) noexcept;
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  char* data() noexcept { return data_; }
+  const char* data() const noexcept { return data_; }
+  size_t size() const noexcept { return size_; }
+
+ private:
+  char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+/// @brief IoRequest is a DTO describing one positioned read or write.
+struct IoRequest {
+  int fd = -1;
+  void* buffer = nullptr;
+  size_t size = 0;
+  uint64_t offset = 0;
+  bool write = false;
+
+  /// Returned with the completion to identify the request.
+  uint64_t tag = 0;
+};
+
+/// @brief IoCompletion is a DTO reporting the outcome of an IoRequest.
+struct IoCompletion {
+  uint64_t tag = 0;
+
+  /// Bytes transferred or a negative errno value.
+  int64_t result = 0;
+};
+
+/// IoBackend determines which implementation of IoQueue is used.
+enum class IoBackend {
+  kSync,    // Positioned reads and writes on the calling thread.
+  kIoUring  // Linux io_uring through raw system calls.
+};
+
+/// @brief IoQueue keeps several reads and writes in flight and reports their
+/// completion. Implementations are not thread safe.
+class IoQueue {
+ public:
+  IoQueue() = default;
+  virtual ~IoQueue() = default;
+
+  IoQueue(const IoQueue&) = delete;
+  IoQueue& operator=(const IoQueue&) = delete;
+
+  /// @brief Queues a request. The buffer must stay valid until the request
+  /// has completed.
+  /// @return false if the queue is full or the request could not be queued.
+  virtual bool Submit(const IoRequest& request) noexcept = 0;
+
+  /// @brief Waits until at least one request completed and returns it.
+  /// @return false if nothing is in flight.
+  virtual bool WaitOne(IoCompletion& completion) noexcept = 0;
+
+  /// @brief Number of submitted requests that have not been returned by
+  /// WaitOne yet.
+  virtual size_t InFlight() const noexcept = 0;
+
+  /// @brief Returns the backend that is actually in use.
+  virtual IoBackend Backend() const noexcept = 0;
+};
+
+/// @brief IoQueue that performs every request synchronously in Submit.
+class SyncIoQueue : public IoQueue {
+ public:
+  SyncIoQueue() = default;
+  virtual ~SyncIoQueue() = default;
+
+  virtual bool Submit(const IoRequest& request) noexcept override;
+  virtual bool WaitOne(IoCompletion& completion) noexcept override;
+  virtual size_t InFlight() const noexcept override { return done_.size(); }
+  virtual IoBackend Backend() const noexcept override {
+    return IoBackend::kSync;
+  }
+
+ private:
+  std::deque<IoCompletion> done_;
+};
+
+/// @brief Returns true if the library was built with io_uring support and the
+/// running kernel allows creating a ring and implements its read and write
+/// requests, which needs Linux 5.6.
+bool IoUringAvailable() noexcept;
+
+/// @brief Creates a queue for the requested backend. Falls back to
+/// SyncIoQueue if io_uring is not available.
+/// @param backend Preferred backend.
+/// @param depth Maximum number of requests in flight.
+std::unique_ptr<IoQueue> MakeIoQueue(IoBackend backend, unsigned depth);
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_FILE_IO_H_
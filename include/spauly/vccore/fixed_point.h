@@ -0,0 +1,442 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_FIXED_POINT_H_
+#define SPAULY_VCCORE_FIXED_POINT_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "spauly/vccore/data.h"
+#include "spauly/vccore/impl/chart.h"
+#include "spauly/vccore/impl/fixed.h"
+
+namespace spauly {
+namespace vccore {
+
+// Fixed point variant of Calculator::Calculate for controllers without an
+// FPU, and for targets that need bit-identical results everywhere. The chart
+// is integer pixel space already, so the scale mapping and the line
+// intersection run on fixed point pixel positions. The curves are evaluated
+// on a finer internal format: the polynomials in Horner form on the chart
+// window mapped to [-1, 1], the logistic functions with an integer exp and a
+// Newton reciprocal. All constants are folded at compile time, the
+// calculation itself uses no floating point and no division.
+//
+// Inputs must be in the standard units. Convert them on the host, or with
+// integer factors before.
+//
+// Maximum error against Calculator::Calculate over a dense grid of valid
+// inputs, the input rounding included:
+//   FixedQ16  Q16.16  < 1e-5
+//   FixedQ32  Q32.32  < 5e-10
+// Chart positions are within 1e-4 px (Q16.16) and 1e-8 px (Q32.32) of
+// ChartPosition. Positions that close to a chart cutoff may fall on the
+// other side of it than in Calculate, the factor then jumps by the step of
+// the chart at the cutoff.
+
+/// @brief Q16.16 in 32 bit words. Intermediate products use 64 bits, the
+/// curves are evaluated in Q5.26.
+struct FixedQ16 {
+  using Int = int32_t;
+  static constexpr int kFrac = 16;
+  static constexpr int kInnerFrac = 26;
+  static constexpr int kExpTerms = 11;
+  static constexpr int kNewtonSteps = 5;
+};
+
+/// @brief Q32.32 in 64 bit words. Intermediate products use 128 bits, the
+/// curves are evaluated in Q5.58.
+struct FixedQ32 {
+  using Int = int64_t;
+  static constexpr int kFrac = 32;
+  static constexpr int kInnerFrac = 58;
+  static constexpr int kExpTerms = 18;
+  static constexpr int kNewtonSteps = 6;
+};
+
+/// @brief FixedParameters holds the input of the fixed point engine in the
+/// standard units, each value with Format::kFrac fractional bits.
+template <typename Format>
+struct FixedParameters {
+  using Int = typename Format::Int;
+
+  Int flowrate = 0;
+  Int total_head = 0;
+  Int viscosity = 0;
+};
+
+/// @brief FixedFactors holds the correction factors with Format::kFrac
+/// fractional bits. Same layout and error flags as CorrectionFactors.
+template <typename Format>
+struct FixedFactors {
+  using Int = typename Format::Int;
+
+  Int q = 0;
+  Int eta = 0;
+  std::array<Int, 4> h{};
+  size_t error_flag = 0;
+};
+
+namespace impl {
+
+/// @brief Returns pixels / range of every tick of scale. The first tick has
+/// no pixels, so its ratio is 0.
+template <typename Int, int kFrac, size_t N>
+inline constexpr std::array<Int, N> FixedScaleRatios(
+    const std::array<ScaleTick, N>& scale) noexcept {
+  std::array<Int, N> ratios{};
+  int prev_value = 0;
+  for (size_t i = 0; i < N; i++) {
+    ratios[i] = ToFixedRaw<Int>(static_cast<double>(scale[i].pixels) /
+                                    (scale[i].value - prev_value),
+                                kFrac);
+    prev_value = scale[i].value;
+  }
+  return ratios;
+}
+
+/// @brief Rewrites the chart polynomial coeffs into the polynomial of the
+/// correction factor in u = (x - mid) / half_width, lowest power first. The
+/// factor scale and offset are folded in, and every coefficient is below 1,
+/// which keeps the Horner steps in a narrow fixed point format.
+template <typename Int, int kFrac>
+inline constexpr std::array<Int, 6> FixedCurve(
+    const std::array<DoubleT, 6>& coeffs, double lo, double hi) noexcept {
+  const double mid = (lo + hi) / 2;
+  const double half_width = (hi - lo) / 2;
+
+  // Horner's scheme on polynomials: p = p * (mid + half_width * u) + c.
+  double p[6] = {};
+  for (double c : coeffs) {
+    double next[6] = {};
+    for (size_t j = 0; j < 6; j++) {
+      next[j] = mid * p[j] + (j > 0 ? half_width * p[j - 1] : 0.0);
+    }
+    next[0] += c;
+    for (size_t j = 0; j < 6; j++) p[j] = next[j];
+  }
+
+  std::array<Int, 6> out{};
+  for (size_t j = 0; j < 6; j++) {
+    const double factor =
+        p[j] / kPixelsCorrectionScale / 10.0 + (j == 0 ? 0.2 : 0.0);
+    out[j] = ToFixedRaw<Int>(factor, kFrac);
+  }
+  return out;
+}
+
+/// @brief Returns the Taylor coefficients 1 / k! of e^r, lowest first.
+template <typename Int, int kFrac, int kTerms>
+inline constexpr std::array<Int, kTerms> FixedExpCoeffs() noexcept {
+  std::array<Int, kTerms> out{};
+  double term = 1.0;
+  for (int k = 0; k < kTerms; k++) {
+    if (k > 0) term /= k;
+    out[k] = ToFixedRaw<Int>(term, kFrac);
+  }
+  return out;
+}
+
+/// @brief Constants of the fixed point engine in Format, all computed at
+/// compile time from the tables in chart.h.
+template <typename Format>
+struct FixedChart {
+  using Int = typename Format::Int;
+  static constexpr int kFrac = Format::kFrac;
+  static constexpr int kInner = Format::kInnerFrac;
+
+  static constexpr std::array<Int, kFlowrateScale.size()> kFlowrateRatios =
+      FixedScaleRatios<Int, kInner>(kFlowrateScale);
+  static constexpr std::array<Int, kTotalHeadScale.size()> kTotalHeadRatios =
+      FixedScaleRatios<Int, kInner>(kTotalHeadScale);
+  static constexpr std::array<Int, kViscoScale.size()> kViscoRatios =
+      FixedScaleRatios<Int, kInner>(kViscoScale);
+
+  static constexpr Int kPitchTotalH =
+      ToFixedRaw<Int>(impl::kPitchTotalH, kInner);
+  static constexpr Int kPitchVisco = ToFixedRaw<Int>(impl::kPitchVisco, kInner);
+  static constexpr Int kInvPitchVisco =
+      ToFixedRaw<Int>(1.0 / impl::kPitchVisco, kInner);
+  static constexpr Int kHeadOffset = ToFixedRaw<Int>(
+      impl::kPitchTotalH * static_cast<double>(kStartTotalH[0]), kFrac);
+
+  // Chart windows, same as ChartValidQ, ChartValidEta and ChartValidH.
+  static constexpr Int kQLow = Int{242} << kFrac;
+  static constexpr Int kQHigh = Int{384} << kFrac;
+  static constexpr Int kEtaLow = Int{122} << kFrac;
+  static constexpr Int kEtaHigh = Int{363} << kFrac;
+  static constexpr Int kHLow = Int{146} << kFrac;
+  static constexpr Int kHHigh = Int{382} << kFrac;
+
+  static constexpr std::array<Int, 6> kQ =
+      FixedCurve<Int, kInner>(kChartQ, 242.0, 384.0);
+  static constexpr Int kQMid = ToFixedRaw<Int>(313.0, kFrac);
+  static constexpr Int kQInvHalfWidth = ToFixedRaw<Int>(1.0 / 71.0, kInner);
+
+  static constexpr std::array<Int, 6> kEta =
+      FixedCurve<Int, kInner>(kChartEta, 122.0, 363.0);
+  static constexpr Int kEtaMid = ToFixedRaw<Int>(242.5, kFrac);
+  static constexpr Int kEtaInvHalfWidth =
+      ToFixedRaw<Int>(1.0 / 120.5, kInner);
+
+  /// l / 220, -k and x0 of each logistic function.
+  static constexpr std::array<std::array<Int, 3>, 4> kH{{
+      {ToFixedRaw<Int>(kChartH[0][0] / kPixelsCorrectionScale / 10.0, kInner),
+       ToFixedRaw<Int>(-kChartH[0][1], kInner),
+       ToFixedRaw<Int>(kChartH[0][2], kFrac)},
+      {ToFixedRaw<Int>(kChartH[1][0] / kPixelsCorrectionScale / 10.0, kInner),
+       ToFixedRaw<Int>(-kChartH[1][1], kInner),
+       ToFixedRaw<Int>(kChartH[1][2], kFrac)},
+      {ToFixedRaw<Int>(kChartH[2][0] / kPixelsCorrectionScale / 10.0, kInner),
+       ToFixedRaw<Int>(-kChartH[2][1], kInner),
+       ToFixedRaw<Int>(kChartH[2][2], kFrac)},
+      {ToFixedRaw<Int>(kChartH[3][0] / kPixelsCorrectionScale / 10.0, kInner),
+       ToFixedRaw<Int>(-kChartH[3][1], kInner),
+       ToFixedRaw<Int>(kChartH[3][2], kFrac)},
+  }};
+
+  static constexpr std::array<Int, Format::kExpTerms> kExp =
+      FixedExpCoeffs<Int, kInner, Format::kExpTerms>();
+  static constexpr Int kLog2e = ToFixedRaw<Int>(1.4426950408889634, kInner);
+  static constexpr Int kLn2 = ToFixedRaw<Int>(0.6931471805599453, kInner);
+
+  static constexpr Int kOne = Int{1} << kFrac;
+  static constexpr Int kInnerOne = Int{1} << kInner;
+  static constexpr Int kInnerTwo = Int{2} << kInner;
+  static constexpr Int kPointTwo = ToFixedRaw<Int>(0.2, kInner);
+  static constexpr Int kPointThree = ToFixedRaw<Int>(0.3, kInner);
+};
+
+/// @brief Fixed point ChartFitToScale. Returns -1 if input is beyond the
+/// last tick.
+template <typename Format, size_t N>
+inline constexpr typename Format::Int FixedFitToScale(
+    const std::array<ScaleTick, N>& scale,
+    const std::array<typename Format::Int, N>& ratios,
+    typename Format::Int input, int start_pos) noexcept {
+  using Int = typename Format::Int;
+  constexpr int kFrac = Format::kFrac;
+
+  Int absolute_position = static_cast<Int>(start_pos) << kFrac;
+  Int prev_value = 0;
+
+  for (size_t i = 0; i < N; i++) {
+    const Int curr_value = static_cast<Int>(scale[i].value) << kFrac;
+    const Int pixels = static_cast<Int>(scale[i].pixels) << kFrac;
+
+    if (curr_value == input) {
+      return absolute_position + pixels;
+    } else if (curr_value > input) {
+      return absolute_position +
+             MulShift(input - prev_value, ratios[i], Format::kInnerFrac);
+    }
+
+    absolute_position += pixels;
+    prev_value = curr_value;
+  }
+  return -(Int{1} << kFrac);
+}
+
+/// @brief Fixed point ChartPosition of a valid p.
+template <typename Format>
+inline constexpr typename Format::Int FixedPosition(
+    const FixedParameters<Format>& p) noexcept {
+  using C = FixedChart<Format>;
+  using Int = typename Format::Int;
+  constexpr int kInner = Format::kInnerFrac;
+
+  const Int flow_pos = FixedFitToScale<Format>(
+      kFlowrateScale, C::kFlowrateRatios, p.flowrate, 0);
+  const Int head_pos = FixedFitToScale<Format>(
+      kTotalHeadScale, C::kTotalHeadRatios, p.total_head, kStartTotalH[1]);
+  const Int visc_pos = FixedFitToScale<Format>(kViscoScale, C::kViscoRatios,
+                                               p.viscosity, kStartVisco[0]);
+
+  // Same intersection as ChartPosition, the division by the pitch of the
+  // viscosity line is a multiplication with its reciprocal.
+  const Int head_b = head_pos - C::kHeadOffset;
+  const Int visc_b = (static_cast<Int>(kStartVisco[1]) << Format::kFrac) -
+                     MulShift(C::kPitchVisco, visc_pos, kInner);
+  return MulShift(MulShift(C::kPitchTotalH, flow_pos, kInner) + head_b - visc_b,
+                  C::kInvPitchVisco, kInner);
+}
+
+/// @brief Evaluates a curve of FixedCurve at u, both in the inner format.
+template <typename Format>
+inline constexpr typename Format::Int FixedHorner(
+    const std::array<typename Format::Int, 6>& coeffs,
+    typename Format::Int u) noexcept {
+  typename Format::Int y = coeffs[5];
+  for (size_t j = 5; j-- > 0;) {
+    y = MulShift(y, u, Format::kInnerFrac) + coeffs[j];
+  }
+  return y;
+}
+
+/// @brief Returns e^z for z <= 0, both in the inner format. z is split into
+/// z / ln 2 = n + f with integral n, e^z = 2^n * e^(f ln 2).
+template <typename Format>
+inline constexpr typename Format::Int FixedExp(
+    typename Format::Int z) noexcept {
+  using C = FixedChart<Format>;
+  using Int = typename Format::Int;
+  constexpr int kInner = Format::kInnerFrac;
+
+  const Int t = MulShift(z, C::kLog2e, kInner);
+  const Int n = t >> kInner;  // floor
+  const Int f = t & (C::kInnerOne - 1);
+  const Int r = MulShift(f, C::kLn2, kInner);
+
+  Int y = C::kExp[Format::kExpTerms - 1];
+  for (size_t k = Format::kExpTerms - 1; k-- > 0;) {
+    y = MulShift(y, r, kInner) + C::kExp[k];
+  }
+  return RoundShift(y, static_cast<int>(-n));
+}
+
+/// @brief Returns 1 / d for d in [1, 2), both in the inner format.
+template <typename Format>
+inline constexpr typename Format::Int FixedReciprocal(
+    typename Format::Int d) noexcept {
+  using C = FixedChart<Format>;
+  constexpr int kInner = Format::kInnerFrac;
+
+  // Newton's iteration y = y * (2 - d * y), the error squares each step.
+  typename Format::Int y = C::kInnerOne;
+  for (int i = 0; i < Format::kNewtonSteps; i++) {
+    y = MulShift(y, C::kInnerTwo - MulShift(d, y, kInner), kInner);
+  }
+  return y;
+}
+
+/// @brief Fixed point ChartFactors.
+template <typename Format>
+inline constexpr void FixedFactorsAt(typename Format::Int pos,
+                                     FixedFactors<Format>& out) noexcept {
+  using C = FixedChart<Format>;
+  using Int = typename Format::Int;
+  constexpr int kFrac = Format::kFrac;
+  constexpr int kInner = Format::kInnerFrac;
+  constexpr int kDrop = kInner - kFrac;
+
+  if (pos >= C::kQLow && pos <= C::kQHigh) {
+    const Int u = MulShift(pos - C::kQMid, C::kQInvHalfWidth, kFrac);
+    out.q = RoundShift(FixedHorner<Format>(C::kQ, u), kDrop);
+  } else {
+    out.q = pos < C::kQLow ? C::kOne : 0;
+  }
+
+  if (pos >= C::kEtaLow && pos <= C::kEtaHigh) {
+    const Int u = MulShift(pos - C::kEtaMid, C::kEtaInvHalfWidth, kFrac);
+    out.eta = RoundShift(FixedHorner<Format>(C::kEta, u), kDrop);
+  } else {
+    out.eta = pos < C::kEtaLow ? C::kOne : 0;
+  }
+
+  if (pos >= C::kHLow && pos <= C::kHHigh) {
+    for (size_t i = 0; i < C::kH.size(); i++) {
+      // -k (x - x0) is negative on the whole window.
+      const Int z = MulShift(pos - C::kH[i][2], C::kH[i][1], kFrac);
+      const Int y = FixedReciprocal<Format>(C::kInnerOne + FixedExp<Format>(z));
+      out.h[i] =
+          RoundShift(MulShift(C::kH[i][0], y, kInner) - C::kPointThree, kDrop);
+    }
+  } else {
+    for (Int& h : out.h) h = pos < C::kHLow ? C::kOne : 0;
+  }
+}
+
+}  // namespace impl
+
+/// @brief Converts p in the standard units to Format. Values beyond the
+/// range of Format saturate, they are invalid inputs anyway. Meant for hosts
+/// and tests, it uses floating point.
+template <typename Format>
+inline FixedParameters<Format> ToFixed(const Parameters& p) noexcept {
+  using Int = typename Format::Int;
+  constexpr int kIntBits = 8 * sizeof(Int) - 1 - Format::kFrac;
+  constexpr double kLimit =
+      static_cast<double>(uint64_t{1} << kIntBits) - 1.0;
+
+  auto convert = [](double v) -> Int {
+    if (!(v > -kLimit)) return impl::ToFixedRaw<Int>(-kLimit, Format::kFrac);
+    if (v > kLimit) return impl::ToFixedRaw<Int>(kLimit, Format::kFrac);
+    return impl::ToFixedRaw<Int>(v, Format::kFrac);
+  };
+
+  FixedParameters<Format> out;
+  out.flowrate = convert(p.flowrate);
+  out.total_head = convert(p.total_head);
+  out.viscosity = convert(p.viscosity);
+  return out;
+}
+
+/// @brief Converts fixed point factors back to CorrectionFactors.
+template <typename Format>
+inline CorrectionFactors ToCorrectionFactors(
+    const FixedFactors<Format>& f) noexcept {
+  constexpr double kScale =
+      1.0 / static_cast<double>(uint64_t{1} << Format::kFrac);
+
+  CorrectionFactors out;
+  out.q = static_cast<double>(f.q) * kScale;
+  out.eta = static_cast<double>(f.eta) * kScale;
+  for (size_t i = 0; i < f.h.size(); i++) {
+    out.h[i] = static_cast<double>(f.h[i]) * kScale;
+  }
+  out.error_flag = f.error_flag;
+  return out;
+}
+
+/// @brief Calculates the correction factors of p in fixed point. Invalid
+/// inputs set the same error flags as Calculator::Calculate and leave the
+/// factors at 0.
+template <typename Format>
+inline constexpr FixedFactors<Format> CalculateFixed(
+    const FixedParameters<Format>& p) noexcept {
+  using Int = typename Format::Int;
+  constexpr int kFrac = Format::kFrac;
+
+  FixedFactors<Format> out;
+  if (p.flowrate < (Int{6} << kFrac) || p.flowrate > (Int{2000} << kFrac)) {
+    out.error_flag |= kFlowrateError;
+  }
+  if (p.total_head < (Int{5} << kFrac) || p.total_head > (Int{200} << kFrac)) {
+    out.error_flag |= kTotalHeadError;
+  }
+  if (p.viscosity < (Int{10} << kFrac) || p.viscosity > (Int{4000} << kFrac)) {
+    out.error_flag |= kViscosityError;
+  }
+  if (out.error_flag != 0) return out;
+
+  impl::FixedFactorsAt(impl::FixedPosition(p), out);
+  return out;
+}
+
+/// @brief Calculates count rows of in into out on the calling thread.
+template <typename Format>
+inline void CalculateFixed(const FixedParameters<Format>* in,
+                           FixedFactors<Format>* out, size_t count) noexcept {
+  for (size_t i = 0; i < count; i++) out[i] = CalculateFixed(in[i]);
+}
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_FIXED_POINT_H_
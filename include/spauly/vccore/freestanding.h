@@ -0,0 +1,63 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_FREESTANDING_H_
+#define SPAULY_VCCORE_FREESTANDING_H_
+
+#include <array>
+#include <cstddef>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// Entry points of the freestanding core library ViscoCorrectCore::freestanding,
+// built with vcc_BUILD_FREESTANDING. It holds nothing but the chart
+// calculation: no heap, no exceptions, no RTTI, no iostream and no std::map,
+// only the constexpr tables of impl/chart.h. It returns CoreFactors instead
+// of CorrectionFactors, which owns a std::string, so both libraries can be
+// linked into one program.
+//
+// The results are bit-identical to Calculator::Calculate.
+
+/// @brief CoreFactors is the result DTO of the freestanding core library,
+/// CorrectionFactors without the error message.
+struct CoreFactors {
+  double q = 0;
+  double eta = 0;
+  std::array<double, 4> h{};
+
+  size_t error_flag = 0;
+};
+
+/// @brief Returns the ErrorFlag bits of p in the units u, 0 if p is valid.
+size_t ValidateCore(const Parameters& p,
+                    const Units& u = kStandardUnits) noexcept;
+
+/// @brief Calculates the correction factors for p in the units u.
+CoreFactors CalculateCore(const Parameters& p,
+                          const Units& u = kStandardUnits) noexcept;
+
+/// @brief Calculates count rows of in into out on the calling thread.
+void CalculateCore(const Parameters* in, CoreFactors* out, size_t count,
+                   const Units& u = kStandardUnits) noexcept;
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_FREESTANDING_H_
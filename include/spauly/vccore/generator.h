@@ -0,0 +1,268 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_GENERATOR_H_
+#define SPAULY_VCCORE_GENERATOR_H_
+
+// The generators require C++20 coroutines. Link against
+// ViscoCorrectCore::coroutines to get the matching compile features, the core
+// library itself stays C++17.
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "spauly/vccore/generator.h requires C++20 coroutines"
+#endif
+
+#include <array>
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "spauly/vccore/calculator.h"
+
+namespace spauly {
+namespace vccore {
+
+/// @brief Minimal lazily evaluated coroutine generator. The coroutine only
+/// runs while the consumer advances the iterator, so stopping early skips all
+/// remaining work.
+/// @tparam T Type of the yielded values.
+template <typename T>
+class Generator {
+ public:
+  struct promise_type {
+    const T* current = nullptr;
+
+    Generator get_return_object() noexcept {
+      return Generator(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    std::suspend_always final_suspend() const noexcept { return {}; }
+    std::suspend_always yield_value(const T& value) noexcept {
+      current = std::addressof(value);
+      return {};
+    }
+    void return_void() const noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = T;
+    using reference = const T&;
+    using pointer = const T*;
+
+    iterator() = default;
+    explicit iterator(std::coroutine_handle<promise_type> handle)
+        : handle_(handle) {}
+
+    reference operator*() const { return *handle_.promise().current; }
+    pointer operator->() const { return handle_.promise().current; }
+
+    iterator& operator++() {
+      handle_.resume();
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    bool operator==(std::default_sentinel_t) const {
+      return !handle_ || handle_.done();
+    }
+
+   private:
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+  Generator() = default;
+  Generator(Generator&& other) noexcept
+      : handle_(std::exchange(other.handle_, {})) {}
+  Generator& operator=(Generator&& other) noexcept {
+    if (this != &other) {
+      if (handle_) handle_.destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  Generator(const Generator&) = delete;
+  Generator& operator=(const Generator&) = delete;
+
+  ~Generator() {
+    if (handle_) handle_.destroy();
+  }
+
+  /// @brief Starts the coroutine and returns an iterator to the first value.
+  iterator begin() {
+    if (handle_) handle_.resume();
+    return iterator(handle_);
+  }
+  std::default_sentinel_t end() const noexcept { return {}; }
+
+ private:
+  explicit Generator(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/// @brief CorrectionBlock is a DTO yielded by the generators. It views up to
+/// kBlockSize consecutive rows and is only valid until the generator is
+/// advanced.
+struct CorrectionBlock {
+  /// Index of the first row of the block within the sweep or stream.
+  size_t first = 0;
+  std::span<const Parameters> parameters;
+  std::span<const CorrectionFactors> factors;
+};
+
+/// @brief SweepAxis describes count evenly spaced values in [from, to].
+struct SweepAxis {
+  DoubleT from = 0;
+  DoubleT to = 0;
+  size_t count = 1;
+
+  /// @brief Returns the i-th value of the axis.
+  DoubleT At(size_t i) const noexcept {
+    if (count <= 1) return from;
+    return from + (to - from) * static_cast<DoubleT>(i) /
+                      static_cast<DoubleT>(count - 1);
+  }
+};
+
+/// @brief SweepSpec describes the grid flowrate x total_head x viscosity. The
+/// flowrate varies fastest.
+struct SweepSpec {
+  SweepAxis flowrate;
+  SweepAxis total_head;
+  SweepAxis viscosity;
+  DoubleT density = 0;
+
+  /// @brief Returns the number of points in the grid.
+  size_t Size() const noexcept {
+    return flowrate.count * total_head.count * viscosity.count;
+  }
+
+  /// @brief Returns the Parameters of the i-th grid point.
+  Parameters At(size_t i) const noexcept {
+    size_t fi = i % flowrate.count;
+    size_t hi = (i / flowrate.count) % total_head.count;
+    size_t vi = i / (flowrate.count * total_head.count);
+    return Parameters(flowrate.At(fi), total_head.At(hi), viscosity.At(vi),
+                      density);
+  }
+};
+
+/// @brief Lazily calculates a sweep grid block by block. Only the current
+/// block is kept in memory.
+/// @param calc Calculator to use, must outlive the generator.
+/// @param spec Grid to sweep over.
+/// @param u Units of the grid values.
+/// @param options Applied to every block, which is calculated on the
+/// consuming thread. The generator ends early once cancelled, the grid size
+/// is announced to the progress sink when iteration starts.
+/// @return Generator yielding CorrectionBlocks in grid order.
+inline Generator<CorrectionBlock> Sweep(const Calculator& calc, SweepSpec spec,
+                                        Units u = kStandardUnits,
+                                        BatchOptions options = BatchOptions()) {
+  std::array<Parameters, kBlockSize> params;
+  std::array<CorrectionFactors, kBlockSize> factors;
+  const size_t size = spec.Size();
+  if (options.progress != nullptr) options.progress->AddTotal(size);
+
+  // Cancellation and progress are handled per block here.
+  BatchOptions batch = options;
+  batch.executor = nullptr;
+  batch.cancel = nullptr;
+  batch.progress = nullptr;
+
+  for (size_t first = 0; first < size; first += kBlockSize) {
+    if (options.IsCancelled()) co_return;
+
+    size_t n = (size - first < kBlockSize) ? size - first : kBlockSize;
+    for (size_t i = 0; i < n; i++) params[i] = spec.At(first + i);
+
+    batch.first_row = options.first_row + first;
+    calc.Calculate(params.data(), factors.data(), n, u, batch);
+    if (options.progress != nullptr) options.progress->AddDone(n);
+
+    CorrectionBlock block;
+    block.first = first;
+    block.parameters = std::span<const Parameters>(params.data(), n);
+    block.factors = std::span<const CorrectionFactors>(factors.data(), n);
+    co_yield block;
+  }
+}
+
+/// @brief Lazily calculates the correction factors of an input range of
+/// Parameters, e.g. another Generator or a std::vector. The input is only
+/// read as far as the consumer advances.
+/// @param calc Calculator to use, must outlive the generator.
+/// @param input Range of Parameters, must outlive the generator.
+/// @param u Units shared by all rows.
+/// @param options Applied to every block, which is calculated on the
+/// consuming thread. Every block read adds to the total of the progress sink.
+/// @return Generator yielding CorrectionBlocks in input order.
+template <typename InputRange>
+Generator<CorrectionBlock> Stream(const Calculator& calc, InputRange& input,
+                                  Units u = kStandardUnits,
+                                  BatchOptions options = BatchOptions()) {
+  std::array<Parameters, kBlockSize> params;
+  std::array<CorrectionFactors, kBlockSize> factors;
+  size_t first = 0;
+  size_t n = 0;
+
+  // Cancellation and progress are handled per block here.
+  BatchOptions batch = options;
+  batch.executor = nullptr;
+  batch.cancel = nullptr;
+  batch.progress = nullptr;
+
+  auto flush = [&]() {
+    batch.first_row = options.first_row + first;
+    calc.Calculate(params.data(), factors.data(), n, u, batch);
+    if (options.progress != nullptr) {
+      options.progress->AddTotal(n);
+      options.progress->AddDone(n);
+    }
+
+    CorrectionBlock block;
+    block.first = first;
+    block.parameters = std::span<const Parameters>(params.data(), n);
+    block.factors = std::span<const CorrectionFactors>(factors.data(), n);
+    return block;
+  };
+
+  for (const Parameters& p : input) {
+    if (n == 0 && options.IsCancelled()) co_return;
+    params[n++] = p;
+    if (n == kBlockSize) {
+      co_yield flush();
+      first += n;
+      n = 0;
+    }
+  }
+
+  if (n != 0) co_yield flush();
+}
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_GENERATOR_H_
@@ -0,0 +1,280 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_IMPL_CHART_H_
+#define SPAULY_VCCORE_IMPL_CHART_H_
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+/// Version of the chart tables below. Bump it whenever the fitted constants
+/// or the scales change, persistent result caches are reset then.
+static constexpr uint32_t kChartTableVersion = 1;
+
+namespace impl {
+
+// Everything here is inline so callers can inline the whole calculation into
+// their own loops. Calculator uses the same functions, which keeps the
+// results of both bit-identical.
+
+//------------------------------------------------
+// Constants for the correction factors calculation
+
+// The provided values here were calculated in the original code and must
+// be updated. Please refer to the original code for how the were
+// obtained: <https://github.com/SPauly/ViscoCorrect>
+inline constexpr std::array<DoubleT, 6> kChartQ{
+    4.3286373442021278e-09, -6.5935466655309209e-06, 0.0039704102541411324,
+    -1.1870337647376101,    176.52190832690891,      -10276.558815133236};
+inline constexpr std::array<DoubleT, 6> kChartEta{
+    2.5116987378131985e-10, -3.2416532447274418e-07, 0.00015531747394399714,
+    -0.037300324399145976,  4.2391803778160968,      -6.2364025573465849};
+inline constexpr std::array<std::array<DoubleT, 3>, 4> kChartH{{
+    {285.39113639063004, -0.019515612319848788, 451.79876054847699},  // 0.6
+    {286.44331640461877, -0.016739174282778945, 453.11949555301783},  // 0.8
+    {285.70823636118865, -0.016126836943018912, 443.60573501332937},  // 1.0
+    {285.91175890816675, -0.015057232233799856, 436.03377039579027}   // 1.2
+}};
+
+// 22 pixels per unit in the original correction factors scale
+inline constexpr DoubleT kPixelsCorrectionScale = 22;
+inline constexpr std::array<int, 2> kStartTotalH{4, 1};
+inline constexpr std::array<int, 2> kStartVisco{105, 304};
+inline constexpr double kPitchTotalH = 0.5255813953488372;
+inline constexpr double kPitchVisco = -1.9090909090909092;
+
+/// One tick of a chart scale: its value and the distance in pixels to the
+/// previous tick.
+struct ScaleTick {
+  int value;
+  int pixels;
+};
+
+inline constexpr std::array<ScaleTick, 27> kFlowrateScale{{
+    {6, 0},    {7, 14},    {8, 9},    {9, 9},    {10, 9},   {15, 30},
+    {20, 21},  {30, 30},   {40, 21},  {50, 17},  {60, 13},  {70, 12},
+    {80, 9},   {90, 9},    {100, 9},  {150, 30}, {200, 21}, {300, 30},
+    {400, 21}, {500, 17},  {600, 14}, {700, 11}, {800, 10}, {900, 8},
+    {1000, 8}, {1500, 30}, {2000, 22}}};
+
+inline constexpr std::array<ScaleTick, 7> kTotalHeadScale{
+    {{5, 0}, {10, 15}, {20, 12}, {40, 14}, {50, 8}, {100, 9}, {200, 13}}};
+
+inline constexpr std::array<ScaleTick, 17> kViscoScale{{
+    {10, 0},   {20, 27},  {30, 16},   {40, 10},   {60, 15},  {80, 11},
+    {100, 8},  {200, 26}, {300, 16},  {400, 11},  {500, 8},  {600, 6},
+    {800, 12}, {1000, 9}, {2000, 26}, {3000, 14}, {4000, 10}}};
+
+//------------------------------------------------
+// Calculation steps
+
+/// @brief Converts p to the standard units. Same factors as
+/// ConvertToBaseUnit and ConvertViscosityTomm2s.
+inline Parameters ChartConvert(const Parameters& p, const Units& u) noexcept {
+  DoubleT flow = 1.0;
+  if (u.flowrate == FlowrateUnit::kLitersPerMinute) flow = 0.06;
+  if (u.flowrate == FlowrateUnit::kGallonsPerMinute) flow = 0.227125;
+
+  const DoubleT head = u.total_head == HeadUnit::kFeet ? 0.3048 : 1.0;
+  const DoubleT density =
+      u.density == DensityUnit::kKilogramsPerCubicMeter ? 0.001 : 1.0;
+
+  DoubleT viscosity = p.viscosity;
+  if (u.viscosity == ViscosityUnit::kcP ||
+      u.viscosity == ViscosityUnit::kmPas) {
+    viscosity = p.density != 0 ? p.viscosity / (p.density * density) : 0.0;
+  }
+
+  return Parameters(p.flowrate * flow, p.total_head * head, viscosity,
+                    p.density * density);
+}
+
+/// @brief Returns the ErrorFlag bits of p in the standard units.
+inline constexpr size_t ChartValidate(const Parameters& p) noexcept {
+  size_t errors = 0;
+  if (p.flowrate < 6 || p.flowrate > 2000) errors |= kFlowrateError;
+  if (p.total_head < 5 || p.total_head > 200) errors |= kTotalHeadError;
+  if (p.viscosity < 10 || p.viscosity > 4000) errors |= kViscosityError;
+  return errors;
+}
+
+/// @brief Maps input to its position in pixels on the scale, -1 if it is
+/// beyond the last tick.
+template <size_t N>
+inline constexpr double ChartFitToScale(const std::array<ScaleTick, N>& scale,
+                                        double input, int start_pos) noexcept {
+  double absolute_position = static_cast<double>(start_pos);
+  double prev_value = 0;
+
+  for (const ScaleTick& tick : scale) {
+    const double curr_value = static_cast<double>(tick.value);
+
+    if (curr_value == input) {
+      return absolute_position + static_cast<double>(tick.pixels);
+    } else if (curr_value > input) {
+      double range = curr_value - prev_value;
+      double relative_value = input - prev_value;
+      return absolute_position +
+             (relative_value / range) * static_cast<double>(tick.pixels);
+    }
+
+    absolute_position += static_cast<double>(tick.pixels);
+    prev_value = curr_value;
+  }
+  return -1.0;
+}
+
+/// @brief Returns the x position on the correction charts of a valid p in
+/// the standard units.
+inline DoubleT ChartPosition(const Parameters& p) noexcept {
+  const double flow_pos = ChartFitToScale(kFlowrateScale, p.flowrate, 0);
+  // head_pos is on the y-axis and visc_pos on the x-axis, so each starts at
+  // that coordinate.
+  const double head_pos =
+      ChartFitToScale(kTotalHeadScale, p.total_head, kStartTotalH[1]);
+  const double visc_pos =
+      ChartFitToScale(kViscoScale, p.viscosity, kStartVisco[0]);
+
+  // Intersection of the total head line through (4, head_pos) with the
+  // viscosity line through (visc_pos, 304).
+  const DoubleT head_b =
+      head_pos - kPitchTotalH * static_cast<DoubleT>(kStartTotalH[0]);
+  const DoubleT visc_b =
+      static_cast<DoubleT>(kStartVisco[1]) - kPitchVisco * visc_pos;
+  return ((kPitchTotalH * flow_pos + head_b) - visc_b) / kPitchVisco;
+}
+
+/// @brief Evaluates the fitted polynomial coeffs at x, highest power first.
+inline DoubleT ChartPolynomial(const std::array<DoubleT, 6>& coeffs,
+                               DoubleT x) noexcept {
+  DoubleT y = 0;
+  size_t inverse_iter = coeffs.size() - 1;
+  for (size_t i = 0; i < coeffs.size(); i++) {
+    y += static_cast<DoubleT>(
+        coeffs[i] *
+        std::pow(static_cast<double>(x), static_cast<double>(inverse_iter)));
+    --inverse_iter;
+  }
+  return y;
+}
+
+/// @brief Evaluates the fitted polynomial coeffs at x in Horner form. Much
+/// faster than ChartPolynomial but differs from it in the last bits.
+inline constexpr DoubleT ChartHorner(const std::array<DoubleT, 6>& coeffs,
+                                     DoubleT x) noexcept {
+  DoubleT y = coeffs[0];
+  for (size_t i = 1; i < coeffs.size(); i++) y = y * x + coeffs[i];
+  return y;
+}
+
+/// @brief Evaluates the fitted logistical function l / (1 + e^(-k(x - x0))).
+inline double ChartLogistic(const std::array<DoubleT, 3>& c,
+                            double x) noexcept {
+  return c[0] / (1 + std::exp(-c[1] * (x - c[2])));
+}
+
+/// Windows of the chart positions the fitted functions are valid for. Left
+/// of a window the factor is 1, right of it 0.
+inline constexpr DoubleT kChartMinQ = 242.0;
+inline constexpr DoubleT kChartMaxQ = 384.0;
+inline constexpr DoubleT kChartMinEta = 122.0;
+inline constexpr DoubleT kChartMaxEta = 363.0;
+inline constexpr DoubleT kChartMinH = 146.0;
+inline constexpr DoubleT kChartMaxH = 382.0;
+
+inline constexpr bool ChartValidQ(double x) noexcept {
+  return x >= kChartMinQ && x <= kChartMaxQ;
+}
+
+inline constexpr bool ChartValidEta(double x) noexcept {
+  return x >= kChartMinEta && x <= kChartMaxEta;
+}
+
+inline constexpr bool ChartValidH(double x) noexcept {
+  return x >= kChartMinH && x <= kChartMaxH;
+}
+
+/// @brief Returns true if x lies right of any window, so at least one factor
+/// is cut off to 0. See ErrorFlag::kCalculationOOR.
+inline constexpr bool ChartCutoff(double x) noexcept {
+  return x > kChartMaxQ || x > kChartMaxEta || x > kChartMaxH;
+}
+
+/// @brief Evaluates coeffs at x, in Horner form if kHorner is set.
+template <bool kHorner>
+inline DoubleT ChartPolynomialOf(const std::array<DoubleT, 6>& coeffs,
+                                 DoubleT x) noexcept {
+  if constexpr (kHorner) {
+    return ChartHorner(coeffs, x);
+  } else {
+    return ChartPolynomial(coeffs, x);
+  }
+}
+
+/// @brief Writes the correction factors at the chart position pos to out.
+/// Positions left of a chart give 1, right of it 0.
+/// @tparam kHorner Evaluates the polynomials in Horner form, see
+/// ExecutionMode::kFast.
+/// @tparam Factors CorrectionFactors or any type with its q, eta and h.
+template <bool kHorner = false, typename Factors>
+inline void ChartFactors(DoubleT pos, Factors& out) noexcept {
+  // Take the function value of the correction function at pos. Get the
+  // relative value by deviding by the scale and add the offset.
+  if (ChartValidQ(pos)) {
+    out.q = (ChartPolynomialOf<kHorner>(kChartQ, pos) /
+             kPixelsCorrectionScale / 10.0) +
+            0.2;
+  } else {
+    out.q = (pos < kChartMinQ) ? 1.0 : 0.0;
+  }
+
+  if (ChartValidEta(pos)) {
+    out.eta =
+        (ChartPolynomialOf<kHorner>(kChartEta, pos) / kPixelsCorrectionScale /
+         10.0) +
+        0.2;
+  } else {
+    out.eta = (pos < kChartMinEta) ? 1.0 : 0.0;
+  }
+
+  if (ChartValidH(pos)) {
+    for (size_t i = 0; i < kChartH.size(); i++) {
+      out.h[i] = (ChartLogistic(kChartH[i], pos) / kPixelsCorrectionScale /
+                  10) -
+                 0.3;
+    }
+  } else {
+    for (size_t i = 0; i < kChartH.size(); i++) {
+      out.h[i] = (pos < kChartMinH) ? 1.0 : 0.0;
+    }
+  }
+}
+
+}  // namespace impl
+
+}  // namespace vccore
+
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_IMPL_CHART_H_
@@ -0,0 +1,108 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_IMPL_FIXED_H_
+#define SPAULY_VCCORE_IMPL_FIXED_H_
+
+#include <cstdint>
+
+namespace spauly {
+namespace vccore {
+namespace impl {
+
+// Integer helpers of the fixed point engine. Every operation is exact
+// integer arithmetic with round half up, so the results do not depend on
+// the compiler, the floating point flags or whether the target has an FPU.
+// Right shifts of negative values are arithmetic on every supported
+// compiler.
+
+/// @brief Converts v to a fixed point value with frac fractional bits,
+/// rounded half away from zero. Only meant for constant expressions, so
+/// targets without an FPU never run it.
+template <typename Int>
+inline constexpr Int ToFixedRaw(double v, int frac) noexcept {
+  const double scaled = v * static_cast<double>(uint64_t{1} << frac);
+  return static_cast<Int>(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+/// @brief Returns x / 2^shift rounded half up.
+template <typename Int>
+inline constexpr Int RoundShift(Int x, int shift) noexcept {
+  if (shift <= 0) return x;
+  return static_cast<Int>((x + (Int{1} << (shift - 1))) >> shift);
+}
+
+/// @brief Returns a * b / 2^shift rounded half up, 0 < shift < 32. The
+/// product is formed in 64 bits.
+inline constexpr int32_t MulShift(int32_t a, int32_t b, int shift) noexcept {
+  const int64_t p = static_cast<int64_t>(a) * b;
+  return static_cast<int32_t>((p + (int64_t{1} << (shift - 1))) >> shift);
+}
+
+/// @brief Portable version of the 64 bit MulShift for compilers without a
+/// 128 bit integer type. The product is formed as two 64 bit halves.
+inline constexpr int64_t MulShiftPortable(int64_t a, int64_t b,
+                                          int shift) noexcept {
+  const bool negative = (a < 0) != (b < 0);
+  const uint64_t ua = a < 0 ? 0 - static_cast<uint64_t>(a)
+                            : static_cast<uint64_t>(a);
+  const uint64_t ub = b < 0 ? 0 - static_cast<uint64_t>(b)
+                            : static_cast<uint64_t>(b);
+
+  const uint64_t a_lo = ua & 0xFFFFFFFFu, a_hi = ua >> 32;
+  const uint64_t b_lo = ub & 0xFFFFFFFFu, b_hi = ub >> 32;
+  const uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi;
+  const uint64_t hl = a_hi * b_lo, hh = a_hi * b_hi;
+
+  const uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFFu) + (hl & 0xFFFFFFFFu);
+  uint64_t lo = (ll & 0xFFFFFFFFu) | (mid << 32);
+  uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+  // Two's complement of the 128 bit product, so the rounding below matches
+  // the native version for negative products as well.
+  if (negative) {
+    lo = ~lo + 1;
+    hi = ~hi + (lo == 0 ? 1 : 0);
+  }
+
+  const uint64_t half = uint64_t{1} << (shift - 1);
+  const uint64_t sum = lo + half;
+  hi += sum < lo ? 1 : 0;
+  lo = sum;
+
+  // The result fits into 64 bits, so the low word of the shifted product is
+  // all that is needed.
+  return static_cast<int64_t>((lo >> shift) | (hi << (64 - shift)));
+}
+
+/// @brief Returns a * b / 2^shift rounded half up, 0 < shift < 64. The
+/// product is formed in 128 bits.
+inline constexpr int64_t MulShift(int64_t a, int64_t b, int shift) noexcept {
+#if defined(__SIZEOF_INT128__)
+  const __int128 p = static_cast<__int128>(a) * b;
+  return static_cast<int64_t>((p + (static_cast<__int128>(1) << (shift - 1))) >>
+                              shift);
+#else
+  return MulShiftPortable(a, b, shift);
+#endif
+}
+
+}  // namespace impl
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_IMPL_FIXED_H_
@@ -0,0 +1,388 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_IMPL_FORMULA_H_
+#define SPAULY_VCCORE_IMPL_FORMULA_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "spauly/vccore/data.h"
+#include "spauly/vccore/impl/chart.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VCCORE_FORMULA_SSE2 1
+#endif
+
+namespace spauly {
+namespace vccore {
+namespace impl {
+
+// Closed form correction of ANSI/HI 9.6.7, see Engine::kFormula. With the
+// parameter
+//   B = 26.6 * nu^0.5 * H^0.0625 / (Q^0.375 * N^0.25)
+// in m³/h, m, mm²/s and rpm the factors are
+//   C_Q   = 2.71^(-0.165 * (log10 B)^3.15)
+//   C_eta = B^(-0.0547 * B^0.69)
+//   C_H   = 1 - (1 - C_Q) * (Q / Q_BEP)^0.75
+// for 1 < B < 40. Up to B = 1 all factors are 1, from B = 40 on the method
+// does not apply.
+
+inline constexpr double kFormulaB = 26.6;
+inline constexpr double kFormulaMaxB = 40.0;
+inline constexpr double kFormulaLnMaxB = 3.6888794541139363;
+
+/// Flow rates of the head factors CorrectionFactors::h relative to the best
+/// efficiency point, same as the chart.
+inline constexpr std::array<double, 4> kFormulaFlowRatios{0.6, 0.8, 1.0, 1.2};
+
+/// @brief Returns the ErrorFlag bits of p in the standard units.
+inline size_t FormulaValidate(const Parameters& p, DoubleT speed) noexcept {
+  size_t errors = 0;
+  if (!(p.flowrate > 0) || !std::isfinite(p.flowrate)) {
+    errors |= kFlowrateError;
+  }
+  if (!(p.total_head > 0) || !std::isfinite(p.total_head)) {
+    errors |= kTotalHeadError;
+  }
+  if (!(p.viscosity > 0) || !std::isfinite(p.viscosity)) {
+    errors |= kViscosityError;
+  }
+  if (!(speed > 0)) errors |= kCalculationOOR;
+  return errors;
+}
+
+/// @brief Returns the parameter B of a valid p in the standard units.
+inline double FormulaParameter(const Parameters& p, DoubleT speed) noexcept {
+  return kFormulaB * std::pow(p.viscosity, 0.5) *
+         std::pow(p.total_head, 0.0625) /
+         (std::pow(p.flowrate, 0.375) * std::pow(speed, 0.25));
+}
+
+/// @brief Writes the correction factors of the parameter b < 40 to out.
+inline void FormulaFactors(double b, CorrectionFactors& out) noexcept {
+  if (b <= 1.0) {
+    out.q = 1.0;
+    out.eta = 1.0;
+    out.h.fill(1.0);
+    return;
+  }
+
+  out.q = std::pow(2.71, -0.165 * std::pow(std::log10(b), 3.15));
+  out.eta = std::pow(b, -(0.0547 * std::pow(b, 0.69)));
+  for (size_t i = 0; i < kFormulaFlowRatios.size(); i++) {
+    out.h[i] = 1.0 - (1.0 - out.q) * std::pow(kFormulaFlowRatios[i], 0.75);
+  }
+}
+
+/// @brief Calculates the correction factors for p in the units u. The
+/// reference of the formula engine, FormulaBlock stays close to it.
+inline CorrectionFactors FormulaCalculate(const Parameters& p, const Units& u,
+                                          DoubleT speed) noexcept {
+  CorrectionFactors out;
+  const Parameters p_base = (u != kStandardUnits) ? ChartConvert(p, u) : p;
+
+  out.error_flag = FormulaValidate(p_base, speed);
+  if (out.error_flag != 0) return out;
+
+  const double b = FormulaParameter(p_base, speed);
+  if (!(b < kFormulaMaxB)) {
+    out.error_flag = kCalculationOOR;
+    return out;
+  }
+
+  FormulaFactors(b, out);
+  return out;
+}
+
+//------------------------------------------------
+// Vectorised version
+
+// FormulaBlock gathers the rows into columns and evaluates the formula in
+// logarithms, with log and exp built from polynomials instead of the calls
+// to the C library. The SSE2 version takes two rows per step and performs
+// the same operations in the same order as the scalar one, so every row
+// gets the same result no matter which path it took.
+
+/// Inputs are clamped to it so every lane stays finite. The results of
+/// those rows are dropped.
+inline constexpr double kFormulaTiny = 1e-300;
+
+inline constexpr double kFormulaTwo52 = 4503599627370496.0;
+inline constexpr double kFormulaSqrt2 = 1.4142135623730951;
+inline constexpr double kFormulaLn2 = 0.6931471805599453;
+inline constexpr double kFormulaLn2High = 0.6931471803691238;
+inline constexpr double kFormulaLn2Low = 1.9082149292705877e-10;
+inline constexpr double kFormulaLog2e = 1.4426950408889634;
+inline constexpr double kFormulaLn10 = 2.302585092994046;
+// Adding it rounds to an integer that ends up in the low mantissa bits.
+inline constexpr double kFormulaRound = 6755399441055744.0;
+// ln 2.71, the base of C_Q is rounded in the standard.
+inline constexpr double kFormulaLnBaseQ = 0.9969486348916096;
+
+/// 2 / (2k + 1) of the atanh series, highest first. |s| < 0.172, so the
+/// first term left out is below 1e-15 of the result.
+inline constexpr std::array<double, 9> kFormulaLogSeries{
+    2.0 / 17, 2.0 / 15, 2.0 / 13, 2.0 / 11, 2.0 / 9,
+    2.0 / 7,  2.0 / 5,  2.0 / 3,  2.0};
+
+/// 1 / k! of the exp series, highest first. |r| < 0.347, so the first term
+/// left out is below 1e-14 of the result.
+inline constexpr std::array<double, 12> kFormulaExpSeries{
+    1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0,
+    1.0 / 5040.0,     1.0 / 720.0,     1.0 / 120.0,    1.0 / 24.0,
+    1.0 / 6.0,        0.5,             1.0,            1.0};
+
+inline uint64_t FormulaBits(double x) noexcept {
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline double FormulaDouble(uint64_t bits) noexcept {
+  double x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+/// Same as maxpd and minpd, which return b if either is NaN.
+inline double FormulaMax(double a, double b) noexcept { return a > b ? a : b; }
+inline double FormulaMin(double a, double b) noexcept { return a < b ? a : b; }
+
+/// @brief Returns ln x for finite x > 0 as e ln 2 + 2 atanh((m - 1) / (m + 1))
+/// with the mantissa m in [sqrt(1/2), sqrt(2)).
+inline double FormulaLog(double x) noexcept {
+  const uint64_t bits = FormulaBits(x);
+  double m = FormulaDouble((bits & 0x000FFFFFFFFFFFFFull) |
+                           0x3FF0000000000000ull);
+  // The biased exponent as a double, without an int to double conversion.
+  double e = FormulaDouble((bits >> 52) | 0x4330000000000000ull) -
+             (kFormulaTwo52 + 1023.0);
+
+  if (m > kFormulaSqrt2) {
+    m = m * 0.5;
+    e = e + 1.0;
+  }
+
+  const double s = (m - 1.0) / (m + 1.0);
+  const double s2 = s * s;
+  double y = kFormulaLogSeries[0];
+  for (size_t i = 1; i < kFormulaLogSeries.size(); i++) {
+    y = y * s2 + kFormulaLogSeries[i];
+  }
+  return e * kFormulaLn2 + s * y;
+}
+
+/// @brief Returns e^x as 2^n e^r with |r| <= ln 2 / 2. x is clamped to
+/// [-700, 700], which keeps 2^n and the result normal. Denormals would slow
+/// down the lanes of rows whose results are dropped.
+inline double FormulaExp(double x) noexcept {
+  x = FormulaMin(FormulaMax(x, -700.0), 700.0);
+  const double k = x * kFormulaLog2e + kFormulaRound;
+  const double n = k - kFormulaRound;
+  const double r = (x - n * kFormulaLn2High) - n * kFormulaLn2Low;
+
+  double y = kFormulaExpSeries[0];
+  for (size_t i = 1; i < kFormulaExpSeries.size(); i++) {
+    y = y * r + kFormulaExpSeries[i];
+  }
+
+  // 2^n from the low bits of k, the high bits are shifted out.
+  return y * FormulaDouble((FormulaBits(k) + 1023) << 52);
+}
+
+/// @brief Returns ln B, C_Q and C_eta of one row in the standard units.
+/// ln_const is ln 26.6 - 0.25 ln N.
+inline void FormulaRow(double flow, double head, double visc, double ln_const,
+                       double& ln_b, double& cq, double& ceta) noexcept {
+  ln_b = ln_const + 0.5 * FormulaLog(FormulaMax(visc, kFormulaTiny)) +
+         0.0625 * FormulaLog(FormulaMax(head, kFormulaTiny)) -
+         0.375 * FormulaLog(FormulaMax(flow, kFormulaTiny));
+  // (log10 B)^3.15 and B^0.69.
+  const double ln_bc = FormulaMax(ln_b, kFormulaTiny);
+  const double lg = FormulaExp(3.15 * FormulaLog(ln_bc / kFormulaLn10));
+  const double b069 = FormulaExp(0.69 * ln_bc);
+
+  const double q_factor = FormulaExp(-0.165 * kFormulaLnBaseQ * lg);
+  const double eta_factor = FormulaExp(-0.0547 * b069 * ln_bc);
+  cq = ln_b > 0.0 ? q_factor : 1.0;
+  ceta = ln_b > 0.0 ? eta_factor : 1.0;
+}
+
+#if defined(VCCORE_FORMULA_SSE2)
+
+inline __m128d FormulaSelect(__m128d mask, __m128d a, __m128d b) noexcept {
+  return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+/// @brief Two lane FormulaLog.
+inline __m128d FormulaLog(__m128d x) noexcept {
+  const __m128i bits = _mm_castpd_si128(x);
+  __m128d m = _mm_castsi128_pd(
+      _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi64x(0x000FFFFFFFFFFFFF)),
+                   _mm_set1_epi64x(0x3FF0000000000000)));
+  __m128d e = _mm_sub_pd(
+      _mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52),
+                                    _mm_set1_epi64x(0x4330000000000000))),
+      _mm_set1_pd(kFormulaTwo52 + 1023.0));
+
+  const __m128d high = _mm_cmpgt_pd(m, _mm_set1_pd(kFormulaSqrt2));
+  m = FormulaSelect(high, _mm_mul_pd(m, _mm_set1_pd(0.5)), m);
+  e = FormulaSelect(high, _mm_add_pd(e, _mm_set1_pd(1.0)), e);
+
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d s = _mm_div_pd(_mm_sub_pd(m, one), _mm_add_pd(m, one));
+  const __m128d s2 = _mm_mul_pd(s, s);
+  __m128d y = _mm_set1_pd(kFormulaLogSeries[0]);
+  for (size_t i = 1; i < kFormulaLogSeries.size(); i++) {
+    y = _mm_add_pd(_mm_mul_pd(y, s2), _mm_set1_pd(kFormulaLogSeries[i]));
+  }
+  return _mm_add_pd(_mm_mul_pd(e, _mm_set1_pd(kFormulaLn2)), _mm_mul_pd(s, y));
+}
+
+/// @brief Two lane FormulaExp.
+inline __m128d FormulaExp(__m128d x) noexcept {
+  x = _mm_min_pd(_mm_max_pd(x, _mm_set1_pd(-700.0)), _mm_set1_pd(700.0));
+  const __m128d round = _mm_set1_pd(kFormulaRound);
+  const __m128d k =
+      _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(kFormulaLog2e)), round);
+  const __m128d n = _mm_sub_pd(k, round);
+  const __m128d r =
+      _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(n, _mm_set1_pd(kFormulaLn2High))),
+                 _mm_mul_pd(n, _mm_set1_pd(kFormulaLn2Low)));
+
+  __m128d y = _mm_set1_pd(kFormulaExpSeries[0]);
+  for (size_t i = 1; i < kFormulaExpSeries.size(); i++) {
+    y = _mm_add_pd(_mm_mul_pd(y, r), _mm_set1_pd(kFormulaExpSeries[i]));
+  }
+
+  const __m128i scale = _mm_slli_epi64(
+      _mm_add_epi64(_mm_castpd_si128(k), _mm_set1_epi64x(1023)), 52);
+  return _mm_mul_pd(y, _mm_castsi128_pd(scale));
+}
+
+/// @brief Two lane FormulaRow.
+inline void FormulaRows(const double* flow, const double* head,
+                        const double* visc, double ln_const, double* ln_b,
+                        double* cq, double* ceta) noexcept {
+  const __m128d tiny = _mm_set1_pd(kFormulaTiny);
+  const __m128d one = _mm_set1_pd(1.0);
+
+  const __m128d ln_b_row = _mm_sub_pd(
+      _mm_add_pd(
+          _mm_add_pd(_mm_set1_pd(ln_const),
+                     _mm_mul_pd(_mm_set1_pd(0.5),
+                                FormulaLog(_mm_max_pd(_mm_loadu_pd(visc),
+                                                      tiny)))),
+          _mm_mul_pd(_mm_set1_pd(0.0625),
+                     FormulaLog(_mm_max_pd(_mm_loadu_pd(head), tiny)))),
+      _mm_mul_pd(_mm_set1_pd(0.375),
+                 FormulaLog(_mm_max_pd(_mm_loadu_pd(flow), tiny))));
+  const __m128d ln_bc = _mm_max_pd(ln_b_row, tiny);
+  const __m128d lg = FormulaExp(_mm_mul_pd(
+      _mm_set1_pd(3.15),
+      FormulaLog(_mm_div_pd(ln_bc, _mm_set1_pd(kFormulaLn10)))));
+  const __m128d b069 = FormulaExp(_mm_mul_pd(_mm_set1_pd(0.69), ln_bc));
+
+  const __m128d q_factor = FormulaExp(
+      _mm_mul_pd(_mm_set1_pd(-0.165 * kFormulaLnBaseQ), lg));
+  const __m128d eta_factor = FormulaExp(
+      _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(-0.0547), b069), ln_bc));
+
+  const __m128d corrected = _mm_cmpgt_pd(ln_b_row, _mm_setzero_pd());
+  _mm_storeu_pd(ln_b, ln_b_row);
+  _mm_storeu_pd(cq, FormulaSelect(corrected, q_factor, one));
+  _mm_storeu_pd(ceta, FormulaSelect(corrected, eta_factor, one));
+}
+
+#endif  // VCCORE_FORMULA_SSE2
+
+/// Number of rows FormulaBlock gathers into columns at a time.
+static constexpr size_t kFormulaBlockRows = 64;
+
+/// @brief Calculates count rows of in into out with the vectorised formula.
+/// Same error flags as FormulaCalculate, the factors differ from it by less
+/// than 1e-12.
+inline void FormulaBlock(const Parameters* in, CorrectionFactors* out,
+                         size_t count, const Units& u,
+                         DoubleT speed) noexcept {
+  std::array<double, kFormulaBlockRows> flow, head, visc;
+  std::array<double, kFormulaBlockRows> ln_b, cq, ceta;
+
+  const double ln_const = std::log(kFormulaB) - 0.25 * std::log(speed);
+  double head_ratio[4];
+  for (size_t j = 0; j < 4; j++) {
+    head_ratio[j] = std::pow(kFormulaFlowRatios[j], 0.75);
+  }
+
+  const bool convert = u != kStandardUnits;
+  for (size_t begin = 0; begin < count; begin += kFormulaBlockRows) {
+    const size_t n = std::min(kFormulaBlockRows, count - begin);
+
+    for (size_t k = 0; k < n; k++) {
+      const Parameters p =
+          convert ? ChartConvert(in[begin + k], u) : in[begin + k];
+      flow[k] = p.flowrate;
+      head[k] = p.total_head;
+      visc[k] = p.viscosity;
+    }
+
+    size_t k = 0;
+#if defined(VCCORE_FORMULA_SSE2)
+    for (; k + 2 <= n; k += 2) {
+      FormulaRows(&flow[k], &head[k], &visc[k], ln_const, &ln_b[k], &cq[k],
+                  &ceta[k]);
+    }
+#endif
+    for (; k < n; k++) {
+      FormulaRow(flow[k], head[k], visc[k], ln_const, ln_b[k], cq[k], ceta[k]);
+    }
+
+    for (k = 0; k < n; k++) {
+      CorrectionFactors& cf = out[begin + k];
+      cf.error_msg.clear();
+      const Parameters p(flow[k], head[k], visc[k]);
+      cf.error_flag = FormulaValidate(p, speed);
+      if (cf.error_flag == 0 && !(ln_b[k] < kFormulaLnMaxB)) {
+        cf.error_flag = kCalculationOOR;
+      }
+
+      if (cf.error_flag != 0) {
+        cf.q = 0;
+        cf.eta = 0;
+        cf.h = {};
+      } else {
+        cf.q = cq[k];
+        cf.eta = ceta[k];
+        for (size_t j = 0; j < 4; j++) {
+          cf.h[j] = 1.0 - (1.0 - cq[k]) * head_ratio[j];
+        }
+      }
+    }
+  }
+}
+
+}  // namespace impl
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_IMPL_FORMULA_H_
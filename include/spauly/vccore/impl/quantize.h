@@ -0,0 +1,171 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_IMPL_QUANTIZE_H_
+#define SPAULY_VCCORE_IMPL_QUANTIZE_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "spauly/vccore/data.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VCCORE_QUANTIZE_SSE2 1
+#endif
+
+namespace spauly {
+namespace vccore {
+namespace impl {
+
+// A quantised record is eight little endian 16 bit words:
+// q, eta, h[0], h[1], h[2], h[3], error_flag, 0.
+// Factors are stored as round(x * kQ16Scale) clamped to [0, 65535].
+
+/// Scale of the 16 bit fixed point encoding.
+static constexpr double kQ16Scale = 32768.0;
+
+/// Number of 16 bit words per quantised record.
+static constexpr size_t kQ16Words = 8;
+
+/// Encodes one factor. NaN and negative values map to 0.
+inline uint16_t QuantizeFactor(double x) noexcept {
+  double scaled = x * kQ16Scale;
+  if (!(scaled > 0.0)) return 0;
+  if (scaled >= 65535.0) return 65535;
+  return static_cast<uint16_t>(std::nearbyint(scaled));
+}
+
+inline double DequantizeFactor(uint16_t v) noexcept {
+  return static_cast<double>(v) * (1.0 / kQ16Scale);
+}
+
+inline void StoreWordLE(char* out, uint16_t v) noexcept {
+  out[0] = static_cast<char>(v & 0xFF);
+  out[1] = static_cast<char>(v >> 8);
+}
+
+inline uint16_t LoadWordLE(const char* in) noexcept {
+  return static_cast<uint16_t>(static_cast<unsigned char>(in[0]) |
+                               (static_cast<unsigned char>(in[1]) << 8));
+}
+
+/// Portable version of QuantizeRecords.
+inline void QuantizeRecordsScalar(const CorrectionFactors* in, size_t count,
+                                  char* out) noexcept {
+  for (size_t i = 0; i < count; i++, out += 2 * kQ16Words) {
+    StoreWordLE(out + 0, QuantizeFactor(in[i].q));
+    StoreWordLE(out + 2, QuantizeFactor(in[i].eta));
+    for (size_t j = 0; j < 4; j++) {
+      StoreWordLE(out + 4 + 2 * j, QuantizeFactor(in[i].h[j]));
+    }
+    StoreWordLE(out + 12, static_cast<uint16_t>(in[i].error_flag));
+    StoreWordLE(out + 14, 0);
+  }
+}
+
+/// Portable version of DequantizeRecords.
+inline void DequantizeRecordsScalar(const char* in, size_t count,
+                                    CorrectionFactors* out) noexcept {
+  for (size_t i = 0; i < count; i++, in += 2 * kQ16Words) {
+    out[i].q = DequantizeFactor(LoadWordLE(in + 0));
+    out[i].eta = DequantizeFactor(LoadWordLE(in + 2));
+    for (size_t j = 0; j < 4; j++) {
+      out[i].h[j] = DequantizeFactor(LoadWordLE(in + 4 + 2 * j));
+    }
+    out[i].error_flag = LoadWordLE(in + 12);
+  }
+}
+
+/// Encodes count records into count * 16 bytes at out. Uses SSE2 if
+/// available, the result is identical to QuantizeRecordsScalar.
+inline void QuantizeRecords(const CorrectionFactors* in, size_t count,
+                            char* out) noexcept {
+#if defined(VCCORE_QUANTIZE_SSE2)
+  const __m128d scale = _mm_set1_pd(kQ16Scale);
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d top = _mm_set1_pd(65535.0);
+  const __m128i bias = _mm_set1_epi32(32768);
+  const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000));
+
+  for (size_t i = 0; i < count; i++, out += 2 * kQ16Words) {
+    const CorrectionFactors& cf = in[i];
+    __m128d a = _mm_mul_pd(_mm_set_pd(cf.eta, cf.q), scale);
+    __m128d b = _mm_mul_pd(_mm_loadu_pd(cf.h.data()), scale);
+    __m128d c = _mm_mul_pd(_mm_loadu_pd(cf.h.data() + 2), scale);
+
+    // max(x, 0) returns 0 for NaN since the second operand wins.
+    a = _mm_min_pd(_mm_max_pd(a, zero), top);
+    b = _mm_min_pd(_mm_max_pd(b, zero), top);
+    c = _mm_min_pd(_mm_max_pd(c, zero), top);
+
+    // The conversion rounds to nearest even like std::nearbyint.
+    __m128i lo = _mm_unpacklo_epi64(_mm_cvtpd_epi32(a), _mm_cvtpd_epi32(b));
+    __m128i hi = _mm_unpacklo_epi64(
+        _mm_cvtpd_epi32(c),
+        _mm_cvtsi32_si128(static_cast<int>(cf.error_flag & 0xFFFF)));
+
+    // There is no unsigned 32 to 16 bit pack in SSE2, so shift the values
+    // into the signed range and flip the sign bit back afterwards.
+    __m128i packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias),
+                                     _mm_sub_epi32(hi, bias));
+    packed = _mm_xor_si128(packed, flip);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+  }
+#else
+  QuantizeRecordsScalar(in, count, out);
+#endif
+}
+
+/// Decodes count records from count * 16 bytes at in. Uses SSE2 if
+/// available, the result is identical to DequantizeRecordsScalar.
+inline void DequantizeRecords(const char* in, size_t count,
+                              CorrectionFactors* out) noexcept {
+#if defined(VCCORE_QUANTIZE_SSE2)
+  const __m128d step = _mm_set1_pd(1.0 / kQ16Scale);
+  const __m128i zero = _mm_setzero_si128();
+
+  for (size_t i = 0; i < count; i++, in += 2 * kQ16Words) {
+    __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    __m128i lo = _mm_unpacklo_epi16(words, zero);  // q, eta, h0, h1
+    __m128i hi = _mm_unpackhi_epi16(words, zero);  // h2, h3, flag, 0
+
+    CorrectionFactors& cf = out[i];
+    __m128d a = _mm_mul_pd(_mm_cvtepi32_pd(lo), step);
+    __m128d b = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(lo, lo)), step);
+    __m128d c = _mm_mul_pd(_mm_cvtepi32_pd(hi), step);
+
+    _mm_storel_pd(&cf.q, a);
+    _mm_storeh_pd(&cf.eta, a);
+    _mm_storeu_pd(cf.h.data(), b);
+    _mm_storeu_pd(cf.h.data() + 2, c);
+    cf.error_flag = static_cast<size_t>(_mm_extract_epi16(words, 6));
+  }
+#else
+  DequantizeRecordsScalar(in, count, out);
+#endif
+}
+
+}  // namespace impl
+
+}  // namespace vccore
+
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_IMPL_QUANTIZE_H_
@@ -0,0 +1,122 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_IMPL_SIMD_SCAN_H_
+#define SPAULY_VCCORE_IMPL_SIMD_SCAN_H_
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VCCORE_SIMD_SCAN_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace spauly {
+namespace vccore {
+namespace impl {
+
+#if defined(_MSC_VER) && !defined(__clang__)
+inline int CountTrailingZeros(uint32_t mask) noexcept {
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+}
+#else
+inline int CountTrailingZeros(uint32_t mask) noexcept {
+  return __builtin_ctz(mask);
+}
+#endif
+
+/// Returns true if c is one of the JSON structural characters the record
+/// parser stops at: " : , { } [ ] and the line feed.
+constexpr inline bool IsStructural(char c) noexcept {
+  return c == '"' || c == ':' || c == ',' || c == '{' || c == '}' ||
+         c == '[' || c == ']' || c == '\n';
+}
+
+/// Returns a pointer to the first occurrence of c in [begin, end) or end.
+/// Compares 16 bytes per step if SSE2 is available.
+inline const char* FindByte(const char* begin, const char* end,
+                            char c) noexcept {
+  const char* p = begin;
+
+#if defined(VCCORE_SIMD_SCAN_SSE2)
+  const __m128i needle = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+    if (mask != 0) return p + CountTrailingZeros(mask);
+  }
+#endif
+
+  for (; p < end; p++) {
+    if (*p == c) return p;
+  }
+  return end;
+}
+
+/// Returns a pointer to the first structural character (see IsStructural) in
+/// [begin, end) or end. Compares 16 bytes per step if SSE2 is available.
+inline const char* FindStructural(const char* begin,
+                                  const char* end) noexcept {
+  const char* p = begin;
+
+#if defined(VCCORE_SIMD_SCAN_SSE2)
+  // '{' and '}' as well as '[' and ']' only differ in bit 0x20 from each
+  // other, so setting it folds the brackets onto the braces.
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i open = _mm_set1_epi8('{');
+  const __m128i close = _mm_set1_epi8('}');
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i newline = _mm_set1_epi8('\n');
+
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i folded = _mm_or_si128(chunk, lower);
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(folded, open),
+                                _mm_cmpeq_epi8(folded, close));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, quote));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, colon));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, comma));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, newline));
+
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+    if (mask != 0) return p + CountTrailingZeros(mask);
+  }
+#endif
+
+  for (; p < end; p++) {
+    if (IsStructural(*p)) return p;
+  }
+  return end;
+}
+
+}  // namespace impl
+
+}  // namespace vccore
+
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_IMPL_SIMD_SCAN_H_
@@ -0,0 +1,59 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_IMPL_TRACE_H_
+#define SPAULY_VCCORE_IMPL_TRACE_H_
+
+// Static tracepoints of the provider "vccore". They follow the SystemTap SDT
+// convention, so perf, bpftrace and SystemTap attach to them in a running
+// process, e.g.
+//
+//   bpftrace -e 'usdt:./libViscoCorrectCore.so:vccore:chunk
+//                { @rows = hist(arg1 - arg0); }'
+//
+// A probe that is not attached is a single nop. The library only defines
+// VCCORE_HAS_SDT if <sys/sdt.h> was found, otherwise the macros expand to
+// nothing.
+//
+// Probes and their arguments:
+//   batch_start   rows, grain            Calculator batch call begins
+//   batch_end     rows                   Calculator batch call returns
+//   chunk         begin, end             a chunk is calculated
+//   input_error   error_flag             a row fails the input validation
+//   cutoff        chart, pos_main        a factor is cut off, chart 0 = q,
+//                                        1 = eta, 2 = h, pos_main in 1/1000
+//   cache_hit     row                    ResultCache found a row
+//   cache_miss    row                    ResultCache calculated a row
+//   file_start    rows, chunk_records    RunBinaryBatch begins
+//   file_chunk    first, count           RunBinaryBatch calculates a chunk
+//   file_end      rows, ok               RunBinaryBatch returns
+
+#if defined(VCCORE_HAS_SDT)
+#include <sys/sdt.h>
+
+#define VCCORE_TRACE1(name, a) DTRACE_PROBE1(vccore, name, a)
+#define VCCORE_TRACE2(name, a, b) DTRACE_PROBE2(vccore, name, a, b)
+#else
+#define VCCORE_TRACE1(name, a) \
+  do {                         \
+  } while (0)
+#define VCCORE_TRACE2(name, a, b) \
+  do {                            \
+  } while (0)
+#endif  // VCCORE_HAS_SDT
+
+#endif  // SPAULY_VCCORE_IMPL_TRACE_H_
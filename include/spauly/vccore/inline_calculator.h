@@ -0,0 +1,70 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_INLINE_CALCULATOR_H_
+#define SPAULY_VCCORE_INLINE_CALCULATOR_H_
+
+#include <cstddef>
+
+#include "spauly/vccore/data.h"
+#include "spauly/vccore/impl/chart.h"
+
+namespace spauly {
+namespace vccore {
+
+// Header only variant of Calculator::Calculate, usable through the
+// ViscoCorrectCore::header_only target without linking the library. The
+// compiler can inline it into the caller's loops and hoist the unit handling
+// out of them. Results are bit-identical to Calculator when both are built
+// with the same floating point flags: no -ffast-math, and -ffp-contract=off
+// which the target adds unless vcc_REPRODUCIBLE_FP is off.
+
+/// @brief Calculates the correction factors for p in the units u. Same
+/// results as Calculator::Calculate.
+inline CorrectionFactors CalculateInline(
+    const Parameters& p, const Units& u = kStandardUnits) noexcept {
+  CorrectionFactors out;
+  const Parameters p_base = (u != kStandardUnits) ? impl::ChartConvert(p, u)
+                                                  : p;
+
+  out.error_flag = impl::ChartValidate(p_base);
+  if (out.error_flag != 0) return out;
+
+  impl::ChartFactors(impl::ChartPosition(p_base), out);
+  return out;
+}
+
+/// @brief Calculates count rows of in into out on the calling thread. Same
+/// results as the batch Calculator::Calculate.
+inline void CalculateInline(const Parameters* in, CorrectionFactors* out,
+                            size_t count,
+                            const Units& u = kStandardUnits) noexcept {
+  if (u == kStandardUnits) {
+    for (size_t i = 0; i < count; i++) {
+      out[i] = CalculateInline(in[i], kStandardUnits);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      out[i] = CalculateInline(impl::ChartConvert(in[i], u), kStandardUnits);
+    }
+  }
+}
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_INLINE_CALCULATOR_H_
@@ -0,0 +1,127 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_JSONL_H_
+#define SPAULY_VCCORE_JSONL_H_
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string_view>
+#include <vector>
+
+#include "spauly/vccore/batch_options.h"
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// forward declarations
+class Calculator;
+
+/// Default number of bytes the JSONL reader buffers.
+static constexpr size_t kDefaultJsonlBufferBytes = 1 << 20;
+
+/// Default number of records handed to the batch calculator at once.
+static constexpr size_t kDefaultJsonlChunkRows = 4096;
+
+/// @brief Parses a unit name like "m3/h", "l/min", "gpm", "m", "ft", "mm2/s",
+/// "cSt", "cP", "mPas", "g/l" or "kg/m3" into the matching enum value.
+/// @return false if name is not a known unit of that kind.
+bool ParseUnitName(std::string_view name, FlowrateUnit& out) noexcept;
+bool ParseUnitName(std::string_view name, HeadUnit& out) noexcept;
+bool ParseUnitName(std::string_view name, ViscosityUnit& out) noexcept;
+bool ParseUnitName(std::string_view name, DensityUnit& out) noexcept;
+
+/// @brief Parses one duty point record. Only the fields of Parameters and
+/// Units are read, all other keys are skipped:
+/// {"flowrate": 100, "total_head": 50, "viscosity": 200, "density": 0.9,
+///  "flowrate_unit": "m3/h", "total_head_unit": "m",
+///  "viscosity_unit": "mm2/s", "density_unit": "g/l"}
+/// Missing values are set to 0, missing units to the standard units.
+/// @param line One record without the line feed.
+/// @param p Parsed Parameters.
+/// @param u Parsed Units.
+/// @return false if the record is malformed.
+bool ParseJsonlRecord(std::string_view line, Parameters& p, Units& u) noexcept;
+
+/// @brief Reads duty point records from a JSON lines stream with a fixed size
+/// buffer. Empty lines are skipped, every other line yields one row.
+class JsonlReader {
+ public:
+  /// @param in Stream to read from, must outlive the reader.
+  /// @param buffer_bytes Size of the read buffer. Lines longer than this are
+  /// reported as malformed.
+  explicit JsonlReader(std::istream& in,
+                       size_t buffer_bytes = kDefaultJsonlBufferBytes);
+  ~JsonlReader() = default;
+
+  /// @brief Reads up to max_rows records.
+  /// @param p Receives the Parameters of every row.
+  /// @param u Receives the Units of every row.
+  /// @param flags Receives 0 or ErrorFlag::kParseError for every row.
+  /// @param max_rows Capacity of p, u and flags.
+  /// @return Number of rows read, 0 once the stream is exhausted.
+  size_t Read(Parameters* p, Units* u, size_t* flags, size_t max_rows);
+
+  /// @brief Number of rows returned so far.
+  size_t Rows() const noexcept { return rows_; }
+
+  /// @brief Number of rows that were malformed.
+  size_t Malformed() const noexcept { return malformed_; }
+
+ private:
+  /// Moves the unread tail to the front and refills the buffer.
+  bool Refill();
+
+  std::istream& in_;
+  std::vector<char> buffer_;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  bool eof_ = false;
+  bool skipping_ = false;  // Discarding the rest of an overlong line.
+
+  size_t rows_ = 0;
+  size_t malformed_ = 0;
+};
+
+/// @brief Receives the rows [first, first + count) of a streamed batch. The
+/// pointers are only valid during the call.
+using BatchSink = std::function<void(size_t first, const Parameters* in,
+                                     const CorrectionFactors* out,
+                                     size_t count)>;
+
+/// @brief Streams a JSON lines input through the batch calculator chunk by
+/// chunk, so memory stays bounded regardless of the input size. Rows with
+/// other than the standard units are converted before the calculation.
+/// Malformed rows are passed on with ErrorFlag::kParseError.
+/// @param calc Calculator to use.
+/// @param in JSON lines stream.
+/// @param sink Receives every calculated chunk in input order.
+/// @param options Executor and grain for the batch calls. Once cancelled no
+/// further chunk is passed to the sink.
+/// @param chunk_rows Number of rows per chunk.
+/// @return Number of rows passed to the sink.
+size_t CalculateJsonl(const Calculator& calc, std::istream& in,
+                      const BatchSink& sink,
+                      const BatchOptions& options = BatchOptions(),
+                      size_t chunk_rows = kDefaultJsonlChunkRows);
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_JSONL_H_
@@ -0,0 +1,155 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_METRICS_H_
+#define SPAULY_VCCORE_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+/// Number of counter shards. Threads are spread over them round robin.
+static constexpr size_t kMetricsShards = 16;
+
+/// Upper bounds in seconds of the batch latency histogram.
+static constexpr std::array<double, 7> kLatencyBuckets = {
+    1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1.0, 10.0};
+
+/// Upper bounds of the batch size histogram in rows.
+static constexpr std::array<double, 7> kBatchSizeBuckets = {
+    1, 8, 64, 512, 4096, 32768, 262144};
+
+/// Number of ErrorFlag bits that are counted.
+static constexpr size_t kErrorFlagCount = 6;
+
+/// MetricType determines the TYPE line of a callback metric.
+enum class MetricType { kCounter, kGauge };
+
+/// @brief Metrics collects the counters of batch calculations and renders
+/// them in the Prometheus text exposition format.
+///
+/// Writers update one of kMetricsShards cache line aligned shards with
+/// relaxed atomic adds, so concurrent batches do not contend. Render sums
+/// the shards without locking. Values owned by other objects, like cache
+/// hits or queue depths, are added as callbacks read at render time.
+class Metrics {
+ public:
+  Metrics() = default;
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  /// @brief Counts one batch call of rows rows that took seconds.
+  void RecordBatch(size_t rows, double seconds) noexcept;
+
+  /// @brief Counts the ErrorFlag bits of count results.
+  void RecordFlags(const CorrectionFactors* out, size_t count) noexcept;
+
+  /// @brief Counts rows chart results cut off to 0 under kCalculationOOR.
+  /// Chart results do not carry the bit, it is only set in diagnostics.
+  void RecordCutoffs(size_t rows) noexcept;
+
+  /// @brief Adds a metric whose value is read from value on every render.
+  /// value must be thread safe and stay valid while the Metrics is used.
+  /// @param name Metric name, e.g. vccore_cache_hits_total.
+  void AddCallback(const std::string& name, const std::string& help,
+                   MetricType type, std::function<double()> value);
+
+  /// Totals over all shards.
+  uint64_t Calls() const noexcept;
+  uint64_t Rows() const noexcept;
+  uint64_t FlagCount(size_t bit) const noexcept;
+
+  /// @brief Returns all metrics in the Prometheus text format 0.0.4.
+  std::string Render() const;
+
+  /// @brief Writes Render() to path for the node-exporter textfile
+  /// collector. The file is replaced atomically so a scrape never sees a
+  /// partial file.
+  bool WriteTextfile(const std::string& path) const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> rows{0};
+    std::atomic<uint64_t> latency_ns{0};
+    std::array<std::atomic<uint64_t>, kLatencyBuckets.size() + 1> latency{};
+    std::array<std::atomic<uint64_t>, kBatchSizeBuckets.size() + 1> sizes{};
+    std::array<std::atomic<uint64_t>, kErrorFlagCount> flags{};
+  };
+
+  struct Callback {
+    std::string name;
+    std::string help;
+    MetricType type;
+    std::function<double()> value;
+  };
+
+  Shard& LocalShard() noexcept;
+
+  std::array<Shard, kMetricsShards> shards_;
+
+  mutable std::mutex callbacks_mutex_;
+  std::vector<Callback> callbacks_;
+};
+
+/// @brief MetricsServer answers HTTP requests on 127.0.0.1 with the rendered
+/// metrics, so Prometheus can scrape a running process. POSIX only, Start
+/// fails elsewhere.
+class MetricsServer {
+ public:
+  /// @param metrics Rendered on every request, must outlive the server.
+  explicit MetricsServer(const Metrics& metrics) : metrics_(metrics) {}
+  ~MetricsServer() { Stop(); }
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+  /// @brief Listens on the loopback interface.
+  /// @param port TCP port, 0 picks a free one, see Port().
+  bool Start(uint16_t port);
+
+  /// @brief Stops listening and joins the server thread.
+  void Stop();
+
+  uint16_t Port() const noexcept { return port_; }
+
+ private:
+  void Serve();
+
+  const Metrics& metrics_;
+  int listen_fd_ = -1;
+  uint16_t port_ = 0;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_METRICS_H_
@@ -0,0 +1,177 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_NUMA_H_
+#define SPAULY_VCCORE_NUMA_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "spauly/vccore/batch_options.h"
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+
+/// @brief NumaNode describes one memory node and the cpus attached to it.
+struct NumaNode {
+  int id = 0;
+  std::vector<int> cpus;
+};
+
+/// @brief NodeStats is a DTO holding the work a NumaExecutor did per node.
+struct NodeStats {
+  int node = 0;
+  size_t indices = 0;  // Number of indices processed by the node.
+  double seconds = 0;  // Accumulated time spent in tasks on the node.
+};
+
+/// @brief Returns the memory nodes of the machine. On Linux they are read from
+/// sysfs, elsewhere a single node with all hardware threads is returned.
+std::vector<NumaNode> DetectNumaNodes();
+
+/// @brief Executor with one group of workers per memory node. ParallelFor
+/// assigns every node a contiguous part of the index range, which only the
+/// workers of that node process. Buffers initialised through FirstTouch are
+/// therefore placed on the node that later reads and writes them.
+class NumaExecutor : public Executor {
+ public:
+  /// @brief Starts one worker per cpu of every detected node.
+  /// @param pin_workers Pins every worker to the cpus of its node (Linux only).
+  explicit NumaExecutor(bool pin_workers = true);
+
+  /// @brief Starts one worker per cpu of every given node.
+  NumaExecutor(const std::vector<NumaNode>& nodes, bool pin_workers = true);
+  virtual ~NumaExecutor();
+
+  virtual size_t Concurrency() const noexcept override;
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override;
+
+  /// @brief Queues task on the workers of the first node.
+  virtual void Post(std::function<void()> task) override;
+
+  /// @brief Writes every element of the buffer from the node that processes
+  /// the same indices in ParallelFor, so the kernel places the pages there.
+  /// Must be called with the same count and grain as the later batch. The
+  /// grain is rounded with BlockAlignedGrain like the batch Calculate does.
+  /// @param init Invoked for [begin, end) to initialise the elements.
+  void FirstTouch(size_t count, size_t grain, const RangeTask& init) {
+    ParallelFor(count, BlockAlignedGrain(grain), init);
+  }
+
+  /// @brief Returns the nodes the executor runs on.
+  const std::vector<NumaNode>& Nodes() const noexcept { return node_info_; }
+
+  /// @brief Returns the work done per node since construction or the last
+  /// ResetStats.
+  std::vector<NodeStats> Stats() const;
+  void ResetStats() noexcept;
+
+ private:
+  struct Node;
+
+  std::vector<NumaNode> node_info_;
+  std::vector<std::unique_ptr<Node>> nodes_;
+};
+
+/// @brief Allocates bytes of page aligned memory. If huge_pages is set the
+/// mapping is advised to be backed by transparent huge pages (Linux only).
+/// Memory is not touched, so pages are placed on first write.
+void* AllocateLarge(size_t bytes, bool huge_pages);
+
+/// @brief Releases memory obtained from AllocateLarge.
+void FreeLarge(void* data, size_t bytes) noexcept;
+
+/// @brief Fixed size array for large batch buffers. Elements are constructed
+/// through the executor so that each page is first touched by the worker that
+/// later processes it.
+/// @tparam T Element type.
+template <typename T>
+class LargeBuffer {
+ public:
+  LargeBuffer() = default;
+
+  /// @brief Allocates and default constructs count elements.
+  /// @param count Number of elements.
+  /// @param options Executor and grain of the batch the buffer is used for.
+  /// @param huge_pages Back the buffer with transparent huge pages.
+  LargeBuffer(size_t count, const BatchOptions& options = BatchOptions(),
+              bool huge_pages = false)
+      : count_(count), bytes_(count * sizeof(T)) {
+    data_ = static_cast<T*>(AllocateLarge(bytes_, huge_pages));
+    if (data_ == nullptr && bytes_ != 0) throw std::bad_alloc();
+
+    auto init = [this](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) new (data_ + i) T();
+    };
+
+    if (options.executor != nullptr && count_ != 0) {
+      options.executor->ParallelFor(count_, BlockAlignedGrain(options.grain),
+                                    init);
+    } else {
+      init(0, count_);
+    }
+  }
+
+  ~LargeBuffer() { Release(); }
+
+  LargeBuffer(LargeBuffer&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        count_(std::exchange(other.count_, 0)),
+        bytes_(std::exchange(other.bytes_, 0)) {}
+  LargeBuffer& operator=(LargeBuffer&& other) noexcept {
+    if (this != &other) {
+      Release();
+      data_ = std::exchange(other.data_, nullptr);
+      count_ = std::exchange(other.count_, 0);
+      bytes_ = std::exchange(other.bytes_, 0);
+    }
+    return *this;
+  }
+  LargeBuffer(const LargeBuffer&) = delete;
+  LargeBuffer& operator=(const LargeBuffer&) = delete;
+
+  T* data() noexcept { return data_; }
+  const T* data() const noexcept { return data_; }
+  size_t size() const noexcept { return count_; }
+
+  T& operator[](size_t i) noexcept { return data_[i]; }
+  const T& operator[](size_t i) const noexcept { return data_[i]; }
+
+ private:
+  void Release() noexcept {
+    if (data_ == nullptr) return;
+    for (size_t i = 0; i < count_; i++) data_[i].~T();
+    FreeLarge(data_, bytes_);
+    data_ = nullptr;
+  }
+
+  T* data_ = nullptr;
+  size_t count_ = 0;
+  size_t bytes_ = 0;
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_NUMA_H_
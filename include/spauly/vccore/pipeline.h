@@ -0,0 +1,154 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_PIPELINE_H_
+#define SPAULY_VCCORE_PIPELINE_H_
+
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "spauly/vccore/batch_options.h"
+#include "spauly/vccore/binary_format.h"
+#include "spauly/vccore/checkpoint.h"
+#include "spauly/vccore/data.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/shard.h"
+
+namespace spauly {
+namespace vccore {
+
+// forward declarations
+class Calculator;
+
+/// Default number of records per pipeline chunk, 16 blocks.
+static constexpr size_t kDefaultPipelineChunkRecords =
+    16 * kBinaryBlockRecords;
+
+/// Default number of chunks in flight.
+static constexpr unsigned kDefaultPipelineDepth = 4;
+
+/// @brief PipelineOptions is a DTO that configures the file batch pipeline.
+struct PipelineOptions {
+  /// Executor and grain used for the calculation of every chunk.
+  BatchOptions batch;
+
+  /// Preferred I/O backend. Falls back to kSync if io_uring is unavailable.
+  IoBackend io = IoBackend::kSync;
+
+  /// Records per chunk. Rounded up to a multiple of the block size so every
+  /// read and write stays aligned.
+  size_t chunk_records = kDefaultPipelineChunkRecords;
+
+  /// Number of chunks in flight. While one chunk is calculated the others
+  /// are read or written, 2 gives plain double buffering.
+  unsigned depth = kDefaultPipelineDepth;
+
+  /// Encoding of the result columns of binary and CSV outputs.
+  ResultEncoding encoding = ResultEncoding::kDouble;
+
+  /// Enables checkpoints of binary batches if set. Completed chunks are
+  /// recorded there, and a rerun with the same options skips them. The file
+  /// is removed once the batch is complete. Shards use
+  /// ShardPath(checkpoint_path, shard).
+  std::string checkpoint_path;
+
+  /// Minimum time between two checkpoints. Each one flushes the output.
+  double checkpoint_seconds = kDefaultCheckpointSeconds;
+
+  /// Part of the input to calculate. Unless the spec covers the whole input
+  /// the results are written to ShardPath(output_path, shard).
+  ShardSpec shard;
+};
+
+/// @brief PipelineResult is a DTO reporting the outcome of a file batch.
+struct PipelineResult {
+  bool ok = true;
+  std::string error_msg;
+
+  /// Number of rows in the output, including resumed_rows.
+  size_t rows = 0;
+
+  /// Number of rows a checkpoint showed to be complete already.
+  size_t resumed_rows = 0;
+
+  /// Set if options.batch.cancel stopped the batch. The output is
+  /// incomplete, a checkpoint if enabled is saved so a rerun continues.
+  bool cancelled = false;
+
+  /// Backend that was actually used.
+  IoBackend io = IoBackend::kSync;
+};
+
+/// @brief Calculates a binary input file into a binary result file of the
+/// same row order. Several aligned reads stay in flight while earlier chunks
+/// are calculated, results are written back asynchronously.
+/// @param calc Calculator to use.
+/// @param input_path Binary file of RecordKind::kInput.
+/// @param output_path Result file, created or truncated.
+/// @param options Chunking, I/O backend, executor and shard.
+PipelineResult RunBinaryBatch(const Calculator& calc,
+                              const std::string& input_path,
+                              const std::string& output_path,
+                              const PipelineOptions& options = {});
+
+/// @brief Streams CSV input rows through the batch calculator and writes CSV
+/// result rows. Malformed rows yield ErrorFlag::kParseError.
+/// @param units Units of the input rows.
+PipelineResult RunCsvBatch(const Calculator& calc, std::istream& in,
+                           std::ostream& out,
+                           const Units& units = kStandardUnits,
+                           const PipelineOptions& options = {});
+
+/// @brief Calculates a CSV input file into a CSV result file. Honors
+/// options.shard, so each process can take one byte range of the input. With
+/// diagnostics, a shard first counts the records before its range, so its
+/// events name rows of the whole input.
+PipelineResult RunCsvFile(const Calculator& calc, const std::string& input_path,
+                          const std::string& output_path,
+                          const Units& units = kStandardUnits,
+                          const PipelineOptions& options = {});
+
+/// @brief Reassembles the outputs ShardPath(output_path, i/shard_count) of
+/// all shards into output_path in the original row order. Binary shards must
+/// be contiguous, of CSV shards only the first header line is kept.
+PipelineResult MergeShards(const std::string& output_path,
+                           size_t shard_count);
+
+/// TextFormat determines how a text input is parsed.
+enum class TextFormat { kCsv, kJsonl };
+
+/// @brief Converts CSV or JSON lines input rows into a binary input file.
+/// Rows are stored in the standard units, malformed rows as
+/// UnreadableInputRecord so the row order is kept.
+/// @param calc Calculator used for the unit conversion.
+/// @param units Units of CSV rows. JSON lines rows carry their own units.
+PipelineResult ConvertToBinary(const Calculator& calc, std::istream& in,
+                               TextFormat format,
+                               const std::string& output_path,
+                               const Units& units = kStandardUnits);
+
+/// @brief Writes a binary result file as CSV result rows. Quantised files
+/// are written with the kQ16 CSV format.
+PipelineResult ConvertResultsToCsv(const std::string& input_path,
+                                   std::ostream& out);
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_PIPELINE_H_
@@ -0,0 +1,105 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_PROGRESS_H_
+#define SPAULY_VCCORE_PROGRESS_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace spauly {
+namespace vccore {
+
+/// @brief CancellationToken lets another thread stop a running batch. The
+/// batch APIs check it once per chunk, chunks that already started are
+/// finished. It is a single atomic flag, so checking it costs one load.
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+
+  CancellationToken(const CancellationToken&) = delete;
+  CancellationToken& operator=(const CancellationToken&) = delete;
+
+  /// @brief Requests the cancellation. May be called from any thread.
+  void Cancel() noexcept { cancelled_.store(true, std::memory_order_release); }
+
+  /// @brief Returns true once Cancel was called.
+  bool IsCancelled() const noexcept {
+    return cancelled_.load(std::memory_order_acquire);
+  }
+
+  /// @brief Clears the flag so the token can be used for the next batch.
+  void Reset() noexcept { cancelled_.store(false, std::memory_order_release); }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+
+/// @brief ProgressSink counts the rows of a batch. The batch APIs add the
+/// rows they were given to Total() when they start and every finished chunk
+/// to Done(). Streaming APIs learn their total while reading, so for them
+/// Total() grows as well. Front-ends poll it from any thread.
+class ProgressSink {
+ public:
+  ProgressSink() = default;
+
+  ProgressSink(const ProgressSink&) = delete;
+  ProgressSink& operator=(const ProgressSink&) = delete;
+
+  /// @brief Adds rows to the number of rows the batch consists of.
+  void AddTotal(uint64_t rows) noexcept {
+    total_.fetch_add(rows, std::memory_order_relaxed);
+  }
+
+  /// @brief Adds rows to the number of finished rows.
+  void AddDone(uint64_t rows) noexcept {
+    done_.fetch_add(rows, std::memory_order_relaxed);
+  }
+
+  uint64_t Total() const noexcept {
+    return total_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t Done() const noexcept {
+    return done_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Returns Done() / Total(), 0 if no rows were announced yet.
+  double Fraction() const noexcept {
+    const uint64_t total = Total();
+    if (total == 0) return 0.0;
+    const double fraction =
+        static_cast<double>(Done()) / static_cast<double>(total);
+    return fraction < 1.0 ? fraction : 1.0;
+  }
+
+  /// @brief Sets both counters to zero for the next batch.
+  void Reset() noexcept {
+    total_.store(0, std::memory_order_relaxed);
+    done_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  // Every chunk updates done_, so it gets a cache line of its own.
+  alignas(64) std::atomic<uint64_t> total_{0};
+  alignas(64) std::atomic<uint64_t> done_{0};
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_PROGRESS_H_
@@ -0,0 +1,114 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_RESULT_CACHE_H_
+#define SPAULY_VCCORE_RESULT_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// forward declarations
+class Calculator;
+
+/// Default number of slots of a ResultCache, 80 bytes each.
+static constexpr size_t kDefaultResultCacheSlots = size_t(1) << 16;
+
+/// @brief ResultCache is a fixed-size hash table of duty points and their
+/// correction factors in a memory-mapped file. Every process that opens the
+/// same file shares the table, and the results survive restarts.
+///
+/// Keys are the flowrate, total head and viscosity in the standard units,
+/// the results are stored exactly, so a cached row is bit-identical to a
+/// calculated one. Slots are probed linearly and guarded by a sequence
+/// counter: readers never block and treat a slot that is being written as
+/// a miss, writers claim a slot with one compare-and-swap and skip it if
+/// another writer holds it. A full probe window evicts its first slot.
+///
+/// The file header carries the layout and kChartTableVersion. A file of
+/// another version is reset when it is opened. Only available on POSIX
+/// systems, Open fails elsewhere.
+class ResultCache {
+ public:
+  ResultCache() = default;
+  ~ResultCache() { Close(); }
+
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  /// @brief Maps the cache file at path and creates it if needed.
+  /// @param slot_count Slots of a new file, rounded up to a power of two.
+  /// An existing file of the current version keeps its size.
+  /// @return false if the file could not be created or mapped.
+  bool Open(const std::string& path,
+            size_t slot_count = kDefaultResultCacheSlots) noexcept;
+
+  /// @brief Unmaps the file. The contents stay on disk.
+  void Close() noexcept;
+
+  bool IsOpen() const noexcept { return slots_ != nullptr; }
+
+  size_t SlotCount() const noexcept { return IsOpen() ? mask_ + 1 : 0; }
+
+  /// @brief Looks up the duty point p given in the standard units.
+  /// @return true and the cached factors in out on a hit.
+  bool Lookup(const Parameters& p, CorrectionFactors& out) const noexcept;
+
+  /// @brief Stores the factors of the duty point p given in the standard
+  /// units. Does nothing if all candidate slots are being written.
+  void Insert(const Parameters& p, const CorrectionFactors& cf) noexcept;
+
+  /// @brief Calculates count rows through the cache. Misses are calculated
+  /// with calc and inserted.
+  void Calculate(const Calculator& calc, const Parameters* in,
+                 CorrectionFactors* out, size_t count,
+                 const Units& u = kStandardUnits) noexcept;
+
+  /// @brief Empties every slot. Other processes must not write meanwhile.
+  void Clear() noexcept;
+
+  /// Rows Calculate found in the cache or had to calculate, counted per
+  /// process.
+  uint64_t Hits() const noexcept {
+    return hits_.load(std::memory_order_relaxed);
+  }
+  uint64_t Misses() const noexcept {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot;
+
+  void* map_ = nullptr;
+  size_t map_bytes_ = 0;
+  Slot* slots_ = nullptr;
+  size_t mask_ = 0;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_RESULT_CACHE_H_
@@ -0,0 +1,81 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_SHARD_H_
+#define SPAULY_VCCORE_SHARD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "spauly/vccore/binary_format.h"
+
+namespace spauly {
+namespace vccore {
+
+// A batch input can be split into shards that are calculated by separate
+// processes. Binary files are split at block boundaries, CSV files at line
+// boundaries. Every shard writes its own output file, MergeShards in
+// pipeline.h reassembles them in the original row order.
+
+/// @brief ShardSpec is a DTO selecting shard index out of count shards.
+struct ShardSpec {
+  size_t index = 0;
+  size_t count = 1;
+
+  bool IsValid() const noexcept { return count > 0 && index < count; }
+  bool IsWhole() const noexcept { return count == 1; }
+};
+
+/// @brief RecordRange is a DTO of the records [first, first + count).
+struct RecordRange {
+  uint64_t first = 0;
+  uint64_t count = 0;
+};
+
+/// @brief ByteRange is a DTO of the bytes [begin, end) of a file.
+struct ByteRange {
+  uint64_t begin = 0;
+  uint64_t end = 0;
+};
+
+/// @brief Parses a shard spec of the form "index/count", e.g. "2/8".
+/// @return false if text is malformed or index >= count.
+bool ParseShardSpec(std::string_view text, ShardSpec& shard) noexcept;
+
+/// @brief Returns the output path of a shard, e.g. "out.vccb.shard-2-of-8".
+std::string ShardPath(const std::string& path, const ShardSpec& shard);
+
+/// @brief Returns the records of a binary file that belong to shard. The
+/// blocks are distributed evenly so every shard starts at a block boundary.
+RecordRange BinaryShardRange(const BinaryHeader& header,
+                             const ShardSpec& shard) noexcept;
+
+/// @brief Returns the bytes of a text file that belong to shard. A shard
+/// starts at the first line that begins at or after index * size / count and
+/// ends where the next shard starts, so every line belongs to one shard.
+/// @param path Text file to split.
+/// @param range Receives the byte range.
+/// @return false if the file could not be read.
+bool TextShardRange(const std::string& path, const ShardSpec& shard,
+                    ByteRange& range);
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_SHARD_H_
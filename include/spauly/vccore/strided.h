@@ -0,0 +1,156 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_STRIDED_H_
+#define SPAULY_VCCORE_STRIDED_H_
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+/// Number of rows a strided batch gathers into a contiguous block before it
+/// calculates them.
+static constexpr size_t kStridedBlockRows = 64;
+
+/// @brief StridedColumn is one field of a strided view: the address of the
+/// field in the first row and the byte distance between two rows. A column
+/// without data is skipped.
+template <typename T>
+struct StridedColumn {
+  T* data = nullptr;
+  std::ptrdiff_t stride = sizeof(T);
+
+  StridedColumn() = default;
+  StridedColumn(T* data, std::ptrdiff_t stride = sizeof(T))
+      : data(data), stride(stride) {}
+
+  bool IsSet() const noexcept { return data != nullptr; }
+
+  /// @brief Returns the address of the field in row i.
+  T* At(size_t i) const noexcept {
+    using Byte = typename std::conditional<std::is_const<T>::value,
+                                           const char, char>::type;
+    return reinterpret_cast<T*>(reinterpret_cast<Byte*>(data) +
+                                static_cast<std::ptrdiff_t>(i) * stride);
+  }
+};
+
+/// @brief StridedInput reads the Parameters of a batch straight from the
+/// caller's rows, e.g. an array of structs that embed the fields. Rows with
+/// no density column use a density of 0.
+struct StridedInput {
+  StridedColumn<const DoubleT> flowrate;
+  StridedColumn<const DoubleT> total_head;
+  StridedColumn<const DoubleT> viscosity;
+  StridedColumn<const DoubleT> density;
+
+  /// @brief Returns a view of the fields of rows of type Row. Pass nullptr
+  /// as density if Row has none.
+  template <typename Row>
+  static StridedInput FromRows(const Row* rows, const DoubleT Row::*flowrate,
+                               const DoubleT Row::*total_head,
+                               const DoubleT Row::*viscosity,
+                               const DoubleT Row::*density = nullptr) noexcept {
+    constexpr std::ptrdiff_t stride = sizeof(Row);
+    StridedInput in;
+    in.flowrate = {&(rows->*flowrate), stride};
+    in.total_head = {&(rows->*total_head), stride};
+    in.viscosity = {&(rows->*viscosity), stride};
+    if (density != nullptr) in.density = {&(rows->*density), stride};
+    return in;
+  }
+
+  /// @brief Returns a view of a Parameters array.
+  static StridedInput FromParameters(const Parameters* rows) noexcept {
+    return FromRows(rows, &Parameters::flowrate, &Parameters::total_head,
+                    &Parameters::viscosity, &Parameters::density);
+  }
+
+  /// @brief Copies the count rows from begin into out.
+  void Gather(size_t begin, size_t count, Parameters* out) const noexcept {
+    for (size_t i = 0; i < count; i++) {
+      out[i].flowrate = *flowrate.At(begin + i);
+      out[i].total_head = *total_head.At(begin + i);
+      out[i].viscosity = *viscosity.At(begin + i);
+    }
+    if (density.IsSet()) {
+      for (size_t i = 0; i < count; i++) {
+        out[i].density = *density.At(begin + i);
+      }
+    } else {
+      for (size_t i = 0; i < count; i++) out[i].density = 0;
+    }
+  }
+};
+
+/// @brief StridedOutput writes the results of a batch straight into the
+/// caller's rows. Columns that are not set are not written.
+struct StridedOutput {
+  StridedColumn<double> q;
+  StridedColumn<double> eta;
+  std::array<StridedColumn<double>, 4> h;
+  StridedColumn<size_t> error_flag;
+
+  /// @brief Returns a view of the fields of rows of type Row. Pass nullptr
+  /// for fields Row does not have.
+  template <typename Row>
+  static StridedOutput FromRows(Row* rows, double Row::*q, double Row::*eta,
+                                std::array<double, 4> Row::*h,
+                                size_t Row::*error_flag = nullptr) noexcept {
+    constexpr std::ptrdiff_t stride = sizeof(Row);
+    StridedOutput out;
+    if (q != nullptr) out.q = {&(rows->*q), stride};
+    if (eta != nullptr) out.eta = {&(rows->*eta), stride};
+    if (h != nullptr) {
+      for (size_t j = 0; j < out.h.size(); j++) {
+        out.h[j] = {&(rows->*h)[j], stride};
+      }
+    }
+    if (error_flag != nullptr) out.error_flag = {&(rows->*error_flag), stride};
+    return out;
+  }
+
+  /// @brief Copies count results of in to the rows from begin.
+  void Scatter(size_t begin, size_t count,
+               const CorrectionFactors* in) const noexcept {
+    if (q.IsSet()) {
+      for (size_t i = 0; i < count; i++) *q.At(begin + i) = in[i].q;
+    }
+    if (eta.IsSet()) {
+      for (size_t i = 0; i < count; i++) *eta.At(begin + i) = in[i].eta;
+    }
+    for (size_t j = 0; j < h.size(); j++) {
+      if (!h[j].IsSet()) continue;
+      for (size_t i = 0; i < count; i++) *h[j].At(begin + i) = in[i].h[j];
+    }
+    if (error_flag.IsSet()) {
+      for (size_t i = 0; i < count; i++) {
+        *error_flag.At(begin + i) = in[i].error_flag;
+      }
+    }
+  }
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_STRIDED_H_
@@ -0,0 +1,108 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_VIEW_H_
+#define SPAULY_VCCORE_VIEW_H_
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+
+#include "spauly/vccore/batch_options.h"
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+
+// forward declarations
+class Calculator;
+
+/// @brief CalculationView is a lazy range over the CorrectionFactors of a
+/// sequence of Parameters. Nothing is stored besides the current block of the
+/// iterator, which is calculated kBlockSize rows at a time on dereference.
+/// Obtain it through Calculator::View. The Calculator and the input must
+/// outlive the view and its iterators.
+class CalculationView {
+ public:
+  /// @brief Single pass iterator over the view. References are valid until the
+  /// iterator is advanced past the current block or destroyed.
+  class Iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = CorrectionFactors;
+    using reference = const CorrectionFactors&;
+    using pointer = const CorrectionFactors*;
+
+    Iterator() = default;
+    Iterator(const CalculationView* view, size_t index)
+        : view_(view), index_(index) {}
+
+    reference operator*() const;
+    pointer operator->() const { return &**this; }
+
+    Iterator& operator++() noexcept {
+      index_++;
+      return *this;
+    }
+    Iterator operator++(int) noexcept {
+      Iterator tmp = *this;
+      index_++;
+      return tmp;
+    }
+
+    /// @brief Returns the row of the input the iterator points to.
+    size_t Index() const noexcept { return index_; }
+
+    bool operator==(const Iterator& other) const noexcept {
+      return index_ == other.index_;
+    }
+    bool operator!=(const Iterator& other) const noexcept {
+      return index_ != other.index_;
+    }
+
+   private:
+    const CalculationView* view_ = nullptr;
+    size_t index_ = 0;
+
+    // Current block, calculated on demand.
+    mutable size_t block_begin_ = 0;
+    mutable size_t block_size_ = 0;
+    mutable std::array<CorrectionFactors, kBlockSize> block_{};
+  };
+
+  CalculationView(const Calculator& calc, const Parameters* in, size_t count,
+                  const Units& u = kStandardUnits) noexcept
+      : calc_(&calc), in_(in), count_(count), units_(u) {}
+
+  Iterator begin() const noexcept { return Iterator(this, 0); }
+  Iterator end() const noexcept { return Iterator(this, count_); }
+
+  size_t size() const noexcept { return count_; }
+  bool empty() const noexcept { return count_ == 0; }
+
+ private:
+  const Calculator* calc_ = nullptr;
+  const Parameters* in_ = nullptr;
+  size_t count_ = 0;
+  Units units_;
+};
+
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_VIEW_H_
@@ -0,0 +1,139 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/approximate_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "spauly/vccore/impl/chart.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+// Every valid duty point lies between these chart positions.
+constexpr double kMinPos = 100.0;
+constexpr double kMaxPos = 500.0;
+
+constexpr uint32_t kCellEmpty = 0;
+constexpr uint32_t kCellFilling = 1;
+constexpr uint32_t kCellReady = 2;
+
+/// The charts whose window contains pos, as one bit each.
+inline int WindowsOf(double pos) noexcept {
+  return static_cast<int>(impl::ChartValidQ(pos)) |
+         static_cast<int>(impl::ChartValidEta(pos)) << 1 |
+         static_cast<int>(impl::ChartValidH(pos)) << 2;
+}
+
+inline std::array<double, 6> ExactAt(double pos) noexcept {
+  CorrectionFactors cf;
+  impl::ChartFactors(pos, cf);
+  return {cf.q, cf.eta, cf.h[0], cf.h[1], cf.h[2], cf.h[3]};
+}
+
+}  // namespace
+
+ApproximateCache::ApproximateCache(double tolerance, double step)
+    : tolerance_(tolerance),
+      step_(step > 0 ? step : kDefaultApproximateStep),
+      cell_count_(static_cast<size_t>(std::ceil((kMaxPos - kMinPos) / step_))),
+      cells_(new Cell[cell_count_]) {}
+
+CorrectionFactors ApproximateCache::Calculate(const Parameters& p,
+                                              const Units& u) noexcept {
+  CorrectionFactors out;
+  const Parameters p_base = (u != kStandardUnits) ? impl::ChartConvert(p, u)
+                                                  : p;
+
+  out.error_flag = impl::ChartValidate(p_base);
+  if (out.error_flag != 0) return out;
+
+  Resolve(impl::ChartPosition(p_base), out);
+  return out;
+}
+
+void ApproximateCache::Calculate(const Parameters* in, CorrectionFactors* out,
+                                 size_t count, const Units& u) noexcept {
+  for (size_t i = 0; i < count; i++) out[i] = Calculate(in[i], u);
+}
+
+void ApproximateCache::Resolve(DoubleT pos, CorrectionFactors& out) noexcept {
+  const double offset = (pos - kMinPos) / step_;
+  if (!(offset >= 0) || offset >= static_cast<double>(cell_count_)) {
+    impl::ChartFactors(pos, out);
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const size_t index = static_cast<size_t>(offset);
+  Cell& cell = cells_[index];
+  uint32_t state = cell.state.load(std::memory_order_acquire);
+
+  if (state == kCellEmpty &&
+      cell.state.compare_exchange_strong(state, kCellFilling,
+                                         std::memory_order_acquire)) {
+    Fill(cell, kMinPos + static_cast<double>(index) * step_);
+    cell.state.store(kCellReady, std::memory_order_release);
+    state = kCellReady;
+  }
+
+  if (state != kCellReady || !cell.interpolate || cell.error > tolerance_) {
+    impl::ChartFactors(pos, out);
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const double t = offset - static_cast<double>(index);
+  Factors f;
+  for (size_t i = 0; i < f.size(); i++) {
+    f[i] = cell.lo[i] + t * (cell.hi[i] - cell.lo[i]);
+  }
+  out.q = f[0];
+  out.eta = f[1];
+  out.h = {f[2], f[3], f[4], f[5]};
+
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  double max_error = max_error_.load(std::memory_order_relaxed);
+  while (cell.error > max_error &&
+         !max_error_.compare_exchange_weak(max_error, cell.error,
+                                           std::memory_order_relaxed)) {
+  }
+}
+
+void ApproximateCache::Fill(Cell& cell, double lo_pos) noexcept {
+  const double hi_pos = lo_pos + step_;
+  cell.lo = ExactAt(lo_pos);
+  cell.hi = ExactAt(hi_pos);
+
+  // A cutoff inside the cell makes the factors jump, never interpolate
+  // across it.
+  cell.interpolate = WindowsOf(lo_pos) == WindowsOf(hi_pos);
+  if (!cell.interpolate) return;
+
+  const Factors mid = ExactAt(lo_pos + 0.5 * step_);
+  cell.error = 0;
+  for (size_t i = 0; i < mid.size(); i++) {
+    cell.error = std::max(cell.error,
+                          std::fabs(mid[i] - 0.5 * (cell.lo[i] + cell.hi[i])));
+  }
+}
+
+}  // namespace vccore
+}  // namespace spauly
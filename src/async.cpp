@@ -0,0 +1,106 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/async.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace spauly {
+namespace vccore {
+
+struct BatchHandle::State {
+  Executor* executor = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  std::vector<std::function<void()>> continuations;
+
+  /// Marks the work as finished and schedules the waiting continuations.
+  void Complete() {
+    std::vector<std::function<void()>> next;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      next.swap(continuations);
+    }
+    cv.notify_all();
+
+    for (auto& continuation : next) Schedule(std::move(continuation));
+  }
+
+  void Schedule(std::function<void()> task) {
+    if (executor != nullptr) {
+      executor->Post(std::move(task));
+    } else {
+      task();
+    }
+  }
+};
+
+BatchHandle BatchHandle::Post(Executor* executor, std::function<void()> work) {
+  auto state = std::make_shared<State>();
+  state->executor = executor;
+
+  state->Schedule([state, work = std::move(work)]() {
+    work();
+    state->Complete();
+  });
+
+  return BatchHandle(state);
+}
+
+bool BatchHandle::IsReady() const noexcept {
+  if (!state_) return true;
+
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->done;
+}
+
+void BatchHandle::Wait() const noexcept {
+  if (!state_) return;
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->cv.wait(lock, [this]() { return state_->done; });
+}
+
+BatchHandle BatchHandle::Then(std::function<void()> continuation) const {
+  auto next = std::make_shared<State>();
+  next->executor = state_ ? state_->executor : nullptr;
+
+  std::function<void()> task = [next,
+                                continuation = std::move(continuation)]() {
+    continuation();
+    next->Complete();
+  };
+
+  if (state_) {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    if (!state_->done) {
+      state_->continuations.push_back(std::move(task));
+      return BatchHandle(next);
+    }
+  }
+
+  next->Schedule(std::move(task));
+  return BatchHandle(next);
+}
+
+}  // namespace vccore
+}  // namespace spauly
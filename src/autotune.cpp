@@ -0,0 +1,301 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/autotune.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "spauly/vccore/approximate_cache.h"
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/impl/formula.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+// The profile is a small text file:
+//   vccore-profile 1
+//   <fingerprint>
+//   <key> <value>...    one line per field of TuneProfile
+constexpr const char* kMagic = "vccore-profile 1";
+
+/// Grains tried with more than one thread.
+constexpr size_t kTuneGrains[] = {256, 1024, 4096, 16384};
+
+/// ApproximateCache cell widths tried if max_error allows interpolation.
+constexpr double kTuneSteps[] = {0.05, 0.1, 0.2};
+
+/// Batch settings of one candidate besides threads and grain.
+struct Variant {
+  ExecutionMode mode;
+  double step;
+};
+
+/// Difference of two factors. NaN only matches NaN in the same field.
+double Difference(double a, double b) {
+  if (std::isnan(a) || std::isnan(b)) {
+    return std::isnan(a) && std::isnan(b)
+               ? 0.0
+               : std::numeric_limits<double>::infinity();
+  }
+  return std::fabs(a - b);
+}
+
+double MaxDifference(const CorrectionFactors& a, const CorrectionFactors& b) {
+  if (a.error_flag != b.error_flag) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double diff = std::max(Difference(a.q, b.q), Difference(a.eta, b.eta));
+  for (size_t j = 0; j < a.h.size(); j++) {
+    diff = std::max(diff, Difference(a.h[j], b.h[j]));
+  }
+  return diff;
+}
+
+/// 1, the powers of two below max_threads and max_threads.
+std::vector<size_t> ThreadCounts(size_t max_threads) {
+  std::vector<size_t> counts{1};
+  for (size_t t = 2; t < max_threads; t *= 2) counts.push_back(t);
+  if (max_threads > 1) counts.push_back(max_threads);
+  return counts;
+}
+
+}  // namespace
+
+std::string HostFingerprint() {
+  std::string fingerprint =
+      "cores=" + std::to_string(std::thread::hardware_concurrency());
+#if defined(VCCORE_FORMULA_SSE2)
+  fingerprint += " isa=sse2";
+#else
+  fingerprint += " isa=scalar";
+#endif
+  return fingerprint;
+}
+
+TuneProfile Autotune(const Calculator& calc, const Parameters* sample,
+                     size_t count, const TuneOptions& options) {
+  size_t max_threads = options.max_threads;
+  if (max_threads == 0) {
+    max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+  const int repeat = std::max(1, options.repeat);
+
+  BatchOptions reference_options;
+  reference_options.engine = options.engine;
+  std::vector<CorrectionFactors> reference(count);
+  calc.Calculate(sample, reference.data(), count, kStandardUnits,
+                 reference_options);
+
+  std::vector<Variant> variants{{ExecutionMode::kReproducible, 0}};
+  if (options.max_error > 0) {
+    variants.push_back({ExecutionMode::kFast, 0});
+    if (options.engine.engine == Engine::kChart) {
+      for (double step : kTuneSteps) {
+        variants.push_back({ExecutionMode::kFast, step});
+      }
+    }
+  }
+
+  TuneProfile best;
+  best.fingerprint = HostFingerprint();
+  best.accuracy = options.max_error;
+  best.engine = options.engine;
+
+  std::vector<CorrectionFactors> out(count);
+  for (size_t threads : ThreadCounts(max_threads)) {
+    // The calling thread takes part, the pool needs one worker less.
+    std::unique_ptr<ThreadPoolExecutor> pool;
+    if (threads > 1) pool = std::make_unique<ThreadPoolExecutor>(threads - 1);
+
+    for (const Variant& variant : variants) {
+      for (size_t grain : kTuneGrains) {
+        if (threads == 1) grain = kDefaultGrain;
+
+        std::unique_ptr<ApproximateCache> approximate;
+        if (variant.step > 0) {
+          approximate = std::make_unique<ApproximateCache>(options.max_error,
+                                                           variant.step);
+        }
+        BatchOptions batch(pool.get(), grain);
+        batch.mode = variant.mode;
+        batch.engine = options.engine;
+        batch.approximate = approximate.get();
+
+        // The first run also fills the approximate cache, the timed runs
+        // measure the steady state of a long batch.
+        calc.Calculate(sample, out.data(), count, kStandardUnits, batch);
+        double error = 0;
+        for (size_t i = 0; i < count; i++) {
+          error = std::max(error, MaxDifference(out[i], reference[i]));
+        }
+        if (error > options.max_error) {
+          if (threads == 1) break;
+          continue;
+        }
+
+        double seconds = 0;
+        for (int r = 0; r < repeat; r++) {
+          auto start = std::chrono::steady_clock::now();
+          calc.Calculate(sample, out.data(), count, kStandardUnits, batch);
+          std::chrono::duration<double> elapsed =
+              std::chrono::steady_clock::now() - start;
+          if (r == 0 || elapsed.count() < seconds) seconds = elapsed.count();
+        }
+        const double rows_per_second =
+            static_cast<double>(count) / std::max(seconds, 1e-9);
+
+        if (best.rows_per_second == 0 ||
+            rows_per_second > best.rows_per_second * (1.0 + kTuneMargin)) {
+          best.mode = variant.mode;
+          best.grain = grain;
+          best.threads = threads;
+          best.approximate_step = variant.step;
+          best.approximate_tolerance = variant.step > 0 ? options.max_error : 0;
+          best.error = error;
+          best.rows_per_second = rows_per_second;
+        }
+
+        // The grain only matters if the chunks run on several threads.
+        if (threads == 1) break;
+      }
+    }
+  }
+  return best;
+}
+
+TuneProfile Autotune(const Calculator& calc, const TuneOptions& options) {
+  std::vector<Parameters> sample(options.rows);
+  for (size_t i = 0; i < sample.size(); i++) {
+    sample[i] = Parameters(6.0 + static_cast<double>(i % 1994),
+                           5.0 + static_cast<double>(i % 195),
+                           10.0 + static_cast<double>(i % 3990));
+  }
+  return Autotune(calc, sample.data(), sample.size(), options);
+}
+
+bool SaveProfile(const TuneProfile& profile, const std::string& path) {
+  std::ostringstream text;
+  text.precision(17);
+  text << kMagic << '\n'
+       << profile.fingerprint << '\n'
+       << "accuracy " << profile.accuracy << '\n'
+       << "engine " << static_cast<int>(profile.engine.engine) << ' '
+       << profile.engine.speed << '\n'
+       << "mode " << static_cast<int>(profile.mode) << '\n'
+       << "grain " << profile.grain << '\n'
+       << "threads " << profile.threads << '\n'
+       << "approximate " << profile.approximate_step << ' '
+       << profile.approximate_tolerance << '\n'
+       << "error " << profile.error << '\n'
+       << "rows_per_second " << profile.rows_per_second << '\n';
+  const std::string data = text.str();
+
+  const std::string tmp = path + ".tmp";
+  File file;
+  if (!file.Open(tmp, File::OpenMode::kWrite) ||
+      file.WriteAt(data.data(), data.size(), 0) !=
+          static_cast<int64_t>(data.size()) ||
+      !file.Sync()) {
+    return false;
+  }
+  file.Close();
+  return AtomicReplaceFile(tmp, path);
+}
+
+bool LoadProfile(const std::string& path, TuneProfile& profile) {
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line) || line != kMagic) return false;
+  if (!std::getline(in, line) || line != HostFingerprint()) return false;
+
+  TuneProfile loaded;
+  loaded.fingerprint = line;
+  int engine = -1;
+  int mode = -1;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    fields >> key;
+    if (key == "accuracy") {
+      fields >> loaded.accuracy;
+    } else if (key == "engine") {
+      fields >> engine >> loaded.engine.speed;
+    } else if (key == "mode") {
+      fields >> mode;
+    } else if (key == "grain") {
+      fields >> loaded.grain;
+    } else if (key == "threads") {
+      fields >> loaded.threads;
+    } else if (key == "approximate") {
+      fields >> loaded.approximate_step >> loaded.approximate_tolerance;
+    } else if (key == "error") {
+      fields >> loaded.error;
+    } else if (key == "rows_per_second") {
+      fields >> loaded.rows_per_second;
+    }
+    if (!fields) return false;  // A damaged file is treated as no profile.
+  }
+
+  if (engine != static_cast<int>(Engine::kChart) &&
+      engine != static_cast<int>(Engine::kFormula)) {
+    return false;
+  }
+  if (mode != static_cast<int>(ExecutionMode::kReproducible) &&
+      mode != static_cast<int>(ExecutionMode::kFast)) {
+    return false;
+  }
+  if (loaded.grain == 0 || loaded.threads == 0 ||
+      loaded.approximate_step < 0) {
+    return false;
+  }
+  loaded.engine.engine = static_cast<Engine>(engine);
+  loaded.mode = static_cast<ExecutionMode>(mode);
+
+  profile = loaded;
+  return true;
+}
+
+TuneProfile LoadOrAutotune(const std::string& path, const Calculator& calc,
+                           const TuneOptions& options, bool* tuned) {
+  TuneProfile profile;
+  if (LoadProfile(path, profile) && profile.accuracy == options.max_error &&
+      profile.engine.engine == options.engine.engine &&
+      profile.engine.speed == options.engine.speed) {
+    if (tuned != nullptr) *tuned = false;
+    return profile;
+  }
+
+  profile = Autotune(calc, options);
+  SaveProfile(profile, path);
+  if (tuned != nullptr) *tuned = true;
+  return profile;
+}
+
+}  // namespace vccore
+}  // namespace spauly
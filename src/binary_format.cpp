@@ -0,0 +1,182 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/binary_format.h"
+
+#include <cstring>
+
+#include "spauly/vccore/impl/quantize.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+constexpr char kMagic[4] = {'V', 'C', 'C', 'B'};
+
+// Header field offsets.
+constexpr size_t kOffVersion = 4;
+constexpr size_t kOffKind = 6;
+constexpr size_t kOffRecordCount = 8;
+constexpr size_t kOffRecordBytes = 16;
+constexpr size_t kOffBlockRecords = 20;
+constexpr size_t kOffUnits = 24;
+constexpr size_t kOffFirstRecord = 32;
+
+template <typename T>
+void StoreLE(char* out, T value) noexcept {
+  const uint64_t bits = static_cast<uint64_t>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out[i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+  }
+}
+
+template <typename T>
+T LoadLE(const char* in) noexcept {
+  uint64_t value = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    const uint64_t byte = static_cast<unsigned char>(in[i]);
+    value |= byte << (8 * i);
+  }
+  return static_cast<T>(value);
+}
+
+// Doubles go through their bit pattern, so the files are little endian on
+// every host. Compilers turn the byte loops into plain moves on little
+// endian ones.
+inline void StoreDouble(char* out, double value) noexcept {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(double));
+  StoreLE<uint64_t>(out, bits);
+}
+
+inline double LoadDouble(const char* in) noexcept {
+  const uint64_t bits = LoadLE<uint64_t>(in);
+  double value;
+  std::memcpy(&value, &bits, sizeof(double));
+  return value;
+}
+
+}  // namespace
+
+void EncodeHeader(const BinaryHeader& header, char* out) noexcept {
+  std::memset(out, 0, kBinaryHeaderBytes);
+  std::memcpy(out, kMagic, sizeof(kMagic));
+
+  StoreLE<uint16_t>(out + kOffVersion, kBinaryVersion);
+  StoreLE<uint16_t>(out + kOffKind, static_cast<uint16_t>(header.kind));
+  StoreLE<uint64_t>(out + kOffRecordCount, header.record_count);
+  StoreLE<uint32_t>(out + kOffRecordBytes, header.record_bytes);
+  StoreLE<uint32_t>(out + kOffBlockRecords, header.block_records);
+
+  out[kOffUnits + 0] = static_cast<char>(header.units.flowrate);
+  out[kOffUnits + 1] = static_cast<char>(header.units.total_head);
+  out[kOffUnits + 2] = static_cast<char>(header.units.viscosity);
+  out[kOffUnits + 3] = static_cast<char>(header.units.density);
+
+  StoreLE<uint64_t>(out + kOffFirstRecord, header.first_record);
+}
+
+bool DecodeHeader(const char* in, BinaryHeader& header) noexcept {
+  if (std::memcmp(in, kMagic, sizeof(kMagic)) != 0) return false;
+  if (LoadLE<uint16_t>(in + kOffVersion) != kBinaryVersion) return false;
+
+  header.kind = static_cast<RecordKind>(LoadLE<uint16_t>(in + kOffKind));
+  header.record_count = LoadLE<uint64_t>(in + kOffRecordCount);
+  header.record_bytes = LoadLE<uint32_t>(in + kOffRecordBytes);
+  header.block_records = LoadLE<uint32_t>(in + kOffBlockRecords);
+
+  header.units.flowrate = static_cast<FlowrateUnit>(in[kOffUnits + 0]);
+  header.units.total_head = static_cast<HeadUnit>(in[kOffUnits + 1]);
+  header.units.viscosity = static_cast<ViscosityUnit>(in[kOffUnits + 2]);
+  header.units.density = static_cast<DensityUnit>(in[kOffUnits + 3]);
+
+  header.first_record = LoadLE<uint64_t>(in + kOffFirstRecord);
+
+  if (header.block_records == 0) return false;
+
+  switch (header.kind) {
+    case RecordKind::kInput:
+    case RecordKind::kResult:
+    case RecordKind::kResultQ16:
+      return header.record_bytes == RecordBytes(header.kind);
+    default:
+      return false;
+  }
+}
+
+void EncodeInputRecords(const Parameters* in, size_t count,
+                        char* out) noexcept {
+  for (size_t i = 0; i < count; i++, out += kInputRecordBytes) {
+    StoreDouble(out + 0, in[i].flowrate);
+    StoreDouble(out + 8, in[i].total_head);
+    StoreDouble(out + 16, in[i].viscosity);
+    StoreDouble(out + 24, in[i].density);
+  }
+}
+
+void DecodeInputRecords(const char* in, size_t count,
+                        Parameters* out) noexcept {
+  for (size_t i = 0; i < count; i++, in += kInputRecordBytes) {
+    out[i].flowrate = LoadDouble(in + 0);
+    out[i].total_head = LoadDouble(in + 8);
+    out[i].viscosity = LoadDouble(in + 16);
+    out[i].density = LoadDouble(in + 24);
+  }
+}
+
+void EncodeResultRecords(const CorrectionFactors* in, size_t count,
+                         char* out) noexcept {
+  for (size_t i = 0; i < count; i++, out += kResultRecordBytes) {
+    StoreDouble(out + 0, in[i].q);
+    StoreDouble(out + 8, in[i].eta);
+    for (size_t j = 0; j < 4; j++) StoreDouble(out + 16 + 8 * j, in[i].h[j]);
+    StoreLE<uint64_t>(out + 48, static_cast<uint64_t>(in[i].error_flag));
+  }
+}
+
+void DecodeResultRecords(const char* in, size_t count,
+                         CorrectionFactors* out) noexcept {
+  for (size_t i = 0; i < count; i++, in += kResultRecordBytes) {
+    out[i].q = LoadDouble(in + 0);
+    out[i].eta = LoadDouble(in + 8);
+    for (size_t j = 0; j < 4; j++) out[i].h[j] = LoadDouble(in + 16 + 8 * j);
+    out[i].error_flag = static_cast<size_t>(LoadLE<uint64_t>(in + 48));
+  }
+}
+
+void EncodeResultRecords(const CorrectionFactors* in, size_t count,
+                         ResultEncoding encoding, char* out) noexcept {
+  if (encoding == ResultEncoding::kQ16) {
+    impl::QuantizeRecords(in, count, out);
+  } else {
+    EncodeResultRecords(in, count, out);
+  }
+}
+
+void DecodeResultRecords(const char* in, size_t count,
+                         ResultEncoding encoding,
+                         CorrectionFactors* out) noexcept {
+  if (encoding == ResultEncoding::kQ16) {
+    impl::DequantizeRecords(in, count, out);
+  } else {
+    DecodeResultRecords(in, count, out);
+  }
+}
+
+}  // namespace vccore
+}  // namespace spauly
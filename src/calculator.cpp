@@ -17,142 +17,413 @@
 // Contact via <https://github.com/SPauly/ViscoCorrectCore>
 #include "spauly/vccore/calculator.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#include "spauly/vccore/approximate_cache.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/impl/formula.h"
+#include "spauly/vccore/impl/trace.h"
+#include "spauly/vccore/metrics.h"
+#include "spauly/vccore/result_cache.h"
+
 namespace spauly {
 namespace vccore {
 
+namespace {
+
+/// Rows of a batch range are classified this many at a time.
+constexpr size_t kRegionBlockRows = 256;
+
+/// Region groups the rows of a batch by the branches the calculation takes.
+enum Region : size_t {
+  kRegionOutside,  // Beyond every chart window, all factors are 0 or 1.
+  kRegionPartial,  // Inside some of the chart windows.
+  kRegionInside,   // Inside all chart windows.
+  kRegionCount
+};
+
+inline Region RegionOf(DoubleT pos) noexcept {
+  const int inside = static_cast<int>(impl::ChartValidQ(pos)) +
+                     static_cast<int>(impl::ChartValidEta(pos)) +
+                     static_cast<int>(impl::ChartValidH(pos));
+  if (inside == 3) return kRegionInside;
+  return inside == 0 ? kRegionOutside : kRegionPartial;
+}
+
+inline void TraceCutoffs(DoubleT pos) noexcept {
+  if (!impl::ChartValidQ(pos)) {
+    VCCORE_TRACE2(cutoff, 0, static_cast<int64_t>(pos * 1000));
+  }
+  if (!impl::ChartValidEta(pos)) {
+    VCCORE_TRACE2(cutoff, 1, static_cast<int64_t>(pos * 1000));
+  }
+  if (!impl::ChartValidH(pos)) {
+    VCCORE_TRACE2(cutoff, 2, static_cast<int64_t>(pos * 1000));
+  }
+}
+
+/// Rows beyond every window only select the constants left or right of each
+/// chart.
+void OutsideKernel(const DoubleT* pos, const uint16_t* rows, size_t count,
+                   CorrectionFactors* out) noexcept {
+  for (size_t k = 0; k < count; k++) {
+    const DoubleT x = pos[k];
+    CorrectionFactors& cf = out[rows[k]];
+    cf.q = (x < impl::kChartMinQ) ? 1.0 : 0.0;
+    cf.eta = (x < impl::kChartMinEta) ? 1.0 : 0.0;
+    const double h = (x < impl::kChartMinH) ? 1.0 : 0.0;
+    cf.h = {h, h, h, h};
+    TraceCutoffs(x);
+  }
+}
+
+/// Rows inside every window evaluate all fitted functions without a cutoff,
+/// one factor after another over the compacted positions.
+template <bool kHorner>
+void InsideKernel(const DoubleT* pos, const uint16_t* rows, size_t count,
+                  CorrectionFactors* out) noexcept {
+  for (size_t k = 0; k < count; k++) {
+    out[rows[k]].q =
+        (impl::ChartPolynomialOf<kHorner>(impl::kChartQ, pos[k]) /
+         impl::kPixelsCorrectionScale / 10.0) +
+        0.2;
+  }
+  for (size_t k = 0; k < count; k++) {
+    out[rows[k]].eta =
+        (impl::ChartPolynomialOf<kHorner>(impl::kChartEta, pos[k]) /
+         impl::kPixelsCorrectionScale / 10.0) +
+        0.2;
+  }
+  for (size_t j = 0; j < impl::kChartH.size(); j++) {
+    for (size_t k = 0; k < count; k++) {
+      out[rows[k]].h[j] = (impl::ChartLogistic(impl::kChartH[j], pos[k]) /
+                           impl::kPixelsCorrectionScale / 10) -
+                          0.3;
+    }
+  }
+}
+
+template <bool kHorner>
+void PartialKernel(const DoubleT* pos, const uint16_t* rows, size_t count,
+                   CorrectionFactors* out) noexcept {
+  for (size_t k = 0; k < count; k++) {
+    impl::ChartFactors<kHorner>(pos[k], out[rows[k]]);
+    TraceCutoffs(pos[k]);
+  }
+}
+
+/// Calculates count rows, at most kRegionBlockRows. Every row is validated
+/// and placed on the charts first, then the rows of each region are
+/// compacted and run through the kernel of that region. Gives the same
+/// results as calculating every row on its own unless kHorner is set.
+/// Records a DiagnosticEvent for every flagged or cut off row, in row order,
+/// if diagnostics is set. first_row is the batch index of in[0]. Returns the
+/// number of cut off rows if diagnostics or count_cutoffs is set, else 0.
+template <bool kHorner>
+size_t CalculateRegions(const Parameters* in, CorrectionFactors* out,
+                        size_t count, const Units& u,
+                        DiagnosticsChannel* diagnostics, uint64_t first_row,
+                        bool count_cutoffs) noexcept {
+  DoubleT pos[kRegionCount][kRegionBlockRows];
+  uint16_t rows[kRegionCount][kRegionBlockRows];
+  size_t sizes[kRegionCount] = {};
+  DoubleT row_pos[kRegionBlockRows];
+
+  const bool convert = u != kStandardUnits;
+  for (size_t i = 0; i < count; i++) {
+    const Parameters p = convert ? impl::ChartConvert(in[i], u) : in[i];
+    CorrectionFactors& cf = out[i];
+    cf.error_flag = impl::ChartValidate(p);
+    cf.error_msg.clear();
+
+    if (cf.error_flag != 0) {
+      cf.q = 0;
+      cf.eta = 0;
+      cf.h = {};
+      row_pos[i] = std::numeric_limits<DoubleT>::quiet_NaN();
+      VCCORE_TRACE1(input_error, cf.error_flag);
+      continue;
+    }
+
+    const DoubleT x = impl::ChartPosition(p);
+    row_pos[i] = x;
+    const Region region = RegionOf(x);
+    pos[region][sizes[region]] = x;
+    rows[region][sizes[region]] = static_cast<uint16_t>(i);
+    sizes[region]++;
+  }
+
+  OutsideKernel(pos[kRegionOutside], rows[kRegionOutside],
+                sizes[kRegionOutside], out);
+  PartialKernel<kHorner>(pos[kRegionPartial], rows[kRegionPartial],
+                sizes[kRegionPartial], out);
+  InsideKernel<kHorner>(pos[kRegionInside], rows[kRegionInside],
+                        sizes[kRegionInside], out);
+
+  if (diagnostics == nullptr && !count_cutoffs) return 0;
+  size_t cutoffs = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t flags = static_cast<uint32_t>(out[i].error_flag);
+    if (impl::ChartCutoff(row_pos[i])) {
+      flags |= ErrorFlag::kCalculationOOR;
+      cutoffs++;
+    }
+    if (diagnostics != nullptr && flags != 0) {
+      diagnostics->Record(DiagnosticEvent{first_row + i, flags,
+                                          static_cast<float>(row_pos[i])});
+    }
+  }
+  return cutoffs;
+}
+
+/// Counts the cut off rows of chart results that carry no chart position.
+/// The eta window ends first and eta stays above 0.2 inside it, so a valid
+/// row is cut off exactly if its eta is 0.
+size_t CountCutoffs(const CorrectionFactors* out, size_t count) noexcept {
+  size_t cutoffs = 0;
+  for (size_t i = 0; i < count; i++) {
+    cutoffs += out[i].error_flag == 0 && out[i].eta == 0;
+  }
+  return cutoffs;
+}
+
+}  // namespace
+
 CorrectionFactors Calculator::Calculate(const Parameters& p,
                                         const Units& u) const noexcept {
+  DoubleT pos_main;
+  return Calculate(p, u, pos_main);
+}
+
+CorrectionFactors Calculator::Calculate(
+    const Parameters& p, const Units& u,
+    const EngineOptions& engine) const noexcept {
+  if (engine.engine == Engine::kFormula) {
+    return impl::FormulaCalculate(p, u, engine.speed);
+  }
+  return Calculate(p, u);
+}
+
+CorrectionFactors Calculator::Calculate(const Parameters& p, const Units& u,
+                                        DoubleT& pos_main) const noexcept {
   CorrectionFactors out;
   Parameters p_base = p;
+  pos_main = std::numeric_limits<DoubleT>::quiet_NaN();
 
   // Check if we need to convert the input values to the base units.
   if (u != kStandardUnits) p_base = GetConverted(p, u);
 
   // Validate the Input
   out.error_flag = ValidateInput(p_base);
-  if (out.error_flag != 0) return out;
-
-  // Map the input values to the scales.
-  double flow_pos = FitToScale(kFlowrateScale, p_base.flowrate, 0);
-  double head_pos =
-      FitToScale(kTotalHeadScale, p_base.total_head,
-                 kStartTotalH.at(1));  // head_pos is on the y-axis so we take
-                                       // this is start coordinate.
-  double visc_pos =
-      FitToScale(kViscoScale, p_base.viscosity,
-                 kStartVisco.at(0));  // visc_pos is on the x-axis so we take
-                                      // this is start coordinate.
-
-  // Create linear functions for totalhead and viscosity.
-  impl::LinearFunc<DoubleT> head_func(
-      kPitchTotalH, static_cast<DoubleT>(kStartTotalH.at(0)), head_pos);
-  impl::LinearFunc<DoubleT> visc_func(kPitchVisco, visc_pos,
-                                      static_cast<DoubleT>(kStartVisco.at(1)));
-
-  // Calculate the correction x position.
-  DoubleT pos_main = visc_func.SolveForX(
-      head_func(flow_pos));  // Get the position of the intersection point of
-                             // the two lines.
-
-  // Calculate the correction factors.
-  // Take the function value  of the correction function at the calculated
-  // pos_main position. Get the relative value by deviding by the scale and add
-  // the offset.
-  if (ValidateXQ(pos_main)) {
-    out.q = (kFuncQ(pos_main) / kPixelsCorrectionScale / 10.0) + 0.2;
-  } else {
-    out.q = (pos_main < 242) ? 1.0 : 0.0;  // 242 is the lower cutoff value.
+  if (out.error_flag != 0) {
+    VCCORE_TRACE1(input_error, out.error_flag);
+    return out;
   }
 
-  if (ValidateXEta(pos_main)) {
-    out.eta = (kFuncEta(pos_main) / kPixelsCorrectionScale / 10.0) + 0.2;
+  pos_main = impl::ChartPosition(p_base);
+  impl::ChartFactors(pos_main, out);
+  TraceCutoffs(pos_main);
+
+  return out;
+}
+
+template <typename Task>
+void Calculator::RunBatch(size_t count, const BatchOptions& options,
+                          const Task& task) const noexcept {
+  if (count == 0) return;
+
+  ProgressSink* progress = options.progress;
+  if (progress != nullptr) progress->AddTotal(count);
+
+  VCCORE_TRACE2(batch_start, count, options.grain);
+
+  const auto start = options.metrics != nullptr
+                         ? std::chrono::steady_clock::now()
+                         : std::chrono::steady_clock::time_point();
+
+  if (options.executor == nullptr && options.cancel == nullptr &&
+      progress == nullptr) {
+    task(0, count);
   } else {
-    out.eta = (pos_main < 122) ? 1.0 : 0.0;  // 122 is the lower cutoff value.
+    // Cancellation and progress work per chunk, so even a batch on the
+    // calling thread is split.
+    SequentialExecutor sequential;
+    Executor* executor =
+        options.executor != nullptr ? options.executor : &sequential;
+
+    // Keep the chunks aligned to whole blocks.
+    executor->ParallelFor(
+        count, BlockAlignedGrain(options.grain),
+        [&task, &options, progress](size_t begin, size_t end) {
+          if (options.IsCancelled()) return;
+          task(begin, end);
+          if (progress != nullptr) progress->AddDone(end - begin);
+        });
   }
 
-  if (ValidateXH(pos_main)) {
-    for (int i = 0; i < kFuncH.size(); i++) {
-      out.h.at(i) =
-          (kFuncH.at(i)(pos_main) / kPixelsCorrectionScale / 10) - 0.3;
-    }
-  } else {
-    for (int i = 0; i < kFuncH.size(); i++) {
-      out.h.at(i) = (pos_main < 146.0) ? 1.0 : 0.0;
-    }
+  VCCORE_TRACE1(batch_end, count);
+
+  if (options.metrics != nullptr) {
+    options.metrics->RecordBatch(
+        count, std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+                   .count());
   }
+}
+
+void Calculator::Calculate(const Parameters* in, CorrectionFactors* out,
+                           size_t count, const Units& u,
+                           const BatchOptions& options) const noexcept {
+  RunBatch(count, options, [this, in, out, &u, &options](size_t begin,
+                                                         size_t end) {
+    CalculateRange(in, out, begin, end, u, options);
+  });
+}
+
+void Calculator::Calculate(const StridedInput& in, const StridedOutput& out,
+                           size_t count, const Units& u,
+                           const BatchOptions& options) const noexcept {
+  RunBatch(count, options, [this, &in, &out, &u, &options](size_t begin,
+                                                           size_t end) {
+    Parameters block_in[kStridedBlockRows];
+    CorrectionFactors block_out[kStridedBlockRows];
+
+    // Diagnostics report the rows of the batch, not of the block.
+    BatchOptions block_options = options;
+    for (size_t row = begin; row < end; row += kStridedBlockRows) {
+      const size_t n = std::min(kStridedBlockRows, end - row);
+      block_options.first_row = options.first_row + row;
+      if (options.row_flags != nullptr) {
+        block_options.row_flags = options.row_flags + row;
+      }
 
+      in.Gather(row, n, block_in);
+      CalculateRange(block_in, block_out, 0, n, u, block_options);
+      out.Scatter(row, n, block_out);
+    }
+  });
+}
+
+std::vector<CorrectionFactors> Calculator::Calculate(
+    const std::vector<Parameters>& in, const Units& u,
+    const BatchOptions& options) const {
+  std::vector<CorrectionFactors> out(in.size());
+  Calculate(in.data(), out.data(), in.size(), u, options);
   return out;
 }
 
+BatchHandle Calculator::CalculateAsync(const Parameters* in,
+                                       CorrectionFactors* out, size_t count,
+                                       const Units& u,
+                                       const BatchOptions& options) const {
+  return BatchHandle::Post(options.executor, [this, in, out, count, u,
+                                              options]() {
+    Calculate(in, out, count, u, options);
+  });
+}
+
+BatchHandle Calculator::CalculateAsync(const Parameters* in,
+                                       CorrectionFactors* out, size_t count,
+                                       const Units& u,
+                                       const BatchOptions& options,
+                                       std::function<void()> on_done) const {
+  return CalculateAsync(in, out, count, u, options).Then(std::move(on_done));
+}
+
 Parameters Calculator::GetConverted(const Parameters& p,
                                     const Units& u) const noexcept {
-  Parameters out;
-
-  // Set all converted values, the units can be left standard initialized.
-  out.flowrate = impl::ConvertToBaseUnit<FlowrateUnit>(
-      impl::DoubleT(p.flowrate), u.flowrate);
-  out.total_head = impl::ConvertToBaseUnit<HeadUnit>(
-      impl::DoubleT(p.total_head), u.total_head);
-  out.viscosity =
-      impl::ConvertViscosityTomm2s(impl::DoubleT(p.viscosity), u.viscosity,
-                                   impl::DoubleT(p.density), u.density);
-  out.density =
-      impl::ConvertToBaseUnit<DensityUnit>(impl::DoubleT(p.density), u.density);
-
-  return out;
+  return impl::ChartConvert(p, u);
 }
 
 const size_t Calculator::ValidateInput(const Parameters& p) const noexcept {
-  size_t errors = 0;
+  return impl::ChartValidate(p);
+}
 
-  if (p.flowrate < 6 || p.flowrate > 2000) {
-    errors |= ErrorFlag::kFlowrateError;
-  }
+void Calculator::CalculateRange(const Parameters* in, CorrectionFactors* out,
+                                size_t begin, size_t end, const Units& u,
+                                const BatchOptions& options) const noexcept {
+  VCCORE_TRACE2(chunk, begin, end);
+  const size_t* row_flags = options.row_flags;
+  size_t cutoffs = 0;
+  if (row_flags == nullptr) {
+    cutoffs = CalculateRun(in, out, begin, end, u, options);
+  } else {
+    // Flagged rows are rare, the runs between them are calculated as usual.
+    size_t run = begin;
+    for (size_t i = begin; i < end; i++) {
+      if (row_flags[i] == 0) continue;
+      if (run < i) cutoffs += CalculateRun(in, out, run, i, u, options);
+      run = i + 1;
 
-  if (p.total_head < 5 || p.total_head > 200) {
-    errors |= ErrorFlag::kTotalHeadError;
+      out[i] = CorrectionFactors();
+      out[i].error_flag = row_flags[i];
+      if (options.diagnostics != nullptr) {
+        options.diagnostics->Record(DiagnosticEvent{
+            options.first_row + i, static_cast<uint32_t>(row_flags[i]),
+            std::numeric_limits<float>::quiet_NaN()});
+      }
+    }
+    if (run < end) cutoffs += CalculateRun(in, out, run, end, u, options);
   }
 
-  if (p.viscosity < 10 || p.viscosity > 4000) {
-    errors |= ErrorFlag::kViscosityError;
+  if (options.metrics != nullptr) {
+    options.metrics->RecordFlags(out + begin, end - begin);
+    // Chart results never carry kCalculationOOR, count their cutoffs here.
+    options.metrics->RecordCutoffs(cutoffs);
   }
-
-  return errors;
 }
 
-const double Calculator::FitToScale(
-    const std::map<const int, const int>& raw_scale, const double& input,
-    const int start_pos) const noexcept {
-  double absolute_position = static_cast<double>(start_pos);
-  double prev_value = 0;
-  double curr_value = 0;
-  bool bfound = false;
-
-  for (const auto& [key, distpixels] : raw_scale) {
-    curr_value = static_cast<double>(key);
-
-    if (curr_value == input) {
-      absolute_position += static_cast<double>(distpixels);
-      bfound = true;
-      break;
-    } else if (curr_value > input) {
-      double range = curr_value - prev_value;
-      double relative_value = input - prev_value;
+size_t Calculator::CalculateRun(const Parameters* in, CorrectionFactors* out,
+                                size_t begin, size_t end, const Units& u,
+                                const BatchOptions& options) const noexcept {
+  // Cached rows carry no chart position, so diagnostics bypass the caches.
+  DiagnosticsChannel* diagnostics = options.diagnostics;
+  Metrics* metrics = options.metrics;
+  size_t cutoffs = 0;
 
-      absolute_position +=
-          (relative_value / range) * static_cast<double>(distpixels);
-      bfound = true;
-      break;
+  if (options.engine.engine == Engine::kFormula) {
+    // The caches hold chart results, so the formula bypasses them.
+    const DoubleT speed = options.engine.speed;
+    if (options.mode == ExecutionMode::kFast) {
+      impl::FormulaBlock(in + begin, out + begin, end - begin, u, speed);
+    } else {
+      for (size_t i = begin; i < end; i++) {
+        out[i] = impl::FormulaCalculate(in[i], u, speed);
+      }
+    }
+    if (diagnostics != nullptr) {
+      for (size_t i = begin; i < end; i++) {
+        if (out[i].error_flag == 0) continue;
+        diagnostics->Record(DiagnosticEvent{
+            options.first_row + i, static_cast<uint32_t>(out[i].error_flag),
+            std::numeric_limits<float>::quiet_NaN()});
+      }
+    }
+  } else if (options.approximate != nullptr && diagnostics == nullptr &&
+             options.mode == ExecutionMode::kFast) {
+    options.approximate->Calculate(in + begin, out + begin, end - begin, u);
+    if (metrics != nullptr) cutoffs = CountCutoffs(out + begin, end - begin);
+  } else if (options.cache != nullptr && diagnostics == nullptr) {
+    options.cache->Calculate(*this, in + begin, out + begin, end - begin, u);
+    if (metrics != nullptr) cutoffs = CountCutoffs(out + begin, end - begin);
+  } else if (options.mode == ExecutionMode::kFast) {
+    for (size_t i = begin; i < end; i += kRegionBlockRows) {
+      cutoffs += CalculateRegions<true>(
+          in + i, out + i, std::min(kRegionBlockRows, end - i), u,
+          diagnostics, options.first_row + i, metrics != nullptr);
+    }
+  } else {
+    for (size_t i = begin; i < end; i += kRegionBlockRows) {
+      cutoffs += CalculateRegions<false>(
+          in + i, out + i, std::min(kRegionBlockRows, end - i), u,
+          diagnostics, options.first_row + i, metrics != nullptr);
     }
-
-    absolute_position += static_cast<double>(distpixels);
-    prev_value = curr_value;
   }
 
-  if (bfound)
-    return absolute_position;
-  else
-    return -1.0f;
+  return cutoffs;
 }
 
 }  // namespace vccore
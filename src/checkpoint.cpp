@@ -0,0 +1,174 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/checkpoint.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "spauly/vccore/file_io.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+// The checkpoint is a small text file:
+//   vccore-checkpoint 1
+//   <fingerprint>
+//   <first> <last>      one line per range of completed chunks
+constexpr const char* kMagic = "vccore-checkpoint 1";
+
+}  // namespace
+
+Checkpoint::Checkpoint(std::string path, std::string fingerprint,
+                       double interval_seconds)
+    : path_(std::move(path)),
+      fingerprint_(std::move(fingerprint)),
+      interval_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(interval_seconds))) {}
+
+bool Checkpoint::Load() {
+  ranges_.clear();
+  if (!IsEnabled()) return false;
+
+  std::ifstream in(path_);
+  std::string line;
+  if (!std::getline(in, line) || line != kMagic) return false;
+  if (!std::getline(in, line) || line != fingerprint_) return false;
+
+  std::vector<Range> ranges;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    Range range;
+    if (!(fields >> range.first >> range.second) ||
+        range.second <= range.first ||
+        (!ranges.empty() && range.first <= ranges.back().second)) {
+      return false;  // A damaged file is treated as no checkpoint.
+    }
+    ranges.push_back(range);
+  }
+
+  ranges_ = std::move(ranges);
+  return true;
+}
+
+bool Checkpoint::Save() {
+  if (!IsEnabled()) return true;
+
+  std::string text = std::string(kMagic) + "\n" + fingerprint_ + "\n";
+  for (const Range& range : ranges_) {
+    text += std::to_string(range.first) + " " + std::to_string(range.second) +
+            "\n";
+  }
+
+  const std::string tmp = path_ + ".tmp";
+  File file;
+  if (!file.Open(tmp, File::OpenMode::kWrite) ||
+      file.WriteAt(text.data(), text.size(), 0) !=
+          static_cast<int64_t>(text.size()) ||
+      !file.Sync()) {
+    return false;
+  }
+  file.Close();
+
+  if (!AtomicReplaceFile(tmp, path_)) return false;
+  last_save_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool Checkpoint::Remove() {
+  return !IsEnabled() || RemoveFile(path_);
+}
+
+void Checkpoint::MarkDone(uint64_t chunk) {
+  // Chunks mostly complete in order, so the search ends near the back.
+  auto it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), chunk,
+      [](uint64_t c, const Range& range) { return c < range.first; });
+
+  if (it != ranges_.begin() && std::prev(it)->second > chunk) return;
+
+  const bool joins_prev =
+      it != ranges_.begin() && std::prev(it)->second == chunk;
+  const bool joins_next = it != ranges_.end() && it->first == chunk + 1;
+
+  if (joins_prev && joins_next) {
+    std::prev(it)->second = it->second;
+    ranges_.erase(it);
+  } else if (joins_prev) {
+    std::prev(it)->second = chunk + 1;
+  } else if (joins_next) {
+    it->first = chunk;
+  } else {
+    ranges_.insert(it, Range(chunk, chunk + 1));
+  }
+}
+
+bool Checkpoint::IsDone(uint64_t chunk) const noexcept {
+  auto it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), chunk,
+      [](uint64_t c, const Range& range) { return c < range.first; });
+  return it != ranges_.begin() && std::prev(it)->second > chunk;
+}
+
+uint64_t Checkpoint::DoneCount() const noexcept {
+  uint64_t count = 0;
+  for (const Range& range : ranges_) count += range.second - range.first;
+  return count;
+}
+
+bool Checkpoint::Due() const noexcept {
+  return IsEnabled() &&
+         std::chrono::steady_clock::now() - last_save_ >= interval_;
+}
+
+bool ParallelForCheckpointed(Executor* executor, size_t count,
+                             size_t chunk_size, Checkpoint& checkpoint,
+                             const Executor::RangeTask& task,
+                             const std::function<bool()>& flush) {
+  SequentialExecutor sequential;
+  if (executor == nullptr) executor = &sequential;
+  if (chunk_size == 0) chunk_size = 1;
+
+  const uint64_t chunks = (count + chunk_size - 1) / chunk_size;
+  std::vector<uint64_t> pending;
+  for (uint64_t k = 0; k < chunks; k++) {
+    if (!checkpoint.IsDone(k)) pending.push_back(k);
+  }
+
+  // Waves of a few chunks per thread keep the barrier between them cheap.
+  const size_t wave = std::max<size_t>(1, executor->Concurrency() * 4);
+  for (size_t first = 0; first < pending.size(); first += wave) {
+    const size_t n = std::min(wave, pending.size() - first);
+    executor->ParallelFor(n, 1, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        const size_t b = static_cast<size_t>(pending[first + i] * chunk_size);
+        task(b, std::min(count, b + chunk_size));
+      }
+    });
+
+    for (size_t i = 0; i < n; i++) checkpoint.MarkDone(pending[first + i]);
+    if (checkpoint.Due() && (!flush() || !checkpoint.Save())) return false;
+  }
+
+  return flush() && checkpoint.Save();
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,116 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/csv.h"
+
+#include <charconv>
+
+#include "spauly/vccore/impl/quantize.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+inline const char* SkipSpace(const char* p, const char* end) noexcept {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+/// Reads one number followed by a comma or the end of the line.
+template <typename T>
+bool ReadField(const char*& p, const char* end, T& out, bool last) noexcept {
+  p = SkipSpace(p, end);
+  auto [ptr, ec] = std::from_chars(p, end, out);
+  if (ec != std::errc() || ptr == p) return false;
+
+  p = SkipSpace(ptr, end);
+  if (last) return p == end;
+  if (p == end || *p != ',') return false;
+  p++;
+  return true;
+}
+
+void AppendNumber(double value, std::string& out, ResultEncoding encoding) {
+  char buffer[32];
+  std::to_chars_result res;
+  if (encoding == ResultEncoding::kQ16) {
+    value = impl::DequantizeFactor(impl::QuantizeFactor(value));
+    res = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                        std::chars_format::fixed, 5);
+  } else {
+    res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  }
+  if (res.ec == std::errc()) out.append(buffer, res.ptr);
+}
+
+}  // namespace
+
+bool IsCsvHeaderOrEmpty(std::string_view line) noexcept {
+  const char* p = SkipSpace(line.data(), line.data() + line.size());
+  if (p == line.data() + line.size()) return true;
+
+  char c = *p;
+  return !((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.');
+}
+
+bool ParseCsvRecord(std::string_view line, Parameters& p) noexcept {
+  const char* it = line.data();
+  const char* end = line.data() + line.size();
+  p = Parameters(0, 0, 0, 0);
+
+  if (!ReadField(it, end, p.flowrate, false)) return false;
+  if (!ReadField(it, end, p.total_head, false)) return false;
+
+  // The density column is optional.
+  const char* rest = it;
+  if (ReadField(it, end, p.viscosity, true)) return true;
+  it = rest;
+  return ReadField(it, end, p.viscosity, false) &&
+         ReadField(it, end, p.density, true);
+}
+
+void AppendCsvResult(const CorrectionFactors& cf, std::string& out,
+                     ResultEncoding encoding) {
+  AppendNumber(cf.q, out, encoding);
+  out.push_back(',');
+  AppendNumber(cf.eta, out, encoding);
+  for (double h : cf.h) {
+    out.push_back(',');
+    AppendNumber(h, out, encoding);
+  }
+  out.push_back(',');
+  size_t flag = encoding == ResultEncoding::kQ16 ? (cf.error_flag & 0xFFFF)
+                                                 : cf.error_flag;
+  out.append(std::to_string(flag));
+  out.push_back('\n');
+}
+
+bool ParseCsvResult(std::string_view line, CorrectionFactors& cf) noexcept {
+  const char* it = line.data();
+  const char* end = line.data() + line.size();
+
+  if (!ReadField(it, end, cf.q, false)) return false;
+  if (!ReadField(it, end, cf.eta, false)) return false;
+  for (double& h : cf.h) {
+    if (!ReadField(it, end, h, false)) return false;
+  }
+  return ReadField(it, end, cf.error_flag, true);
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,163 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/diagnostics.h"
+
+#include <algorithm>
+
+namespace spauly {
+namespace vccore {
+
+/// Single producer, single consumer ring of one recording thread.
+struct DiagnosticsChannel::Ring {
+  explicit Ring(size_t capacity) : events(capacity), mask(capacity - 1) {}
+
+  std::vector<DiagnosticEvent> events;
+  const size_t mask;
+
+  // Written by the recording thread only.
+  alignas(64) std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> dropped{0};
+
+  // Written by the drain only.
+  alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+namespace {
+
+/// Ids tell channels apart even if one is allocated where another was.
+std::atomic<uint64_t> g_next_channel_id{1};
+
+/// One entry cache of the ring the thread used last.
+struct LocalRingCache {
+  uint64_t channel_id = 0;
+  void* ring = nullptr;
+};
+
+thread_local LocalRingCache t_ring_cache;
+
+size_t RoundUpPow2(size_t n) noexcept {
+  size_t pow2 = 1;
+  while (pow2 < n) pow2 <<= 1;
+  return pow2;
+}
+
+}  // namespace
+
+DiagnosticsChannel::DiagnosticsChannel(DiagnosticsSink sink,
+                                       size_t ring_events,
+                                       std::chrono::milliseconds interval)
+    : id_(g_next_channel_id.fetch_add(1, std::memory_order_relaxed)),
+      ring_events_(RoundUpPow2(ring_events == 0 ? 1 : ring_events)),
+      interval_(interval),
+      sink_(std::move(sink)) {
+  drainer_ = std::thread([this] { DrainLoop(); });
+}
+
+DiagnosticsChannel::~DiagnosticsChannel() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  drainer_.join();
+  Drain();
+}
+
+void DiagnosticsChannel::Record(const DiagnosticEvent& event) noexcept {
+  Ring* ring = LocalRing();
+  if (ring == nullptr) return;
+
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  if (head - tail > ring->mask) {
+    ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    return;
+  }
+  ring->events[head & ring->mask] = event;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void DiagnosticsChannel::Flush() { Drain(); }
+
+uint64_t DiagnosticsChannel::Dropped() const noexcept {
+  std::lock_guard<std::mutex> lock(rings_mutex_);
+  uint64_t dropped = 0;
+  for (const auto& ring : rings_) {
+    dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+DiagnosticsChannel::Ring* DiagnosticsChannel::LocalRing() noexcept {
+  if (t_ring_cache.channel_id == id_) {
+    return static_cast<Ring*>(t_ring_cache.ring);
+  }
+
+  try {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    Ring*& ring = by_thread_[std::this_thread::get_id()];
+    if (ring == nullptr) {
+      rings_.push_back(std::make_unique<Ring>(ring_events_));
+      ring = rings_.back().get();
+    }
+    t_ring_cache.channel_id = id_;
+    t_ring_cache.ring = ring;
+    return ring;
+  } catch (...) {
+    return nullptr;  // Out of memory, the event is lost.
+  }
+}
+
+void DiagnosticsChannel::DrainLoop() {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_) {
+    stop_cv_.wait_for(lock, interval_);
+    lock.unlock();
+    Drain();
+    lock.lock();
+  }
+}
+
+void DiagnosticsChannel::Drain() {
+  std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+
+  std::vector<Ring*> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (const auto& ring : rings_) rings.push_back(ring.get());
+  }
+
+  for (Ring* ring : rings) {
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+
+    // At most two contiguous spans, before and after the wrap.
+    while (tail != head) {
+      const size_t begin = static_cast<size_t>(tail & ring->mask);
+      const size_t count = static_cast<size_t>(
+          std::min<uint64_t>(head - tail, ring->events.size() - begin));
+      if (sink_) sink_(ring->events.data() + begin, count);
+      tail += count;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+}
+
+}  // namespace vccore
+}  // namespace spauly
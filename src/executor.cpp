@@ -0,0 +1,192 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#if defined(VCCORE_HAS_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(VCCORE_HAS_PARALLEL_STL)
+#include <execution>
+#include <numeric>
+#endif
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+/// Number of chunks needed to cover count indices.
+inline size_t ChunkCount(size_t count, size_t grain) noexcept {
+  return (count + grain - 1) / grain;
+}
+
+}  // namespace
+
+void SequentialExecutor::ParallelFor(size_t count, size_t grain,
+                                     const RangeTask& task) {
+  if (grain == 0) grain = 1;
+
+  for (size_t begin = 0; begin < count; begin += grain) {
+    task(begin, std::min(begin + grain, count));
+  }
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t threads) {
+  if (threads == 0) {
+    size_t hw = static_cast<size_t>(std::thread::hardware_concurrency());
+    threads = (hw > 1) ? hw - 1 : 0;
+  }
+
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(&ThreadPoolExecutor::WorkerLoop, this);
+  }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+
+  for (auto& worker : workers_) {
+    if (worker.joinable()) worker.join();
+  }
+}
+
+void ThreadPoolExecutor::ParallelFor(size_t count, size_t grain,
+                                     const RangeTask& task) {
+  if (grain == 0) grain = 1;
+  const size_t chunks = ChunkCount(count, grain);
+  if (chunks == 0) return;
+
+  // The shared state outlives this call for helpers that are dequeued late.
+  // Such helpers find no chunk left and never touch the task.
+  struct State {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<State>();
+  const RangeTask* task_ptr = &task;
+
+  auto run_chunks = [state, task_ptr, count, grain, chunks]() {
+    size_t finished = 0;
+    for (size_t c = state->next.fetch_add(1); c < chunks;
+         c = state->next.fetch_add(1)) {
+      size_t begin = c * grain;
+      (*task_ptr)(begin, std::min(begin + grain, count));
+      finished++;
+    }
+
+    if (finished != 0 && state->done.fetch_add(finished) + finished == chunks) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->cv.notify_all();
+    }
+  };
+
+  size_t helpers = std::min(workers_.size(), chunks - 1);
+  for (size_t i = 0; i < helpers; i++) Enqueue(run_chunks);
+
+  run_chunks();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&state, chunks]() { return state->done == chunks; });
+}
+
+void ThreadPoolExecutor::Post(std::function<void()> task) {
+  if (workers_.empty()) {
+    task();
+    return;
+  }
+  Enqueue(std::move(task));
+}
+
+void ThreadPoolExecutor::Enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(task));
+    queued_.store(queue_.size(), std::memory_order_relaxed);
+  }
+  cv_.notify_one();
+}
+
+void ThreadPoolExecutor::WorkerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (stop_ && queue_.empty()) return;
+
+      task = std::move(queue_.front());
+      queue_.pop_front();
+      queued_.store(queue_.size(), std::memory_order_relaxed);
+    }
+    task();
+  }
+}
+
+#if defined(VCCORE_HAS_OPENMP)
+size_t OpenMPExecutor::Concurrency() const noexcept {
+  return static_cast<size_t>(threads_ > 0 ? threads_ : omp_get_max_threads());
+}
+
+void OpenMPExecutor::ParallelFor(size_t count, size_t grain,
+                                 const RangeTask& task) {
+  if (grain == 0) grain = 1;
+  const long long chunks = static_cast<long long>(ChunkCount(count, grain));
+  const int threads = threads_ > 0 ? threads_ : omp_get_max_threads();
+
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+  for (long long c = 0; c < chunks; c++) {
+    size_t begin = static_cast<size_t>(c) * grain;
+    task(begin, std::min(begin + grain, count));
+  }
+}
+#endif  // VCCORE_HAS_OPENMP
+
+#if defined(VCCORE_HAS_PARALLEL_STL)
+size_t ParallelAlgorithmsExecutor::Concurrency() const noexcept {
+  size_t hw = static_cast<size_t>(std::thread::hardware_concurrency());
+  return hw > 0 ? hw : 1;
+}
+
+void ParallelAlgorithmsExecutor::ParallelFor(size_t count, size_t grain,
+                                             const RangeTask& task) {
+  if (grain == 0) grain = 1;
+  std::vector<size_t> chunks(ChunkCount(count, grain));
+  std::iota(chunks.begin(), chunks.end(), size_t(0));
+
+  std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+                [&task, count, grain](size_t c) {
+                  size_t begin = c * grain;
+                  task(begin, std::min(begin + grain, count));
+                });
+}
+#endif  // VCCORE_HAS_PARALLEL_STL
+
+}  // namespace vccore
+}  // namespace spauly
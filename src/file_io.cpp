@@ -0,0 +1,494 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/file_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(VCCORE_HAS_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace spauly {
+namespace vccore {
+
+File::File(File&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+
+File& File::operator=(File&& other) noexcept {
+  if (this != &other) {
+    Close();
+    fd_ = std::exchange(other.fd_, -1);
+  }
+  return *this;
+}
+
+bool File::Open(const std::string& path, OpenMode mode) noexcept {
+  Close();
+
+#if defined(_WIN32)
+  int flags = _O_BINARY;
+  switch (mode) {
+    case OpenMode::kRead:
+      flags |= _O_RDONLY;
+      break;
+    case OpenMode::kWrite:
+      flags |= _O_RDWR | _O_CREAT | _O_TRUNC;
+      break;
+    case OpenMode::kReadWrite:
+      flags |= _O_RDWR | _O_CREAT;
+      break;
+  }
+  fd_ = _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+  int flags = O_CLOEXEC;
+  switch (mode) {
+    case OpenMode::kRead:
+      flags |= O_RDONLY;
+      break;
+    case OpenMode::kWrite:
+      flags |= O_RDWR | O_CREAT | O_TRUNC;
+      break;
+    case OpenMode::kReadWrite:
+      flags |= O_RDWR | O_CREAT;
+      break;
+  }
+  fd_ = open(path.c_str(), flags, 0644);
+#endif
+
+  return fd_ >= 0;
+}
+
+void File::Close() noexcept {
+  if (fd_ < 0) return;
+
+#if defined(_WIN32)
+  _close(fd_);
+#else
+  close(fd_);
+#endif
+  fd_ = -1;
+}
+
+int64_t File::Size() const noexcept {
+#if defined(_WIN32)
+  return static_cast<int64_t>(_filelengthi64(fd_));
+#else
+  struct stat st;
+  if (fstat(fd_, &st) != 0) return -1;
+  return static_cast<int64_t>(st.st_size);
+#endif
+}
+
+int64_t File::ModifiedTime() const noexcept {
+#if defined(_WIN32)
+  struct _stat64 st;
+  if (_fstat64(fd_, &st) != 0) return -1;
+  return static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+  struct stat st;
+  if (fstat(fd_, &st) != 0) return -1;
+#if defined(__APPLE__)
+  const struct timespec& mtime = st.st_mtimespec;
+#else
+  const struct timespec& mtime = st.st_mtim;
+#endif
+  return static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+#endif
+}
+
+int64_t File::ReadAt(void* buffer, size_t size,
+                     uint64_t offset) const noexcept {
+  char* out = static_cast<char*>(buffer);
+  size_t done = 0;
+
+  while (done < size) {
+#if defined(_WIN32)
+    if (_lseeki64(fd_, static_cast<__int64>(offset + done), SEEK_SET) < 0) {
+      return -1;
+    }
+    int got = _read(fd_, out + done, static_cast<unsigned>(size - done));
+#else
+    ssize_t got = pread(fd_, out + done, size - done,
+                        static_cast<off_t>(offset + done));
+    if (got < 0 && errno == EINTR) continue;
+#endif
+    if (got < 0) return -1;
+    if (got == 0) break;  // End of file
+    done += static_cast<size_t>(got);
+  }
+
+  return static_cast<int64_t>(done);
+}
+
+int64_t File::WriteAt(const void* buffer, size_t size,
+                      uint64_t offset) const noexcept {
+  const char* in = static_cast<const char*>(buffer);
+  size_t done = 0;
+
+  while (done < size) {
+#if defined(_WIN32)
+    if (_lseeki64(fd_, static_cast<__int64>(offset + done), SEEK_SET) < 0) {
+      return -1;
+    }
+    int put = _write(fd_, in + done, static_cast<unsigned>(size - done));
+#else
+    ssize_t put = pwrite(fd_, in + done, size - done,
+                         static_cast<off_t>(offset + done));
+    if (put < 0 && errno == EINTR) continue;
+#endif
+    if (put <= 0) return -1;
+    done += static_cast<size_t>(put);
+  }
+
+  return static_cast<int64_t>(done);
+}
+
+bool File::Sync() const noexcept {
+#if defined(_WIN32)
+  return _commit(fd_) == 0;
+#elif defined(__linux__)
+  return fdatasync(fd_) == 0;
+#else
+  return fsync(fd_) == 0;
+#endif
+}
+
+bool AtomicReplaceFile(const std::string& from,
+                       const std::string& to) noexcept {
+#if defined(_WIN32)
+  return MoveFileExA(from.c_str(), to.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  if (std::rename(from.c_str(), to.c_str()) != 0) return false;
+
+  // The rename is only durable once the directory is flushed.
+  std::string dir = ".";
+  size_t slash = to.find_last_of('/');
+  if (slash != std::string::npos) dir = slash == 0 ? "/" : to.substr(0, slash);
+
+  int fd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+#endif
+}
+
+bool RemoveFile(const std::string& path) noexcept {
+  return std::remove(path.c_str()) == 0 || errno == ENOENT;
+}
+
+AlignedBuffer::AlignedBuffer(size_t size) : size_(size) {
+  if (size_ == 0) return;
+
+  // Round up so that the allocation size is a multiple of the alignment.
+  size_t bytes = ((size_ + kIoAlignment - 1) / kIoAlignment) * kIoAlignment;
+  data_ = static_cast<char*>(
+      ::operator new(bytes, std::align_val_t(kIoAlignment)));
+}
+
+AlignedBuffer::~AlignedBuffer() {
+  if (data_ != nullptr) {
+    ::operator delete(data_, std::align_val_t(kIoAlignment));
+  }
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+AlignedBuffer& AlignedBuffer::operator=(AlignedBuffer&& other) noexcept {
+  if (this != &other) {
+    if (data_ != nullptr) {
+      ::operator delete(data_, std::align_val_t(kIoAlignment));
+    }
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+bool SyncIoQueue::Submit(const IoRequest& request) noexcept {
+  IoCompletion completion;
+  completion.tag = request.tag;
+
+#if defined(_WIN32)
+  if (_lseeki64(request.fd, static_cast<__int64>(request.offset), SEEK_SET) <
+      0) {
+    completion.result = -errno;
+  } else if (request.write) {
+    int put = _write(request.fd, request.buffer,
+                     static_cast<unsigned>(request.size));
+    completion.result = put < 0 ? -errno : put;
+  } else {
+    int got = _read(request.fd, request.buffer,
+                    static_cast<unsigned>(request.size));
+    completion.result = got < 0 ? -errno : got;
+  }
+#else
+  ssize_t result;
+  do {
+    result = request.write
+                 ? pwrite(request.fd, request.buffer, request.size,
+                          static_cast<off_t>(request.offset))
+                 : pread(request.fd, request.buffer, request.size,
+                         static_cast<off_t>(request.offset));
+  } while (result < 0 && errno == EINTR);
+  completion.result = result < 0 ? -errno : static_cast<int64_t>(result);
+#endif
+
+  done_.push_back(completion);
+  return true;
+}
+
+bool SyncIoQueue::WaitOne(IoCompletion& completion) noexcept {
+  if (done_.empty()) return false;
+
+  completion = done_.front();
+  done_.pop_front();
+  return true;
+}
+
+#if defined(VCCORE_HAS_IO_URING)
+namespace {
+
+/// io_uring driven through the raw system calls, so no liburing is needed.
+class UringIoQueue : public IoQueue {
+ public:
+  /// Returns nullptr if the kernel refuses to create a ring or does not
+  /// implement the read and write opcodes.
+  static std::unique_ptr<UringIoQueue> Create(unsigned depth) noexcept {
+    std::unique_ptr<UringIoQueue> queue(new (std::nothrow) UringIoQueue());
+    if (!queue || !queue->Setup(depth) || !queue->SupportsReadWrite()) {
+      return nullptr;
+    }
+    return queue;
+  }
+
+  virtual ~UringIoQueue() {
+    if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_ != nullptr) munmap(sq_ptr_, sq_size_);
+    if (ring_fd_ >= 0) close(ring_fd_);
+  }
+
+  virtual bool Submit(const IoRequest& request) noexcept override {
+    if (in_flight_ >= sq_entries_) return false;
+
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = request.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(request.buffer);
+    sqe->len = static_cast<uint32_t>(request.size);
+    sqe->off = request.offset;
+    sqe->user_data = request.tag;
+
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+      ret = Enter(1, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    // Take the entry back unless the kernel consumed it, so a failed submit
+    // is not sent along with the next one.
+    if (ret != 1 && __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == tail) {
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      return false;
+    }
+
+    in_flight_++;
+    return true;
+  }
+
+  virtual bool WaitOne(IoCompletion& completion) noexcept override {
+    if (in_flight_ == 0) return false;
+
+    while (true) {
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+      if (head != tail) {
+        const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        completion.tag = cqe.user_data;
+        completion.result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+        in_flight_--;
+        return true;
+      }
+
+      if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  virtual size_t InFlight() const noexcept override { return in_flight_; }
+  virtual IoBackend Backend() const noexcept override {
+    return IoBackend::kIoUring;
+  }
+
+ private:
+  UringIoQueue() = default;
+
+  int Enter(unsigned to_submit, unsigned min_complete,
+            unsigned flags) noexcept {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                                    min_complete, flags, nullptr, 0));
+  }
+
+  /// IORING_OP_READ and IORING_OP_WRITE came with Linux 5.6, before it the
+  /// requests complete with -EINVAL. IORING_REGISTER_PROBE came along with
+  /// them, so older kernels fail the probe.
+  bool SupportsReadWrite() noexcept {
+    constexpr unsigned kOps = 256;
+    alignas(io_uring_probe) unsigned char
+        buffer[sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op)] = {};
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer);
+
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE,
+                probe, kOps) < 0) {
+      return false;
+    }
+    for (unsigned op : {unsigned{IORING_OP_READ}, unsigned{IORING_OP_WRITE}}) {
+      if (op >= probe->ops_len ||
+          (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Setup(unsigned depth) noexcept {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+    if (ring_fd_ < 0) return false;
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+    sq_ptr_ = Map(sq_size_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == nullptr) return false;
+
+    cq_ptr_ = single_mmap ? sq_ptr_ : Map(cq_size_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == nullptr) return false;
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) return false;
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+
+    char* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+  }
+
+  void* Map(size_t size, off_t offset) noexcept {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  int ring_fd_ = -1;
+
+  void* sq_ptr_ = nullptr;
+  size_t sq_size_ = 0;
+  void* cq_ptr_ = nullptr;
+  size_t cq_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_entries_ = 0;
+
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+
+  size_t in_flight_ = 0;
+};
+
+}  // namespace
+#endif  // VCCORE_HAS_IO_URING
+
+bool IoUringAvailable() noexcept {
+#if defined(VCCORE_HAS_IO_URING)
+  static const bool available = UringIoQueue::Create(2) != nullptr;
+  return available;
+#else
+  return false;
+#endif
+}
+
+std::unique_ptr<IoQueue> MakeIoQueue(IoBackend backend, unsigned depth) {
+#if defined(VCCORE_HAS_IO_URING)
+  if (backend == IoBackend::kIoUring) {
+    auto queue = UringIoQueue::Create(depth > 0 ? depth : 1);
+    if (queue) return queue;
+  }
+#else
+  (void)backend;
+  (void)depth;
+#endif
+  return std::make_unique<SyncIoQueue>();
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,48 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/freestanding.h"
+
+#include "spauly/vccore/impl/chart.h"
+
+namespace spauly {
+namespace vccore {
+
+size_t ValidateCore(const Parameters& p, const Units& u) noexcept {
+  return impl::ChartValidate(u != kStandardUnits ? impl::ChartConvert(p, u)
+                                                 : p);
+}
+
+CoreFactors CalculateCore(const Parameters& p, const Units& u) noexcept {
+  CoreFactors out;
+  const Parameters p_base = (u != kStandardUnits) ? impl::ChartConvert(p, u)
+                                                  : p;
+
+  out.error_flag = impl::ChartValidate(p_base);
+  if (out.error_flag != 0) return out;
+
+  impl::ChartFactors(impl::ChartPosition(p_base), out);
+  return out;
+}
+
+void CalculateCore(const Parameters* in, CoreFactors* out, size_t count,
+                   const Units& u) noexcept {
+  for (size_t i = 0; i < count; i++) out[i] = CalculateCore(in[i], u);
+}
+
+}  // namespace vccore
+}  // namespace spauly
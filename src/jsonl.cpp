@@ -0,0 +1,351 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/jsonl.h"
+
+#include <charconv>
+#include <cstring>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/impl/simd_scan.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+inline const char* SkipSpace(const char* p, const char* end) noexcept {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+/// Returns true if the quote at q is escaped by an odd number of backslashes.
+inline bool IsEscaped(const char* begin, const char* q) noexcept {
+  size_t backslashes = 0;
+  while (q > begin && *(q - 1) == '\\') {
+    backslashes++;
+    q--;
+  }
+  return (backslashes % 2) == 1;
+}
+
+/// Reads the string starting at the opening quote at p. Escapes are kept
+/// verbatim, which is enough to compare keys and unit names.
+bool ParseString(const char*& p, const char* end,
+                 std::string_view& out) noexcept {
+  if (p == end || *p != '"') return false;
+
+  const char* start = p + 1;
+  const char* q = impl::FindByte(start, end, '"');
+  while (q != end && IsEscaped(start, q)) q = impl::FindByte(q + 1, end, '"');
+  if (q == end) return false;
+
+  out = std::string_view(start, static_cast<size_t>(q - start));
+  p = q + 1;
+  return true;
+}
+
+bool ParseNumber(const char*& p, const char* end, DoubleT& out) noexcept {
+  auto [ptr, ec] = std::from_chars(p, end, out);
+  if (ec != std::errc() || ptr == p) return false;
+
+  p = ptr;
+  return true;
+}
+
+/// Skips any JSON value starting at p, including nested objects and arrays.
+bool SkipValue(const char*& p, const char* end) noexcept {
+  if (p == end) return false;
+
+  if (*p == '"') {
+    std::string_view ignored;
+    return ParseString(p, end, ignored);
+  }
+
+  if (*p != '{' && *p != '[') {
+    // Scalars end at the next structural character.
+    p = impl::FindStructural(p, end);
+    return true;
+  }
+
+  int depth = 0;
+  while (p < end) {
+    p = impl::FindStructural(p, end);
+    if (p == end) break;
+
+    if (*p == '"') {
+      std::string_view ignored;
+      if (!ParseString(p, end, ignored)) return false;
+      continue;
+    }
+
+    if (*p == '{' || *p == '[') {
+      depth++;
+    } else if (*p == '}' || *p == ']') {
+      if (--depth == 0) {
+        p++;
+        return true;
+      }
+    }
+    p++;
+  }
+  return false;
+}
+
+template <typename _Unit>
+bool ParseUnitValue(const char*& p, const char* end, _Unit& out) noexcept {
+  std::string_view name;
+  return ParseString(p, end, name) && ParseUnitName(name, out);
+}
+
+}  // namespace
+
+bool ParseUnitName(std::string_view name, FlowrateUnit& out) noexcept {
+  if (name == "m3/h" || name == "m³/h" || name == "m^3/h") {
+    out = FlowrateUnit::kCubicMetersPerHour;
+  } else if (name == "l/min" || name == "lpm") {
+    out = FlowrateUnit::kLitersPerMinute;
+  } else if (name == "gpm") {
+    out = FlowrateUnit::kGallonsPerMinute;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseUnitName(std::string_view name, HeadUnit& out) noexcept {
+  if (name == "m") {
+    out = HeadUnit::kMeters;
+  } else if (name == "ft") {
+    out = HeadUnit::kFeet;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseUnitName(std::string_view name, ViscosityUnit& out) noexcept {
+  if (name == "mm2/s" || name == "mm²/s" || name == "mm^2/s") {
+    out = ViscosityUnit::kSquareMilPerSecond;
+  } else if (name == "cSt") {
+    out = ViscosityUnit::kcSt;
+  } else if (name == "cP") {
+    out = ViscosityUnit::kcP;
+  } else if (name == "mPas" || name == "mPa·s" || name == "mPa*s") {
+    out = ViscosityUnit::kmPas;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseUnitName(std::string_view name, DensityUnit& out) noexcept {
+  if (name == "g/l") {
+    out = DensityUnit::kGramPerLiter;
+  } else if (name == "kg/m3" || name == "kg/m³" || name == "kg/m^3") {
+    out = DensityUnit::kKilogramsPerCubicMeter;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseJsonlRecord(std::string_view line, Parameters& p,
+                      Units& u) noexcept {
+  p = Parameters(0, 0, 0, 0);
+  u = Units();
+
+  const char* it = line.data();
+  const char* end = line.data() + line.size();
+
+  it = SkipSpace(it, end);
+  if (it == end || *it != '{') return false;
+  it = SkipSpace(it + 1, end);
+
+  if (it != end && *it == '}') {
+    it++;
+  } else {
+    while (true) {
+      std::string_view key;
+      if (!ParseString(it, end, key)) return false;
+
+      it = SkipSpace(it, end);
+      if (it == end || *it != ':') return false;
+      it = SkipSpace(it + 1, end);
+
+      bool ok = true;
+      if (key == "flowrate") {
+        ok = ParseNumber(it, end, p.flowrate);
+      } else if (key == "total_head") {
+        ok = ParseNumber(it, end, p.total_head);
+      } else if (key == "viscosity") {
+        ok = ParseNumber(it, end, p.viscosity);
+      } else if (key == "density") {
+        ok = ParseNumber(it, end, p.density);
+      } else if (key == "flowrate_unit") {
+        ok = ParseUnitValue(it, end, u.flowrate);
+      } else if (key == "total_head_unit") {
+        ok = ParseUnitValue(it, end, u.total_head);
+      } else if (key == "viscosity_unit") {
+        ok = ParseUnitValue(it, end, u.viscosity);
+      } else if (key == "density_unit") {
+        ok = ParseUnitValue(it, end, u.density);
+      } else {
+        ok = SkipValue(it, end);
+      }
+      if (!ok) return false;
+
+      it = SkipSpace(it, end);
+      if (it == end) return false;
+      if (*it == ',') {
+        it = SkipSpace(it + 1, end);
+        continue;
+      }
+      if (*it != '}') return false;
+      it++;
+      break;
+    }
+  }
+
+  // Nothing but whitespace may follow the record.
+  return SkipSpace(it, end) == end;
+}
+
+JsonlReader::JsonlReader(std::istream& in, size_t buffer_bytes)
+    : in_(in), buffer_(buffer_bytes > 16 ? buffer_bytes : 16) {}
+
+size_t JsonlReader::Read(Parameters* p, Units* u, size_t* flags,
+                         size_t max_rows) {
+  size_t n = 0;
+
+  while (n < max_rows) {
+    const char* base = buffer_.data();
+    const char* nl = impl::FindByte(base + begin_, base + end_, '\n');
+    std::string_view line;
+
+    if (nl == base + end_) {
+      if (!eof_) {
+        if (begin_ == 0 && end_ == buffer_.size()) {
+          // The line does not fit into the buffer. Report it once and drop
+          // everything up to the next line feed.
+          begin_ = end_ = 0;
+          if (!skipping_) {
+            skipping_ = true;
+            p[n] = Parameters(0, 0, 0, 0);
+            u[n] = Units();
+            flags[n] = ErrorFlag::kParseError;
+            n++;
+            rows_++;
+            malformed_++;
+          }
+        } else {
+          Refill();
+        }
+        continue;
+      }
+
+      // Last line without a line feed.
+      if (begin_ == end_) break;
+      line = std::string_view(base + begin_, end_ - begin_);
+      begin_ = end_;
+    } else {
+      line = std::string_view(base + begin_,
+                              static_cast<size_t>(nl - (base + begin_)));
+      begin_ = static_cast<size_t>(nl - base) + 1;
+    }
+
+    if (skipping_) {
+      skipping_ = false;
+      continue;
+    }
+
+    if (SkipSpace(line.data(), line.data() + line.size()) ==
+        line.data() + line.size()) {
+      continue;
+    }
+
+    if (ParseJsonlRecord(line, p[n], u[n])) {
+      flags[n] = 0;
+    } else {
+      p[n] = Parameters(0, 0, 0, 0);
+      u[n] = Units();
+      flags[n] = ErrorFlag::kParseError;
+      malformed_++;
+    }
+    n++;
+    rows_++;
+  }
+
+  return n;
+}
+
+bool JsonlReader::Refill() {
+  if (begin_ != 0) {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+
+  in_.read(buffer_.data() + end_,
+           static_cast<std::streamsize>(buffer_.size() - end_));
+  size_t got = static_cast<size_t>(in_.gcount());
+  end_ += got;
+
+  if (got == 0) eof_ = true;
+  return got != 0;
+}
+
+size_t CalculateJsonl(const Calculator& calc, std::istream& in,
+                      const BatchSink& sink, const BatchOptions& options,
+                      size_t chunk_rows) {
+  if (chunk_rows == 0) chunk_rows = kDefaultJsonlChunkRows;
+
+  JsonlReader reader(in);
+  std::vector<Parameters> params(chunk_rows);
+  std::vector<Parameters> converted(chunk_rows);
+  std::vector<Units> units(chunk_rows);
+  std::vector<size_t> flags(chunk_rows);
+  std::vector<CorrectionFactors> out(chunk_rows);
+
+  BatchOptions batch = options;
+  size_t first = 0;
+  size_t n = 0;
+  while ((n = reader.Read(params.data(), units.data(), flags.data(),
+                          chunk_rows)) != 0) {
+    // Rows may use different units, convert them so one batch call covers
+    // the whole chunk.
+    for (size_t i = 0; i < n; i++) {
+      converted[i] = (units[i] == kStandardUnits)
+                         ? params[i]
+                         : calc.GetConverted(params[i], units[i]);
+    }
+
+    // Malformed rows are left out of the calculation.
+    batch.first_row = options.first_row + first;
+    batch.row_flags = flags.data();
+    calc.Calculate(converted.data(), out.data(), n, kStandardUnits, batch);
+    if (options.IsCancelled()) break;  // The chunk may be incomplete.
+
+    sink(first, params.data(), out.data(), n);
+    first += n;
+  }
+
+  return first;
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,334 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/metrics.h"
+
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/file_io.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+/// Metric name suffix of every counted ErrorFlag bit.
+constexpr const char* kFlagNames[kErrorFlagCount] = {
+    "flowrate", "total_head", "viscosity", "density", "calculation_oor",
+    "parse"};
+
+/// Bit index of ErrorFlag::kCalculationOOR.
+constexpr size_t kCalculationOORBit = 4;
+static_assert(ErrorFlag::kCalculationOOR == 1 << kCalculationOORBit);
+
+/// Shard index of the calling thread, assigned on first use.
+std::atomic<size_t> g_next_shard{0};
+thread_local size_t t_shard = kMetricsShards;
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+constexpr int MSG_NOSIGNAL = 0;
+#endif
+
+void AppendValue(double value, std::string& out) {
+  char buffer[32];
+  auto res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  if (res.ec == std::errc()) out.append(buffer, res.ptr);
+}
+
+void AppendHeader(const char* name, const char* help, const char* type,
+                  std::string& out) {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+template <size_t N>
+void AppendHistogram(const char* name, const std::array<double, N>& bounds,
+                     const std::array<uint64_t, N + 1>& counts, double sum,
+                     std::string& out) {
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= N; i++) {
+    cumulative += counts[i];
+    out.append(name).append("_bucket{le=\"");
+    if (i < N) {
+      AppendValue(bounds[i], out);
+    } else {
+      out.append("+Inf");
+    }
+    out.append("\"} ").append(std::to_string(cumulative)).append("\n");
+  }
+  out.append(name).append("_sum ");
+  AppendValue(sum, out);
+  out.append("\n");
+  out.append(name).append("_count ").append(std::to_string(cumulative));
+  out.append("\n");
+}
+
+template <size_t N>
+size_t BucketOf(const std::array<double, N>& bounds, double value) noexcept {
+  size_t i = 0;
+  while (i < N && value > bounds[i]) i++;
+  return i;
+}
+
+}  // namespace
+
+Metrics::Shard& Metrics::LocalShard() noexcept {
+  if (t_shard == kMetricsShards) {
+    t_shard = g_next_shard.fetch_add(1, std::memory_order_relaxed) %
+              kMetricsShards;
+  }
+  return shards_[t_shard];
+}
+
+void Metrics::RecordBatch(size_t rows, double seconds) noexcept {
+  Shard& shard = LocalShard();
+  shard.calls.fetch_add(1, std::memory_order_relaxed);
+  shard.rows.fetch_add(rows, std::memory_order_relaxed);
+  shard.latency_ns.fetch_add(static_cast<uint64_t>(seconds * 1e9),
+                             std::memory_order_relaxed);
+  shard.latency[BucketOf(kLatencyBuckets, seconds)].fetch_add(
+      1, std::memory_order_relaxed);
+  shard.sizes[BucketOf(kBatchSizeBuckets, static_cast<double>(rows))]
+      .fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordFlags(const CorrectionFactors* out,
+                          size_t count) noexcept {
+  // Count locally first, most chunks have no flags at all.
+  std::array<uint64_t, kErrorFlagCount> counts{};
+  size_t any = 0;
+  for (size_t i = 0; i < count; i++) {
+    const size_t flag = out[i].error_flag;
+    any |= flag;
+    for (size_t bit = 0; bit < kErrorFlagCount; bit++) {
+      counts[bit] += (flag >> bit) & 1;
+    }
+  }
+  if (any == 0) return;
+
+  Shard& shard = LocalShard();
+  for (size_t bit = 0; bit < kErrorFlagCount; bit++) {
+    if (counts[bit] != 0) {
+      shard.flags[bit].fetch_add(counts[bit], std::memory_order_relaxed);
+    }
+  }
+}
+
+void Metrics::RecordCutoffs(size_t rows) noexcept {
+  if (rows == 0) return;
+  LocalShard().flags[kCalculationOORBit].fetch_add(rows,
+                                                   std::memory_order_relaxed);
+}
+
+void Metrics::AddCallback(const std::string& name, const std::string& help,
+                          MetricType type, std::function<double()> value) {
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  callbacks_.push_back(Callback{name, help, type, std::move(value)});
+}
+
+uint64_t Metrics::Calls() const noexcept {
+  uint64_t total = 0;
+  for (const Shard& shard : shards_) {
+    total += shard.calls.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+uint64_t Metrics::Rows() const noexcept {
+  uint64_t total = 0;
+  for (const Shard& shard : shards_) {
+    total += shard.rows.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+uint64_t Metrics::FlagCount(size_t bit) const noexcept {
+  if (bit >= kErrorFlagCount) return 0;
+  uint64_t total = 0;
+  for (const Shard& shard : shards_) {
+    total += shard.flags[bit].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+std::string Metrics::Render() const {
+  std::array<uint64_t, kLatencyBuckets.size() + 1> latency{};
+  std::array<uint64_t, kBatchSizeBuckets.size() + 1> sizes{};
+  uint64_t latency_ns = 0;
+  for (const Shard& shard : shards_) {
+    latency_ns += shard.latency_ns.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < latency.size(); i++) {
+      latency[i] += shard.latency[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < sizes.size(); i++) {
+      sizes[i] += shard.sizes[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  std::string out;
+  AppendHeader("vccore_batch_calls_total", "Number of batch calculations.",
+               "counter", out);
+  out.append("vccore_batch_calls_total ")
+      .append(std::to_string(Calls()))
+      .append("\n");
+
+  AppendHeader("vccore_rows_total", "Number of calculated rows.", "counter",
+               out);
+  out.append("vccore_rows_total ").append(std::to_string(Rows())).append("\n");
+
+  AppendHeader("vccore_error_flags_total",
+               "Number of results with the ErrorFlag bit set.", "counter",
+               out);
+  for (size_t bit = 0; bit < kErrorFlagCount; bit++) {
+    out.append("vccore_error_flags_total{flag=\"")
+        .append(kFlagNames[bit])
+        .append("\"} ")
+        .append(std::to_string(FlagCount(bit)))
+        .append("\n");
+  }
+
+  AppendHeader("vccore_batch_duration_seconds",
+               "Duration of batch calculations.", "histogram", out);
+  AppendHistogram("vccore_batch_duration_seconds", kLatencyBuckets, latency,
+                  static_cast<double>(latency_ns) * 1e-9, out);
+
+  AppendHeader("vccore_batch_rows", "Number of rows per batch calculation.",
+               "histogram", out);
+  AppendHistogram("vccore_batch_rows", kBatchSizeBuckets, sizes,
+                  static_cast<double>(Rows()), out);
+
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  for (const Callback& callback : callbacks_) {
+    AppendHeader(callback.name.c_str(), callback.help.c_str(),
+                 callback.type == MetricType::kCounter ? "counter" : "gauge",
+                 out);
+    out.append(callback.name).append(" ");
+    AppendValue(callback.value(), out);
+    out.append("\n");
+  }
+  return out;
+}
+
+bool Metrics::WriteTextfile(const std::string& path) const {
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    const std::string text = Render();
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    if (!out) return false;
+  }
+  return AtomicReplaceFile(tmp_path, path);
+}
+
+#if defined(_WIN32)
+
+bool MetricsServer::Start(uint16_t) { return false; }
+
+void MetricsServer::Stop() {}
+
+void MetricsServer::Serve() {}
+
+#else
+
+bool MetricsServer::Start(uint16_t port) {
+  if (listen_fd_ >= 0) return false;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  socklen_t len = sizeof(addr);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 16) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    close(fd);
+    return false;
+  }
+
+  listen_fd_ = fd;
+  port_ = ntohs(addr.sin_port);
+  stop_.store(false, std::memory_order_relaxed);
+  thread_ = std::thread([this]() { Serve(); });
+  return true;
+}
+
+void MetricsServer::Stop() {
+  if (listen_fd_ < 0) return;
+  stop_.store(true, std::memory_order_relaxed);
+  if (thread_.joinable()) thread_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+  port_ = 0;
+}
+
+void MetricsServer::Serve() {
+  while (!stop_.load(std::memory_order_relaxed)) {
+    // Wake up regularly to notice Stop.
+    pollfd pfd{listen_fd_, POLLIN, 0};
+    if (poll(&pfd, 1, 50) <= 0) continue;
+
+    int client = accept(listen_fd_, nullptr, nullptr);
+    if (client < 0) continue;
+
+    // Every request is answered with the metrics, the request line is read
+    // only so the client does not see a reset.
+    char request[1024];
+    pollfd cfd{client, POLLIN, 0};
+    if (poll(&cfd, 1, 1000) > 0) {
+      (void)recv(client, request, sizeof(request), 0);
+    }
+
+    const std::string body = metrics_.Render();
+    std::string response =
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " +
+        std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    const char* p = response.data();
+    size_t left = response.size();
+    while (left > 0) {
+      ssize_t n = send(client, p, left, MSG_NOSIGNAL);
+      if (n <= 0) break;
+      p += n;
+      left -= static_cast<size_t>(n);
+    }
+    close(client);
+  }
+}
+
+#endif
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,347 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+/// Parses a sysfs cpu or node list like "0-3,8,10-11".
+std::vector<int> ParseList(const std::string& list) {
+  std::vector<int> out;
+  std::stringstream ss(list);
+  std::string item;
+
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    size_t dash = item.find('-');
+    try {
+      if (dash == std::string::npos) {
+        out.push_back(std::stoi(item));
+      } else {
+        int first = std::stoi(item.substr(0, dash));
+        int last = std::stoi(item.substr(dash + 1));
+        for (int i = first; i <= last; i++) out.push_back(i);
+      }
+    } catch (...) {
+      // Ignore malformed entries.
+    }
+  }
+  return out;
+}
+
+std::string ReadFirstLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+/// Restricts the calling thread to the given cpus. No-op outside of Linux.
+void PinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cpus;
+#endif
+}
+
+/// Node of the NumaExecutor worker running on this thread, nullptr for
+/// other threads.
+thread_local const void* t_worker_node = nullptr;
+
+}  // namespace
+
+std::vector<NumaNode> DetectNumaNodes() {
+  std::vector<NumaNode> nodes;
+
+#if defined(__linux__)
+  const std::string base = "/sys/devices/system/node/";
+  for (int id : ParseList(ReadFirstLine(base + "online"))) {
+    NumaNode node;
+    node.id = id;
+    node.cpus = ParseList(
+        ReadFirstLine(base + "node" + std::to_string(id) + "/cpulist"));
+    if (!node.cpus.empty()) nodes.push_back(std::move(node));
+  }
+#endif
+
+  if (nodes.empty()) {
+    NumaNode node;
+    int hw = static_cast<int>(std::thread::hardware_concurrency());
+    for (int i = 0; i < std::max(hw, 1); i++) node.cpus.push_back(i);
+    nodes.push_back(std::move(node));
+  }
+
+  return nodes;
+}
+
+struct NumaExecutor::Node {
+  NumaNode info;
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> queue;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop = false;
+
+  std::atomic<size_t> indices{0};
+  std::atomic<long long> nanoseconds{0};
+
+  void Enqueue(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(task));
+    }
+    cv.notify_one();
+  }
+
+  void WorkerLoop(bool pin) {
+    if (pin) PinCurrentThread(info.cpus);
+    t_worker_node = this;
+
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return stop || !queue.empty(); });
+        if (stop && queue.empty()) return;
+
+        task = std::move(queue.front());
+        queue.pop_front();
+      }
+      task();
+    }
+  }
+};
+
+NumaExecutor::NumaExecutor(bool pin_workers)
+    : NumaExecutor(DetectNumaNodes(), pin_workers) {}
+
+NumaExecutor::NumaExecutor(const std::vector<NumaNode>& nodes,
+                           bool pin_workers) {
+  for (const auto& info : nodes) {
+    if (info.cpus.empty()) continue;
+
+    node_info_.push_back(info);
+    nodes_.push_back(std::make_unique<Node>());
+    nodes_.back()->info = info;
+  }
+
+  for (auto& node : nodes_) {
+    for (size_t i = 0; i < node->info.cpus.size(); i++) {
+      node->workers.emplace_back(&Node::WorkerLoop, node.get(), pin_workers);
+    }
+  }
+}
+
+NumaExecutor::~NumaExecutor() {
+  for (auto& node : nodes_) {
+    {
+      std::lock_guard<std::mutex> lock(node->mutex);
+      node->stop = true;
+    }
+    node->cv.notify_all();
+  }
+
+  for (auto& node : nodes_) {
+    for (auto& worker : node->workers) {
+      if (worker.joinable()) worker.join();
+    }
+  }
+}
+
+size_t NumaExecutor::Concurrency() const noexcept {
+  size_t workers = 0;
+  for (const auto& node : nodes_) workers += node->workers.size();
+  return std::max<size_t>(workers, 1);
+}
+
+void NumaExecutor::ParallelFor(size_t count, size_t grain,
+                               const RangeTask& task) {
+  if (grain == 0) grain = 1;
+  const size_t chunks = (count + grain - 1) / grain;
+  if (chunks == 0) return;
+
+  if (nodes_.empty()) {
+    for (size_t begin = 0; begin < count; begin += grain) {
+      task(begin, std::min(begin + grain, count));
+    }
+    return;
+  }
+
+  // Every node owns a contiguous range of chunks, sized by its worker count.
+  // The split only depends on count and grain, so FirstTouch and a later
+  // ParallelFor with the same arguments agree on the placement.
+  struct Range {
+    size_t end = 0;
+    std::atomic<size_t> next{0};
+  };
+  struct State {
+    explicit State(size_t nodes) : ranges(nodes) {}
+    std::vector<Range> ranges;
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<State>(nodes_.size());
+
+  const size_t workers = Concurrency();
+  size_t assigned = 0;
+  size_t first = 0;
+  for (size_t n = 0; n < nodes_.size(); n++) {
+    assigned += nodes_[n]->workers.size();
+    size_t end = (n + 1 == nodes_.size()) ? chunks : chunks * assigned / workers;
+    state->ranges[n].next = first;
+    state->ranges[n].end = end;
+    first = end;
+  }
+
+  const RangeTask* task_ptr = &task;
+  auto run_node = [this, state, task_ptr, count, grain, chunks](size_t n) {
+    Range& range = state->ranges[n];
+    Node& node = *nodes_[n];
+    size_t finished = 0;
+
+    for (size_t c = range.next.fetch_add(1); c < range.end;
+         c = range.next.fetch_add(1)) {
+      size_t begin = c * grain;
+      size_t end = std::min(begin + grain, count);
+
+      auto start = std::chrono::steady_clock::now();
+      (*task_ptr)(begin, end);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+
+      node.indices.fetch_add(end - begin, std::memory_order_relaxed);
+      node.nanoseconds.fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+              .count(),
+          std::memory_order_relaxed);
+      finished++;
+    }
+
+    if (finished != 0 && state->done.fetch_add(finished) + finished == chunks) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->cv.notify_all();
+    }
+  };
+
+  for (size_t n = 0; n < nodes_.size(); n++) {
+    size_t node_chunks = state->ranges[n].end - state->ranges[n].next;
+    size_t helpers = std::min(nodes_[n]->workers.size(), node_chunks);
+    for (size_t i = 0; i < helpers; i++) {
+      nodes_[n]->Enqueue([run_node, n]() { run_node(n); });
+    }
+  }
+
+  // Only the workers of a node touch its range. A call from inside a worker
+  // helps with whatever is left instead of blocking it, so nested calls can
+  // not deadlock.
+  for (size_t n = 0; n < nodes_.size(); n++) {
+    if (nodes_[n].get() == t_worker_node) {
+      for (size_t m = 0; m < nodes_.size(); m++) run_node(m);
+      break;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&state, chunks]() { return state->done == chunks; });
+}
+
+void NumaExecutor::Post(std::function<void()> task) {
+  if (nodes_.empty()) {
+    task();
+    return;
+  }
+  nodes_.front()->Enqueue(std::move(task));
+}
+
+std::vector<NodeStats> NumaExecutor::Stats() const {
+  std::vector<NodeStats> out;
+  for (const auto& node : nodes_) {
+    NodeStats stats;
+    stats.node = node->info.id;
+    stats.indices = node->indices.load(std::memory_order_relaxed);
+    stats.seconds =
+        static_cast<double>(node->nanoseconds.load(std::memory_order_relaxed)) *
+        1e-9;
+    out.push_back(stats);
+  }
+  return out;
+}
+
+void NumaExecutor::ResetStats() noexcept {
+  for (auto& node : nodes_) {
+    node->indices.store(0, std::memory_order_relaxed);
+    node->nanoseconds.store(0, std::memory_order_relaxed);
+  }
+}
+
+void* AllocateLarge(size_t bytes, bool huge_pages) {
+  if (bytes == 0) return nullptr;
+
+#if defined(__linux__)
+  void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) return nullptr;
+
+#if defined(MADV_HUGEPAGE)
+  if (huge_pages) madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+  return data;
+#else
+  (void)huge_pages;
+  return ::operator new(bytes, std::align_val_t(4096), std::nothrow);
+#endif
+}
+
+void FreeLarge(void* data, size_t bytes) noexcept {
+  if (data == nullptr) return;
+
+#if defined(__linux__)
+  munmap(data, bytes);
+#else
+  (void)bytes;
+  ::operator delete(data, std::align_val_t(4096));
+#endif
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,698 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/pipeline.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "spauly/vccore/approximate_cache.h"
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/checkpoint.h"
+#include "spauly/vccore/csv.h"
+#include "spauly/vccore/impl/trace.h"
+#include "spauly/vccore/jsonl.h"
+#include "spauly/vccore/shard.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+/// Buffers of one chunk that cycles through read, calculate and write.
+struct Slot {
+  AlignedBuffer in;
+  AlignedBuffer out;
+  std::vector<Parameters> params;
+  std::vector<size_t> flags;
+  std::vector<CorrectionFactors> results;
+
+  uint64_t chunk = 0;  // Index of the chunk within the output.
+  uint64_t first = 0;  // First output record of the chunk.
+  size_t count = 0;    // Records in the chunk.
+  size_t done = 0;     // Bytes transferred by the current request.
+};
+
+inline uint64_t MakeTag(size_t slot, bool write) noexcept {
+  return (static_cast<uint64_t>(slot) << 1) | (write ? 1 : 0);
+}
+
+PipelineResult Fail(PipelineResult result, const std::string& msg) {
+  result.ok = false;
+  result.error_msg = msg;
+  return result;
+}
+
+/// Reads and validates the header of a binary file.
+/// result accepts both result encodings, otherwise an input file is expected.
+bool ReadHeader(const File& file, bool result, BinaryHeader& header,
+                std::string& error_msg) {
+  AlignedBuffer buffer(kBinaryHeaderBytes);
+  if (file.ReadAt(buffer.data(), kBinaryHeaderBytes, 0) !=
+          static_cast<int64_t>(kBinaryHeaderBytes) ||
+      !DecodeHeader(buffer.data(), header)) {
+    error_msg = "Not a binary batch file";
+    return false;
+  }
+  const bool is_result = header.kind != RecordKind::kInput;
+  if (is_result != result) {
+    error_msg = "Unexpected record kind";
+    return false;
+  }
+  if (file.Size() < static_cast<int64_t>(header.RecordOffset(
+                        header.record_count))) {
+    error_msg = "Binary batch file is truncated";
+    return false;
+  }
+  return true;
+}
+
+/// Yields the CSV lines that hold a record from at most limit bytes of a
+/// stream. Only the first line of a file may be a header, empty lines are
+/// skipped.
+class CsvLines {
+ public:
+  CsvLines(std::istream& in, bool at_file_start, uint64_t limit = UINT64_MAX)
+      : in_(in), first_line_(at_file_start), remaining_(limit) {}
+
+  bool Next(std::string& line) {
+    while (remaining_ > 0 && std::getline(in_, line)) {
+      remaining_ -= std::min<uint64_t>(remaining_, line.size() + 1);
+
+      const bool header = first_line_ && IsCsvHeaderOrEmpty(line);
+      first_line_ = false;
+      if (!header && line.find_first_not_of(" \t\r") != std::string::npos) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  std::istream& in_;
+  bool first_line_;
+  uint64_t remaining_;
+};
+
+/// Calculates the rows of lines chunk by chunk and writes CSV result rows.
+PipelineResult CalculateCsv(const Calculator& calc, CsvLines& lines,
+                            std::ostream& out, const Units& units,
+                            const PipelineOptions& options) {
+  PipelineResult result;
+  const size_t chunk = std::max<size_t>(1, options.chunk_records);
+
+  std::vector<Parameters> params(chunk);
+  std::vector<size_t> flags(chunk);
+  std::vector<CorrectionFactors> results(chunk);
+  std::string line;
+  std::string text;
+
+  out << kCsvResultHeader << '\n';
+
+  bool eof = false;
+  while (!eof) {
+    size_t n = 0;
+    while (n < chunk) {
+      if (!lines.Next(line)) {
+        eof = true;
+        break;
+      }
+      flags[n] = ParseCsvRecord(line, params[n])
+                     ? 0
+                     : static_cast<size_t>(ErrorFlag::kParseError);
+      n++;
+    }
+    if (n == 0) break;
+
+    // Malformed rows are left out of the calculation.
+    BatchOptions batch = options.batch;
+    batch.first_row += result.rows;
+    batch.row_flags = flags.data();
+    calc.Calculate(params.data(), results.data(), n, units, batch);
+    if (batch.IsCancelled()) {
+      result.cancelled = true;
+      return Fail(result, "Cancelled");
+    }
+
+    text.clear();
+    for (size_t i = 0; i < n; i++) {
+      AppendCsvResult(results[i], text, options.encoding);
+    }
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    result.rows += n;
+  }
+
+  if (!out) return Fail(result, "Could not write the output");
+  return result;
+}
+
+/// Names the batch settings that change the results, so a checkpoint of
+/// another mode, engine or approximation is not resumed.
+std::string BatchFingerprint(const BatchOptions& batch) {
+  std::string fingerprint =
+      "mode " + std::to_string(static_cast<int>(batch.mode)) + " engine " +
+      std::to_string(static_cast<int>(batch.engine.engine)) + " " +
+      std::to_string(batch.engine.speed) + " approximate ";
+  if (batch.approximate == nullptr) return fingerprint + "none";
+  return fingerprint + std::to_string(batch.approximate->Tolerance()) + " " +
+         std::to_string(batch.approximate->Step());
+}
+
+bool WriteHeader(const File& file, const BinaryHeader& header) {
+  AlignedBuffer buffer(kBinaryHeaderBytes);
+  EncodeHeader(header, buffer.data());
+  return file.WriteAt(buffer.data(), kBinaryHeaderBytes, 0) ==
+         static_cast<int64_t>(kBinaryHeaderBytes);
+}
+
+/// Returns true if path is a result file with the given layout. The file of
+/// an interrupted batch is shorter than the header claims, so only the header
+/// is compared.
+bool OutputMatches(const std::string& path, const BinaryHeader& expected) {
+  File file;
+  BinaryHeader header;
+  AlignedBuffer buffer(kBinaryHeaderBytes);
+  return file.Open(path, File::OpenMode::kRead) &&
+         file.ReadAt(buffer.data(), kBinaryHeaderBytes, 0) ==
+             static_cast<int64_t>(kBinaryHeaderBytes) &&
+         DecodeHeader(buffer.data(), header) && header.kind == expected.kind &&
+         header.record_count == expected.record_count &&
+         header.block_records == expected.block_records &&
+         header.first_record == expected.first_record;
+}
+
+/// Writes the rows of read to a binary input file in the standard units.
+/// read(p, u, flags, max_rows) fills up to max_rows rows and returns their
+/// number, 0 at the end. u holds units on entry.
+template <typename ReadRows>
+PipelineResult WriteInputFile(const Calculator& calc,
+                              const std::string& output_path,
+                              const Units& units, const ReadRows& read) {
+  PipelineResult result;
+
+  File output;
+  BinaryHeader header;
+  if (!output.Open(output_path, File::OpenMode::kWrite) ||
+      !WriteHeader(output, header)) {
+    return Fail(result, "Could not write " + output_path);
+  }
+
+  const size_t chunk = kBinaryBlockRecords;
+  std::vector<Parameters> params(chunk);
+  std::vector<Units> row_units(chunk, units);
+  std::vector<size_t> flags(chunk);
+  AlignedBuffer buffer(chunk * kInputRecordBytes);
+
+  size_t n = 0;
+  while ((n = read(params.data(), row_units.data(), flags.data(), chunk)) !=
+         0) {
+    for (size_t i = 0; i < n; i++) {
+      if (flags[i] != 0) {
+        params[i] = UnreadableInputRecord();
+      } else if (row_units[i] != kStandardUnits) {
+        params[i] = calc.GetConverted(params[i], row_units[i]);
+      }
+    }
+
+    EncodeInputRecords(params.data(), n, buffer.data());
+    const size_t bytes = n * kInputRecordBytes;
+    if (output.WriteAt(buffer.data(), bytes,
+                       header.RecordOffset(result.rows)) !=
+        static_cast<int64_t>(bytes)) {
+      return Fail(result, "Could not write " + output_path);
+    }
+    result.rows += n;
+  }
+
+  header.record_count = result.rows;
+  if (!WriteHeader(output, header)) {
+    return Fail(result, "Could not write " + output_path);
+  }
+  return result;
+}
+
+PipelineResult MergeBinaryShards(const std::vector<std::string>& paths,
+                                 const std::string& output_path) {
+  PipelineResult result;
+
+  File output;
+  BinaryHeader out_header;
+  if (!output.Open(output_path, File::OpenMode::kWrite)) {
+    return Fail(result, "Could not write " + output_path);
+  }
+
+  AlignedBuffer buffer(kBinaryBlockRecords * kResultRecordBytes);
+  for (size_t i = 0; i < paths.size(); i++) {
+    File input;
+    BinaryHeader header;
+    if (!input.Open(paths[i], File::OpenMode::kRead)) {
+      return Fail(result, "Missing shard " + paths[i]);
+    }
+    if (!ReadHeader(input, true, header, result.error_msg)) {
+      return Fail(result, result.error_msg + ": " + paths[i]);
+    }
+
+    // Shards must line up exactly, a gap or overlap means a stale file.
+    if (header.first_record != result.rows ||
+        (i > 0 && (header.block_records != out_header.block_records ||
+                   header.kind != out_header.kind))) {
+      return Fail(result, "Shard does not continue the previous one: " +
+                              paths[i]);
+    }
+    out_header.kind = header.kind;
+    out_header.record_bytes = header.record_bytes;
+    out_header.block_records = header.block_records;
+
+    const uint64_t bytes = header.record_count * header.record_bytes;
+    for (uint64_t done = 0; done < bytes;) {
+      const size_t n =
+          static_cast<size_t>(std::min<uint64_t>(buffer.size(), bytes - done));
+      if (input.ReadAt(buffer.data(), n, kBinaryHeaderBytes + done) !=
+              static_cast<int64_t>(n) ||
+          output.WriteAt(buffer.data(), n,
+                         out_header.RecordOffset(result.rows) + done) !=
+              static_cast<int64_t>(n)) {
+        return Fail(result, "Could not copy " + paths[i]);
+      }
+      done += n;
+    }
+    result.rows += static_cast<size_t>(header.record_count);
+  }
+
+  out_header.record_count = result.rows;
+  if (!WriteHeader(output, out_header)) {
+    return Fail(result, "Could not write " + output_path);
+  }
+  return result;
+}
+
+PipelineResult MergeCsvShards(const std::vector<std::string>& paths,
+                              const std::string& output_path) {
+  PipelineResult result;
+
+  std::ofstream out(output_path, std::ios::binary | std::ios::trunc);
+  if (!out) return Fail(result, "Could not write " + output_path);
+  out << kCsvResultHeader << '\n';
+
+  std::string line;
+  for (const std::string& path : paths) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return Fail(result, "Missing shard " + path);
+
+    // Every shard starts with its own header line.
+    if (!std::getline(in, line) || line != kCsvResultHeader) {
+      return Fail(result, "Not a CSV result file: " + path);
+    }
+    while (std::getline(in, line)) {
+      out << line << '\n';
+      result.rows++;
+    }
+  }
+
+  if (!out) return Fail(result, "Could not write " + output_path);
+  return result;
+}
+
+}  // namespace
+
+PipelineResult RunBinaryBatch(const Calculator& calc,
+                              const std::string& input_path,
+                              const std::string& output_path,
+                              const PipelineOptions& options) {
+  PipelineResult result;
+
+  File input;
+  if (!input.Open(input_path, File::OpenMode::kRead)) {
+    return Fail(result, "Could not open " + input_path);
+  }
+
+  BinaryHeader header;
+  if (!ReadHeader(input, false, header, result.error_msg)) {
+    return Fail(result, result.error_msg);
+  }
+
+  if (!options.shard.IsValid()) return Fail(result, "Invalid shard");
+  const RecordRange range = BinaryShardRange(header, options.shard);
+
+  BinaryHeader out_header;
+  out_header.kind = ResultKind(options.encoding);
+  out_header.record_count = range.count;
+  out_header.record_bytes = static_cast<uint32_t>(RecordBytes(out_header.kind));
+  out_header.block_records = header.block_records;
+  out_header.first_record = range.first;
+
+  const std::string path = options.shard.IsWhole()
+                               ? output_path
+                               : ShardPath(output_path, options.shard);
+
+  // Whole blocks per chunk keep every request but the last one aligned.
+  const size_t block = header.block_records;
+  const size_t chunk =
+      std::max<size_t>(1, (options.chunk_records + block - 1) / block) * block;
+  const uint64_t chunks = (range.count + chunk - 1) / chunk;
+  VCCORE_TRACE2(file_start, range.count, chunk);
+
+  // A checkpoint is only trusted if the job and the existing output match.
+  // Every shard keeps its own, so shard processes never share a file.
+  Checkpoint checkpoint;
+  if (!options.checkpoint_path.empty()) {
+    const std::string checkpoint_path =
+        options.shard.IsWhole()
+            ? options.checkpoint_path
+            : ShardPath(options.checkpoint_path, options.shard);
+    // The path, size and modification time identify the input.
+    const std::string fingerprint =
+        "binary " + input_path + " " + std::to_string(input.Size()) + " " +
+        std::to_string(input.ModifiedTime()) + " " +
+        std::to_string(range.first) + " " + std::to_string(range.count) +
+        " " + std::to_string(chunk) + " " +
+        std::to_string(out_header.record_bytes) + " " + path + " " +
+        BatchFingerprint(options.batch);
+    checkpoint =
+        Checkpoint(checkpoint_path, fingerprint, options.checkpoint_seconds);
+    if (checkpoint.Load() && !OutputMatches(path, out_header)) {
+      checkpoint =
+          Checkpoint(checkpoint_path, fingerprint, options.checkpoint_seconds);
+    }
+  }
+  const bool resume = checkpoint.DoneCount() > 0;
+
+  File output;
+  if (!output.Open(path, resume ? File::OpenMode::kReadWrite
+                                : File::OpenMode::kWrite) ||
+      !WriteHeader(output, out_header)) {
+    return Fail(result, "Could not write " + path);
+  }
+
+  for (uint64_t k = 0; k < chunks; k++) {
+    if (checkpoint.IsDone(k)) {
+      result.resumed_rows += static_cast<size_t>(
+          std::min<uint64_t>(chunk, range.count - k * chunk));
+    }
+  }
+  result.rows = result.resumed_rows;
+
+  // Progress counts written rows, the chunks report none themselves.
+  BatchOptions batch = options.batch;
+  batch.progress = nullptr;
+  if (options.batch.progress != nullptr) {
+    options.batch.progress->AddTotal(range.count);
+    options.batch.progress->AddDone(result.resumed_rows);
+  }
+  if (chunks == checkpoint.DoneCount()) {
+    if (!output.Sync() || !checkpoint.Remove()) {
+      return Fail(result, "Could not finish " + path);
+    }
+    return result;
+  }
+
+  const size_t depth = static_cast<size_t>(
+      std::min<uint64_t>(std::max(1u, options.depth), chunks));
+  std::unique_ptr<IoQueue> queue =
+      MakeIoQueue(options.io, static_cast<unsigned>(depth));
+  result.io = queue->Backend();
+
+  std::vector<Slot> slots(depth);
+  uint64_t next_chunk = 0;
+
+  auto submit = [&](size_t s, bool write) {
+    Slot& slot = slots[s];
+    IoRequest request;
+    request.write = write;
+    request.tag = MakeTag(s, write);
+    if (write) {
+      request.fd = output.Descriptor();
+      request.buffer = slot.out.data() + slot.done;
+      request.size = slot.count * out_header.record_bytes - slot.done;
+      request.offset = out_header.RecordOffset(slot.first) + slot.done;
+    } else {
+      request.fd = input.Descriptor();
+      request.buffer = slot.in.data() + slot.done;
+      request.size = slot.count * kInputRecordBytes - slot.done;
+      request.offset =
+          header.RecordOffset(range.first + slot.first) + slot.done;
+    }
+    return queue->Submit(request);
+  };
+
+  auto start_read = [&](size_t s) {
+    Slot& slot = slots[s];
+    if (slot.params.empty()) {
+      slot.in = AlignedBuffer(chunk * kInputRecordBytes);
+      slot.out = AlignedBuffer(chunk * out_header.record_bytes);
+      slot.params.resize(chunk);
+      slot.flags.resize(chunk);
+      slot.results.resize(chunk);
+    }
+    while (next_chunk < chunks && checkpoint.IsDone(next_chunk)) next_chunk++;
+    if (next_chunk == chunks) return true;  // The slot stays idle.
+
+    slot.chunk = next_chunk;
+    slot.first = next_chunk * chunk;
+    slot.count = static_cast<size_t>(
+        std::min<uint64_t>(chunk, range.count - slot.first));
+    slot.done = 0;
+    next_chunk++;
+    return submit(s, false);
+  };
+
+  for (size_t s = 0; s < depth; s++) {
+    if (!start_read(s)) {
+      result.error_msg = "Could not queue read";
+      break;
+    }
+  }
+
+  // Every slot has at most one request in flight. A completed read is
+  // calculated while the reads and writes of the other slots proceed.
+  IoCompletion completion;
+  while (queue->WaitOne(completion)) {
+    if (!result.error_msg.empty()) continue;  // Drain after an error.
+
+    const size_t s = static_cast<size_t>(completion.tag >> 1);
+    const bool write = (completion.tag & 1) != 0;
+    Slot& slot = slots[s];
+    const size_t total =
+        slot.count * (write ? out_header.record_bytes : kInputRecordBytes);
+
+    if (completion.result <= 0) {
+      result.error_msg = write ? "Write failed" : "Read failed";
+      continue;
+    }
+
+    // Resubmit the remainder of a short transfer.
+    slot.done += static_cast<size_t>(completion.result);
+    if (slot.done < total) {
+      if (!submit(s, write)) result.error_msg = "Could not queue request";
+      continue;
+    }
+    slot.done = 0;
+
+    if (!write) {
+      DecodeInputRecords(slot.in.data(), slot.count, slot.params.data());
+      size_t unreadable = 0;
+      for (size_t i = 0; i < slot.count; i++) {
+        slot.flags[i] = IsUnreadableInputRecord(slot.params[i])
+                            ? static_cast<size_t>(ErrorFlag::kParseError)
+                            : 0;
+        unreadable |= slot.flags[i];
+      }
+      batch.row_flags = unreadable != 0 ? slot.flags.data() : nullptr;
+      batch.first_row = options.batch.first_row + range.first + slot.first;
+      VCCORE_TRACE2(file_chunk, slot.first, slot.count);
+      calc.Calculate(slot.params.data(), slot.results.data(), slot.count,
+                     header.units, batch);
+      if (batch.IsCancelled()) {
+        result.cancelled = true;
+        result.error_msg = "Cancelled";
+        continue;
+      }
+      EncodeResultRecords(slot.results.data(), slot.count, options.encoding,
+                          slot.out.data());
+      if (!submit(s, true)) result.error_msg = "Could not queue write";
+    } else {
+      result.rows += slot.count;
+      if (options.batch.progress != nullptr) {
+        options.batch.progress->AddDone(slot.count);
+      }
+
+      // Completed writes are flushed before the checkpoint names them.
+      checkpoint.MarkDone(slot.chunk);
+      if (checkpoint.Due() && (!output.Sync() || !checkpoint.Save())) {
+        result.error_msg = "Could not write the checkpoint";
+        continue;
+      }
+
+      if (!start_read(s)) result.error_msg = "Could not queue read";
+    }
+  }
+
+  // A cancelled batch keeps the chunks it finished.
+  if (result.cancelled && output.Sync()) checkpoint.Save();
+
+  VCCORE_TRACE2(file_end, result.rows, result.error_msg.empty());
+  if (!result.error_msg.empty()) return Fail(result, result.error_msg);
+  if (checkpoint.IsEnabled() && (!output.Sync() || !checkpoint.Remove())) {
+    return Fail(result, "Could not finish " + path);
+  }
+  return result;
+}
+
+PipelineResult RunCsvBatch(const Calculator& calc, std::istream& in,
+                           std::ostream& out, const Units& units,
+                           const PipelineOptions& options) {
+  CsvLines lines(in, true);
+  return CalculateCsv(calc, lines, out, units, options);
+}
+
+PipelineResult RunCsvFile(const Calculator& calc, const std::string& input_path,
+                          const std::string& output_path, const Units& units,
+                          const PipelineOptions& options) {
+  PipelineResult result;
+  if (!options.shard.IsValid()) return Fail(result, "Invalid shard");
+
+  ByteRange range;
+  if (!TextShardRange(input_path, options.shard, range)) {
+    return Fail(result, "Could not open " + input_path);
+  }
+
+  std::ifstream in(input_path, std::ios::binary);
+  in.seekg(static_cast<std::streamoff>(range.begin));
+  const std::string path = options.shard.IsWhole()
+                               ? output_path
+                               : ShardPath(output_path, options.shard);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!in || !out) return Fail(result, "Could not open " + path);
+
+  // Diagnostics name rows of the whole input, so the records before the
+  // shard are counted. Nothing else depends on the row index.
+  PipelineOptions shard_options = options;
+  if (options.batch.diagnostics != nullptr && range.begin > 0) {
+    std::ifstream prefix(input_path, std::ios::binary);
+    CsvLines earlier(prefix, true, range.begin);
+    std::string line;
+    while (earlier.Next(line)) shard_options.batch.first_row++;
+  }
+
+  CsvLines lines(in, range.begin == 0, range.end - range.begin);
+  return CalculateCsv(calc, lines, out, units, shard_options);
+}
+
+PipelineResult MergeShards(const std::string& output_path,
+                           size_t shard_count) {
+  PipelineResult result;
+  if (shard_count == 0) return Fail(result, "Invalid shard count");
+
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < shard_count; i++) {
+    paths.push_back(ShardPath(output_path, ShardSpec{i, shard_count}));
+  }
+
+  // The first shard decides whether binary or CSV results are merged.
+  File first;
+  char magic[4] = {};
+  if (!first.Open(paths[0], File::OpenMode::kRead)) {
+    return Fail(result, "Missing shard " + paths[0]);
+  }
+  const bool binary = first.ReadAt(magic, sizeof(magic), 0) == 4 &&
+                      std::memcmp(magic, "VCCB", 4) == 0;
+  first.Close();
+
+  return binary ? MergeBinaryShards(paths, output_path)
+                : MergeCsvShards(paths, output_path);
+}
+
+PipelineResult ConvertToBinary(const Calculator& calc, std::istream& in,
+                               TextFormat format,
+                               const std::string& output_path,
+                               const Units& units) {
+  if (format == TextFormat::kJsonl) {
+    JsonlReader reader(in);
+    return WriteInputFile(
+        calc, output_path, units,
+        [&reader](Parameters* p, Units* u, size_t* flags, size_t max_rows) {
+          return reader.Read(p, u, flags, max_rows);
+        });
+  }
+
+  CsvLines lines(in, true);
+  std::string line;
+  return WriteInputFile(
+      calc, output_path, units,
+      [&lines, &line](Parameters* p, Units*, size_t* flags, size_t max_rows) {
+        size_t n = 0;
+        while (n < max_rows && lines.Next(line)) {
+          flags[n] = ParseCsvRecord(line, p[n])
+                         ? 0
+                         : static_cast<size_t>(ErrorFlag::kParseError);
+          n++;
+        }
+        return n;
+      });
+}
+
+PipelineResult ConvertResultsToCsv(const std::string& input_path,
+                                   std::ostream& out) {
+  PipelineResult result;
+
+  File input;
+  if (!input.Open(input_path, File::OpenMode::kRead)) {
+    return Fail(result, "Could not open " + input_path);
+  }
+
+  BinaryHeader header;
+  if (!ReadHeader(input, true, header, result.error_msg)) {
+    return Fail(result, result.error_msg);
+  }
+
+  const ResultEncoding encoding = header.kind == RecordKind::kResultQ16
+                                      ? ResultEncoding::kQ16
+                                      : ResultEncoding::kDouble;
+  const size_t chunk = header.block_records;
+  std::vector<CorrectionFactors> results(chunk);
+  AlignedBuffer buffer(chunk * header.record_bytes);
+  std::string text;
+
+  out << kCsvResultHeader << '\n';
+
+  while (result.rows < header.record_count) {
+    const size_t n = static_cast<size_t>(
+        std::min<uint64_t>(chunk, header.record_count - result.rows));
+    const size_t bytes = n * header.record_bytes;
+    if (input.ReadAt(buffer.data(), bytes, header.RecordOffset(result.rows)) !=
+        static_cast<int64_t>(bytes)) {
+      return Fail(result, "Could not read " + input_path);
+    }
+    DecodeResultRecords(buffer.data(), n, encoding, results.data());
+
+    text.clear();
+    for (size_t i = 0; i < n; i++) {
+      AppendCsvResult(results[i], text, encoding);
+    }
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    result.rows += n;
+  }
+
+  if (!out) return Fail(result, "Could not write the output");
+  return result;
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,293 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/result_cache.h"
+
+#include <array>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/impl/trace.h"
+
+namespace spauly {
+namespace vccore {
+
+/// Three key words followed by q, eta and h[4] as raw double bits. seq is
+/// odd while a writer owns the slot and 0 if it was never written.
+struct ResultCache::Slot {
+  std::atomic<uint32_t> seq;
+  std::atomic<uint32_t> error_flag;
+  std::atomic<uint64_t> words[9];
+};
+
+namespace {
+
+constexpr char kMagic[4] = {'V', 'C', 'C', 'R'};
+constexpr uint32_t kLayoutVersion = 1;
+constexpr size_t kHeaderBytes = 64;
+
+/// Slots probed before the first one is evicted.
+constexpr size_t kProbeWindow = 8;
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8 &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "the cache needs address free 64 bit atomics");
+
+/// @brief CacheHeader is the first 64 bytes of the file.
+struct CacheHeader {
+  char magic[4];
+  uint32_t layout_version;
+  uint32_t chart_version;
+  uint32_t slot_bytes;
+  uint64_t slot_count;
+};
+
+using Key = std::array<uint64_t, 3>;
+
+inline uint64_t Bits(double value) noexcept {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline double FromBits(uint64_t bits) noexcept {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline Key MakeKey(const Parameters& p) noexcept {
+  return {Bits(p.flowrate), Bits(p.total_head), Bits(p.viscosity)};
+}
+
+inline uint64_t Mix(uint64_t x) noexcept {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+inline uint64_t Hash(const Key& key) noexcept {
+  return Mix(key[0] ^ Mix(key[1] ^ Mix(key[2])));
+}
+
+bool HeaderMatches(const CacheHeader& header, size_t slot_bytes) noexcept {
+  return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+         header.layout_version == kLayoutVersion &&
+         header.chart_version == kChartTableVersion &&
+         header.slot_bytes == slot_bytes &&
+         header.slot_count != 0 &&
+         (header.slot_count & (header.slot_count - 1)) == 0;
+}
+
+size_t RoundUpPow2(size_t n) noexcept {
+  size_t pow2 = 1;
+  while (pow2 < n) pow2 <<= 1;
+  return pow2;
+}
+
+}  // namespace
+
+bool ResultCache::Open(const std::string& path, size_t slot_count) noexcept {
+  Close();
+
+#if defined(_WIN32)
+  (void)path;
+  (void)slot_count;
+  return false;
+#else
+  File file;
+  if (!file.Open(path, File::OpenMode::kReadWrite)) return false;
+  const int fd = file.Descriptor();
+
+  // The lock keeps a second process from mapping a half initialised file.
+  if (flock(fd, LOCK_EX) != 0) return false;
+
+  CacheHeader header{};
+  const bool valid =
+      file.Size() >= static_cast<int64_t>(kHeaderBytes) &&
+      file.ReadAt(&header, sizeof(header), 0) ==
+          static_cast<int64_t>(sizeof(header)) &&
+      HeaderMatches(header, sizeof(Slot)) &&
+      file.Size() == static_cast<int64_t>(kHeaderBytes +
+                                          header.slot_count * sizeof(Slot));
+
+  if (!valid) {
+    // A new file or one of another version starts out empty.
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.layout_version = kLayoutVersion;
+    header.chart_version = kChartTableVersion;
+    header.slot_bytes = sizeof(Slot);
+    header.slot_count = RoundUpPow2(slot_count == 0 ? 1 : slot_count);
+
+    const off_t bytes =
+        static_cast<off_t>(kHeaderBytes + header.slot_count * sizeof(Slot));
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, bytes) != 0 ||
+        file.WriteAt(&header, sizeof(header), 0) !=
+            static_cast<int64_t>(sizeof(header))) {
+      flock(fd, LOCK_UN);
+      return false;
+    }
+  }
+
+  const size_t bytes = kHeaderBytes + header.slot_count * sizeof(Slot);
+  void* map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  flock(fd, LOCK_UN);
+  if (map == MAP_FAILED) return false;
+
+  // The mapping stays valid once the descriptor is closed.
+  map_ = map;
+  map_bytes_ = bytes;
+  slots_ = reinterpret_cast<Slot*>(static_cast<char*>(map) + kHeaderBytes);
+  mask_ = static_cast<size_t>(header.slot_count - 1);
+  return true;
+#endif
+}
+
+void ResultCache::Close() noexcept {
+#if !defined(_WIN32)
+  if (map_ != nullptr) munmap(map_, map_bytes_);
+#endif
+  map_ = nullptr;
+  map_bytes_ = 0;
+  slots_ = nullptr;
+  mask_ = 0;
+}
+
+bool ResultCache::Lookup(const Parameters& p,
+                         CorrectionFactors& out) const noexcept {
+  if (slots_ == nullptr) return false;
+
+  const Key key = MakeKey(p);
+  const uint64_t home = Hash(key);
+  for (size_t i = 0; i < kProbeWindow; i++) {
+    const Slot& slot = slots_[(home + i) & mask_];
+
+    const uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq == 0) return false;  // Probing ends at a never written slot.
+    if (seq & 1) continue;
+
+    uint64_t words[9];
+    for (size_t w = 0; w < 9; w++) {
+      words[w] = slot.words[w].load(std::memory_order_relaxed);
+    }
+    const uint32_t flag = slot.error_flag.load(std::memory_order_relaxed);
+
+    // A changed sequence means a writer raced with the reads above.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq) continue;
+    if (words[0] != key[0] || words[1] != key[1] || words[2] != key[2]) {
+      continue;
+    }
+
+    out.q = FromBits(words[3]);
+    out.eta = FromBits(words[4]);
+    for (size_t j = 0; j < 4; j++) out.h[j] = FromBits(words[5 + j]);
+    out.error_flag = flag;
+    return true;
+  }
+  return false;
+}
+
+void ResultCache::Insert(const Parameters& p,
+                         const CorrectionFactors& cf) noexcept {
+  if (slots_ == nullptr) return;
+
+  const Key key = MakeKey(p);
+  const uint64_t home = Hash(key);
+
+  // Prefer the slot that holds the key already, then a never written one.
+  // If neither is in the window the home slot is replaced.
+  Slot* target = nullptr;
+  uint32_t seq = 0;
+  for (size_t i = 0; i < kProbeWindow && target == nullptr; i++) {
+    Slot& slot = slots_[(home + i) & mask_];
+    const uint32_t s = slot.seq.load(std::memory_order_acquire);
+    if (s == 0 || (!(s & 1) &&
+                   slot.words[0].load(std::memory_order_relaxed) == key[0] &&
+                   slot.words[1].load(std::memory_order_relaxed) == key[1] &&
+                   slot.words[2].load(std::memory_order_relaxed) == key[2])) {
+      target = &slot;
+      seq = s;
+    }
+  }
+  if (target == nullptr) {
+    target = &slots_[home & mask_];
+    seq = target->seq.load(std::memory_order_acquire);
+  }
+  if ((seq & 1) || !target->seq.compare_exchange_strong(
+                       seq, seq + 1, std::memory_order_relaxed)) {
+    return;  // Another writer owns the slot, its result is as good.
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const uint64_t words[9] = {key[0],          key[1],
+                             key[2],          Bits(cf.q),
+                             Bits(cf.eta),    Bits(cf.h[0]),
+                             Bits(cf.h[1]),   Bits(cf.h[2]),
+                             Bits(cf.h[3])};
+  for (size_t w = 0; w < 9; w++) {
+    target->words[w].store(words[w], std::memory_order_relaxed);
+  }
+  target->error_flag.store(static_cast<uint32_t>(cf.error_flag),
+                           std::memory_order_relaxed);
+  // 0 marks a never written slot, a wrapped counter skips it.
+  const uint32_t next = (seq + 2 == 0) ? 2 : seq + 2;
+  target->seq.store(next, std::memory_order_release);
+}
+
+void ResultCache::Calculate(const Calculator& calc, const Parameters* in,
+                            CorrectionFactors* out, size_t count,
+                            const Units& u) noexcept {
+  uint64_t hits = 0;
+  for (size_t i = 0; i < count; i++) {
+    const Parameters p =
+        (u != kStandardUnits) ? calc.GetConverted(in[i], u) : in[i];
+    if (Lookup(p, out[i])) {
+      VCCORE_TRACE1(cache_hit, i);
+      hits++;
+    } else {
+      VCCORE_TRACE1(cache_miss, i);
+      out[i] = calc.Calculate(p);
+      Insert(p, out[i]);
+    }
+  }
+
+  // Counted once per call so that workers do not contend on them.
+  hits_.fetch_add(hits, std::memory_order_relaxed);
+  misses_.fetch_add(count - hits, std::memory_order_relaxed);
+}
+
+void ResultCache::Clear() noexcept {
+  for (size_t i = 0; slots_ != nullptr && i <= mask_; i++) {
+    slots_[i].seq.store(0, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+}  // namespace vccore
+}  // namespace spauly
@@ -0,0 +1,105 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/shard.h"
+
+#include <algorithm>
+#include <charconv>
+
+#include "spauly/vccore/file_io.h"
+
+namespace spauly {
+namespace vccore {
+
+namespace {
+
+/// Returns the offset of the first line that begins at or after offset.
+int64_t NextLineStart(const File& file, uint64_t offset, uint64_t size) {
+  if (offset == 0) return 0;
+
+  // A line begins at offset if the byte before it is a line feed.
+  char buffer[4096];
+  uint64_t pos = offset - 1;
+  while (pos < size) {
+    int64_t got = file.ReadAt(buffer, sizeof(buffer), pos);
+    if (got <= 0) return -1;
+    for (int64_t i = 0; i < got; i++) {
+      if (buffer[i] == '\n') return static_cast<int64_t>(pos) + i + 1;
+    }
+    pos += static_cast<uint64_t>(got);
+  }
+  return static_cast<int64_t>(size);
+}
+
+}  // namespace
+
+bool ParseShardSpec(std::string_view text, ShardSpec& shard) noexcept {
+  const char* begin = text.data();
+  const char* end = text.data() + text.size();
+
+  auto [slash, ec] = std::from_chars(begin, end, shard.index);
+  if (ec != std::errc() || slash == end || *slash != '/') return false;
+
+  auto [rest, ec2] = std::from_chars(slash + 1, end, shard.count);
+  return ec2 == std::errc() && rest == end && shard.IsValid();
+}
+
+std::string ShardPath(const std::string& path, const ShardSpec& shard) {
+  return path + ".shard-" + std::to_string(shard.index) + "-of-" +
+         std::to_string(shard.count);
+}
+
+RecordRange BinaryShardRange(const BinaryHeader& header,
+                             const ShardSpec& shard) noexcept {
+  RecordRange range;
+  if (!shard.IsValid()) return range;
+
+  const uint64_t blocks = header.BlockCount();
+  const uint64_t first_block = blocks * shard.index / shard.count;
+  const uint64_t last_block = blocks * (shard.index + 1) / shard.count;
+
+  range.first = first_block * header.block_records;
+  const uint64_t end = std::min<uint64_t>(
+      last_block * header.block_records, header.record_count);
+  range.count = end > range.first ? end - range.first : 0;
+  return range;
+}
+
+bool TextShardRange(const std::string& path, const ShardSpec& shard,
+                    ByteRange& range) {
+  if (!shard.IsValid()) return false;
+
+  File file;
+  if (!file.Open(path, File::OpenMode::kRead)) return false;
+
+  const int64_t size = file.Size();
+  if (size < 0) return false;
+  const uint64_t total = static_cast<uint64_t>(size);
+
+  const int64_t begin =
+      NextLineStart(file, total * shard.index / shard.count, total);
+  const int64_t end =
+      NextLineStart(file, total * (shard.index + 1) / shard.count, total);
+  if (begin < 0 || end < 0) return false;
+
+  range.begin = static_cast<uint64_t>(begin);
+  range.end = static_cast<uint64_t>(std::max(begin, end));
+  return true;
+}
+
+}  // namespace vccore
+}  // namespace spauly
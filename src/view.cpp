@@ -0,0 +1,42 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/view.h"
+
+#include "spauly/vccore/calculator.h"
+
+namespace spauly {
+namespace vccore {
+
+CalculationView::Iterator::reference CalculationView::Iterator::operator*()
+    const {
+  if (index_ < block_begin_ || index_ >= block_begin_ + block_size_) {
+    // Blocks are aligned to kBlockSize so every row is calculated once for a
+    // sequential pass.
+    block_begin_ = index_ - (index_ % kBlockSize);
+    block_size_ = view_->count_ - block_begin_;
+    if (block_size_ > kBlockSize) block_size_ = kBlockSize;
+
+    view_->calc_->Calculate(view_->in_ + block_begin_, block_.data(),
+                            block_size_, view_->units_);
+  }
+
+  return block_[index_ - block_begin_];
+}
+
+}  // namespace vccore
+}  // namespace spauly
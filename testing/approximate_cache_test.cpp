@@ -0,0 +1,162 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/approximate_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+double MaxDifference(const CorrectionFactors& a, const CorrectionFactors& b) {
+  double diff = std::max(std::fabs(a.q - b.q), std::fabs(a.eta - b.eta));
+  for (size_t j = 0; j < a.h.size(); j++) {
+    diff = std::max(diff, std::fabs(a.h[j] - b.h[j]));
+  }
+  return diff;
+}
+
+/// A sensor reading drifting around one duty point.
+std::vector<Parameters> MakeDrift(size_t rows) {
+  std::vector<Parameters> in;
+  for (size_t i = 0; i < rows; i++) {
+    const double drift = static_cast<double>(i % 50) * 0.1;
+    in.emplace_back(100.0 + drift * 0.2, 50.0, 300.0 + drift);
+  }
+  return in;
+}
+
+TEST(ApproximateCacheTest, DriftingQueriesHitWithinTolerance) {
+  Calculator calc;
+  ApproximateCache cache;
+  const std::vector<Parameters> in = MakeDrift(1000);
+
+  double max_diff = 0;
+  for (const Parameters& p : in) {
+    max_diff = std::max(max_diff,
+                        MaxDifference(cache.Calculate(p), calc.Calculate(p)));
+  }
+
+  EXPECT_EQ(cache.Hits() + cache.Misses(), in.size());
+  EXPECT_GT(cache.Hits(), in.size() * 9 / 10);
+  EXPECT_GT(cache.MaxError(), 0.0);
+  EXPECT_LE(cache.MaxError(), cache.Tolerance());
+  EXPECT_LE(max_diff, cache.Tolerance());
+}
+
+TEST(ApproximateCacheTest, StaysWithinToleranceAcrossTheCharts) {
+  Calculator calc;
+  ApproximateCache cache(1e-7, 0.5);
+
+  for (double flow = 6; flow <= 2000; flow *= 1.03) {
+    for (double visc = 10; visc <= 4000; visc *= 1.03) {
+      const Parameters p(flow, 40.0, visc);
+      const CorrectionFactors exact = calc.Calculate(p);
+
+      // The first call fills the cell, the second may interpolate.
+      cache.Calculate(p);
+      const CorrectionFactors approx = cache.Calculate(p);
+      EXPECT_LE(MaxDifference(approx, exact), 1e-7) << flow << " " << visc;
+      EXPECT_EQ(approx.error_flag, exact.error_flag);
+    }
+  }
+  // Wide cells near the fitted curves exceed the tolerance and fall back.
+  EXPECT_GT(cache.Hits(), 0u);
+  EXPECT_GT(cache.Misses(), 0u);
+}
+
+TEST(ApproximateCacheTest, ZeroToleranceIsExactOnCurves) {
+  Calculator calc;
+  ApproximateCache cache(0.0);
+
+  for (const Parameters& p : MakeDrift(200)) {
+    const CorrectionFactors exact = calc.Calculate(p);
+    const CorrectionFactors approx = cache.Calculate(p);
+    EXPECT_EQ(approx.q, exact.q);
+    EXPECT_EQ(approx.h, exact.h);
+  }
+  EXPECT_EQ(cache.Hits(), 0u);
+}
+
+TEST(ApproximateCacheTest, InvalidRowsAreNotCounted) {
+  ApproximateCache cache;
+  const CorrectionFactors cf = cache.Calculate(Parameters(1.0, 50.0, 300.0));
+  EXPECT_EQ(cf.error_flag, kFlowrateError);
+  EXPECT_EQ(cache.Hits() + cache.Misses(), 0u);
+}
+
+TEST(ApproximateCacheTest, UsedByFastBatches) {
+  Calculator calc;
+  ApproximateCache cache;
+  ThreadPoolExecutor pool(3);
+  const std::vector<Parameters> in = MakeDrift(5000);
+
+  BatchOptions options(&pool, 64);
+  options.approximate = &cache;
+  std::vector<CorrectionFactors> reproducible =
+      calc.Calculate(in, kStandardUnits, options);
+  EXPECT_EQ(cache.Hits() + cache.Misses(), 0u);
+
+  options.mode = ExecutionMode::kFast;
+  std::vector<CorrectionFactors> fast =
+      calc.Calculate(in, kStandardUnits, options);
+  EXPECT_EQ(cache.Hits() + cache.Misses(), in.size());
+  EXPECT_GT(cache.Hits(), 0u);
+
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_LE(MaxDifference(fast[i], reproducible[i]), cache.Tolerance());
+  }
+}
+
+TEST(ApproximateCacheTest, ConcurrentCallsAgree) {
+  Calculator calc;
+  ApproximateCache cache;
+  const std::vector<Parameters> in = MakeDrift(2000);
+
+  std::vector<std::thread> threads;
+  std::vector<double> max_diff(4, 0);
+  for (size_t t = 0; t < max_diff.size(); t++) {
+    threads.emplace_back([&, t]() {
+      for (const Parameters& p : in) {
+        max_diff[t] = std::max(
+            max_diff[t], MaxDifference(cache.Calculate(p), calc.Calculate(p)));
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  for (double diff : max_diff) EXPECT_LE(diff, cache.Tolerance());
+  EXPECT_EQ(cache.Hits() + cache.Misses(), in.size() * max_diff.size());
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
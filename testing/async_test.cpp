@@ -0,0 +1,115 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "spauly/vccore/async.h"
+#include "spauly/vccore/calculator.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+class AsyncTests : public testing::Test {
+ protected:
+  virtual void SetUp() override {
+    for (int i = 0; i < 5000; i++) {
+      in_.emplace_back(6.0 + (i % 1990), 5.0 + (i % 190), 10.0 + (i % 3000));
+    }
+  }
+
+ protected:
+  Calculator c_;
+  std::vector<Parameters> in_;
+};
+
+TEST(BatchHandleTests, DefaultHandleIsReady) {
+  BatchHandle handle;
+  EXPECT_TRUE(handle.IsReady());
+  handle.Wait();
+
+  bool ran = false;
+  handle.Then([&ran]() { ran = true; }).Wait();
+  EXPECT_TRUE(ran);
+}
+
+TEST(BatchHandleTests, ContinuationsRunInOrder) {
+  ThreadPoolExecutor pool(2);
+  std::vector<int> order;
+
+  BatchHandle handle =
+      BatchHandle::Post(&pool, [&order]() { order.push_back(1); })
+          .Then([&order]() { order.push_back(2); })
+          .Then([&order]() { order.push_back(3); });
+  handle.Wait();
+
+  EXPECT_TRUE(handle.IsReady());
+  EXPECT_EQ(order, (std::vector<int>{1, 2, 3}));
+}
+
+TEST_F(AsyncTests, CalculateAsyncMatchesBatch) {
+  ThreadPoolExecutor pool(3);
+  std::vector<CorrectionFactors> expected = c_.Calculate(in_);
+  std::vector<CorrectionFactors> out(in_.size());
+
+  BatchHandle handle = c_.CalculateAsync(in_.data(), out.data(), in_.size(),
+                                         kStandardUnits, BatchOptions(&pool));
+  handle.Wait();
+
+  for (size_t i = 0; i < in_.size(); i++) {
+    EXPECT_EQ(out.at(i).error_flag, expected.at(i).error_flag);
+    EXPECT_EQ(out.at(i).q, expected.at(i).q);
+    EXPECT_EQ(out.at(i).eta, expected.at(i).eta);
+  }
+}
+
+TEST_F(AsyncTests, CallbackAndChaining) {
+  ThreadPoolExecutor pool(2);
+  std::vector<CorrectionFactors> out(in_.size());
+  std::atomic<bool> callback{false};
+  double eta_sum = 0;
+
+  c_.CalculateAsync(in_.data(), out.data(), in_.size(), kStandardUnits,
+                    BatchOptions(&pool), [&callback]() { callback = true; })
+      .Then([&out, &eta_sum]() {
+        for (const auto& cf : out) eta_sum += cf.eta;
+      })
+      .Wait();
+
+  EXPECT_TRUE(callback);
+  EXPECT_GT(eta_sum, 0.0);
+}
+
+TEST_F(AsyncTests, WithoutExecutorRunsInline) {
+  std::vector<CorrectionFactors> out(in_.size());
+  BatchHandle handle = c_.CalculateAsync(in_.data(), out.data(), in_.size());
+  EXPECT_TRUE(handle.IsReady());
+  EXPECT_EQ(out.front().error_flag, c_.Calculate(in_.front()).error_flag);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
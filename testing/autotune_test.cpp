@@ -0,0 +1,191 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/autotune.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/approximate_cache.h"
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/executor.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+/// Small and quick, the tests check the choice and not the timing.
+TuneOptions QuickOptions(double max_error) {
+  TuneOptions options;
+  options.max_error = max_error;
+  options.rows = 4096;
+  options.repeat = 1;
+  options.max_threads = 2;
+  return options;
+}
+
+TEST(AutotuneTest, ReproducibleWithoutErrorBudget) {
+  Calculator calc;
+  TuneProfile profile = Autotune(calc, QuickOptions(0));
+
+  EXPECT_EQ(profile.mode, ExecutionMode::kReproducible);
+  EXPECT_FALSE(profile.UsesApproximate());
+  EXPECT_EQ(profile.error, 0.0);
+  EXPECT_GE(profile.threads, 1u);
+  EXPECT_LE(profile.threads, 2u);
+  EXPECT_GT(profile.rows_per_second, 0.0);
+  EXPECT_EQ(profile.fingerprint, HostFingerprint());
+}
+
+TEST(AutotuneTest, ProfileMeetsRequestedAccuracy) {
+  Calculator calc;
+  const double max_error = 1e-6;
+
+  // Clustered rows, so the approximate cache is a real candidate.
+  std::vector<Parameters> sample;
+  for (size_t i = 0; i < 8192; i++) {
+    const double drift = static_cast<double>(i % 500) * 0.01;
+    sample.emplace_back(100.0 + drift, 50.0, 300.0 + drift);
+  }
+  TuneProfile profile =
+      Autotune(calc, sample.data(), sample.size(), QuickOptions(max_error));
+  EXPECT_LE(profile.error, max_error);
+  EXPECT_EQ(profile.accuracy, max_error);
+
+  // Running the batch as the profile says stays within the budget as well.
+  ApproximateCache approximate(profile.approximate_tolerance,
+                               profile.UsesApproximate()
+                                   ? profile.approximate_step
+                                   : kDefaultApproximateStep);
+  ThreadPoolExecutor pool(profile.threads - 1);
+  BatchOptions options(profile.threads > 1 ? &pool : nullptr);
+  profile.Apply(options);
+  if (profile.UsesApproximate()) options.approximate = &approximate;
+
+  std::vector<CorrectionFactors> out(sample.size());
+  calc.Calculate(sample.data(), out.data(), sample.size(), kStandardUnits,
+                 options);
+  for (size_t i = 0; i < sample.size(); i++) {
+    const CorrectionFactors expected = calc.Calculate(sample[i]);
+    EXPECT_NEAR(out[i].q, expected.q, max_error);
+    EXPECT_NEAR(out[i].eta, expected.eta, max_error);
+    for (size_t j = 0; j < expected.h.size(); j++) {
+      EXPECT_NEAR(out[i].h[j], expected.h[j], max_error);
+    }
+  }
+}
+
+TEST(AutotuneTest, FormulaEngineSkipsTheApproximateCache) {
+  Calculator calc;
+  TuneOptions options = QuickOptions(1e-3);
+  options.engine = EngineOptions(Engine::kFormula, 1450);
+
+  TuneProfile profile = Autotune(calc, options);
+  EXPECT_FALSE(profile.UsesApproximate());
+  EXPECT_EQ(profile.engine.engine, Engine::kFormula);
+  EXPECT_EQ(profile.engine.speed, 1450);
+  EXPECT_LE(profile.error, 1e-3);
+}
+
+TEST(AutotuneTest, SavedProfileLoadsUnchanged) {
+  const std::string path = TempPath("roundtrip");
+  TuneProfile profile;
+  profile.fingerprint = HostFingerprint();
+  profile.accuracy = 1e-6;
+  profile.engine = EngineOptions(Engine::kFormula, 1450.5);
+  profile.mode = ExecutionMode::kFast;
+  profile.grain = 4096;
+  profile.threads = 3;
+  profile.approximate_step = 0.1;
+  profile.approximate_tolerance = 1e-6;
+  profile.error = 3.25e-9;
+  profile.rows_per_second = 1.25e7;
+  ASSERT_TRUE(SaveProfile(profile, path));
+
+  TuneProfile loaded;
+  ASSERT_TRUE(LoadProfile(path, loaded));
+  EXPECT_EQ(loaded.fingerprint, profile.fingerprint);
+  EXPECT_EQ(loaded.accuracy, profile.accuracy);
+  EXPECT_EQ(loaded.engine.engine, profile.engine.engine);
+  EXPECT_EQ(loaded.engine.speed, profile.engine.speed);
+  EXPECT_EQ(loaded.mode, profile.mode);
+  EXPECT_EQ(loaded.grain, profile.grain);
+  EXPECT_EQ(loaded.threads, profile.threads);
+  EXPECT_EQ(loaded.approximate_step, profile.approximate_step);
+  EXPECT_EQ(loaded.approximate_tolerance, profile.approximate_tolerance);
+  EXPECT_EQ(loaded.error, profile.error);
+  EXPECT_EQ(loaded.rows_per_second, profile.rows_per_second);
+  std::remove(path.c_str());
+}
+
+TEST(AutotuneTest, RejectsProfilesOfOtherHostsAndDamagedFiles) {
+  TuneProfile profile;
+  EXPECT_FALSE(LoadProfile(TempPath("missing"), profile));
+
+  const std::string other = TempPath("other_host");
+  std::ofstream(other) << "vccore-profile 1\ncores=0 isa=none\nthreads 1\n";
+  EXPECT_FALSE(LoadProfile(other, profile));
+
+  const std::string damaged = TempPath("damaged");
+  std::ofstream(damaged) << "vccore-profile 1\n"
+                         << HostFingerprint() << "\nengine 0 2900\nmode 7\n";
+  EXPECT_FALSE(LoadProfile(damaged, profile));
+
+  std::ofstream(damaged) << "vccore-profile 1\n"
+                         << HostFingerprint() << "\ngrain many\n";
+  EXPECT_FALSE(LoadProfile(damaged, profile));
+
+  std::remove(other.c_str());
+  std::remove(damaged.c_str());
+}
+
+TEST(AutotuneTest, TunesOnceThenLoadsTheProfile) {
+  Calculator calc;
+  const std::string path = TempPath("load_or_tune");
+  std::remove(path.c_str());
+
+  bool tuned = false;
+  TuneProfile first = LoadOrAutotune(path, calc, QuickOptions(0), &tuned);
+  EXPECT_TRUE(tuned);
+
+  TuneProfile second = LoadOrAutotune(path, calc, QuickOptions(0), &tuned);
+  EXPECT_FALSE(tuned);
+  EXPECT_EQ(second.threads, first.threads);
+  EXPECT_EQ(second.grain, first.grain);
+  EXPECT_EQ(second.mode, first.mode);
+
+  // Another accuracy needs another profile.
+  LoadOrAutotune(path, calc, QuickOptions(1e-6), &tuned);
+  EXPECT_TRUE(tuned);
+  std::remove(path.c_str());
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,214 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/binary_format.h"
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/impl/quantize.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+TEST(BinaryFormatTests, HeaderRoundTrip) {
+  BinaryHeader header;
+  header.kind = RecordKind::kResult;
+  header.record_count = 123456789;
+  header.record_bytes = kResultRecordBytes;
+  header.block_records = 512;
+  header.units =
+      Units(FlowrateUnit::kGallonsPerMinute, HeadUnit::kFeet,
+            ViscosityUnit::kcP, DensityUnit::kKilogramsPerCubicMeter);
+
+  std::vector<char> buffer(kBinaryHeaderBytes);
+  EncodeHeader(header, buffer.data());
+
+  // The layout is fixed little endian.
+  EXPECT_EQ(std::string(buffer.data(), 4), "VCCB");
+  EXPECT_EQ(buffer[4], static_cast<char>(kBinaryVersion));
+  EXPECT_EQ(buffer[6], 1);
+
+  BinaryHeader decoded;
+  ASSERT_TRUE(DecodeHeader(buffer.data(), decoded));
+  EXPECT_EQ(decoded.kind, RecordKind::kResult);
+  EXPECT_EQ(decoded.record_count, header.record_count);
+  EXPECT_EQ(decoded.record_bytes, header.record_bytes);
+  EXPECT_EQ(decoded.block_records, header.block_records);
+  EXPECT_EQ(decoded.units, header.units);
+  EXPECT_EQ(decoded.BlockCount(), (header.record_count + 511) / 512);
+  EXPECT_EQ(decoded.RecordOffset(2),
+            kBinaryHeaderBytes + 2 * kResultRecordBytes);
+}
+
+TEST(BinaryFormatTests, RejectsInvalidHeader) {
+  std::vector<char> buffer(kBinaryHeaderBytes);
+  BinaryHeader header;
+  EncodeHeader(header, buffer.data());
+
+  BinaryHeader decoded;
+  std::vector<char> bad_magic = buffer;
+  bad_magic[0] = 'X';
+  EXPECT_FALSE(DecodeHeader(bad_magic.data(), decoded));
+
+  // An input file must not claim result sized records.
+  header.record_bytes = kResultRecordBytes;
+  EncodeHeader(header, buffer.data());
+  EXPECT_FALSE(DecodeHeader(buffer.data(), decoded));
+}
+
+TEST(BinaryFormatTests, RecordsRoundTrip) {
+  std::vector<Parameters> in = {Parameters(100, 50, 200, 0.9),
+                                Parameters(-1.5, 1e300, 0, 0)};
+  std::vector<char> buffer(in.size() * kInputRecordBytes);
+  EncodeInputRecords(in.data(), in.size(), buffer.data());
+
+  std::vector<Parameters> decoded(in.size());
+  DecodeInputRecords(buffer.data(), in.size(), decoded.data());
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_EQ(decoded[i].flowrate, in[i].flowrate);
+    EXPECT_EQ(decoded[i].total_head, in[i].total_head);
+    EXPECT_EQ(decoded[i].viscosity, in[i].viscosity);
+    EXPECT_EQ(decoded[i].density, in[i].density);
+  }
+
+  CorrectionFactors cf;
+  cf.q = 0.95;
+  cf.eta = 0.5;
+  cf.h[0] = 1.0;
+  cf.h[3] = 0.25;
+  cf.error_flag = static_cast<size_t>(ErrorFlag::kParseError);
+
+  std::vector<char> result(kResultRecordBytes);
+  EncodeResultRecords(&cf, 1, result.data());
+
+  CorrectionFactors back;
+  DecodeResultRecords(result.data(), 1, &back);
+  EXPECT_EQ(back.q, cf.q);
+  EXPECT_EQ(back.eta, cf.eta);
+  for (size_t j = 0; j < 4; j++) EXPECT_EQ(back.h[j], cf.h[j]);
+  EXPECT_EQ(back.error_flag, cf.error_flag);
+}
+
+TEST(BinaryFormatTests, DoublesAreLittleEndian) {
+  // 1.0 is 0x3FF0000000000000, the sign and exponent bytes come last.
+  const Parameters one(1.0, 2.0, 3.0);
+  std::vector<char> buffer(kInputRecordBytes);
+  EncodeInputRecords(&one, 1, buffer.data());
+  const unsigned char expected[8] = {0, 0, 0, 0, 0, 0, 0xF0, 0x3F};
+  for (size_t i = 0; i < 8; i++) {
+    EXPECT_EQ(static_cast<unsigned char>(buffer[i]), expected[i]) << i;
+  }
+}
+
+TEST(BinaryFormatTests, QuantizedSimdMatchesScalar) {
+  std::vector<double> values = {0.0,
+                                1.0,
+                                0.5 / 32768.0,
+                                1.5 / 32768.0,
+                                65534.5 / 32768.0,
+                                2.0,
+                                1e9,
+                                -0.25,
+                                std::numeric_limits<double>::quiet_NaN()};
+  for (int i = 0; i < 1000; i++) values.push_back(i * 0.001234567);
+
+  std::vector<CorrectionFactors> in(values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    in[i].q = values[i];
+    in[i].eta = values[values.size() - 1 - i];
+    for (size_t j = 0; j < 4; j++) in[i].h[j] = values[(i + j) % values.size()];
+    in[i].error_flag = i % 64;
+  }
+
+  std::vector<char> simd(in.size() * kResultQ16RecordBytes);
+  std::vector<char> scalar(simd.size());
+  impl::QuantizeRecords(in.data(), in.size(), simd.data());
+  impl::QuantizeRecordsScalar(in.data(), in.size(), scalar.data());
+  ASSERT_EQ(std::memcmp(simd.data(), scalar.data(), simd.size()), 0);
+
+  std::vector<CorrectionFactors> a(in.size());
+  std::vector<CorrectionFactors> b(in.size());
+  impl::DequantizeRecords(simd.data(), in.size(), a.data());
+  impl::DequantizeRecordsScalar(simd.data(), in.size(), b.data());
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_EQ(a[i].q, b[i].q);
+    EXPECT_EQ(a[i].eta, b[i].eta);
+    for (size_t j = 0; j < 4; j++) EXPECT_EQ(a[i].h[j], b[i].h[j]);
+    EXPECT_EQ(a[i].error_flag, in[i].error_flag);
+  }
+
+  // Out of range values saturate.
+  EXPECT_EQ(a[0].q, 0.0);
+  EXPECT_EQ(a[5].q, 65535.0 / 32768.0);
+  EXPECT_EQ(a[7].q, 0.0);
+  EXPECT_EQ(a[8].q, 0.0);
+}
+
+TEST(BinaryFormatTests, QuantizedWithinResolution) {
+  Calculator calc;
+  std::vector<Parameters> in;
+  for (double q = 5; q < 2500; q *= 1.3) {
+    for (double h = 4; h < 250; h *= 1.3) {
+      for (double v = 5; v < 4500; v *= 1.5) in.emplace_back(q, h, v);
+    }
+  }
+  std::vector<CorrectionFactors> exact(in.size());
+  calc.Calculate(in.data(), exact.data(), in.size());
+
+  std::vector<char> buffer(in.size() * kResultQ16RecordBytes);
+  EncodeResultRecords(exact.data(), exact.size(), ResultEncoding::kQ16,
+                      buffer.data());
+  std::vector<CorrectionFactors> back(in.size());
+  DecodeResultRecords(buffer.data(), back.size(), ResultEncoding::kQ16,
+                      back.data());
+
+  const double tolerance = kQ16Resolution / 2;
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_NEAR(back[i].q, exact[i].q, tolerance);
+    EXPECT_NEAR(back[i].eta, exact[i].eta, tolerance);
+    for (size_t j = 0; j < 4; j++) {
+      EXPECT_NEAR(back[i].h[j], exact[i].h[j], tolerance);
+    }
+    EXPECT_EQ(back[i].error_flag, exact[i].error_flag);
+  }
+
+  BinaryHeader header;
+  header.kind = RecordKind::kResultQ16;
+  header.record_bytes = kResultQ16RecordBytes;
+  std::vector<char> raw(kBinaryHeaderBytes);
+  EncodeHeader(header, raw.data());
+  BinaryHeader decoded;
+  ASSERT_TRUE(DecodeHeader(raw.data(), decoded));
+  EXPECT_EQ(decoded.kind, RecordKind::kResultQ16);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -17,6 +17,8 @@
 // Contact via <https://github.com/SPauly/ViscoCorrectCore>
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "spauly/vccore/calculator.h"
 
 namespace spauly {
@@ -72,6 +74,132 @@ TEST_F(CalculatorTests, CalculateTest) {
   EXPECT_NEAR(cf.h.at(0), 0.97, 0.01);
 };
 
+TEST_F(CalculatorTests, BatchMatchesScalarTest) {
+  std::vector<Parameters> in;
+  for (int i = 0; i < 1001; i++) {
+    in.emplace_back(5.0 + i * 2.0, 4.0 + (i % 200), 9.0 + i * 4.0);
+  }
+
+  ThreadPoolExecutor pool(3);
+  std::vector<CorrectionFactors> seq = c_.Calculate(in);
+  std::vector<CorrectionFactors> par =
+      c_.Calculate(in, kStandardUnits, BatchOptions(&pool, 16));
+
+  ASSERT_EQ(seq.size(), in.size());
+  ASSERT_EQ(par.size(), in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    CorrectionFactors expected = c_.Calculate(in.at(i));
+    EXPECT_EQ(seq.at(i).error_flag, expected.error_flag);
+    EXPECT_EQ(par.at(i).error_flag, expected.error_flag);
+    EXPECT_EQ(par.at(i).q, expected.q);
+    EXPECT_EQ(par.at(i).eta, expected.eta);
+    EXPECT_EQ(par.at(i).h, expected.h);
+  }
+};
+
+TEST_F(CalculatorTests, BatchRegionsMatchScalarTest) {
+  // Rows of every region in a shuffled order: invalid input, left and right
+  // of all charts, inside some and inside all of them.
+  std::vector<Parameters> in;
+  for (size_t i = 0; i < 3000; i++) {
+    const double flow = 1.0 + static_cast<double>((i * 7919) % 2100);
+    const double head = 3.0 + static_cast<double>((i * 104729) % 210);
+    const double visc = 5.0 + static_cast<double>((i * 1299709) % 4100);
+    in.emplace_back(flow, head, visc, 900.0);
+  }
+  in.at(1000) = Parameters(2000.0, 200.0, 10.0, 900.0);  // Left of all charts.
+  in.at(2000) = Parameters(6.0, 5.0, 4000.0, 900.0);     // Right of all charts.
+
+  const Units units[] = {kStandardUnits,
+                         Units(FlowrateUnit::kGallonsPerMinute, HeadUnit::kFeet,
+                               ViscosityUnit::kcP,
+                               DensityUnit::kKilogramsPerCubicMeter)};
+  for (const Units& u : units) {
+    // Stale values in the output must be overwritten.
+    CorrectionFactors stale;
+    stale.q = stale.eta = -1;
+    stale.h = {-1, -1, -1, -1};
+    stale.error_flag = 99;
+    std::vector<CorrectionFactors> out(in.size(), stale);
+    c_.Calculate(in.data(), out.data(), in.size(), u);
+
+    size_t regions[4] = {};
+    for (size_t i = 0; i < in.size(); i++) {
+      CorrectionFactors expected = c_.Calculate(in.at(i), u);
+      EXPECT_EQ(out.at(i).error_flag, expected.error_flag);
+      EXPECT_EQ(out.at(i).q, expected.q) << "row " << i;
+      EXPECT_EQ(out.at(i).eta, expected.eta) << "row " << i;
+      EXPECT_EQ(out.at(i).h, expected.h) << "row " << i;
+
+      if (expected.error_flag != 0) {
+        regions[0]++;
+      } else if (expected.q == 1.0 && expected.h.at(0) == 1.0) {
+        regions[1]++;
+      } else if (expected.q == 0.0 && expected.eta == 0.0) {
+        regions[2]++;
+      } else {
+        regions[3]++;
+      }
+    }
+    if (u == kStandardUnits) {
+      for (size_t count : regions) EXPECT_GT(count, 0u);
+    }
+  }
+};
+
+TEST_F(CalculatorTests, ReproducibleAcrossThreadCountsTest) {
+  std::vector<Parameters> in;
+  for (size_t i = 0; i < 5000; i++) {
+    in.emplace_back(5.0 + static_cast<double>((i * 7919) % 2000),
+                    4.0 + static_cast<double>((i * 104729) % 200),
+                    9.0 + static_cast<double>((i * 1299709) % 4000));
+  }
+
+  std::vector<CorrectionFactors> expected;
+  for (const Parameters& p : in) expected.push_back(c_.Calculate(p));
+
+  for (size_t threads : {0, 1, 3, 7}) {
+    for (size_t grain : {8, 100, 4096}) {
+      ThreadPoolExecutor pool(threads);
+      BatchOptions options(&pool, grain);
+      options.mode = ExecutionMode::kReproducible;
+      std::vector<CorrectionFactors> out = c_.Calculate(in, kStandardUnits,
+                                                        options);
+      for (size_t i = 0; i < in.size(); i++) {
+        ASSERT_EQ(out.at(i).q, expected.at(i).q) << threads << " " << grain;
+        ASSERT_EQ(out.at(i).eta, expected.at(i).eta);
+        ASSERT_EQ(out.at(i).h, expected.at(i).h);
+        ASSERT_EQ(out.at(i).error_flag, expected.at(i).error_flag);
+      }
+    }
+  }
+};
+
+TEST_F(CalculatorTests, FastModeStaysCloseTest) {
+  std::vector<Parameters> in;
+  for (double flow = 6; flow <= 2000; flow *= 1.1) {
+    for (double visc = 10; visc <= 4000; visc *= 1.1) {
+      in.emplace_back(flow, 50.0, visc);
+    }
+  }
+
+  BatchOptions options;
+  options.mode = ExecutionMode::kFast;
+  std::vector<CorrectionFactors> fast = c_.Calculate(in, kStandardUnits,
+                                                     options);
+  std::vector<CorrectionFactors> exact = c_.Calculate(in);
+
+  bool any_difference = false;
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_EQ(fast.at(i).error_flag, exact.at(i).error_flag);
+    EXPECT_NEAR(fast.at(i).q, exact.at(i).q, 1e-12);
+    EXPECT_NEAR(fast.at(i).eta, exact.at(i).eta, 1e-12);
+    EXPECT_EQ(fast.at(i).h, exact.at(i).h);
+    any_difference |= fast.at(i).q != exact.at(i).q;
+  }
+  EXPECT_TRUE(any_difference);
+};
+
 }  // namespace
 
 }  // namespace vccore_testing
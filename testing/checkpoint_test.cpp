@@ -0,0 +1,254 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/checkpoint.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/pipeline.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+std::string ReadAll(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+TEST(CheckpointTests, MarkDoneMergesRanges) {
+  Checkpoint checkpoint(TempPath("ranges"), "job");
+  for (uint64_t chunk : {5, 0, 2, 1, 7, 6, 6}) checkpoint.MarkDone(chunk);
+
+  ASSERT_EQ(checkpoint.Ranges().size(), 2u);
+  EXPECT_EQ(checkpoint.Ranges()[0], Checkpoint::Range(0, 3));
+  EXPECT_EQ(checkpoint.Ranges()[1], Checkpoint::Range(5, 8));
+  EXPECT_EQ(checkpoint.DoneCount(), 6u);
+  EXPECT_TRUE(checkpoint.IsDone(2));
+  EXPECT_FALSE(checkpoint.IsDone(3));
+  EXPECT_FALSE(checkpoint.IsDone(8));
+
+  checkpoint.MarkDone(3);
+  checkpoint.MarkDone(4);
+  ASSERT_EQ(checkpoint.Ranges().size(), 1u);
+  EXPECT_EQ(checkpoint.Ranges()[0], Checkpoint::Range(0, 8));
+}
+
+TEST(CheckpointTests, SaveAndLoad) {
+  const std::string path = TempPath("save");
+  Checkpoint checkpoint(path, "job 1");
+  checkpoint.MarkDone(3);
+  checkpoint.MarkDone(10);
+  ASSERT_TRUE(checkpoint.Save());
+
+  Checkpoint same(path, "job 1");
+  ASSERT_TRUE(same.Load());
+  EXPECT_EQ(same.Ranges(), checkpoint.Ranges());
+
+  // A checkpoint of another job is never applied.
+  Checkpoint other(path, "job 2");
+  EXPECT_FALSE(other.Load());
+  EXPECT_EQ(other.DoneCount(), 0u);
+
+  EXPECT_TRUE(checkpoint.Remove());
+  EXPECT_FALSE(same.Load());
+
+  // Disabled checkpoints do nothing.
+  Checkpoint disabled;
+  EXPECT_FALSE(disabled.IsEnabled());
+  EXPECT_FALSE(disabled.Due());
+  EXPECT_TRUE(disabled.Save());
+}
+
+TEST(CheckpointTests, ParallelForResumes) {
+  const std::string path = TempPath("parallel");
+  RemoveFile(path);
+  ThreadPoolExecutor pool(3);
+
+  constexpr size_t kCount = 1000;
+  constexpr size_t kChunk = 10;
+  std::vector<std::atomic<int>> calls(kCount);
+  auto task = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) calls[i]++;
+  };
+
+  // The first run is preempted at its second checkpoint.
+  Checkpoint first(path, "job", 0.0);
+  int flushes = 0;
+  EXPECT_FALSE(ParallelForCheckpointed(&pool, kCount, kChunk, first, task,
+                                       [&] { return ++flushes < 2; }));
+  const uint64_t saved = first.DoneCount();
+  EXPECT_GT(saved, 0u);
+  EXPECT_LT(saved, kCount / kChunk);
+
+  Checkpoint second(path, "job", 0.0);
+  ASSERT_TRUE(second.Load());
+  EXPECT_LE(second.DoneCount(), saved);
+  EXPECT_TRUE(ParallelForCheckpointed(&pool, kCount, kChunk, second, task,
+                                      [] { return true; }));
+  EXPECT_EQ(second.DoneCount(), kCount / kChunk);
+
+  // Chunks of the interrupted wave may run twice, none is lost.
+  for (size_t i = 0; i < kCount; i++) {
+    ASSERT_GE(calls[i].load(), 1) << i;
+    ASSERT_LE(calls[i].load(), 2) << i;
+  }
+}
+
+// Runs every chunk on the calling thread and cancels after calls calls.
+class CancellingExecutor : public SequentialExecutor {
+ public:
+  CancellingExecutor(CancellationToken& cancel, size_t calls)
+      : cancel_(cancel), calls_(calls) {}
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override {
+    SequentialExecutor::ParallelFor(count, grain, task);
+    if (--calls_ == 0) cancel_.Cancel();
+  }
+
+ private:
+  CancellationToken& cancel_;
+  size_t calls_;
+};
+
+TEST(CheckpointTests, ChangedModeDiscardsCheckpoint) {
+  Calculator calc;
+  const std::string input = TempPath("mode_in.vccb");
+  const std::string output = TempPath("mode_out.vccb");
+  const std::string ckpt = TempPath("mode_out.ckpt");
+  RemoveFile(ckpt);
+
+  std::stringstream csv;
+  for (size_t i = 0; i < 8 * kBinaryBlockRecords; i++) {
+    csv << 1 + i % 2000 << ',' << 1 + i % 200 << ',' << i % 4000 << '\n';
+  }
+  ASSERT_TRUE(ConvertToBinary(calc, csv, TextFormat::kCsv, input).ok);
+
+  // Leave a checkpoint of two reproducible chunks behind.
+  auto interrupt = [&]() {
+    CancellationToken cancel;
+    CancellingExecutor executor(cancel, 3);
+    PipelineOptions options;
+    options.chunk_records = kBinaryBlockRecords;
+    options.depth = 1;
+    options.checkpoint_path = ckpt;
+    options.batch.executor = &executor;
+    options.batch.cancel = &cancel;
+    PipelineResult result = RunBinaryBatch(calc, input, output, options);
+    EXPECT_TRUE(result.cancelled);
+    return result;
+  };
+  EXPECT_EQ(interrupt().resumed_rows, 0u);
+  EXPECT_EQ(interrupt().resumed_rows,
+            2 * kBinaryBlockRecords);
+
+  // A fast rerun must not keep the reproducible chunks.
+  PipelineOptions fast;
+  fast.chunk_records = kBinaryBlockRecords;
+  fast.checkpoint_path = ckpt;
+  fast.batch.mode = ExecutionMode::kFast;
+  PipelineResult result = RunBinaryBatch(calc, input, output, fast);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  EXPECT_EQ(result.resumed_rows, 0u);
+  EXPECT_EQ(result.rows, 8 * kBinaryBlockRecords);
+}
+
+#if !defined(_WIN32)
+TEST(CheckpointTests, BinaryBatchResumesAfterKill) {
+  Calculator calc;
+  const std::string input = TempPath("in.vccb");
+  const std::string whole = TempPath("whole.vccb");
+  const std::string output = TempPath("out.vccb");
+  const std::string ckpt = TempPath("out.ckpt");
+  RemoveFile(ckpt);
+
+  std::stringstream csv;
+  for (size_t i = 0; i < 64 * kBinaryBlockRecords; i++) {
+    csv << 1 + i % 2000 << ',' << 1 + i % 200 << ',' << i % 4000 << '\n';
+  }
+  ASSERT_TRUE(ConvertToBinary(calc, csv, TextFormat::kCsv, input).ok);
+  ASSERT_TRUE(RunBinaryBatch(calc, input, whole).ok);
+
+  PipelineOptions options;
+  options.chunk_records = kBinaryBlockRecords;
+  options.checkpoint_path = ckpt;
+  options.checkpoint_seconds = 0;
+
+  // Kill the first run as soon as a checkpoint records a completed chunk.
+  auto has_range = [&] {
+    std::ifstream probe(ckpt);
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(probe, line)) lines++;
+    return lines > 2;
+  };
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) _exit(RunBinaryBatch(calc, input, output, options).ok ? 0 : 1);
+
+  int status = 0;
+  bool killed = false;
+  while (waitpid(pid, &status, WNOHANG) == 0) {
+    if (has_range()) {
+      killed = kill(pid, SIGKILL) == 0;
+      waitpid(pid, &status, 0);
+      break;
+    }
+    usleep(100);
+  }
+
+  PipelineResult result = RunBinaryBatch(calc, input, output, options);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  EXPECT_EQ(result.rows, 64 * kBinaryBlockRecords);
+  EXPECT_LT(result.resumed_rows, result.rows);
+  if (killed) {
+    EXPECT_GT(result.resumed_rows, 0u);
+  }
+  EXPECT_EQ(ReadAll(output), ReadAll(whole));
+
+  // The checkpoint is gone once the batch is complete.
+  EXPECT_FALSE(std::ifstream(ckpt).good());
+}
+#endif
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
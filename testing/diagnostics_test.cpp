@@ -0,0 +1,179 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+TEST(DiagnosticsTests, DeliversEventsOfAllThreads) {
+  std::vector<DiagnosticEvent> events;
+  DiagnosticsChannel channel(
+      [&](const DiagnosticEvent* e, size_t n) {
+        events.insert(events.end(), e, e + n);
+      },
+      8192, std::chrono::milliseconds(1));
+
+  // The rings hold all events, so none is dropped.
+  constexpr uint32_t kThreads = 4;
+  constexpr uint64_t kEvents = 5000;
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      for (uint64_t i = 0; i < kEvents; i++) {
+        channel.Record(DiagnosticEvent{i, t, 0.0f});
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  channel.Flush();
+
+  // Events of one thread arrive in the order they were recorded.
+  std::vector<uint64_t> next(kThreads, 0);
+  for (const DiagnosticEvent& event : events) {
+    ASSERT_LT(event.flags, kThreads);
+    ASSERT_EQ(event.row, next[event.flags]++);
+  }
+  for (uint64_t n : next) EXPECT_EQ(n, kEvents);
+  EXPECT_EQ(channel.Dropped(), 0u);
+}
+
+TEST(DiagnosticsTests, DropsWhenFull) {
+  size_t received = 0;
+  DiagnosticsChannel channel(
+      [&](const DiagnosticEvent*, size_t n) { received += n; }, 8,
+      std::chrono::hours(1));
+
+  for (uint64_t i = 0; i < 20; i++) channel.Record(DiagnosticEvent{i, 1, 0});
+  channel.Flush();
+  EXPECT_EQ(received, 8u);
+  EXPECT_EQ(channel.Dropped(), 12u);
+
+  channel.Record(DiagnosticEvent{});
+  channel.Flush();
+  EXPECT_EQ(received, 9u);
+}
+
+TEST(DiagnosticsTests, BatchReportsFlaggedRows) {
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+
+  std::vector<Parameters> in;
+  for (size_t i = 0; i < 4000; i++) {
+    in.emplace_back(1.0 + static_cast<double>(i % 2000),
+                    1.0 + static_cast<double>(i % 200),
+                    static_cast<double>(i % 4000));
+  }
+  const std::vector<CorrectionFactors> expected = calc.Calculate(in);
+
+  std::mutex mutex;
+  std::map<uint64_t, DiagnosticEvent> events;
+  DiagnosticsChannel channel([&](const DiagnosticEvent* e, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < n; i++) events[e[i].row] = e[i];
+  });
+
+  BatchOptions options(&pool, 64);
+  options.diagnostics = &channel;
+  options.first_row = 1000;
+  const std::vector<CorrectionFactors> out =
+      calc.Calculate(in, kStandardUnits, options);
+  channel.Flush();
+
+  size_t input_errors = 0;
+  size_t out_of_range = 0;
+  for (size_t i = 0; i < in.size(); i++) {
+    ASSERT_EQ(out[i].q, expected[i].q);
+    ASSERT_EQ(out[i].error_flag, expected[i].error_flag);
+
+    const bool cut = expected[i].q == 0 || expected[i].eta == 0 ||
+                     expected[i].h[0] == 0;
+    auto it = events.find(1000 + i);
+    if (expected[i].error_flag != 0) {
+      ASSERT_NE(it, events.end()) << i;
+      EXPECT_EQ(it->second.flags, expected[i].error_flag);
+      EXPECT_TRUE(std::isnan(it->second.pos_main));
+      input_errors++;
+    } else if (cut) {
+      ASSERT_NE(it, events.end()) << i;
+      EXPECT_EQ(it->second.flags, ErrorFlag::kCalculationOOR);
+      EXPECT_GT(it->second.pos_main, 122.0f);
+      out_of_range++;
+    } else {
+      EXPECT_EQ(it, events.end()) << i;
+    }
+  }
+  EXPECT_GT(input_errors, 0u);
+  EXPECT_GT(out_of_range, 0u);
+  EXPECT_EQ(events.size(), input_errors + out_of_range);
+}
+
+TEST(DiagnosticsTests, FastBatchKeepsItsMode) {
+  Calculator calc;
+  std::vector<Parameters> in;
+  for (double flow = 6; flow <= 2000; flow *= 1.1) {
+    for (double visc = 10; visc <= 4000; visc *= 1.1) {
+      in.emplace_back(flow, 50.0, visc);
+    }
+  }
+
+  BatchOptions options;
+  options.mode = ExecutionMode::kFast;
+  const std::vector<CorrectionFactors> fast =
+      calc.Calculate(in, kStandardUnits, options);
+
+  std::vector<uint64_t> rows;
+  DiagnosticsChannel channel([&rows](const DiagnosticEvent* e, size_t n) {
+    for (size_t i = 0; i < n; i++) rows.push_back(e[i].row);
+  });
+  options.diagnostics = &channel;
+  const std::vector<CorrectionFactors> diagnosed =
+      calc.Calculate(in, kStandardUnits, options);
+  channel.Flush();
+
+  // Attaching diagnostics changes neither the bits nor the speed path.
+  for (size_t i = 0; i < in.size(); i++) {
+    ASSERT_EQ(diagnosed[i].q, fast[i].q) << i;
+    ASSERT_EQ(diagnosed[i].eta, fast[i].eta) << i;
+    ASSERT_EQ(diagnosed[i].h, fast[i].h) << i;
+  }
+  ASSERT_FALSE(rows.empty());
+  EXPECT_TRUE(std::is_sorted(rows.begin(), rows.end()));
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
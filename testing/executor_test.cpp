@@ -0,0 +1,101 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+// Checks that every index in [0, count) is visited exactly once.
+void ExpectFullCoverage(Executor& ex, size_t count, size_t grain) {
+  std::vector<std::atomic<int>> visits(count);
+  for (auto& v : visits) v = 0;
+
+  ex.ParallelFor(count, grain, [&visits, grain](size_t begin, size_t end) {
+    EXPECT_LE(end - begin, grain == 0 ? 1 : grain);
+    for (size_t i = begin; i < end; i++) visits[i]++;
+  });
+
+  for (size_t i = 0; i < count; i++) EXPECT_EQ(visits[i], 1) << "index " << i;
+}
+
+TEST(ExecutorTests, SequentialCoversRange) {
+  SequentialExecutor ex;
+  EXPECT_EQ(ex.Concurrency(), 1);
+  ExpectFullCoverage(ex, 0, 4);
+  ExpectFullCoverage(ex, 1000, 7);
+  ExpectFullCoverage(ex, 5, 0);
+}
+
+TEST(ExecutorTests, ThreadPoolCoversRange) {
+  ThreadPoolExecutor ex(3);
+  EXPECT_EQ(ex.Concurrency(), 4);
+  ExpectFullCoverage(ex, 0, 4);
+  ExpectFullCoverage(ex, 1, 4);
+  ExpectFullCoverage(ex, 10007, 13);
+}
+
+TEST(ExecutorTests, ThreadPoolWithOneWorker) {
+  // The caller and the single worker share the chunks.
+  ThreadPoolExecutor ex(1);
+  EXPECT_EQ(ex.Concurrency(), 2);
+  ExpectFullCoverage(ex, 333, 10);
+}
+
+TEST(ExecutorTests, ThreadPoolNestedParallelFor) {
+  ThreadPoolExecutor ex(2);
+  std::atomic<size_t> total{0};
+
+  ex.ParallelFor(8, 1, [&ex, &total](size_t, size_t) {
+    ex.ParallelFor(100, 10, [&total](size_t begin, size_t end) {
+      total += end - begin;
+    });
+  });
+
+  EXPECT_EQ(total, 800);
+}
+
+#if defined(VCCORE_HAS_OPENMP)
+TEST(ExecutorTests, OpenMPCoversRange) {
+  OpenMPExecutor ex(2);
+  EXPECT_EQ(ex.Concurrency(), 2);
+  ExpectFullCoverage(ex, 10007, 13);
+}
+#endif
+
+#if defined(VCCORE_HAS_PARALLEL_STL)
+TEST(ExecutorTests, ParallelAlgorithmsCoversRange) {
+  ParallelAlgorithmsExecutor ex;
+  ExpectFullCoverage(ex, 10007, 13);
+}
+#endif
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
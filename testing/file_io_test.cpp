@@ -0,0 +1,139 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/file_io.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+TEST(FileIoTests, AlignedBuffer) {
+  AlignedBuffer buffer(3 * kIoAlignment + 1);
+  ASSERT_NE(buffer.data(), nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data()) % kIoAlignment, 0u);
+  EXPECT_EQ(buffer.size(), 3 * kIoAlignment + 1);
+
+  AlignedBuffer moved(std::move(buffer));
+  EXPECT_EQ(buffer.data(), nullptr);
+  EXPECT_NE(moved.data(), nullptr);
+}
+
+TEST(FileIoTests, PositionedReadWrite) {
+  const std::string path = TempPath("positioned");
+  File file;
+  ASSERT_TRUE(file.Open(path, File::OpenMode::kWrite));
+
+  const char text[] = "0123456789";
+  EXPECT_EQ(file.WriteAt(text, 10, 100), 10);
+  EXPECT_EQ(file.Size(), 110);
+
+  char back[10];
+  File reader;
+  ASSERT_TRUE(reader.Open(path, File::OpenMode::kRead));
+  EXPECT_EQ(reader.ReadAt(back, 10, 100), 10);
+  EXPECT_EQ(std::memcmp(back, text, 10), 0);
+
+  // Reading past the end returns what is there.
+  EXPECT_EQ(reader.ReadAt(back, 10, 105), 5);
+
+  EXPECT_FALSE(File().Open(TempPath("missing/file"), File::OpenMode::kRead));
+}
+
+/// Runs the same sequence of writes and reads on both backends.
+void RoundTrip(IoBackend backend) {
+  const std::string path = TempPath("queue");
+  File file;
+  ASSERT_TRUE(file.Open(path, File::OpenMode::kReadWrite));
+
+  constexpr size_t kRequests = 6;
+  std::unique_ptr<IoQueue> queue = MakeIoQueue(backend, kRequests);
+  ASSERT_NE(queue, nullptr);
+
+  std::vector<AlignedBuffer> buffers;
+  for (size_t i = 0; i < kRequests; i++) {
+    buffers.emplace_back(kIoAlignment);
+    std::memset(buffers[i].data(), static_cast<int>('a' + i), kIoAlignment);
+
+    IoRequest request;
+    request.fd = file.Descriptor();
+    request.buffer = buffers[i].data();
+    request.size = kIoAlignment;
+    request.offset = i * kIoAlignment;
+    request.write = true;
+    request.tag = i;
+    ASSERT_TRUE(queue->Submit(request));
+  }
+  EXPECT_EQ(queue->InFlight(), kRequests);
+
+  std::vector<bool> seen(kRequests, false);
+  IoCompletion completion;
+  while (queue->WaitOne(completion)) {
+    ASSERT_LT(completion.tag, kRequests);
+    EXPECT_EQ(completion.result, static_cast<int64_t>(kIoAlignment));
+    seen[completion.tag] = true;
+  }
+  for (bool s : seen) EXPECT_TRUE(s);
+  EXPECT_EQ(queue->InFlight(), 0u);
+
+  for (size_t i = 0; i < kRequests; i++) {
+    std::memset(buffers[i].data(), 0, kIoAlignment);
+
+    IoRequest request;
+    request.fd = file.Descriptor();
+    request.buffer = buffers[i].data();
+    request.size = kIoAlignment;
+    request.offset = i * kIoAlignment;
+    request.tag = i;
+    ASSERT_TRUE(queue->Submit(request));
+  }
+  while (queue->WaitOne(completion)) {
+    EXPECT_EQ(completion.result, static_cast<int64_t>(kIoAlignment));
+    EXPECT_EQ(buffers[completion.tag].data()[kIoAlignment - 1],
+              static_cast<char>('a' + completion.tag));
+  }
+}
+
+TEST(FileIoTests, SyncQueue) {
+  EXPECT_EQ(MakeIoQueue(IoBackend::kSync, 4)->Backend(), IoBackend::kSync);
+  RoundTrip(IoBackend::kSync);
+}
+
+TEST(FileIoTests, UringQueueOrFallback) {
+  // Without kernel support the queue silently falls back to kSync.
+  auto queue = MakeIoQueue(IoBackend::kIoUring, 4);
+  EXPECT_EQ(queue->Backend(),
+            IoUringAvailable() ? IoBackend::kIoUring : IoBackend::kSync);
+  RoundTrip(IoBackend::kIoUring);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,204 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/fixed_point.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+/// Valid inputs from the lower to the upper end of every scale.
+std::vector<Parameters> MakeGrid() {
+  std::vector<Parameters> in;
+  for (double flow = 6; flow <= 2000; flow *= 1.07) {
+    for (double head = 5; head <= 200; head *= 1.11) {
+      for (double visc = 10; visc <= 4000; visc *= 1.09) {
+        in.emplace_back(flow, head, visc);
+      }
+    }
+  }
+  // Exact scale ticks take a separate branch in the scale mapping.
+  in.emplace_back(100, 50, 1000);
+  in.emplace_back(6, 5, 10);
+  in.emplace_back(2000, 200, 4000);
+  return in;
+}
+
+/// True if a factor of the chart jumps within tolerance of pos.
+bool NearCutoff(double pos, double tolerance) {
+  for (double cutoff : {122.0, 146.0, 242.0, 363.0, 382.0, 384.0}) {
+    if (std::fabs(pos - cutoff) <= tolerance) return true;
+  }
+  return false;
+}
+
+template <typename Format>
+void ExpectCloseToCalculator(double max_error, double max_position_error) {
+  Calculator calc;
+  const double scale = static_cast<double>(uint64_t{1} << Format::kFrac);
+
+  for (const Parameters& p : MakeGrid()) {
+    const FixedParameters<Format> fp = ToFixed<Format>(p);
+    const double pos = impl::ChartPosition(p);
+    EXPECT_NEAR(static_cast<double>(impl::FixedPosition(fp)) / scale, pos,
+                max_position_error);
+    if (NearCutoff(pos, max_position_error)) continue;
+
+    const CorrectionFactors expected = calc.Calculate(p);
+    const CorrectionFactors got = ToCorrectionFactors(CalculateFixed(fp));
+    ASSERT_EQ(got.error_flag, expected.error_flag);
+    EXPECT_NEAR(got.q, expected.q, max_error);
+    EXPECT_NEAR(got.eta, expected.eta, max_error);
+    for (size_t i = 0; i < 4; i++) {
+      EXPECT_NEAR(got.h[i], expected.h[i], max_error);
+    }
+  }
+}
+
+TEST(FixedPointTest, Q16StaysWithinDocumentedError) {
+  ExpectCloseToCalculator<FixedQ16>(1e-5, 1e-4);
+}
+
+TEST(FixedPointTest, Q32StaysWithinDocumentedError) {
+  ExpectCloseToCalculator<FixedQ32>(5e-10, 1e-8);
+}
+
+TEST(FixedPointTest, ErrorFlagsMatchCalculator) {
+  Calculator calc;
+  const Parameters invalid[] = {
+      {5, 50, 100},     {2001, 50, 100}, {100, 4, 100},  {100, 201, 100},
+      {100, 50, 9},     {100, 50, 4001}, {1, 1, 1},      {-3, 50, 100},
+      {1e9, 1e9, 1e9}, {100, 50, -1e9}};
+
+  for (const Parameters& p : invalid) {
+    const CorrectionFactors expected = calc.Calculate(p);
+    EXPECT_EQ(CalculateFixed(ToFixed<FixedQ16>(p)).error_flag,
+              expected.error_flag);
+    EXPECT_EQ(CalculateFixed(ToFixed<FixedQ32>(p)).error_flag,
+              expected.error_flag);
+  }
+}
+
+TEST(FixedPointTest, FactorsOutsideTheChartsAreConstant) {
+  // High flow and low viscosity lie left of all charts, the reverse right
+  // of them.
+  const FixedFactors<FixedQ16> left =
+      CalculateFixed(ToFixed<FixedQ16>(Parameters(2000, 200, 10)));
+  const FixedFactors<FixedQ16> right =
+      CalculateFixed(ToFixed<FixedQ16>(Parameters(6, 5, 4000)));
+  const int32_t one = int32_t{1} << FixedQ16::kFrac;
+
+  EXPECT_EQ(left.q, one);
+  EXPECT_EQ(left.eta, one);
+  for (int32_t h : left.h) EXPECT_EQ(h, one);
+  EXPECT_EQ(right.q, 0);
+  EXPECT_EQ(right.eta, 0);
+  for (int32_t h : right.h) EXPECT_EQ(h, 0);
+}
+
+TEST(FixedPointTest, ScaleTicksMapToWholePixels) {
+  using C = impl::FixedChart<FixedQ16>;
+  static_assert(impl::FixedFitToScale<FixedQ16>(impl::kFlowrateScale,
+                                                C::kFlowrateRatios,
+                                                int32_t{7} << 16, 0) ==
+                int32_t{14} << 16);
+  static_assert(impl::FixedFitToScale<FixedQ16>(impl::kViscoScale,
+                                                C::kViscoRatios,
+                                                int32_t{20} << 16, 105) ==
+                int32_t{132} << 16);
+  static_assert(impl::FixedFitToScale<FixedQ16>(impl::kTotalHeadScale,
+                                                C::kTotalHeadRatios,
+                                                int32_t{201} << 16, 1) ==
+                -(int32_t{1} << 16));
+}
+
+TEST(FixedPointTest, PortableMultiplyMatchesNative) {
+#if defined(__SIZEOF_INT128__)
+  std::mt19937_64 rng(7);
+  // Operands of the sizes the engine uses, both signs, every shift.
+  for (int i = 0; i < 100000; i++) {
+    const int64_t a = static_cast<int64_t>(rng()) >> (rng() % 40 + 20);
+    const int64_t b = static_cast<int64_t>(rng()) >> (rng() % 40 + 2);
+    const int shift = static_cast<int>(rng() % 63) + 1;
+
+    // Skip products whose result does not fit into 64 bits.
+    const __int128 p = static_cast<__int128>(a) * b;
+    if ((p >> shift) > INT64_MAX / 2 || (p >> shift) < INT64_MIN / 2) continue;
+
+    ASSERT_EQ(impl::MulShiftPortable(a, b, shift), impl::MulShift(a, b, shift))
+        << a << " * " << b << " >> " << shift;
+  }
+#else
+  GTEST_SKIP() << "No 128 bit integer type to compare against.";
+#endif
+}
+
+TEST(FixedPointTest, ResultsArePinned) {
+  // The engine only uses integer arithmetic, so these hashes are the same on
+  // every target. A change means the results changed.
+  uint64_t hash16 = 14695981039346656037ull;
+  uint64_t hash32 = 14695981039346656037ull;
+  auto mix = [](uint64_t& hash, uint64_t v) {
+    hash = (hash ^ v) * 1099511628211ull;
+  };
+
+  for (int32_t flow = 6; flow <= 2000; flow += 37) {
+    for (int32_t head = 5; head <= 200; head += 13) {
+      for (int32_t visc = 10; visc <= 4000; visc += 71) {
+        FixedParameters<FixedQ16> p16;
+        p16.flowrate = (flow << 16) + 12345;
+        p16.total_head = head << 16;
+        p16.viscosity = visc << 16;
+        const FixedFactors<FixedQ16> f16 = CalculateFixed(p16);
+        mix(hash16, static_cast<uint32_t>(f16.q));
+        mix(hash16, static_cast<uint32_t>(f16.eta));
+        for (int32_t h : f16.h) mix(hash16, static_cast<uint32_t>(h));
+
+        FixedParameters<FixedQ32> p32;
+        p32.flowrate = (int64_t{flow} << 32) + 123456789;
+        p32.total_head = int64_t{head} << 32;
+        p32.viscosity = int64_t{visc} << 32;
+        const FixedFactors<FixedQ32> f32 = CalculateFixed(p32);
+        mix(hash32, static_cast<uint64_t>(f32.q));
+        mix(hash32, static_cast<uint64_t>(f32.eta));
+        for (int64_t h : f32.h) mix(hash32, static_cast<uint64_t>(h));
+      }
+    }
+  }
+
+  EXPECT_EQ(hash16, 1935105097107408245ull);
+  EXPECT_EQ(hash32, 8378660910280772511ull);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
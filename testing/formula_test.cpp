@@ -0,0 +1,226 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/impl/formula.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/executor.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+const EngineOptions kFormula(Engine::kFormula);
+
+/// Covers B from below 1 to beyond 40 and a few invalid rows.
+std::vector<Parameters> MakeGrid() {
+  std::vector<Parameters> in;
+  for (double flow = 0.5; flow < 5000; flow *= 1.21) {
+    for (double head = 0.5; head < 500; head *= 1.33) {
+      for (double visc = 0.5; visc < 10000; visc *= 1.25) {
+        in.emplace_back(flow, head, visc, 870);
+      }
+    }
+  }
+  in.emplace_back(0, 50, 100);
+  in.emplace_back(100, -1, 100);
+  in.emplace_back(100, 50, std::nan(""));
+  return in;
+}
+
+TEST(FormulaTest, MatchesTheStandard) {
+  Calculator calc;
+
+  // Values of the HI 9.6.7 equations, calculated independently.
+  const CorrectionFactors cf =
+      calc.Calculate(Parameters(100, 50, 500), kStandardUnits, kFormula);
+  EXPECT_EQ(cf.error_flag, 0u);
+  EXPECT_NEAR(cf.q, 0.7082925263349997, 1e-12);
+  EXPECT_NEAR(cf.eta, 0.304598275643172, 1e-12);
+  EXPECT_NEAR(cf.h[0], 0.8011337914471112, 1e-12);
+  EXPECT_NEAR(cf.h[1], 0.7532455200126269, 1e-12);
+  EXPECT_NEAR(cf.h[2], 0.7082925263349997, 1e-12);
+  EXPECT_NEAR(cf.h[3], 0.6655482362255565, 1e-12);
+
+  const CorrectionFactors low_b = calc.Calculate(
+      Parameters(500, 80, 20), kStandardUnits, kFormula);
+  EXPECT_NEAR(low_b.q, 0.9956154322124682, 1e-12);
+  EXPECT_NEAR(low_b.eta, 0.9361765665359432, 1e-12);
+}
+
+TEST(FormulaTest, AppliesBetweenBOneAndForty) {
+  Calculator calc;
+
+  // B is about 0.73, the fluid behaves like water.
+  const CorrectionFactors water = calc.Calculate(
+      Parameters(2000, 5, 10), kStandardUnits, kFormula);
+  EXPECT_EQ(water.error_flag, 0u);
+  EXPECT_EQ(water.q, 1.0);
+  EXPECT_EQ(water.eta, 1.0);
+  for (double h : water.h) EXPECT_EQ(h, 1.0);
+
+  // B is about 45.9, beyond the method.
+  const EngineOptions slow(Engine::kFormula, 1450);
+  const CorrectionFactors beyond =
+      calc.Calculate(Parameters(30, 20, 1000), kStandardUnits, slow);
+  EXPECT_EQ(beyond.error_flag, ErrorFlag::kCalculationOOR);
+  EXPECT_EQ(beyond.q, 0.0);
+
+  const EngineOptions no_speed(Engine::kFormula, 0);
+  EXPECT_EQ(calc.Calculate(Parameters(100, 50, 500), kStandardUnits, no_speed)
+                .error_flag,
+            ErrorFlag::kCalculationOOR);
+}
+
+TEST(FormulaTest, ChartEngineIsTheDefault) {
+  Calculator calc;
+  for (const Parameters& p : MakeGrid()) {
+    EXPECT_TRUE(SameBits(calc.Calculate(p, kStandardUnits, EngineOptions()),
+                         calc.Calculate(p)));
+  }
+}
+
+TEST(FormulaTest, ConvertsUnits) {
+  Calculator calc;
+  const Units u(FlowrateUnit::kGallonsPerMinute, HeadUnit::kFeet,
+                ViscosityUnit::kcP);
+
+  for (const Parameters& p : MakeGrid()) {
+    const CorrectionFactors expected = calc.Calculate(
+        calc.GetConverted(p, u), kStandardUnits, kFormula);
+    EXPECT_TRUE(SameBits(calc.Calculate(p, u, kFormula), expected));
+  }
+}
+
+TEST(FormulaTest, ReproducibleBatchMatchesScalar) {
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+  const std::vector<Parameters> in = MakeGrid();
+
+  BatchOptions options(&pool, 40);
+  options.engine = kFormula;
+  const std::vector<CorrectionFactors> out =
+      calc.Calculate(in, kStandardUnits, options);
+
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_TRUE(SameBits(out[i], calc.Calculate(in[i], kStandardUnits,
+                                                kFormula)))
+        << "row " << i;
+  }
+}
+
+TEST(FormulaTest, VectorisedBatchStaysClose) {
+  Calculator calc;
+  const std::vector<Parameters> in = MakeGrid();
+  const Units u(FlowrateUnit::kLitersPerMinute);
+
+  BatchOptions options;
+  options.engine = kFormula;
+  options.mode = ExecutionMode::kFast;
+  const std::vector<CorrectionFactors> out = calc.Calculate(in, u, options);
+
+  size_t corrected = 0;
+  for (size_t i = 0; i < in.size(); i++) {
+    const CorrectionFactors expected = calc.Calculate(in[i], u, kFormula);
+    ASSERT_EQ(out[i].error_flag, expected.error_flag) << "row " << i;
+    EXPECT_NEAR(out[i].q, expected.q, 1e-12);
+    EXPECT_NEAR(out[i].eta, expected.eta, 1e-12);
+    for (size_t j = 0; j < 4; j++) {
+      EXPECT_NEAR(out[i].h[j], expected.h[j], 1e-12);
+    }
+    if (expected.error_flag == 0 && expected.q < 1.0) corrected++;
+  }
+  EXPECT_GT(corrected, in.size() / 4);
+}
+
+TEST(FormulaTest, VectorisedLanesMatchScalarRows) {
+  const std::vector<Parameters> in = MakeGrid();
+  const double ln_const = std::log(impl::kFormulaB) - 0.25 * std::log(2900.0);
+
+  // The SSE2 lanes take the same steps as the scalar tail of a block, so a
+  // row gets the same result in either.
+  for (size_t i = 0; i + 1 < in.size(); i += 2) {
+    double flow[2] = {in[i].flowrate, in[i + 1].flowrate};
+    double head[2] = {in[i].total_head, in[i + 1].total_head};
+    double visc[2] = {in[i].viscosity, in[i + 1].viscosity};
+    double ln_b[2], cq[2], ceta[2];
+#if defined(VCCORE_FORMULA_SSE2)
+    impl::FormulaRows(flow, head, visc, ln_const, ln_b, cq, ceta);
+#else
+    for (size_t k = 0; k < 2; k++) {
+      impl::FormulaRow(flow[k], head[k], visc[k], ln_const, ln_b[k], cq[k],
+                       ceta[k]);
+    }
+#endif
+
+    for (size_t k = 0; k < 2; k++) {
+      double row_ln_b, row_cq, row_ceta;
+      impl::FormulaRow(flow[k], head[k], visc[k], ln_const, row_ln_b, row_cq,
+                       row_ceta);
+      EXPECT_EQ(ln_b[k], row_ln_b);
+      EXPECT_EQ(cq[k], row_cq);
+      EXPECT_EQ(ceta[k], row_ceta);
+    }
+  }
+}
+
+TEST(FormulaTest, DiagnosticsReportFlaggedRows) {
+  Calculator calc;
+  const std::vector<Parameters> in = MakeGrid();
+
+  std::mutex mutex;
+  std::vector<DiagnosticEvent> events;
+  DiagnosticsChannel channel([&](const DiagnosticEvent* e, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.insert(events.end(), e, e + n);
+  });
+
+  BatchOptions options;
+  options.engine = kFormula;
+  options.mode = ExecutionMode::kFast;
+  options.diagnostics = &channel;
+  const std::vector<CorrectionFactors> out =
+      calc.Calculate(in, kStandardUnits, options);
+  channel.Flush();
+
+  size_t flagged = 0;
+  for (const CorrectionFactors& cf : out) flagged += cf.error_flag != 0;
+  ASSERT_GT(flagged, 3u);
+  ASSERT_EQ(events.size(), flagged);
+  for (const DiagnosticEvent& e : events) {
+    EXPECT_EQ(e.flags, out[e.row].error_flag);
+    EXPECT_TRUE(std::isnan(e.pos_main));
+  }
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,85 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/freestanding.h"
+
+#include <gtest/gtest.h>
+
+#include <type_traits>
+#include <vector>
+
+#include "spauly/vccore/inline_calculator.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+// Only the freestanding library is linked here. CalculateInline is
+// bit-identical to Calculator.
+
+static_assert(std::is_trivially_copyable_v<CoreFactors>,
+              "CoreFactors must not own heap memory");
+
+std::vector<Parameters> MakeGrid() {
+  std::vector<Parameters> in;
+  for (double flow = 1; flow < 3000; flow *= 1.13) {
+    for (double head = 2; head < 300; head *= 1.27) {
+      for (double visc = 5; visc < 6000; visc *= 1.19) {
+        in.emplace_back(flow, head, visc, 870);
+      }
+    }
+  }
+  in.emplace_back(100, 50, 1000);
+  return in;
+}
+
+TEST(FreestandingTest, MatchesInlineCalculator) {
+  const Units units[] = {
+      kStandardUnits, Units(FlowrateUnit::kGallonsPerMinute, HeadUnit::kFeet),
+      Units(FlowrateUnit::kLitersPerMinute, HeadUnit::kMeters,
+            ViscosityUnit::kcP)};
+
+  for (const Units& u : units) {
+    for (const Parameters& p : MakeGrid()) {
+      const CorrectionFactors expected = CalculateInline(p, u);
+      EXPECT_TRUE(SameBits(CalculateCore(p, u), expected));
+      EXPECT_EQ(ValidateCore(p, u), expected.error_flag);
+    }
+  }
+}
+
+TEST(FreestandingTest, BatchMatchesSingleRows) {
+  const std::vector<Parameters> in = MakeGrid();
+  const Units u(FlowrateUnit::kLitersPerMinute);
+
+  std::vector<CoreFactors> out(in.size());
+  CalculateCore(in.data(), out.data(), in.size(), u);
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_TRUE(SameBits(out[i], CalculateCore(in[i], u))) << "row " << i;
+  }
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
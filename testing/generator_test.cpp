@@ -0,0 +1,161 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "spauly/vccore/generator.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+class GeneratorTests : public testing::Test {
+ protected:
+  virtual void SetUp() override {
+    spec_.flowrate = SweepAxis{10.0, 1000.0, 11};
+    spec_.total_head = SweepAxis{10.0, 150.0, 3};
+    spec_.viscosity = SweepAxis{20.0, 3000.0, 5};
+  }
+
+ protected:
+  Calculator c_;
+  SweepSpec spec_;
+};
+
+// Yields count Parameters and records how many were requested.
+Generator<Parameters> CountingSource(size_t count, size_t& produced) {
+  for (size_t i = 0; i < count; i++) {
+    produced++;
+    co_yield Parameters(100.0 + i, 50.0, 200.0);
+  }
+}
+
+TEST_F(GeneratorTests, SweepMatchesCalculate) {
+  size_t rows = 0;
+
+  for (const CorrectionBlock& block : Sweep(c_, spec_)) {
+    EXPECT_EQ(block.first, rows);
+    EXPECT_LE(block.factors.size(), kBlockSize);
+    ASSERT_EQ(block.factors.size(), block.parameters.size());
+
+    for (size_t i = 0; i < block.factors.size(); i++) {
+      CorrectionFactors expected = c_.Calculate(spec_.At(rows + i));
+      EXPECT_EQ(block.parameters[i].flowrate, spec_.At(rows + i).flowrate);
+      EXPECT_EQ(block.factors[i].q, expected.q);
+      EXPECT_EQ(block.factors[i].eta, expected.eta);
+      EXPECT_EQ(block.factors[i].error_flag, expected.error_flag);
+    }
+    rows += block.factors.size();
+  }
+
+  EXPECT_EQ(rows, spec_.Size());
+}
+
+TEST_F(GeneratorTests, SweepAxisEndpoints) {
+  EXPECT_EQ(spec_.flowrate.At(0), 10.0);
+  EXPECT_EQ(spec_.flowrate.At(10), 1000.0);
+  EXPECT_EQ(spec_.At(spec_.Size() - 1).viscosity, 3000.0);
+}
+
+TEST_F(GeneratorTests, StreamStopsEarly) {
+  size_t produced = 0;
+  auto source = CountingSource(1000, produced);
+
+  size_t blocks = 0;
+  for (const CorrectionBlock& block : Stream(c_, source)) {
+    EXPECT_EQ(block.factors.size(), kBlockSize);
+    if (++blocks == 2) break;
+  }
+
+  // Only the consumed blocks were pulled from the source.
+  EXPECT_EQ(produced, 2 * kBlockSize);
+}
+
+TEST_F(GeneratorTests, StreamOverVector) {
+  std::vector<Parameters> in(kBlockSize + 3, Parameters(100.0, 100.0, 100.0));
+
+  size_t rows = 0;
+  for (const CorrectionBlock& block : Stream(c_, in)) {
+    for (const auto& cf : block.factors) EXPECT_NEAR(cf.q, 0.98, 0.01);
+    rows += block.factors.size();
+  }
+
+  EXPECT_EQ(rows, in.size());
+}
+
+TEST_F(GeneratorTests, GeneratorsUseTheBatchEngine) {
+  BatchOptions options;
+  options.engine = EngineOptions(Engine::kFormula, 1450);
+  std::vector<Parameters> in;
+
+  for (const CorrectionBlock& block : Sweep(c_, spec_, kStandardUnits,
+                                            options)) {
+    for (size_t i = 0; i < block.factors.size(); i++) {
+      const CorrectionFactors expected =
+          c_.Calculate(block.parameters[i], kStandardUnits, options.engine);
+      EXPECT_EQ(block.factors[i].q, expected.q);
+      EXPECT_EQ(block.factors[i].eta, expected.eta);
+      EXPECT_EQ(block.factors[i].error_flag, expected.error_flag);
+      in.push_back(block.parameters[i]);
+    }
+  }
+
+  size_t rows = 0;
+  for (const CorrectionBlock& block : Stream(c_, in, kStandardUnits,
+                                             options)) {
+    for (size_t i = 0; i < block.factors.size(); i++) {
+      const CorrectionFactors expected =
+          c_.Calculate(in[rows + i], kStandardUnits, options.engine);
+      EXPECT_EQ(block.factors[i].q, expected.q);
+      EXPECT_EQ(block.factors[i].eta, expected.eta);
+    }
+    rows += block.factors.size();
+  }
+  EXPECT_EQ(rows, in.size());
+}
+
+TEST_F(GeneratorTests, SweepReportsProgressAndCancels) {
+  CancellationToken cancel;
+  ProgressSink progress;
+  BatchOptions options;
+  options.cancel = &cancel;
+  options.progress = &progress;
+
+  size_t blocks = 0;
+  for (const CorrectionBlock& block : Sweep(c_, spec_, kStandardUnits,
+                                            options)) {
+    EXPECT_EQ(progress.Total(), spec_.Size());
+    EXPECT_EQ(progress.Done(), block.first + block.factors.size());
+    if (++blocks == 3) cancel.Cancel();
+  }
+
+  // The block that was being consumed is the last one.
+  EXPECT_EQ(blocks, 3u);
+  EXPECT_EQ(progress.Done(), 3 * kBlockSize);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
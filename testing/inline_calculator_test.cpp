@@ -0,0 +1,107 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/inline_calculator.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+/// Covers both sides of every scale tick and chart cutoff.
+std::vector<Parameters> MakeGrid() {
+  std::vector<Parameters> in;
+  for (double flow = 1; flow < 3000; flow *= 1.09) {
+    for (double head = 2; head < 300; head *= 1.21) {
+      for (double visc = 5; visc < 6000; visc *= 1.17) {
+        in.emplace_back(flow, head, visc, 870);
+      }
+    }
+  }
+  // Exact scale ticks take a separate branch in the scale mapping.
+  in.emplace_back(100, 50, 1000);
+  in.emplace_back(6, 5, 10);
+  in.emplace_back(2000, 200, 4000);
+  return in;
+}
+
+TEST(InlineCalculatorTest, MatchesCalculatorInStandardUnits) {
+  Calculator calc;
+  for (const Parameters& p : MakeGrid()) {
+    EXPECT_TRUE(SameBits(CalculateInline(p), calc.Calculate(p)))
+        << p.flowrate << " " << p.total_head << " " << p.viscosity;
+  }
+}
+
+TEST(InlineCalculatorTest, MatchesCalculatorInOtherUnits) {
+  Calculator calc;
+  const Units units[] = {
+      Units(FlowrateUnit::kGallonsPerMinute, HeadUnit::kFeet),
+      Units(FlowrateUnit::kLitersPerMinute, HeadUnit::kMeters,
+            ViscosityUnit::kcP),
+      Units(FlowrateUnit::kCubicMetersPerHour, HeadUnit::kFeet,
+            ViscosityUnit::kmPas, DensityUnit::kKilogramsPerCubicMeter)};
+
+  for (const Units& u : units) {
+    for (const Parameters& p : MakeGrid()) {
+      EXPECT_TRUE(SameBits(CalculateInline(p, u), calc.Calculate(p, u)));
+    }
+  }
+
+  // Dynamic viscosity without a density is invalid.
+  const Parameters no_density(100, 50, 1000, 0);
+  EXPECT_EQ(CalculateInline(no_density, units[1]).error_flag,
+            calc.Calculate(no_density, units[1]).error_flag);
+  EXPECT_NE(CalculateInline(no_density, units[1]).error_flag, 0u);
+}
+
+TEST(InlineCalculatorTest, BatchMatchesCalculator) {
+  Calculator calc;
+  const std::vector<Parameters> in = MakeGrid();
+  const Units u(FlowrateUnit::kLitersPerMinute);
+
+  std::vector<CorrectionFactors> out(in.size());
+  CalculateInline(in.data(), out.data(), in.size(), u);
+  const std::vector<CorrectionFactors> expected = calc.Calculate(in, u);
+
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_TRUE(SameBits(out[i], expected[i])) << "row " << i;
+  }
+}
+
+TEST(InlineCalculatorTest, ScaleMappingIsConstexpr) {
+  static_assert(impl::ChartFitToScale(impl::kFlowrateScale, 6, 0) == 0.0);
+  static_assert(impl::ChartFitToScale(impl::kFlowrateScale, 7, 0) == 14.0);
+  static_assert(impl::ChartFitToScale(impl::kFlowrateScale, 3000, 0) == -1.0);
+  static_assert(impl::ChartValidQ(242.0) && !impl::ChartValidQ(241.9));
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
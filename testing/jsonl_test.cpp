@@ -0,0 +1,204 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/impl/simd_scan.h"
+#include "spauly/vccore/jsonl.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+TEST(JsonlTests, FindStructural) {
+  std::string s = "abcdefghijklmnopqrstuvwxyz0123456789 ]";
+  EXPECT_EQ(impl::FindStructural(s.data(), s.data() + s.size()),
+            s.data() + s.size() - 1);
+
+  std::string none = "0123456789.0123456789e-5";
+  EXPECT_EQ(impl::FindStructural(none.data(), none.data() + none.size()),
+            none.data() + none.size());
+
+  std::string line = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\nb";
+  EXPECT_EQ(impl::FindByte(line.data(), line.data() + line.size(), '\n'),
+            line.data() + 30);
+}
+
+TEST(JsonlTests, ParseRecord) {
+  Parameters p;
+  Units u;
+
+  ASSERT_TRUE(ParseJsonlRecord(
+      R"({"flowrate": 100.5, "total_head":50,"viscosity" : 2e2,)"
+      R"( "density": 0.9, "flowrate_unit": "l/min", "total_head_unit": "ft",)"
+      R"( "viscosity_unit": "cP", "density_unit": "kg/m3"})",
+      p, u));
+  EXPECT_EQ(p.flowrate, 100.5);
+  EXPECT_EQ(p.total_head, 50.0);
+  EXPECT_EQ(p.viscosity, 200.0);
+  EXPECT_EQ(p.density, 0.9);
+  EXPECT_EQ(u.flowrate, FlowrateUnit::kLitersPerMinute);
+  EXPECT_EQ(u.total_head, HeadUnit::kFeet);
+  EXPECT_EQ(u.viscosity, ViscosityUnit::kcP);
+  EXPECT_EQ(u.density, DensityUnit::kKilogramsPerCubicMeter);
+}
+
+TEST(JsonlTests, ParseRecordSkipsUnknownFields) {
+  Parameters p;
+  Units u;
+
+  ASSERT_TRUE(ParseJsonlRecord(
+      R"({"id": "pump \"7\"", "tags": [1, {"a": "}"}], "ok": true,)"
+      R"( "flowrate": 10, "total_head": 20, "viscosity": 30})",
+      p, u));
+  EXPECT_EQ(p.flowrate, 10.0);
+  EXPECT_EQ(p.viscosity, 30.0);
+  EXPECT_EQ(p.density, 0.0);
+  EXPECT_EQ(u, kStandardUnits);
+}
+
+TEST(JsonlTests, RejectsMalformedRecords) {
+  Parameters p;
+  Units u;
+
+  EXPECT_FALSE(ParseJsonlRecord(R"({"flowrate": })", p, u));
+  EXPECT_FALSE(ParseJsonlRecord(R"({"flowrate": 10)", p, u));
+  EXPECT_FALSE(ParseJsonlRecord(R"({"flowrate_unit": "furlong"})", p, u));
+  EXPECT_FALSE(ParseJsonlRecord(R"({"flowrate": 10} trailing)", p, u));
+  EXPECT_FALSE(ParseJsonlRecord(R"([1, 2])", p, u));
+  EXPECT_TRUE(ParseJsonlRecord(R"({})", p, u));
+}
+
+TEST(JsonlTests, ReaderHandlesSmallBuffers) {
+  std::stringstream ss;
+  ss << R"({"flowrate": 1, "total_head": 2, "viscosity": 3})" << "\n\n";
+  ss << R"({"flowrate": 4, "total_head": 5, "viscosity": 6})" << "\r\n";
+  ss << "not json\n";
+  ss << R"({"flowrate": 7, "padding": ")" << std::string(200, 'x')
+     << "\"}\n";
+  ss << R"({"flowrate": 8, "total_head": 9, "viscosity": 10})";
+
+  JsonlReader reader(ss, 64);
+  std::vector<Parameters> p(10);
+  std::vector<Units> u(10);
+  std::vector<size_t> flags(10);
+
+  size_t n = reader.Read(p.data(), u.data(), flags.data(), 2);
+  ASSERT_EQ(n, 2);
+  EXPECT_EQ(p[0].flowrate, 1.0);
+  EXPECT_EQ(p[1].viscosity, 6.0);
+
+  n = reader.Read(p.data(), u.data(), flags.data(), p.size());
+  ASSERT_EQ(n, 3);
+  EXPECT_EQ(flags[0], ErrorFlag::kParseError);  // not json
+  EXPECT_EQ(flags[1], ErrorFlag::kParseError);  // longer than the buffer
+  EXPECT_EQ(flags[2], 0);
+  EXPECT_EQ(p[2].flowrate, 8.0);
+
+  EXPECT_EQ(reader.Read(p.data(), u.data(), flags.data(), p.size()), 0);
+  EXPECT_EQ(reader.Rows(), 5);
+  EXPECT_EQ(reader.Malformed(), 2);
+}
+
+TEST(JsonlTests, CalculateJsonlMatchesCalculate) {
+  Calculator calc;
+  std::stringstream ss;
+  std::vector<Parameters> expected_in;
+  for (int i = 0; i < 1000; i++) {
+    Parameters p(10.0 + i, 10.0 + (i % 150), 20.0 + i * 3);
+    ss << "{\"flowrate\": " << p.flowrate << ", \"total_head\": "
+       << p.total_head << ", \"viscosity\": " << p.viscosity << "}\n";
+    expected_in.push_back(p);
+  }
+  ss << R"({"flowrate": 100, "total_head": 100, "viscosity": 100,)"
+     << R"( "flowrate_unit": "l/min"})" << "\n";
+  ss << "{broken\n";
+
+  ThreadPoolExecutor pool(2);
+  std::vector<CorrectionFactors> out;
+  size_t rows = CalculateJsonl(
+      calc, ss,
+      [&out](size_t first, const Parameters*, const CorrectionFactors* cf,
+             size_t count) {
+        EXPECT_EQ(first, out.size());
+        out.insert(out.end(), cf, cf + count);
+      },
+      BatchOptions(&pool), 100);
+
+  ASSERT_EQ(rows, 1002);
+  ASSERT_EQ(out.size(), 1002);
+  for (size_t i = 0; i < expected_in.size(); i++) {
+    CorrectionFactors expected = calc.Calculate(expected_in[i]);
+    EXPECT_EQ(out[i].q, expected.q);
+    EXPECT_EQ(out[i].error_flag, expected.error_flag);
+  }
+
+  CorrectionFactors lpm = calc.Calculate(
+      Parameters(100, 100, 100), Units(FlowrateUnit::kLitersPerMinute));
+  EXPECT_EQ(out[1000].q, lpm.q);
+  EXPECT_EQ(out[1000].error_flag, lpm.error_flag);
+  EXPECT_EQ(out[1001].error_flag, ErrorFlag::kParseError);
+}
+
+TEST(JsonlTests, MalformedRowsReportParseErrors) {
+  Calculator calc;
+  std::stringstream ss;
+  ss << R"({"flowrate": 100, "total_head": 50, "viscosity": 200})" << "\n"
+     << "{broken\n"
+     << R"({"flowrate": 80, "total_head": 60, "viscosity": 150})" << "\n";
+
+  std::vector<DiagnosticEvent> events;
+  DiagnosticsChannel channel([&events](const DiagnosticEvent* e, size_t n) {
+    events.insert(events.end(), e, e + n);
+  });
+  BatchOptions options;
+  options.diagnostics = &channel;
+  options.first_row = 10;
+
+  std::vector<CorrectionFactors> out;
+  CalculateJsonl(
+      calc, ss,
+      [&out](size_t, const Parameters*, const CorrectionFactors* cf,
+             size_t count) { out.insert(out.end(), cf, cf + count); },
+      options);
+  channel.Flush();
+
+  ASSERT_EQ(out.size(), 3u);
+  EXPECT_EQ(out[1].error_flag, ErrorFlag::kParseError);
+  EXPECT_EQ(out[2].q, calc.Calculate(Parameters(80, 60, 150)).q);
+
+  // Only the malformed row is reported, with its real flag.
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0].row, 11u);
+  EXPECT_EQ(events[0].flags, ErrorFlag::kParseError);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
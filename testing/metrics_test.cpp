@@ -0,0 +1,234 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/impl/chart.h"
+#include "spauly/vccore/jsonl.h"
+#include "spauly/vccore/metrics.h"
+#include "spauly/vccore/result_cache.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+bool Contains(const std::string& text, const std::string& line) {
+  return text.find(line) != std::string::npos;
+}
+
+TEST(MetricsTest, CountsBatchesRowsAndFlags) {
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+  Metrics metrics;
+  BatchOptions options(&pool, 64);
+  options.metrics = &metrics;
+
+  const std::vector<Parameters> in = MakeInput(5000);
+  std::vector<CorrectionFactors> out = calc.Calculate(in, kStandardUnits,
+                                                      options);
+  calc.Calculate(in.data(), out.data(), 10, kStandardUnits, options);
+
+  EXPECT_EQ(metrics.Calls(), 2u);
+  EXPECT_EQ(metrics.Rows(), 5010u);
+
+  out = calc.Calculate(in, kStandardUnits);
+  std::vector<uint64_t> expected(kErrorFlagCount, 0);
+  for (size_t i = 0; i < in.size(); i++) {
+    for (size_t bit = 0; bit < kErrorFlagCount; bit++) {
+      expected[bit] += ((out[i].error_flag >> bit) & 1) * (i < 10 ? 2 : 1);
+    }
+  }
+  for (size_t bit = 0; bit < kErrorFlagCount; bit++) {
+    // Chart cutoffs are counted without being in the results.
+    if (bit == 4) continue;
+    EXPECT_EQ(metrics.FlagCount(bit), expected[bit]) << "bit " << bit;
+  }
+  EXPECT_GT(metrics.FlagCount(2), 0u);
+}
+
+TEST(MetricsTest, CountsChartCutoffs) {
+  Calculator calc;
+  const std::vector<Parameters> in = MakeInput(5000);
+
+  uint64_t expected = 0;
+  for (const Parameters& p : in) {
+    if (impl::ChartValidate(p) != 0) continue;
+    expected += impl::ChartCutoff(impl::ChartPosition(p));
+  }
+  ASSERT_GT(expected, 0u);
+
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(TempPath("cutoffs.cache"), 1 << 14));
+  cache.Clear();
+
+  // Calculated, cached and cache hit rows count the same.
+  for (int run = 0; run < 4; run++) {
+    Metrics metrics;
+    BatchOptions options;
+    options.metrics = &metrics;
+    if (run == 1) options.mode = ExecutionMode::kFast;
+    if (run >= 2) options.cache = &cache;
+    calc.Calculate(in, kStandardUnits, options);
+    EXPECT_EQ(metrics.FlagCount(4), expected) << "run " << run;
+  }
+  std::remove(TempPath("cutoffs.cache").c_str());
+}
+
+TEST(MetricsTest, CountsParseErrors) {
+  Calculator calc;
+  Metrics metrics;
+  BatchOptions options;
+  options.metrics = &metrics;
+
+  std::stringstream in;
+  in << R"({"flowrate": 100, "total_head": 50, "viscosity": 200})" << "\n"
+     << "{broken\n";
+  CalculateJsonl(
+      calc, in,
+      [](size_t, const Parameters*, const CorrectionFactors*, size_t) {},
+      options);
+
+  // The malformed row counts as a parse error only.
+  EXPECT_EQ(metrics.Rows(), 2u);
+  for (size_t bit = 0; bit < kErrorFlagCount; bit++) {
+    EXPECT_EQ(metrics.FlagCount(bit), bit == 5 ? 1u : 0u) << "bit " << bit;
+  }
+  EXPECT_TRUE(Contains(metrics.Render(),
+                       "vccore_error_flags_total{flag=\"parse\"} 1\n"));
+}
+
+TEST(MetricsTest, RendersPrometheusText) {
+  Calculator calc;
+  Metrics metrics;
+  BatchOptions options;
+  options.metrics = &metrics;
+
+  const std::vector<Parameters> in = MakeInput(100);
+  calc.Calculate(in, kStandardUnits, options);
+  calc.Calculate(in, kStandardUnits, options);
+
+  metrics.AddCallback("vccore_test_gauge", "A test gauge.", MetricType::kGauge,
+                      []() { return 42.0; });
+
+  const std::string text = metrics.Render();
+  EXPECT_TRUE(Contains(text, "# TYPE vccore_batch_calls_total counter\n"));
+  EXPECT_TRUE(Contains(text, "\nvccore_batch_calls_total 2\n"));
+  EXPECT_TRUE(Contains(text, "\nvccore_rows_total 200\n"));
+  EXPECT_TRUE(Contains(text, "vccore_error_flags_total{flag=\"viscosity\"}"));
+
+  // Histogram buckets are cumulative and end with +Inf equal to the count.
+  EXPECT_TRUE(Contains(text, "vccore_batch_rows_bucket{le=\"64\"} 0\n"));
+  EXPECT_TRUE(Contains(text, "vccore_batch_rows_bucket{le=\"512\"} 2\n"));
+  EXPECT_TRUE(Contains(text, "vccore_batch_rows_bucket{le=\"+Inf\"} 2\n"));
+  EXPECT_TRUE(Contains(text, "vccore_batch_rows_count 2\n"));
+  EXPECT_TRUE(Contains(text, "vccore_batch_rows_sum 200\n"));
+  EXPECT_TRUE(
+      Contains(text, "vccore_batch_duration_seconds_bucket{le=\"+Inf\"} 2\n"));
+
+  EXPECT_TRUE(Contains(text, "# TYPE vccore_test_gauge gauge\n"));
+  EXPECT_TRUE(Contains(text, "\nvccore_test_gauge 42\n"));
+}
+
+TEST(MetricsTest, WritesTextfile) {
+  Metrics metrics;
+  metrics.RecordBatch(8, 0.001);
+
+  const std::string path = TempPath("textfile.prom");
+  ASSERT_TRUE(metrics.WriteTextfile(path));
+
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  EXPECT_EQ(text.str(), metrics.Render());
+  EXPECT_FALSE(std::ifstream(path + ".tmp").good());
+  std::remove(path.c_str());
+}
+
+TEST(MetricsTest, ReportsQueueDepth) {
+  ThreadPoolExecutor pool(2);
+  EXPECT_EQ(pool.QueueDepth(), 0u);
+
+  Metrics metrics;
+  metrics.AddCallback("vccore_queue_depth", "Queued tasks.",
+                      MetricType::kGauge,
+                      [&pool]() {
+                        return static_cast<double>(pool.QueueDepth());
+                      });
+  EXPECT_TRUE(Contains(metrics.Render(), "\nvccore_queue_depth 0\n"));
+}
+
+#if !defined(_WIN32)
+TEST(MetricsTest, ServesOverHttp) {
+  Metrics metrics;
+  metrics.RecordBatch(100, 0.002);
+
+  MetricsServer server(metrics);
+  ASSERT_TRUE(server.Start(0));
+  ASSERT_NE(server.Port(), 0);
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(server.Port());
+  ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+
+  const std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+  ASSERT_EQ(send(fd, request.data(), request.size(), 0),
+            static_cast<ssize_t>(request.size()));
+
+  std::string response;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, static_cast<size_t>(n));
+  }
+  close(fd);
+  server.Stop();
+
+  EXPECT_EQ(response.rfind("HTTP/1.0 200 OK\r\n", 0), 0u);
+  EXPECT_TRUE(Contains(response, "Content-Type: text/plain; version=0.0.4"));
+  EXPECT_TRUE(Contains(response, "\r\n\r\n" + metrics.Render()));
+}
+#endif
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,139 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/numa.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+// Two fake nodes so the partitioning is exercised on single node machines.
+std::vector<NumaNode> FakeNodes() {
+  NumaNode a;
+  a.id = 0;
+  a.cpus = {0};
+  NumaNode b;
+  b.id = 1;
+  b.cpus = {0, 0};
+  return {a, b};
+}
+
+TEST(NumaTests, DetectsAtLeastOneNode) {
+  auto nodes = DetectNumaNodes();
+  ASSERT_FALSE(nodes.empty());
+  for (const auto& node : nodes) EXPECT_FALSE(node.cpus.empty());
+}
+
+TEST(NumaTests, ParallelForCoversRange) {
+  NumaExecutor ex(FakeNodes(), false);
+  EXPECT_EQ(ex.Concurrency(), 3);
+
+  std::vector<std::atomic<int>> visits(10007);
+  for (auto& v : visits) v = 0;
+
+  ex.ParallelFor(visits.size(), 16, [&visits](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) visits[i]++;
+  });
+  for (size_t i = 0; i < visits.size(); i++) EXPECT_EQ(visits[i], 1);
+
+  // Every node processed its share of the range.
+  size_t total = 0;
+  for (const NodeStats& stats : ex.Stats()) total += stats.indices;
+  EXPECT_EQ(total, visits.size());
+
+  ex.ResetStats();
+  for (const NodeStats& stats : ex.Stats()) EXPECT_EQ(stats.indices, 0);
+}
+
+TEST(NumaTests, CallerOnlyWaits) {
+  NumaExecutor ex(FakeNodes(), false);
+  const std::thread::id caller = std::this_thread::get_id();
+
+  // The caller is on no node, so it must not touch any chunk.
+  std::atomic<int> by_caller{0};
+  ex.ParallelFor(4096, 16, [&](size_t, size_t) {
+    if (std::this_thread::get_id() == caller) by_caller++;
+  });
+  EXPECT_EQ(by_caller, 0);
+
+  // A call from inside a worker helps instead of blocking it.
+  std::atomic<size_t> nested{0};
+  ex.ParallelFor(6, 1, [&](size_t, size_t) {
+    ex.ParallelFor(64, 8, [&](size_t begin, size_t end) {
+      nested += end - begin;
+    });
+  });
+  EXPECT_EQ(nested, 6u * 64u);
+}
+
+TEST(NumaTests, FirstTouchUsesTheBatchGrain) {
+  NumaExecutor ex(FakeNodes(), false);
+  std::mutex mutex;
+  std::vector<size_t> begins;
+  ex.FirstTouch(1000, 100, [&](size_t begin, size_t) {
+    std::lock_guard<std::mutex> lock(mutex);
+    begins.push_back(begin);
+  });
+  ASSERT_EQ(begins.size(), 10u);
+  for (size_t begin : begins) EXPECT_EQ(begin % BlockAlignedGrain(100), 0u);
+}
+
+TEST(NumaTests, LargeBufferBatch) {
+  NumaExecutor ex(FakeNodes(), false);
+  BatchOptions options(&ex, 64);
+  Calculator calc;
+
+  LargeBuffer<Parameters> in(1000, options, true);
+  LargeBuffer<CorrectionFactors> out(1000, options, true);
+  ASSERT_EQ(in.size(), 1000);
+
+  for (size_t i = 0; i < in.size(); i++) {
+    in[i] = Parameters(10.0 + i, 20.0 + (i % 100), 30.0 + i);
+  }
+  calc.Calculate(in.data(), out.data(), in.size(), kStandardUnits, options);
+
+  for (size_t i = 0; i < in.size(); i++) {
+    EXPECT_EQ(out[i].q, calc.Calculate(in[i]).q);
+  }
+
+  LargeBuffer<CorrectionFactors> moved(std::move(out));
+  EXPECT_EQ(moved.size(), 1000);
+  EXPECT_EQ(out.data(), nullptr);
+}
+
+TEST(NumaTests, EmptyLargeBuffer) {
+  LargeBuffer<Parameters> empty(0);
+  EXPECT_EQ(empty.size(), 0);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
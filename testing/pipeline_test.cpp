@@ -0,0 +1,270 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/csv.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/pipeline.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+/// Writes in as CSV and converts it to a binary input file.
+void WriteBinaryInput(const Calculator& calc, const std::vector<Parameters>& in,
+                      const std::string& path) {
+  std::stringstream csv;
+  csv << "flowrate,total_head,viscosity\n";
+  for (const Parameters& p : in) {
+    csv << p.flowrate << ',' << p.total_head << ',' << p.viscosity << '\n';
+  }
+  PipelineResult result = ConvertToBinary(calc, csv, TextFormat::kCsv, path);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  ASSERT_EQ(result.rows, in.size());
+}
+
+void ExpectResults(const Calculator& calc, const std::vector<Parameters>& in,
+                   const std::string& result_path) {
+  std::stringstream csv;
+  PipelineResult result = ConvertResultsToCsv(result_path, csv);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  ASSERT_EQ(result.rows, in.size());
+
+  std::string line;
+  ASSERT_TRUE(std::getline(csv, line));
+  EXPECT_EQ(line, kCsvResultHeader);
+
+  for (size_t i = 0; i < in.size(); i++) {
+    ASSERT_TRUE(std::getline(csv, line));
+    CorrectionFactors got;
+    ASSERT_TRUE(ParseCsvResult(line, got)) << line;
+
+    CorrectionFactors expected = calc.Calculate(in[i]);
+    EXPECT_EQ(got.q, expected.q) << "row " << i;
+    EXPECT_EQ(got.eta, expected.eta) << "row " << i;
+    for (size_t j = 0; j < 4; j++) EXPECT_EQ(got.h[j], expected.h[j]);
+    EXPECT_EQ(got.error_flag, expected.error_flag) << "row " << i;
+  }
+}
+
+TEST(PipelineTests, CsvRecords) {
+  Parameters p;
+  EXPECT_TRUE(ParseCsvRecord("100, 50.5,200", p));
+  EXPECT_EQ(p.flowrate, 100.0);
+  EXPECT_EQ(p.total_head, 50.5);
+  EXPECT_EQ(p.viscosity, 200.0);
+  EXPECT_EQ(p.density, 0.0);
+
+  EXPECT_TRUE(ParseCsvRecord("1,2,3,0.9\r", p));
+  EXPECT_EQ(p.density, 0.9);
+
+  EXPECT_FALSE(ParseCsvRecord("1,2", p));
+  EXPECT_FALSE(ParseCsvRecord("1,x,3", p));
+  EXPECT_FALSE(ParseCsvRecord("1,2,3,4,5", p));
+
+  EXPECT_TRUE(IsCsvHeaderOrEmpty("flowrate,total_head,viscosity"));
+  EXPECT_TRUE(IsCsvHeaderOrEmpty("  "));
+  EXPECT_FALSE(IsCsvHeaderOrEmpty("-1,2,3"));
+}
+
+TEST(PipelineTests, BinaryBatchMatchesScalar) {
+  Calculator calc;
+  const std::vector<Parameters> in = MakeInput(3 * kBinaryBlockRecords + 17);
+  const std::string input = TempPath("in.vccb");
+  const std::string output = TempPath("out.vccb");
+  WriteBinaryInput(calc, in, input);
+
+  ThreadPoolExecutor pool(2);
+  for (IoBackend io : {IoBackend::kSync, IoBackend::kIoUring}) {
+    PipelineOptions options;
+    options.io = io;
+    options.chunk_records = 1;  // Rounded up to one block.
+    options.depth = 2;
+    options.batch.executor = &pool;
+
+    PipelineResult result = RunBinaryBatch(calc, input, output, options);
+    ASSERT_TRUE(result.ok) << result.error_msg;
+    EXPECT_EQ(result.rows, in.size());
+    if (io == IoBackend::kSync) {
+      EXPECT_EQ(result.io, IoBackend::kSync);
+    }
+
+    ExpectResults(calc, in, output);
+  }
+}
+
+TEST(PipelineTests, QuantizedBinaryBatch) {
+  Calculator calc;
+  const std::vector<Parameters> in = MakeInput(kBinaryBlockRecords + 3);
+  const std::string input = TempPath("q16_in.vccb");
+  const std::string output = TempPath("q16_out.vccb");
+  WriteBinaryInput(calc, in, input);
+
+  PipelineOptions options;
+  options.encoding = ResultEncoding::kQ16;
+  ASSERT_TRUE(RunBinaryBatch(calc, input, output, options).ok);
+
+  // A quarter of the size of the double encoding.
+  File file;
+  ASSERT_TRUE(file.Open(output, File::OpenMode::kRead));
+  EXPECT_EQ(file.Size(), static_cast<int64_t>(kBinaryHeaderBytes +
+                                              in.size() * 16));
+
+  std::stringstream csv;
+  ASSERT_TRUE(ConvertResultsToCsv(output, csv).ok);
+  std::string line;
+  std::getline(csv, line);
+
+  // Rounding to the grid and to 5 decimals.
+  const double tolerance = kQ16Resolution / 2 + 5e-6;
+  for (const Parameters& p : in) {
+    ASSERT_TRUE(std::getline(csv, line));
+    CorrectionFactors got;
+    ASSERT_TRUE(ParseCsvResult(line, got)) << line;
+
+    CorrectionFactors expected = calc.Calculate(p);
+    EXPECT_NEAR(got.q, expected.q, tolerance);
+    EXPECT_NEAR(got.eta, expected.eta, tolerance);
+    for (size_t j = 0; j < 4; j++) {
+      EXPECT_NEAR(got.h[j], expected.h[j], tolerance);
+    }
+    EXPECT_EQ(got.error_flag, expected.error_flag);
+  }
+}
+
+TEST(PipelineTests, BinaryBatchErrors) {
+  Calculator calc;
+  PipelineResult result =
+      RunBinaryBatch(calc, TempPath("missing.vccb"), TempPath("x.vccb"));
+  EXPECT_FALSE(result.ok);
+  EXPECT_FALSE(result.error_msg.empty());
+
+  // A result file is no valid input.
+  const std::vector<Parameters> in = MakeInput(10);
+  WriteBinaryInput(calc, in, TempPath("small.vccb"));
+  ASSERT_TRUE(RunBinaryBatch(calc, TempPath("small.vccb"),
+                             TempPath("small_out.vccb"))
+                  .ok);
+  EXPECT_FALSE(RunBinaryBatch(calc, TempPath("small_out.vccb"),
+                              TempPath("again.vccb"))
+                   .ok);
+}
+
+TEST(PipelineTests, ConvertedParseErrorsStayParseErrors) {
+  Calculator calc;
+  const std::string input = TempPath("unreadable.vccb");
+  const std::string output = TempPath("unreadable_out.vccb");
+
+  for (TextFormat format : {TextFormat::kCsv, TextFormat::kJsonl}) {
+    std::stringstream text;
+    if (format == TextFormat::kCsv) {
+      text << "100,50,200\nnot,a,row\n";
+    } else {
+      text << R"({"flowrate": 100, "total_head": 50, "viscosity": 200})"
+           << "\n{broken\n";
+    }
+    ASSERT_TRUE(ConvertToBinary(calc, text, format, input).ok);
+    ASSERT_TRUE(RunBinaryBatch(calc, input, output).ok);
+
+    std::stringstream csv;
+    ASSERT_TRUE(ConvertResultsToCsv(output, csv).ok);
+    std::string line;
+    CorrectionFactors cf;
+    ASSERT_TRUE(std::getline(csv, line));
+    ASSERT_TRUE(std::getline(csv, line));
+    ASSERT_TRUE(ParseCsvResult(line, cf));
+    EXPECT_EQ(cf.q, calc.Calculate(Parameters(100, 50, 200)).q);
+    ASSERT_TRUE(std::getline(csv, line));
+    ASSERT_TRUE(ParseCsvResult(line, cf));
+    EXPECT_EQ(cf.error_flag, static_cast<size_t>(ErrorFlag::kParseError));
+  }
+}
+
+TEST(PipelineTests, CsvBatch) {
+  Calculator calc;
+  std::stringstream in;
+  in << "flowrate,total_head,viscosity\n"
+     << "100,50,200\n"
+     << "\n"
+     << "not,a,row\n"
+     << "60,40,1000\n";
+
+  std::stringstream out;
+  PipelineOptions options;
+  options.chunk_records = 1;
+  PipelineResult result = RunCsvBatch(calc, in, out, kStandardUnits, options);
+  ASSERT_TRUE(result.ok);
+  EXPECT_EQ(result.rows, 3u);
+
+  std::string line;
+  ASSERT_TRUE(std::getline(out, line));
+  EXPECT_EQ(line, kCsvResultHeader);
+
+  CorrectionFactors cf;
+  ASSERT_TRUE(std::getline(out, line));
+  ASSERT_TRUE(ParseCsvResult(line, cf));
+  EXPECT_EQ(cf.q, calc.Calculate(Parameters(100, 50, 200)).q);
+
+  ASSERT_TRUE(std::getline(out, line));
+  ASSERT_TRUE(ParseCsvResult(line, cf));
+  EXPECT_EQ(cf.error_flag, static_cast<size_t>(ErrorFlag::kParseError));
+
+  ASSERT_TRUE(std::getline(out, line));
+  ASSERT_TRUE(ParseCsvResult(line, cf));
+  EXPECT_EQ(cf.eta, calc.Calculate(Parameters(60, 40, 1000)).eta);
+}
+
+TEST(PipelineTests, CsvBatchReportsParseErrors) {
+  Calculator calc;
+  std::stringstream in;
+  in << "100,50,200\n"
+     << "not,a,row\n"
+     << "80,60,150\n";
+
+  std::vector<DiagnosticEvent> events;
+  DiagnosticsChannel channel([&events](const DiagnosticEvent* e, size_t n) {
+    events.insert(events.end(), e, e + n);
+  });
+  std::stringstream out;
+  PipelineOptions options;
+  options.batch.diagnostics = &channel;
+  ASSERT_TRUE(RunCsvBatch(calc, in, out, kStandardUnits, options).ok);
+  channel.Flush();
+
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events[0].row, 1u);
+  EXPECT_EQ(events[0].flags, ErrorFlag::kParseError);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
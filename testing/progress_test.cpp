@@ -0,0 +1,205 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/pipeline.h"
+#include "spauly/vccore/progress.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+/// Runs every batch call on the calling thread and cancels the token at the
+/// start of call number cancel_at.
+class CancellingExecutor : public SequentialExecutor {
+ public:
+  CancellingExecutor(CancellationToken& cancel, size_t cancel_at)
+      : cancel_(cancel), cancel_at_(cancel_at) {}
+
+  virtual void ParallelFor(size_t count, size_t grain,
+                           const RangeTask& task) override {
+    if (calls_++ == cancel_at_) cancel_.Cancel();
+    SequentialExecutor::ParallelFor(count, grain, task);
+  }
+
+ private:
+  CancellationToken& cancel_;
+  size_t cancel_at_;
+  size_t calls_ = 0;
+};
+
+TEST(ProgressTests, BatchCountsEveryRow) {
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+  ProgressSink progress;
+
+  const std::vector<Parameters> in = MakeInput(10000);
+  BatchOptions options(&pool, 100);
+  options.progress = &progress;
+  std::vector<CorrectionFactors> out = calc.Calculate(in, kStandardUnits,
+                                                      options);
+
+  EXPECT_EQ(progress.Total(), in.size());
+  EXPECT_EQ(progress.Done(), in.size());
+  EXPECT_DOUBLE_EQ(progress.Fraction(), 1.0);
+  for (size_t i = 0; i < in.size(); i += 97) {
+    EXPECT_EQ(out[i].q, calc.Calculate(in[i]).q);
+  }
+
+  progress.Reset();
+  EXPECT_EQ(progress.Fraction(), 0.0);
+}
+
+TEST(ProgressTests, CancelledBatchSkipsAllChunks) {
+  Calculator calc;
+  CancellationToken cancel;
+  cancel.Cancel();
+
+  const std::vector<Parameters> in = MakeInput(1000);
+  CorrectionFactors untouched;
+  untouched.error_flag = 12345;
+  std::vector<CorrectionFactors> out(in.size(), untouched);
+
+  BatchOptions options;
+  options.cancel = &cancel;
+  calc.Calculate(in.data(), out.data(), in.size(), kStandardUnits, options);
+  for (const CorrectionFactors& cf : out) ASSERT_EQ(cf.error_flag, 12345u);
+
+  cancel.Reset();
+  calc.Calculate(in.data(), out.data(), in.size(), kStandardUnits, options);
+  EXPECT_EQ(out.back().error_flag, calc.Calculate(in.back()).error_flag);
+}
+
+TEST(ProgressTests, CancelStopsRunningBatch) {
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+  CancellationToken cancel;
+  ProgressSink progress;
+
+  const std::vector<Parameters> in = MakeInput(1 << 18);
+  std::vector<CorrectionFactors> out(in.size());
+  BatchOptions options(&pool);
+  options.cancel = &cancel;
+  options.progress = &progress;
+
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point cancelled_at;
+  std::thread canceller([&] {
+    while (progress.Done() == 0) std::this_thread::yield();
+    cancelled_at = Clock::now();
+    cancel.Cancel();
+  });
+  calc.Calculate(in.data(), out.data(), in.size(), kStandardUnits, options);
+  const Clock::time_point returned_at = Clock::now();
+  canceller.join();
+
+  EXPECT_LT(progress.Done(), progress.Total());
+  EXPECT_EQ(progress.Done() % kDefaultGrain, 0u);
+
+  // Only the chunks in flight finish, a chunk takes well below 1 ms. The
+  // bound is loose so that loaded machines pass as well.
+  const std::chrono::duration<double, std::milli> latency =
+      returned_at - cancelled_at;
+  EXPECT_LT(latency.count(), 50.0);
+}
+
+TEST(ProgressTests, CancelledBinaryBatchResumes) {
+  Calculator calc;
+  const std::string input = TempPath("in.vccb");
+  const std::string whole = TempPath("whole.vccb");
+  const std::string output = TempPath("out.vccb");
+  const std::string ckpt = TempPath("out.ckpt");
+  RemoveFile(ckpt);
+
+  std::stringstream csv;
+  for (const Parameters& p : MakeInput(8 * kBinaryBlockRecords)) {
+    csv << p.flowrate << ',' << p.total_head << ',' << p.viscosity << '\n';
+  }
+  ASSERT_TRUE(ConvertToBinary(calc, csv, TextFormat::kCsv, input).ok);
+  ASSERT_TRUE(RunBinaryBatch(calc, input, whole).ok);
+
+  // One chunk per block, the fourth calculation is cancelled.
+  CancellationToken cancel;
+  CancellingExecutor executor(cancel, 3);
+  ProgressSink progress;
+  PipelineOptions options;
+  options.chunk_records = kBinaryBlockRecords;
+  options.depth = 1;
+  options.checkpoint_path = ckpt;
+  options.batch.executor = &executor;
+  options.batch.cancel = &cancel;
+  options.batch.progress = &progress;
+
+  PipelineResult result = RunBinaryBatch(calc, input, output, options);
+  EXPECT_FALSE(result.ok);
+  EXPECT_TRUE(result.cancelled);
+  EXPECT_EQ(result.rows, 3 * kBinaryBlockRecords);
+  EXPECT_EQ(progress.Done(), 3 * kBinaryBlockRecords);
+  EXPECT_EQ(progress.Total(), 8 * kBinaryBlockRecords);
+
+  options.batch = BatchOptions();
+  result = RunBinaryBatch(calc, input, output, options);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  EXPECT_EQ(result.resumed_rows, 3 * kBinaryBlockRecords);
+
+  File a, b;
+  ASSERT_TRUE(a.Open(output, File::OpenMode::kRead));
+  ASSERT_TRUE(b.Open(whole, File::OpenMode::kRead));
+  ASSERT_EQ(a.Size(), b.Size());
+  std::vector<char> da(static_cast<size_t>(a.Size()));
+  std::vector<char> db(da.size());
+  a.ReadAt(da.data(), da.size(), 0);
+  b.ReadAt(db.data(), db.size(), 0);
+  EXPECT_TRUE(da == db);
+}
+
+TEST(ProgressTests, CancelledCsvBatch) {
+  Calculator calc;
+  CancellationToken cancel;
+  cancel.Cancel();
+
+  std::stringstream in("100,100,100\n200,50,300\n");
+  std::stringstream out;
+  PipelineOptions options;
+  options.batch.cancel = &cancel;
+
+  PipelineResult result = RunCsvBatch(calc, in, out, kStandardUnits, options);
+  EXPECT_FALSE(result.ok);
+  EXPECT_TRUE(result.cancelled);
+  EXPECT_EQ(result.rows, 0u);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
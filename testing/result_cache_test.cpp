@@ -0,0 +1,211 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/file_io.h"
+#include "spauly/vccore/result_cache.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+#if !defined(_WIN32)
+
+void ExpectSame(const CorrectionFactors& a, const CorrectionFactors& b) {
+  EXPECT_EQ(a.q, b.q);
+  EXPECT_EQ(a.eta, b.eta);
+  EXPECT_EQ(a.h, b.h);
+  EXPECT_EQ(a.error_flag, b.error_flag);
+}
+
+TEST(ResultCacheTests, InsertAndLookup) {
+  const std::string path = TempPath("basic");
+  RemoveFile(path);
+  Calculator calc;
+
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path, 100));
+  EXPECT_EQ(cache.SlotCount(), 128u);
+
+  const Parameters p(100.0, 100.0, 100.0);
+  CorrectionFactors got;
+  EXPECT_FALSE(cache.Lookup(p, got));
+
+  const CorrectionFactors expected = calc.Calculate(p);
+  cache.Insert(p, expected);
+  ASSERT_TRUE(cache.Lookup(p, got));
+  ExpectSame(got, expected);
+  EXPECT_FALSE(cache.Lookup(Parameters(100.0, 100.0, 101.0), got));
+
+  cache.Clear();
+  EXPECT_FALSE(cache.Lookup(p, got));
+}
+
+TEST(ResultCacheTests, BatchMatchesCalculator) {
+  const std::string path = TempPath("batch");
+  RemoveFile(path);
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path, 4096));
+
+  // Duty points repeat every 1000 rows.
+  std::vector<Parameters> in = MakeInput(1000);
+  in.insert(in.end(), in.begin(), in.end());
+  const std::vector<CorrectionFactors> expected = calc.Calculate(in);
+
+  BatchOptions parallel(&pool, 100);
+  parallel.cache = &cache;
+  BatchOptions sequential;
+  sequential.cache = &cache;
+  auto run = [&](const BatchOptions& options) {
+    const std::vector<CorrectionFactors> got =
+        calc.Calculate(in, kStandardUnits, options);
+    for (size_t i = 0; i < in.size(); i++) ExpectSame(got[i], expected[i]);
+  };
+
+  // Concurrent chunks may both miss a duty point and one of the inserts is
+  // skipped, the sequential run adds whatever the first one left out.
+  run(parallel);
+  run(sequential);
+  const uint64_t hits = cache.Hits();
+  run(parallel);
+  EXPECT_EQ(cache.Hits() - hits, in.size());
+  EXPECT_EQ(cache.Hits() + cache.Misses(), 3 * in.size());
+
+  // Rows in other units are keyed by their standard values.
+  Units units = kStandardUnits;
+  units.flowrate = FlowrateUnit::kLitersPerMinute;
+  const Parameters p(1000.0, 100.0, 100.0);
+  CorrectionFactors got;
+  cache.Calculate(calc, &p, &got, 1, units);
+  ASSERT_TRUE(cache.Lookup(calc.GetConverted(p, units), got));
+  ExpectSame(got, calc.Calculate(p, units));
+}
+
+TEST(ResultCacheTests, SharedBetweenProcesses) {
+  const std::string path = TempPath("shared");
+  RemoveFile(path);
+  Calculator calc;
+  const std::vector<Parameters> in = MakeInput(500);
+
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    ResultCache cache;
+    if (!cache.Open(path, 2048)) _exit(1);
+    std::vector<CorrectionFactors> out(in.size());
+    cache.Calculate(calc, in.data(), out.data(), in.size());
+    _exit(0);
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  // The other process is gone, its results are still there.
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path, 16));
+  EXPECT_EQ(cache.SlotCount(), 2048u);
+  std::vector<CorrectionFactors> out(in.size());
+  cache.Calculate(calc, in.data(), out.data(), in.size());
+  EXPECT_EQ(cache.Misses(), 0u);
+  for (size_t i = 0; i < in.size(); i++) {
+    ExpectSame(out[i], calc.Calculate(in[i]));
+  }
+}
+
+TEST(ResultCacheTests, OtherChartVersionIsReset) {
+  const std::string path = TempPath("version");
+  RemoveFile(path);
+  const Parameters p(100.0, 100.0, 100.0);
+  CorrectionFactors cf;
+  {
+    ResultCache cache;
+    ASSERT_TRUE(cache.Open(path, 64));
+    cache.Insert(p, cf);
+    ASSERT_TRUE(cache.Lookup(p, cf));
+  }
+
+  // The chart version follows the magic and the layout version.
+  File file;
+  ASSERT_TRUE(file.Open(path, File::OpenMode::kReadWrite));
+  const uint32_t old_version = kChartTableVersion + 1;
+  ASSERT_EQ(file.WriteAt(&old_version, sizeof(old_version), 8), 4);
+  file.Close();
+
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path, 64));
+  EXPECT_FALSE(cache.Lookup(p, cf));
+}
+
+TEST(ResultCacheTests, ConcurrentWritersNeverTearRows) {
+  const std::string path = TempPath("concurrent");
+  RemoveFile(path);
+  Calculator calc;
+
+  // Far more keys than slots, so slots are evicted all the time.
+  ResultCache cache;
+  ASSERT_TRUE(cache.Open(path, 64));
+  const std::vector<Parameters> in = MakeInput(2000);
+  const std::vector<CorrectionFactors> expected = calc.Calculate(in);
+
+  std::vector<std::thread> threads;
+  std::vector<size_t> torn(4, 0);
+  for (size_t t = 0; t < torn.size(); t++) {
+    threads.emplace_back([&, t] {
+      for (size_t round = 0; round < 20; round++) {
+        for (size_t i = t; i < in.size(); i += 3) {
+          CorrectionFactors got;
+          if (cache.Lookup(in[i], got)) {
+            torn[t] += got.q != expected[i].q || got.h != expected[i].h;
+          } else {
+            cache.Insert(in[i], expected[i]);
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  for (size_t count : torn) EXPECT_EQ(count, 0u);
+}
+
+#endif  // !_WIN32
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,235 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/pipeline.h"
+#include "spauly/vccore/shard.h"
+#include "test_helpers.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+std::string ReadAll(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+/// Writes rows CSV duty points with a header, an empty and a malformed line.
+std::string WriteCsvInput(const char* name, size_t rows) {
+  const std::string path = TempPath(name);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << "flowrate,total_head,viscosity\n";
+  for (size_t i = 0; i < rows; i++) {
+    out << 1 + i % 2000 << ',' << 1 + i % 200 << ',' << i % 4000 << '\n';
+    if (i == rows / 3) out << '\n';
+    if (i == rows / 2) out << "broken,row\n";
+  }
+  return path;
+}
+
+/// Converts a CSV input into a binary input file.
+std::string WriteBinaryInput(const Calculator& calc, const char* name,
+                             size_t rows) {
+  const std::string csv = WriteCsvInput("binary_source.csv", rows);
+  const std::string path = TempPath(name);
+  std::ifstream in(csv, std::ios::binary);
+  EXPECT_TRUE(ConvertToBinary(calc, in, TextFormat::kCsv, path).ok);
+  return path;
+}
+
+TEST(ShardTests, ParseShardSpec) {
+  ShardSpec shard;
+  ASSERT_TRUE(ParseShardSpec("2/8", shard));
+  EXPECT_EQ(shard.index, 2u);
+  EXPECT_EQ(shard.count, 8u);
+
+  EXPECT_FALSE(ParseShardSpec("8/8", shard));
+  EXPECT_FALSE(ParseShardSpec("1/0", shard));
+  EXPECT_FALSE(ParseShardSpec("1", shard));
+  EXPECT_FALSE(ParseShardSpec("1/2x", shard));
+
+  EXPECT_EQ(ShardPath("out.vccb", ShardSpec{2, 8}), "out.vccb.shard-2-of-8");
+}
+
+TEST(ShardTests, BinaryRangesCoverAllRecords) {
+  BinaryHeader header;
+  header.record_count = 10 * header.block_records + 5;
+
+  for (size_t count : {1, 3, 4, 11, 16}) {
+    uint64_t next = 0;
+    for (size_t i = 0; i < count; i++) {
+      RecordRange range = BinaryShardRange(header, ShardSpec{i, count});
+      EXPECT_EQ(range.first, next);
+      EXPECT_EQ(range.first % header.block_records, 0u);
+      next += range.count;
+    }
+    EXPECT_EQ(next, header.record_count);
+  }
+}
+
+TEST(ShardTests, TextRangesSplitAtLines) {
+  const std::string path = WriteCsvInput("ranges.csv", 1000);
+  const std::string text = ReadAll(path);
+
+  for (size_t count : {1, 2, 7, 64}) {
+    uint64_t next = 0;
+    for (size_t i = 0; i < count; i++) {
+      ByteRange range;
+      ASSERT_TRUE(TextShardRange(path, ShardSpec{i, count}, range));
+      EXPECT_EQ(range.begin, next);
+      if (range.begin > 0 && range.begin < text.size()) {
+        EXPECT_EQ(text[range.begin - 1], '\n');
+      }
+      next = range.end;
+    }
+    EXPECT_EQ(next, text.size());
+  }
+}
+
+TEST(ShardTests, MergedBinaryMatchesSingleRun) {
+  Calculator calc;
+  const std::string input =
+      WriteBinaryInput(calc, "in.vccb", 5 * kBinaryBlockRecords + 99);
+  const std::string whole = TempPath("whole.vccb");
+  const std::string merged = TempPath("merged.vccb");
+  ASSERT_TRUE(RunBinaryBatch(calc, input, whole).ok);
+
+  constexpr size_t kShards = 4;
+  for (size_t i = 0; i < kShards; i++) {
+    PipelineOptions options;
+    options.shard = ShardSpec{i, kShards};
+    PipelineResult result = RunBinaryBatch(calc, input, merged, options);
+    ASSERT_TRUE(result.ok) << result.error_msg;
+  }
+
+  PipelineResult result = MergeShards(merged, kShards);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  EXPECT_EQ(ReadAll(merged), ReadAll(whole));
+
+  // A missing shard is reported instead of silently dropping rows.
+  EXPECT_FALSE(MergeShards(merged, kShards + 1).ok);
+}
+
+TEST(ShardTests, MergedCsvMatchesSingleRun) {
+  Calculator calc;
+  const std::string input = WriteCsvInput("in.csv", 3000);
+  const std::string whole = TempPath("whole.csv");
+  const std::string merged = TempPath("merged.csv");
+  ASSERT_TRUE(RunCsvFile(calc, input, whole).ok);
+
+  constexpr size_t kShards = 7;
+  for (size_t i = 0; i < kShards; i++) {
+    PipelineOptions options;
+    options.shard = ShardSpec{i, kShards};
+    ASSERT_TRUE(RunCsvFile(calc, input, merged, kStandardUnits, options).ok);
+  }
+
+  PipelineResult result = MergeShards(merged, kShards);
+  ASSERT_TRUE(result.ok) << result.error_msg;
+  EXPECT_EQ(result.rows, 3001u);  // Including the malformed row.
+  EXPECT_EQ(ReadAll(merged), ReadAll(whole));
+}
+
+TEST(ShardTests, CsvShardEventsNameInputRows) {
+  Calculator calc;
+  const std::string input = WriteCsvInput("events.csv", 3000);
+  const std::string output = TempPath("events_out.csv");
+
+  auto collect = [&](size_t shards) {
+    std::vector<DiagnosticEvent> events;
+    DiagnosticsChannel channel([&events](const DiagnosticEvent* e, size_t n) {
+      events.insert(events.end(), e, e + n);
+    });
+    for (size_t i = 0; i < shards; i++) {
+      PipelineOptions options;
+      options.shard = ShardSpec{i, shards};
+      options.batch.diagnostics = &channel;
+      EXPECT_TRUE(
+          RunCsvFile(calc, input, output, kStandardUnits, options).ok);
+    }
+    channel.Flush();
+
+    std::vector<uint64_t> rows;
+    for (const DiagnosticEvent& e : events) rows.push_back(e.row);
+    std::sort(rows.begin(), rows.end());
+    return rows;
+  };
+
+  const std::vector<uint64_t> whole = collect(1);
+  ASSERT_FALSE(whole.empty());
+  EXPECT_EQ(collect(7), whole);
+}
+
+#if !defined(_WIN32)
+TEST(ShardTests, SeparateProcesses) {
+  Calculator calc;
+  const std::string input =
+      WriteBinaryInput(calc, "proc_in.vccb", 8 * kBinaryBlockRecords + 1);
+  const std::string whole = TempPath("proc_whole.vccb");
+  const std::string merged = TempPath("proc_merged.vccb");
+  ASSERT_TRUE(RunBinaryBatch(calc, input, whole).ok);
+
+  constexpr size_t kProcesses = 3;
+  std::vector<pid_t> children;
+  for (size_t i = 0; i < kProcesses; i++) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      PipelineOptions options;
+      options.shard = ShardSpec{i, kProcesses};
+      _exit(RunBinaryBatch(calc, input, merged, options).ok ? 0 : 1);
+    }
+    children.push_back(pid);
+  }
+
+  for (pid_t pid : children) {
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  ASSERT_TRUE(MergeShards(merged, kProcesses).ok);
+  EXPECT_EQ(ReadAll(merged), ReadAll(whole));
+}
+#endif
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,201 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include "spauly/vccore/strided.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/diagnostics.h"
+#include "spauly/vccore/executor.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+/// A caller's row with the fields embedded between unrelated members.
+struct PumpRecord {
+  int id;
+  double flowrate;
+  char tag[3];
+  double head;
+  double viscosity;
+  double density;
+  double q;
+  double eta;
+  std::array<double, 4> h;
+  size_t flags;
+};
+
+std::vector<PumpRecord> MakeRecords(size_t rows) {
+  std::vector<PumpRecord> records(rows);
+  for (size_t i = 0; i < rows; i++) {
+    PumpRecord& r = records[i];
+    r = PumpRecord{};
+    r.id = static_cast<int>(i);
+    r.flowrate = 1.0 + static_cast<double>(i % 2000);
+    r.tag[0] = 'a';
+    r.tag[1] = 'b';
+    r.tag[2] = 'c';
+    r.head = 1.0 + static_cast<double>(i % 200);
+    r.viscosity = static_cast<double>(i % 4000);
+    r.density = 800.0 + static_cast<double>(i % 300);
+  }
+  return records;
+}
+
+std::vector<Parameters> Repack(const std::vector<PumpRecord>& records) {
+  std::vector<Parameters> in;
+  for (const PumpRecord& r : records) {
+    in.emplace_back(r.flowrate, r.head, r.viscosity, r.density);
+  }
+  return in;
+}
+
+StridedInput InputOf(const std::vector<PumpRecord>& records) {
+  return StridedInput::FromRows(records.data(), &PumpRecord::flowrate,
+                                &PumpRecord::head, &PumpRecord::viscosity,
+                                &PumpRecord::density);
+}
+
+StridedOutput OutputOf(std::vector<PumpRecord>& records) {
+  return StridedOutput::FromRows(records.data(), &PumpRecord::q,
+                                 &PumpRecord::eta, &PumpRecord::h,
+                                 &PumpRecord::flags);
+}
+
+void ExpectSameResults(const std::vector<PumpRecord>& records,
+                       const std::vector<CorrectionFactors>& expected) {
+  ASSERT_EQ(records.size(), expected.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(records[i].q, expected[i].q) << "row " << i;
+    EXPECT_EQ(records[i].eta, expected[i].eta) << "row " << i;
+    EXPECT_EQ(records[i].h, expected[i].h) << "row " << i;
+    EXPECT_EQ(records[i].flags, expected[i].error_flag) << "row " << i;
+    EXPECT_EQ(records[i].id, static_cast<int>(i));
+  }
+}
+
+TEST(StridedTest, MatchesContiguousBatch) {
+  Calculator calc;
+  std::vector<PumpRecord> records = MakeRecords(1000);
+  const Units u(FlowrateUnit::kLitersPerMinute, HeadUnit::kMeters,
+                ViscosityUnit::kcP);
+
+  calc.Calculate(InputOf(records), OutputOf(records), records.size(), u);
+  ExpectSameResults(records, calc.Calculate(Repack(records), u));
+}
+
+TEST(StridedTest, MatchesContiguousBatchOnPool) {
+  Calculator calc;
+  ThreadPoolExecutor pool(3);
+  std::vector<PumpRecord> records = MakeRecords(10000);
+
+  // The grain is not a multiple of the gather block.
+  calc.Calculate(InputOf(records), OutputOf(records), records.size(),
+                 kStandardUnits, BatchOptions(&pool, 100));
+  ExpectSameResults(records, calc.Calculate(Repack(records)));
+}
+
+TEST(StridedTest, WritesOnlySetColumns) {
+  Calculator calc;
+  std::vector<PumpRecord> records = MakeRecords(100);
+  for (PumpRecord& r : records) {
+    r.q = -1;
+    r.h = {-1, -1, -1, -1};
+    r.flags = 99;
+  }
+
+  StridedOutput out;
+  out.eta = {&records[0].eta, sizeof(PumpRecord)};
+  calc.Calculate(InputOf(records), out, records.size());
+
+  const std::vector<CorrectionFactors> expected =
+      calc.Calculate(Repack(records));
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(records[i].eta, expected[i].eta);
+    EXPECT_EQ(records[i].q, -1);
+    EXPECT_EQ(records[i].h[3], -1);
+    EXPECT_EQ(records[i].flags, 99u);
+  }
+}
+
+TEST(StridedTest, ReadsSeparateColumnsWithoutDensity) {
+  Calculator calc;
+  const std::vector<double> flow = {100, 50, 1};
+  const std::vector<double> head = {50, 20, 10};
+  const std::vector<double> visc = {1000, 500, 100};
+
+  StridedInput in;
+  in.flowrate = {flow.data()};
+  in.total_head = {head.data()};
+  in.viscosity = {visc.data()};
+
+  std::vector<CorrectionFactors> out(flow.size());
+  StridedOutput strided_out = StridedOutput::FromRows(
+      out.data(), &CorrectionFactors::q, &CorrectionFactors::eta,
+      &CorrectionFactors::h, &CorrectionFactors::error_flag);
+  calc.Calculate(in, strided_out, flow.size());
+
+  for (size_t i = 0; i < flow.size(); i++) {
+    CorrectionFactors expected =
+        calc.Calculate(Parameters(flow[i], head[i], visc[i]));
+    EXPECT_EQ(out[i].q, expected.q);
+    EXPECT_EQ(out[i].h, expected.h);
+    EXPECT_EQ(out[i].error_flag, expected.error_flag);
+  }
+  EXPECT_NE(out[2].error_flag, 0u);
+}
+
+TEST(StridedTest, ReportsBatchRowsInDiagnostics) {
+  Calculator calc;
+  std::vector<PumpRecord> records = MakeRecords(300);
+
+  std::vector<uint64_t> rows;
+  DiagnosticsChannel channel([&rows](const DiagnosticEvent* events, size_t n) {
+    for (size_t i = 0; i < n; i++) rows.push_back(events[i].row);
+  });
+  BatchOptions options;
+  options.diagnostics = &channel;
+  options.first_row = 1000;
+
+  calc.Calculate(Repack(records), kStandardUnits, options);
+  channel.Flush();
+  const std::vector<uint64_t> expected = rows;
+  rows.clear();
+
+  calc.Calculate(InputOf(records), OutputOf(records), records.size(),
+                 kStandardUnits, options);
+  channel.Flush();
+
+  EXPECT_FALSE(expected.empty());
+  EXPECT_GT(expected.back(), 1000u + kStridedBlockRows);
+  EXPECT_EQ(rows, expected);
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,72 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#ifndef SPAULY_VCCORE_TESTING_TEST_HELPERS_H_
+#define SPAULY_VCCORE_TESTING_TEST_HELPERS_H_
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "spauly/vccore/data.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+// Helpers shared by the test programs. Header only, so tests that link only
+// a part of the library can use them as well.
+
+/// @brief Returns a path for name in the temporary directory of gtest. The
+/// name of the running test suite keeps the files of different test
+/// programs apart.
+inline std::string TempPath(const char* name) {
+  const ::testing::TestInfo* info =
+      ::testing::UnitTest::GetInstance()->current_test_info();
+  const std::string suite = info != nullptr ? info->test_suite_name() : "";
+  return ::testing::TempDir() + "vccore_" + suite + "_" + name;
+}
+
+/// @brief Duty points across all regions of the charts, including invalid
+/// ones.
+inline std::vector<Parameters> MakeInput(size_t rows) {
+  std::vector<Parameters> in(rows);
+  for (size_t i = 0; i < rows; i++) {
+    in[i] = Parameters(1.0 + static_cast<double>(i % 2000),
+                       1.0 + static_cast<double>(i % 200),
+                       static_cast<double>(i % 4000));
+  }
+  return in;
+}
+
+/// @brief Compares the factors bit by bit, so NaN and signed zeros count as
+/// well. A and B are CorrectionFactors or any type with the same fields.
+template <typename A, typename B>
+bool SameBits(const A& a, const B& b) {
+  const double va[6] = {a.q, a.eta, a.h[0], a.h[1], a.h[2], a.h[3]};
+  const double vb[6] = {b.q, b.eta, b.h[0], b.h[1], b.h[2], b.h[3]};
+  return std::memcmp(va, vb, sizeof(va)) == 0 && a.error_flag == b.error_flag;
+}
+
+}  // namespace vccore_testing
+}  // namespace vccore
+}  // namespace spauly
+
+#endif  // SPAULY_VCCORE_TESTING_TEST_HELPERS_H_
@@ -0,0 +1,92 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "spauly/vccore/calculator.h"
+
+namespace spauly {
+namespace vccore {
+namespace vccore_testing {
+
+namespace {
+
+class ViewTests : public testing::Test {
+ protected:
+  virtual void SetUp() override {
+    for (int i = 0; i < 3 * static_cast<int>(kBlockSize) + 5; i++) {
+      in_.emplace_back(20.0 + i * 30.0, 30.0 + i, 50.0 + i * 40.0);
+    }
+  }
+
+ protected:
+  Calculator c_;
+  std::vector<Parameters> in_;
+};
+
+TEST_F(ViewTests, IteratesAllRows) {
+  auto view = c_.View(in_);
+  EXPECT_EQ(view.size(), in_.size());
+
+  size_t i = 0;
+  for (const CorrectionFactors& cf : view) {
+    CorrectionFactors expected = c_.Calculate(in_.at(i));
+    EXPECT_EQ(cf.q, expected.q);
+    EXPECT_EQ(cf.eta, expected.eta);
+    EXPECT_EQ(cf.h, expected.h);
+    EXPECT_EQ(cf.error_flag, expected.error_flag);
+    i++;
+  }
+  EXPECT_EQ(i, in_.size());
+}
+
+TEST_F(ViewTests, ReductionWithoutStorage) {
+  auto view = c_.View(in_);
+  double eta_sum =
+      std::accumulate(view.begin(), view.end(), 0.0,
+                      [](double sum, const CorrectionFactors& cf) {
+                        return sum + cf.eta;
+                      });
+
+  double expected = 0;
+  for (const auto& p : in_) expected += c_.Calculate(p).eta;
+  EXPECT_EQ(eta_sum, expected);
+
+  auto valid = std::count_if(
+      view.begin(), view.end(),
+      [](const CorrectionFactors& cf) { return cf.error_flag == 0; });
+  EXPECT_GT(valid, 0);
+}
+
+TEST_F(ViewTests, EmptyView) {
+  std::vector<Parameters> empty;
+  auto view = c_.View(empty);
+  EXPECT_TRUE(view.empty());
+  EXPECT_TRUE(view.begin() == view.end());
+}
+
+}  // namespace
+
+}  // namespace vccore_testing
+
+}  // namespace vccore
+
+}  // namespace spauly
@@ -0,0 +1,424 @@
+// ViscoCorrectCore - Correction factors for centrifugal pumps
+// Copyright (C) 2024  Simon Pauly
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact via <https://github.com/SPauly/ViscoCorrectCore>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "spauly/vccore/approximate_cache.h"
+#include "spauly/vccore/autotune.h"
+#include "spauly/vccore/calculator.h"
+#include "spauly/vccore/csv.h"
+#include "spauly/vccore/executor.h"
+#include "spauly/vccore/jsonl.h"
+#include "spauly/vccore/metrics.h"
+#include "spauly/vccore/pipeline.h"
+#include "spauly/vccore/progress.h"
+#include "spauly/vccore/result_cache.h"
+#include "spauly/vccore/shard.h"
+
+using namespace spauly::vccore;
+
+namespace {
+
+constexpr const char* kUsage =
+    "Usage: vccore_batch <command> --input FILE --output FILE [options]\n"
+    "\n"
+    "Commands:\n"
+    "  run       Calculates the input. .vccb inputs give .vccb results,\n"
+    "            .csv and .jsonl inputs give CSV results.\n"
+    "  convert   Converts .csv or .jsonl input rows to .vccb, or a .vccb\n"
+    "            result file to CSV.\n"
+    "  merge     Reassembles the shard outputs of --output, needs --shards.\n"
+    "  tune      Measures the batch settings on this host and writes the\n"
+    "            fastest profile to --output, needs no --input.\n"
+    "\n"
+    "Options:\n"
+    "  --threads N     Worker threads, 0 uses all cores (default 1)\n"
+    "  --io MODE       sync or uring (default sync)\n"
+    "  --chunk N       Records per chunk\n"
+    "  --depth N       Chunks in flight for .vccb files\n"
+    "  --shard I/N     Calculate shard I of N of a .vccb or .csv input and\n"
+    "                  write it to OUTPUT.shard-I-of-N\n"
+    "  --shards N      Number of shards to merge\n"
+    "  --processes N   Run N shard processes and merge their outputs\n"
+    "  --encoding E    Result columns as double or q16, 16 bit fixed point\n"
+    "                  with a resolution of 2^-15 (default double)\n"
+    "  --checkpoint F  Records completed .vccb chunks in F, a rerun with the\n"
+    "                  same options continues from there\n"
+    "  --cache F       Shares calculated rows with other processes through\n"
+    "                  the memory-mapped result cache F\n"
+    "  --metrics F     Writes Prometheus metrics to F when done, for the\n"
+    "                  node-exporter textfile collector, not with\n"
+    "                  --processes\n"
+    "  --profile F     Runs with the settings of the tune profile F, tunes\n"
+    "                  and writes it first if it is missing or stale.\n"
+    "                  --threads overrides its thread count\n"
+    "  --accuracy E    Largest error a tuned profile may add to the\n"
+    "                  reproducible results (default 0)\n";
+
+/// Set by SIGINT and SIGTERM. A cancelled run keeps its checkpoint.
+CancellationToken g_cancel;
+
+void OnSignal(int) { g_cancel.Cancel(); }
+
+/// FileKind is derived from the file extension.
+enum class FileKind { kBinary, kCsv, kJsonl };
+
+FileKind KindOf(const std::string& path) {
+  auto ends_with = [&](const char* ext) {
+    size_t n = std::strlen(ext);
+    return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+  };
+  if (ends_with(".vccb")) return FileKind::kBinary;
+  if (ends_with(".jsonl")) return FileKind::kJsonl;
+  return FileKind::kCsv;
+}
+
+int Finish(const PipelineResult& result) {
+  if (!result.ok) {
+    std::fprintf(stderr, "vccore_batch: %s\n", result.error_msg.c_str());
+    return 1;
+  }
+  std::fprintf(stderr, "vccore_batch: %zu rows (%s I/O)\n", result.rows,
+               result.io == IoBackend::kIoUring ? "io_uring" : "sync");
+  return 0;
+}
+
+int Run(const Calculator& calc, const std::string& input,
+        const std::string& output, const PipelineOptions& options) {
+  if (KindOf(input) == FileKind::kBinary) {
+    return Finish(RunBinaryBatch(calc, input, output, options));
+  }
+  if (KindOf(input) == FileKind::kCsv) {
+    return Finish(RunCsvFile(calc, input, output, kStandardUnits, options));
+  }
+  if (!options.shard.IsWhole()) {
+    std::fprintf(stderr, "vccore_batch: only .vccb and .csv can be sharded\n");
+    return 1;
+  }
+
+  std::ifstream in(input, std::ios::binary);
+  std::ofstream out(output, std::ios::binary | std::ios::trunc);
+  if (!in || !out) {
+    std::fprintf(stderr, "vccore_batch: could not open the files\n");
+    return 1;
+  }
+
+  PipelineResult result;
+  std::string text;
+  out << kCsvResultHeader << '\n';
+  result.rows = CalculateJsonl(
+      calc, in,
+      [&](size_t, const Parameters*, const CorrectionFactors* cf,
+          size_t count) {
+        text.clear();
+        for (size_t i = 0; i < count; i++) {
+          AppendCsvResult(cf[i], text, options.encoding);
+        }
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      },
+      options.batch, options.chunk_records);
+  if (!out) {
+    result.ok = false;
+    result.error_msg = "Could not write " + output;
+  }
+  return Finish(result);
+}
+
+int Convert(const Calculator& calc, const std::string& input,
+            const std::string& output) {
+  if (KindOf(input) == FileKind::kBinary) {
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      std::fprintf(stderr, "vccore_batch: could not open %s\n",
+                   output.c_str());
+      return 1;
+    }
+    return Finish(ConvertResultsToCsv(input, out));
+  }
+
+  std::ifstream in(input, std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "vccore_batch: could not open %s\n", input.c_str());
+    return 1;
+  }
+  TextFormat format = KindOf(input) == FileKind::kJsonl ? TextFormat::kJsonl
+                                                         : TextFormat::kCsv;
+  return Finish(ConvertToBinary(calc, in, format, output));
+}
+
+/// Returns nullptr for a single thread. The calling thread participates in
+/// the pool, so it needs one worker less.
+std::unique_ptr<ThreadPoolExecutor> MakePool(size_t threads) {
+  if (threads == 1) return nullptr;
+  return std::make_unique<ThreadPoolExecutor>(threads == 0 ? 0 : threads - 1);
+}
+
+/// Runs every shard in its own process and merges the outputs. The pools are
+/// created after the fork since threads do not survive it.
+int RunProcesses(const Calculator& calc, const std::string& input,
+                 const std::string& output, PipelineOptions options,
+                 size_t threads, size_t processes) {
+#if defined(_WIN32)
+  (void)calc;
+  (void)input;
+  (void)output;
+  (void)options;
+  (void)threads;
+  (void)processes;
+  std::fprintf(stderr, "vccore_batch: --processes needs a POSIX system\n");
+  return 1;
+#else
+  std::fflush(nullptr);
+
+  std::vector<pid_t> children;
+  for (size_t i = 0; i < processes; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::perror("vccore_batch: fork");
+      return 1;
+    }
+    if (pid == 0) {
+      std::unique_ptr<ThreadPoolExecutor> pool = MakePool(threads);
+      options.batch.executor = pool.get();
+      options.shard = ShardSpec{i, processes};
+      int ret = Run(calc, input, output, options);
+      pool.reset();
+      _exit(ret);
+    }
+    children.push_back(pid);
+  }
+
+  bool ok = true;
+  for (pid_t pid : children) {
+    int status = 0;
+    ok &= waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+          WEXITSTATUS(status) == 0;
+  }
+  if (!ok) return 1;
+
+  int ret = Finish(MergeShards(output, processes));
+  if (ret == 0) {
+    for (size_t i = 0; i < processes; i++) {
+      std::remove(ShardPath(output, ShardSpec{i, processes}).c_str());
+    }
+  }
+  return ret;
+#endif
+}
+
+void PrintProfile(const TuneProfile& profile) {
+  std::fprintf(stderr,
+               "vccore_batch: %zu threads, grain %zu, %s mode, approximate "
+               "step %g, error %.2e, %.2f Mrows/s\n",
+               profile.threads, profile.grain,
+               profile.mode == ExecutionMode::kFast ? "fast" : "reproducible",
+               profile.approximate_step, profile.error,
+               profile.rows_per_second * 1e-6);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fputs(kUsage, stderr);
+    return 2;
+  }
+
+  const std::string command = argv[1];
+  std::string input;
+  std::string output;
+  size_t threads = 1;
+  bool threads_set = false;
+  size_t shards = 0;
+  size_t processes = 0;
+  std::string cache_path;
+  std::string metrics_path;
+  std::string profile_path;
+  TuneOptions tune;
+  bool accuracy_set = false;
+  PipelineOptions options;
+
+  for (int i = 2; i < argc; i++) {
+    const bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--input") == 0 && has_value) {
+      input = argv[++i];
+    } else if (std::strcmp(argv[i], "--output") == 0 && has_value) {
+      output = argv[++i];
+    } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+      threads = std::strtoull(argv[++i], nullptr, 10);
+      threads_set = true;
+    } else if (std::strcmp(argv[i], "--io") == 0 && has_value) {
+      const char* io = argv[++i];
+      if (std::strcmp(io, "uring") == 0) {
+        options.io = IoBackend::kIoUring;
+      } else if (std::strcmp(io, "sync") == 0) {
+        options.io = IoBackend::kSync;
+      } else {
+        std::fputs(kUsage, stderr);
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--chunk") == 0 && has_value) {
+      options.chunk_records = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--depth") == 0 && has_value) {
+      options.depth = static_cast<unsigned>(std::strtoul(argv[++i], nullptr,
+                                                         10));
+    } else if (std::strcmp(argv[i], "--shard") == 0 && has_value) {
+      if (!ParseShardSpec(argv[++i], options.shard)) {
+        std::fputs(kUsage, stderr);
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--encoding") == 0 && has_value) {
+      const char* encoding = argv[++i];
+      if (std::strcmp(encoding, "q16") == 0) {
+        options.encoding = ResultEncoding::kQ16;
+      } else if (std::strcmp(encoding, "double") == 0) {
+        options.encoding = ResultEncoding::kDouble;
+      } else {
+        std::fputs(kUsage, stderr);
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--checkpoint") == 0 && has_value) {
+      options.checkpoint_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--cache") == 0 && has_value) {
+      cache_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--metrics") == 0 && has_value) {
+      metrics_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--profile") == 0 && has_value) {
+      profile_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--accuracy") == 0 && has_value) {
+      tune.max_error = std::strtod(argv[++i], nullptr);
+      accuracy_set = true;
+    } else if (std::strcmp(argv[i], "--shards") == 0 && has_value) {
+      shards = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--processes") == 0 && has_value) {
+      processes = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::fputs(kUsage, stderr);
+      return 2;
+    }
+  }
+
+  if (command == "merge" && !output.empty() && shards > 0) {
+    return Finish(MergeShards(output, shards));
+  }
+  if (command == "tune" && !output.empty()) {
+    if (threads_set) tune.max_threads = threads;
+    TuneProfile profile = Autotune(Calculator(), tune);
+    PrintProfile(profile);
+    if (!SaveProfile(profile, output)) {
+      std::fprintf(stderr, "vccore_batch: could not write %s\n",
+                   output.c_str());
+      return 1;
+    }
+    return 0;
+  }
+  // Every shard process would count only its own rows.
+  if (input.empty() || output.empty() ||
+      (!metrics_path.empty() && processes > 1)) {
+    std::fputs(kUsage, stderr);
+    return 2;
+  }
+
+  // The mapping is shared, forked shard processes use it as well.
+  ResultCache cache;
+  if (!cache_path.empty()) {
+    if (!cache.Open(cache_path)) {
+      std::fprintf(stderr, "vccore_batch: could not open %s\n",
+                   cache_path.c_str());
+      return 1;
+    }
+    options.batch.cache = &cache;
+  }
+
+  // The profile sets mode and grain, and threads unless given. Without
+  // --accuracy any stored profile of this host is used.
+  std::unique_ptr<ApproximateCache> approximate;
+  if (!profile_path.empty()) {
+    TuneProfile profile;
+    if (accuracy_set || !LoadProfile(profile_path, profile)) {
+      bool tuned = false;
+      profile = LoadOrAutotune(profile_path, Calculator(), tune, &tuned);
+      if (tuned) PrintProfile(profile);
+    }
+    profile.Apply(options.batch);
+    if (!threads_set) threads = profile.threads;
+    if (profile.UsesApproximate()) {
+      approximate = std::make_unique<ApproximateCache>(
+          profile.approximate_tolerance, profile.approximate_step);
+      options.batch.approximate = approximate.get();
+    }
+  }
+
+  options.batch.cancel = &g_cancel;
+  std::signal(SIGINT, OnSignal);
+  std::signal(SIGTERM, OnSignal);
+
+  Calculator calc;
+  if (command == "run" && processes > 1) {
+    return RunProcesses(calc, input, output, options, threads, processes);
+  }
+
+  std::unique_ptr<ThreadPoolExecutor> pool = MakePool(threads);
+  options.batch.executor = pool.get();
+  if (command == "run" && !metrics_path.empty()) {
+    Metrics metrics;
+    options.batch.metrics = &metrics;
+    if (options.batch.cache != nullptr) {
+      metrics.AddCallback("vccore_cache_hits_total", "Result cache hits.",
+                          MetricType::kCounter, [&cache]() {
+                            return static_cast<double>(cache.Hits());
+                          });
+      metrics.AddCallback("vccore_cache_misses_total", "Result cache misses.",
+                          MetricType::kCounter, [&cache]() {
+                            return static_cast<double>(cache.Misses());
+                          });
+    }
+    if (pool != nullptr) {
+      ThreadPoolExecutor* queue = pool.get();
+      metrics.AddCallback("vccore_queue_depth", "Tasks waiting for a worker.",
+                          MetricType::kGauge, [queue]() {
+                            return static_cast<double>(queue->QueueDepth());
+                          });
+    }
+
+    int ret = Run(calc, input, output, options);
+    if (!metrics.WriteTextfile(metrics_path)) {
+      std::fprintf(stderr, "vccore_batch: could not write %s\n",
+                   metrics_path.c_str());
+      return 1;
+    }
+    return ret;
+  }
+  if (command == "run") return Run(calc, input, output, options);
+  if (command == "convert") return Convert(calc, input, output);
+
+  std::fputs(kUsage, stderr);
+  return 2;
+}